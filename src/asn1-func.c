@@ -222,6 +222,9 @@ copy_node (const AsnNode s)
   if (s->name)
     d->name = xstrdup (s->name);
   d->flags = s->flags;
+  d->flags.static_name = 0;
+  d->flags.in_block = 0;
+  d->flags.block_head = 0;
   copy_value (d, s);
   return d;
 }
@@ -238,9 +241,11 @@ _ksba_asn_set_name (AsnNode node, const char *name)
 
   if (node->name)
     {
-      xfree (node->name);
+      if (!node->flags.static_name)
+        xfree (node->name);
       node->name = NULL;
     }
+  node->flags.static_name = 0;
 
   if (name && *name)
       node->name = xstrdup (name);
@@ -279,7 +284,8 @@ _ksba_asn_remove_node (AsnNode  node)
   if (node == NULL)
     return;
 
-  xfree (node->name);
+  if (!node->flags.static_name)
+    xfree (node->name);
   if (node->valuetype == VALTYPE_CSTR)
     xfree (node->value.v_cstr);
   else if (node->valuetype == VALTYPE_MEM)
@@ -1236,6 +1242,531 @@ _ksba_asn_expand_tree (AsnNode parse_tree, const char *name)
 }
 
 
+#ifndef BUILD_GENTOOLS
+/* Copy the expanded tree S into the array of nodes at BLOCKP which
+   is advanced accordingly.  The names of the nodes are not copied
+   but taken from S; thus S must not be released as long as the copy
+   is in use.  LINK_NEXTP is used to chain the nodes.  */
+static AsnNode
+copy_to_block (AsnNode s, AsnNode *blockp, AsnNode **link_nextp)
+{
+  AsnNode first = NULL, dprev = NULL, d;
+
+  for (; s; s = s->right)
+    {
+      d = (*blockp)++;
+      d->name = s->name;
+      d->type = s->type;
+      d->flags = s->flags;
+      d->flags.static_name = 1;
+      d->flags.in_block = 1;
+      d->flags.block_head = 0;
+      copy_value (d, s);
+      d->actual_type = s->actual_type;
+      **link_nextp = d;
+      *link_nextp = &d->link_next;
+
+      if (!first)
+        first = d;
+      else
+        {
+          dprev->right = d;
+          d->left = dprev;
+        }
+      dprev = d;
+      if (s->down)
+        {
+          d->down = copy_to_block (s->down, blockp, link_nextp);
+          d->down->left = d;
+        }
+    }
+  return first;
+}
+
+
+/* Return a copy of the expanded TREE allocated as one block with the
+   nodes in pre-order.  The copy takes over the names of TREE which
+   is released in any case.  The number of nodes is stored at
+   R_NNODES.  */
+static AsnNode
+tree_to_block (AsnNode tree, size_t *r_nnodes)
+{
+  AsnNode block, d, p, *link_nextp;
+  size_t n;
+
+  for (n=0, p=tree; p; p = _ksba_asn_walk_tree (tree, p))
+    n++;
+  block = xtrycalloc (n, sizeof *block);
+  if (!block)
+    {
+      _ksba_asn_release_nodes (tree);
+      return NULL;
+    }
+  d = block;
+  link_nextp = &p;
+  copy_to_block (tree, &d, &link_nextp);
+  block->flags.block_head = 1;
+
+  for (d=block, p=tree; p; p = _ksba_asn_walk_tree (tree, p), d++)
+    {
+      d->flags.static_name = p->flags.static_name;
+      p->name = NULL;
+    }
+  _ksba_asn_release_nodes (tree);
+
+  *r_nnodes = n;
+  return block;
+}
+#endif /*!BUILD_GENTOOLS*/
+
+
+/* This is the same as _ksba_asn_expand_tree but for a shared MODULE
+   the expanded tree is created only once and cached with MODULE.  The
+   returned tree is a private copy of that cached tree which is
+   allocated as one block and which shares the names with the cached
+   tree.  Thus the copy is much cheaper than a new expansion.  The
+   cache is updated without locks and may thus be used by several
+   threads.  */
+AsnNode
+_ksba_asn_expand_module (ksba_asn_tree_t module, const char *name)
+{
+#ifdef HAVE_SYNC_BUILTINS
+  struct asn_expanded_s *ex, *head;
+  AsnNode root, block, *link_nextp, p;
+
+  /* The copies reference the names of the cached tree and thus may
+     not outlive the module.  Shared modules are never released.  */
+  if (!module->shared)
+    return _ksba_asn_expand_tree (module->parse_tree, name);
+
+  if (!name)
+    name = "";
+
+  for (ex = module->expanded; ex; ex = ex->next)
+    if (!strcmp (ex->name, name))
+      break;
+  if (!ex)
+    {
+      root = _ksba_asn_expand_tree (module->parse_tree, *name? name : NULL);
+      if (!root)
+        return NULL;
+      ex = xtrymalloc (sizeof *ex + strlen (name));
+      if (!ex)
+        {
+          _ksba_asn_release_nodes (root);
+          return NULL;
+        }
+      ex->root = tree_to_block (root, &ex->nnodes);
+      if (!ex->root)
+        {
+          xfree (ex);
+          return NULL;
+        }
+      strcpy (ex->name, name);
+      do
+        {
+          head = module->expanded;
+          ex->next = head;
+        }
+      while (!atomic_cas_ptr (&module->expanded, head, ex));
+      /* If another thread added the same name in the meantime, we
+         end up with two identical entries which is harmless.  */
+    }
+
+  block = xtrycalloc (ex->nnodes, sizeof *block);
+  if (!block)
+    return NULL;
+  link_nextp = &p;
+  root = copy_to_block (ex->root, &block, &link_nextp);
+  root->flags.block_head = 1;
+  return root;
+#else /*!HAVE_SYNC_BUILTINS*/
+  return _ksba_asn_expand_tree (module->parse_tree, name);
+#endif /*!HAVE_SYNC_BUILTINS*/
+}
+
+
+/* Release the cache of expanded trees of MODULE.  */
+void
+_ksba_asn_release_expanded (ksba_asn_tree_t module)
+{
+  struct asn_expanded_s *ex, *ex2;
+
+  for (ex = module->expanded; ex; ex = ex2)
+    {
+      ex2 = ex->next;
+      _ksba_asn_release_nodes (ex->root);
+      xfree (ex);
+    }
+  module->expanded = NULL;
+}
+
+
+#ifndef BUILD_GENTOOLS
+/* State for compact_node.  */
+struct compact_state_s
+{
+  AsnNode schema;               /* The schema block or NULL.  */
+  struct asn_value_s *next;     /* The next free entry.  */
+  gpg_error_t err;
+};
+
+
+/* Return true if NODE or one of its descendants has a value.  */
+static int
+has_values (AsnNode node)
+{
+  AsnNode p;
+
+  if (node->off != -1)
+    return 1;
+  for (p = node->down; p; p = p->right)
+    if (has_values (p))
+      return 1;
+  return 0;
+}
+
+
+/* Return the number of entries required for the subtree at NODE.  */
+static size_t
+count_values (AsnNode node)
+{
+  AsnNode p;
+  size_t n = 1;
+
+  if (has_values (node))
+    for (p = node->down; p; p = p->right)
+      n += count_values (p);
+  return n;
+}
+
+
+/* Store the subtree at NODE which corresponds to the schema node S
+   at the next free entries of STATE.  */
+static void
+compact_node (struct compact_state_s *state, AsnNode node, AsnNode s)
+{
+  struct asn_value_s *v, *prev;
+  AsnNode p, sp;
+
+  if (s && s->type != node->type && s->type != TYPE_ANY)
+    {
+      state->err = gpg_error (GPG_ERR_BUG); /* Tree does not match.  */
+      return;
+    }
+
+  v = state->next++;
+  v->off = node->off;
+  v->nhdr = node->nhdr;
+  v->len = node->len;
+  v->snode = s? (s - state->schema) : 0;
+  /* The decoder resolves present ANY values (fixup_type_any); trees
+     from other sources may still have the type ANY.  */
+  if (node->type == TYPE_ANY && node->off != -1)
+    v->type = node->actual_type;
+  else
+    v->type = node->type;
+  v->right = 0;
+
+  prev = NULL;
+  sp = s? s->down : NULL;
+  if (has_values (node))
+    for (p = node->down; p && !state->err; p = p->right)
+      {
+        if (s && !sp)
+          {
+            state->err = gpg_error (GPG_ERR_BUG);
+            return;
+          }
+        if (prev)
+          prev->right = state->next - prev;
+        prev = state->next;
+        compact_node (state, p, sp);
+        /* The repeated elements of a SET OF or SEQUENCE OF all
+           correspond to the last node of the schema.  */
+        if (sp && (sp->right || (s->type != TYPE_SEQUENCE_OF
+                                 && s->type != TYPE_SET_OF)))
+          sp = sp->right;
+      }
+  v->size = state->next - v;
+}
+
+
+/* Create a compact copy of the decoded tree ROOT and store it at
+   R_VTREE.  MODULE and NAME must be the same as used to expand the
+   tree for the decoder; the compact tree then references the cached
+   expanded tree of MODULE instead of copying the names.  If MODULE
+   is NULL no schema is available and the values can't be looked up
+   by name.  ROOT is not changed and may be released by the caller
+   right away.  */
+gpg_error_t
+_ksba_asn_compact_tree (ksba_asn_tree_t module, const char *name,
+                        AsnNode root, AsnVTree *r_vtree)
+{
+  struct compact_state_s state;
+  struct asn_expanded_s *ex;
+  AsnVTree vtree;
+  AsnNode schema = NULL;
+  int own_schema = 0;
+  size_t n, nnodes = 0;
+
+  *r_vtree = NULL;
+  if (!root)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (module)
+    {
+      for (ex = module->expanded; ex; ex = ex->next)
+        if (!strcmp (ex->name, name? name : ""))
+          break;
+      if (ex)
+        {
+          schema = ex->root;
+          nnodes = ex->nnodes;
+        }
+      else
+        { /* Not cached - use a private copy.  */
+          schema = _ksba_asn_expand_tree (module->parse_tree, name);
+          if (schema)
+            schema = tree_to_block (schema, &nnodes);
+          if (!schema)
+            return gpg_error (GPG_ERR_ENOMEM);
+          own_schema = 1;
+        }
+    }
+
+  n = count_values (root);
+  vtree = xtrymalloc (sizeof *vtree + (n - 1) * sizeof *vtree->values);
+  if (!vtree || nnodes >= (1 << 24))
+    {
+      xfree (vtree);
+      if (own_schema)
+        _ksba_asn_release_nodes (schema);
+      return gpg_error (vtree? GPG_ERR_TOO_LARGE : GPG_ERR_ENOMEM);
+    }
+  vtree->schema = schema;
+  vtree->own_schema = own_schema;
+  vtree->nvalues = n;
+
+  state.schema = schema;
+  state.next = vtree->values;
+  state.err = 0;
+  compact_node (&state, root, schema);
+  if (state.err)
+    {
+      _ksba_asn_release_vtree (vtree);
+      return state.err;
+    }
+  assert (state.next == vtree->values + n);
+
+  *r_vtree = vtree;
+  return 0;
+}
+
+
+void
+_ksba_asn_release_vtree (AsnVTree vtree)
+{
+  if (!vtree)
+    return;
+  if (vtree->own_schema)
+    _ksba_asn_release_nodes (vtree->schema);
+  xfree (vtree);
+}
+
+
+/* Return the name of the value V of VTREE.  */
+static const char *
+value_name (AsnVTree vtree, AsnValue v)
+{
+  return vtree->schema[v->snode].name;
+}
+
+
+/* This is the same as _ksba_asn_find_node but for a compact tree.
+   If ROOT is NULL the search starts at the root of VTREE.  */
+AsnValue
+_ksba_asn_find_value (AsnVTree vtree, AsnValue root, const char *name)
+{
+  AsnValue v;
+  const char *s, *vname;
+  char buf[129];
+  int i;
+
+  if (!vtree || !vtree->schema || !name || !name[0])
+    return NULL;
+  if (!root)
+    root = vtree->values;
+
+  /* find the first part */
+  s = name;
+  for (i=0; *s && *s != '.' && i < DIM(buf)-1; s++)
+    buf[i++] = *s;
+  buf[i] = 0;
+  return_null_if_fail (i < DIM(buf)-1);
+
+  for (v = root; v; v = _ksba_asn_value_right (v))
+    {
+      vname = value_name (vtree, v);
+      if (vname && !strcmp (vname, buf))
+        break;
+    }
+
+  /* find other parts */
+  while (v && *s)
+    {
+      assert (*s == '.');
+      s++; /* skip the dot */
+
+      v = _ksba_asn_value_down (v);
+      if (!v)
+        return NULL; /* not found */
+
+      for (i=0; *s && *s != '.' && i < DIM(buf)-1; s++)
+        buf[i++] = *s;
+      buf[i] = 0;
+      return_null_if_fail (i < DIM(buf)-1);
+
+      if (!*buf)
+        ; /* A double dot skips an unnamed node; see find_node.  */
+      else if (!strcmp (buf, "?LAST"))
+        {
+          while (v->right)
+            v = _ksba_asn_value_right (v);
+        }
+      else
+        {
+          for (; v; v = _ksba_asn_value_right (v))
+            {
+              vname = value_name (vtree, v);
+              if (vname && !strcmp (vname, buf))
+                break;
+            }
+        }
+    }
+
+  return v;
+}
+
+
+/* Compile the dotted path NAME into the positions of the children
+   along the path starting at the root of the expanded tree SCHEMA
+   and store them at STEPS which has room for STEPSSIZE bytes.  The
+   first byte receives the number of steps.  Returns false if the
+   path can't be compiled.  */
+static int
+compile_path (AsnNode schema, const char *name,
+              unsigned char *steps, size_t stepssize)
+{
+  AsnNode p;
+  const char *s;
+  size_t n, len;
+  int pos;
+
+  s = strchr (name, '.');
+  len = s? (s - name) : strlen (name);
+  if (!schema->name || strlen (schema->name) != len
+      || strncmp (schema->name, name, len))
+    return 0;
+
+  p = schema;
+  n = 0;
+  while (s)
+    {
+      name = s + 1;
+      s = strchr (name, '.');
+      len = s? (s - name) : strlen (name);
+
+      if (!p->down || ++n >= stepssize)
+        return 0;
+      p = p->down;
+      if (!len)
+        pos = 0; /* Double dot.  */
+      else if (len == 5 && !strncmp (name, "?LAST", 5))
+        {
+          while (p->right)
+            p = p->right;
+          pos = ASN_PATH_LAST;
+        }
+      else
+        {
+          for (pos=0; p; p = p->right, pos++)
+            if (p->name && strlen (p->name) == len
+                && !strncmp (p->name, name, len))
+              break;
+          if (!p || pos >= ASN_PATH_LAST)
+            return 0;
+        }
+      steps[n] = pos;
+    }
+  steps[0] = n;
+  return 1;
+}
+
+
+/* Return the value for PATH in VTREE.  The first use of PATH
+   compiles it so that later lookups don't need to compare names.
+   The compiled path is stored with PATH which is usually a static
+   object; this is done without locks.  Note that the positions of
+   the children are the same in the schema and in all trees decoded
+   from it because repeated elements of a SEQUENCE OF or SET OF
+   always follow the last node of the schema.  */
+AsnValue
+_ksba_asn_find_path (AsnVTree vtree, struct asn_path_s *path)
+{
+  unsigned char buffer[32];
+  const unsigned char *steps;
+  AsnValue v;
+  int i, n, pos;
+
+  if (!vtree || !vtree->schema)
+    return NULL;
+
+  steps = path->steps;
+  if (!steps)
+    {
+      if (!compile_path (vtree->schema, path->name, buffer, sizeof buffer))
+        return _ksba_asn_find_value (vtree, NULL, path->name);
+#ifdef HAVE_SYNC_BUILTINS
+      {
+        unsigned char *tmp;
+
+        tmp = xtrymalloc (buffer[0] + 1);
+        if (tmp)
+          {
+            memcpy (tmp, buffer, buffer[0] + 1);
+            if (!atomic_cas_ptr (&path->steps, NULL, tmp))
+              xfree (tmp); /* Another thread was faster.  */
+          }
+      }
+#endif /*HAVE_SYNC_BUILTINS*/
+      steps = buffer;
+    }
+
+  v = vtree->values;
+  for (n = *steps++; n; n--)
+    {
+      v = _ksba_asn_value_down (v);
+      if (!v)
+        return NULL;
+      pos = *steps++;
+      if (pos == ASN_PATH_LAST)
+        {
+          while (v->right)
+            v = _ksba_asn_value_right (v);
+        }
+      else
+        {
+          for (i=0; i < pos; i++)
+            if (!(v = _ksba_asn_value_right (v)))
+              return NULL;
+        }
+    }
+  return v;
+}
+#endif /*!BUILD_GENTOOLS*/
+
+
 /* Insert a copy of the entire tree at NODE as the sibling of itself
    and return the copy */
 AsnNode
@@ -114,6 +114,9 @@ struct node_flag_s {
   int help_right:1;   /* helper for create_tree */
   int tag_seen:1;
   int skip_this:1;   /* helper */
+  int static_name:1; /* NAME is not allocated but owned by a template. */
+  int in_block:1;    /* The node is part of a block allocation.  */
+  int block_head:1;  /* The node is the start of the block allocation. */
 };
 
 enum asn_value_type {
@@ -164,14 +167,64 @@ struct asn_node_struct {
   AsnNode link_next;             /* to keep track of all nodes in a tree */
 };
 
+/* An expanded tree cached along with its module.  */
+struct asn_expanded_s {
+  struct asn_expanded_s *next;
+  AsnNode root;       /* The expanded tree allocated as one block with
+                         the nodes in pre-order; used read-only.  */
+  size_t nnodes;      /* Number of nodes in ROOT.  */
+  char name[1];       /* The start symbol or "" for the entire module. */
+};
+
 /* Structure to keep an entire ASN.1 parse tree and associated information */
 struct ksba_asn_tree_s {
   AsnNode parse_tree;
   AsnNode node_list;  /* for easier release of all nodes */
+  struct asn_expanded_s *expanded;  /* Cache of expanded trees.  */
+  ksba_asn_tree_t next_shared;      /* Link for the shared trees.  */
+  int shared;         /* This is a shared tree which is never released. */
   char filename[1];
 };
 
 
+/* An entry of a compact value tree.  The entries are stored in
+   pre-order so that the first child of an entry immediately follows
+   it.  Names and flags are not stored but taken from the node of the
+   schema with the index SNODE.  */
+struct asn_value_s {
+  int off;                 /* Offset of this TLV or -1 if not present. */
+  int nhdr;                /* Length of the header.  */
+  int len;                 /* Length part of the TLV.  */
+  unsigned int snode:24;   /* Index of the node in the schema block.  */
+  unsigned int type:8;     /* Type of the value; for a present ANY
+                              value this is its actual type.  */
+  unsigned int right;      /* Distance to the right sibling or 0.  */
+  unsigned int size;       /* Number of entries in this subtree.  */
+};
+typedef const struct asn_value_s *AsnValue;
+
+/* A decoded tree in compact form.  Only the values are stored;
+   subtrees without any value are collapsed into a single entry.  */
+struct asn_vtree_s {
+  AsnNode schema;          /* The expanded tree as one block or NULL.  */
+  int own_schema;          /* SCHEMA needs to be released with us.  */
+  size_t nvalues;
+  struct asn_value_s values[1];
+};
+typedef struct asn_vtree_s *AsnVTree;
+
+/* A path to a value as used by _ksba_asn_find_node.  The path is
+   compiled at first use into the positions of the children along the
+   path; use ASN_PATH to initialize a static object.  */
+struct asn_path_s {
+  const char *name;        /* The dotted path.  */
+  unsigned char *steps;    /* Number of steps followed by the child
+                              positions or NULL if not yet compiled. */
+};
+#define ASN_PATH(name)  { (name), NULL }
+#define ASN_PATH_LAST   0xff    /* Position for "?LAST".  */
+
+
 typedef struct static_struct_asn {
   unsigned int name_off;        /* Node name */
   node_type_t type;             /* Node type */
@@ -198,6 +251,8 @@ int _ksba_asn_expand_object_id(AsnNode node);
 void _ksba_asn_set_default_tag (AsnNode node);
 void _ksba_asn_type_set_config (AsnNode node);
 AsnNode _ksba_asn_expand_tree (AsnNode parse_tree, const char *name);
+AsnNode _ksba_asn_expand_module (ksba_asn_tree_t module, const char *name);
+void _ksba_asn_release_expanded (ksba_asn_tree_t module);
 AsnNode _ksba_asn_insert_copy (AsnNode node);
 
 int _ksba_asn_is_primitive (node_type_t type);
@@ -212,8 +267,34 @@ AsnNode _ksba_asn_find_type_value (const unsigned char *image,
 
 int _ksba_asn_delete_structure (AsnNode root);
 
+#ifndef BUILD_GENTOOLS
+gpg_error_t _ksba_asn_compact_tree (ksba_asn_tree_t module, const char *name,
+                                    AsnNode root, AsnVTree *r_vtree);
+#endif
+void _ksba_asn_release_vtree (AsnVTree vtree);
+AsnValue _ksba_asn_find_value (AsnVTree vtree, AsnValue root,
+                               const char *name);
+AsnValue _ksba_asn_find_path (AsnVTree vtree, struct asn_path_s *path);
+
+/* Return the first child of the value V or NULL.  */
+static inline AsnValue
+_ksba_asn_value_down (AsnValue v)
+{
+  return v->size > 1? v + 1 : NULL;
+}
+
+/* Return the right sibling of the value V or NULL.  */
+static inline AsnValue
+_ksba_asn_value_right (AsnValue v)
+{
+  return v->right? v + v->right : NULL;
+}
+
 /*-- asn2-func.c --*/
-/*(functions are all declared in ksba.h)*/
+#ifndef BUILD_GENTOOLS
+gpg_error_t _ksba_asn_get_shared_tree (const char *mod_name,
+                                       ksba_asn_tree_t *result);
+#endif
 
 /*-- asn1-tables.c (generated) --*/
 const static_asn *_ksba_asn_lookup_table (const char *name,
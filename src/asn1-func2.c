@@ -210,6 +210,9 @@ ksba_asn_create_tree (const char *mod_name, ksba_asn_tree_t *result)
         {
           tree->parse_tree = pointer;
           tree->node_list = p;
+          tree->expanded = NULL;
+          tree->next_shared = NULL;
+          tree->shared = 0;
           strcpy (tree->filename, mod_name);
           *result = tree;
           rc = 0;
@@ -223,3 +226,62 @@ ksba_asn_create_tree (const char *mod_name, ksba_asn_tree_t *result)
 
   return rc;
 }
+
+
+#ifdef HAVE_SYNC_BUILTINS
+/* The list of shared trees.  */
+static ksba_asn_tree_t shared_trees;
+#endif
+
+
+/* Return the parse tree for the module MOD_NAME.  This is the same as
+   ksba_asn_create_tree but the tree is created only once and then
+   shared by all callers and threads.  A shared tree must not be
+   modified; it is possible to call ksba_asn_tree_release on it which
+   is a no-op.  This allows to use the per-module cache of expanded
+   trees (see _ksba_asn_expand_module) for all parser runs.  */
+gpg_error_t
+_ksba_asn_get_shared_tree (const char *mod_name, ksba_asn_tree_t *result)
+{
+#ifdef HAVE_SYNC_BUILTINS
+  gpg_error_t err;
+  ksba_asn_tree_t tree, head, t;
+
+  if (!result || !mod_name)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *result = NULL;
+
+  for (t = shared_trees; t; t = t->next_shared)
+    if (!strcmp (t->filename, mod_name))
+      {
+        *result = t;
+        return 0;
+      }
+
+  err = ksba_asn_create_tree (mod_name, &tree);
+  if (err)
+    return err;
+  tree->shared = 1;
+
+  do
+    {
+      head = shared_trees;
+      /* Check whether another thread was faster.  */
+      for (t = head; t; t = t->next_shared)
+        if (!strcmp (t->filename, mod_name))
+          {
+            tree->shared = 0;
+            ksba_asn_tree_release (tree);
+            *result = t;
+            return 0;
+          }
+      tree->next_shared = head;
+    }
+  while (!atomic_cas_ptr (&shared_trees, head, tree));
+
+  *result = tree;
+  return 0;
+#else /*!HAVE_SYNC_BUILTINS*/
+  return ksba_asn_create_tree (mod_name, result);
+#endif /*!HAVE_SYNC_BUILTINS*/
+}
@@ -897,19 +897,27 @@ static void
 release_all_nodes (AsnNode node)
 {
   AsnNode node2;
+  AsnNode block = NULL;
 
   for (; node; node = node2)
     {
       node2 = node->link_next;
-      xfree (node->name);
+      if (!node->flags.static_name)
+        xfree (node->name);
 
       if (node->valuetype == VALTYPE_CSTR)
         xfree (node->value.v_cstr);
       else if (node->valuetype == VALTYPE_MEM)
         xfree (node->value.v_mem.buf);
 
-      xfree (node);
+      /* Nodes allocated as one block are released at once after we
+         are done with the list.  */
+      if (node->flags.block_head)
+        block = node;
+      else if (!node->flags.in_block)
+        xfree (node);
     }
+  xfree (block);
 }
 
 static void
@@ -1017,6 +1025,9 @@ ksba_asn_parse_file (const char *file_name, ksba_asn_tree_t *result, int debug)
       tree = xmalloc ( sizeof *tree + (file_name? strlen (file_name):1) );
       tree->parse_tree = parsectl.parse_tree;
       tree->node_list = parsectl.all_nodes;
+      tree->expanded = NULL;
+      tree->next_shared = NULL;
+      tree->shared = 0;
       strcpy (tree->filename, file_name? file_name:"-");
       *result = tree;
     }
@@ -1029,8 +1040,9 @@ ksba_asn_parse_file (const char *file_name, ksba_asn_tree_t *result, int debug)
 void
 ksba_asn_tree_release (ksba_asn_tree_t tree)
 {
-  if (!tree)
+  if (!tree || tree->shared)
     return;
+  _ksba_asn_release_expanded (tree);
   release_all_nodes (tree->node_list);
   tree->node_list = NULL;
   xfree (tree);
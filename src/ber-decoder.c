@@ -40,6 +40,7 @@
 #include "asn1-func.h"
 #include "ber-decoder.h"
 #include "ber-help.h"
+#include "reader.h"
 
 
 /* The maximum length we allow for an image, that is for a BER encoded
@@ -72,8 +73,17 @@ typedef struct decoder_state_s *DECODER_STATE;
 /* Context for a decoder. */
 struct ber_decoder_s
 {
-  AsnNode module;    /* the ASN.1 structure */
+  ksba_asn_tree_t module;    /* the ASN.1 structure */
   ksba_reader_t reader;
+  /* If INPUT.BUF is not NULL the decoder works directly on this
+     buffer instead of using READER.  The image is then not copied but
+     points into this buffer.  */
+  struct
+  {
+    const unsigned char *buf;
+    size_t length;
+    size_t pos;
+  } input;
   const char *last_errdesc; /* string with the error description */
   int non_der;    /* set if the encoding is not DER conform */
   AsnNode root;   /* of the expanded parse tree */
@@ -221,7 +231,7 @@ eof_or_error (BerDecoder d, int premature)
 {
   gpg_error_t err;
 
-  err = ksba_reader_error (d->reader);
+  err = d->reader? ksba_reader_error (d->reader) : 0;
   if (err)
     {
       set_error (d, NULL, "read error");
@@ -377,7 +387,7 @@ _ksba_ber_decoder_set_module (BerDecoder d, ksba_asn_tree_t module)
   if (d->module)
     return gpg_error (GPG_ERR_CONFLICT); /* module already set */
 
-  d->module = module->parse_tree;
+  d->module = module;
   return 0;
 }
 
@@ -387,61 +397,144 @@ _ksba_ber_decoder_set_reader (BerDecoder d, ksba_reader_t r)
 {
   if (!d || !r)
     return gpg_error (GPG_ERR_INV_VALUE);
-  if (d->reader)
+  if (d->reader || d->input.buf)
     return gpg_error (GPG_ERR_CONFLICT); /* reader already set */
 
   d->reader = r;
   return 0;
 }
 
+
+/* Use the LENGTH bytes at BUFFER as input for the decoder.  This is
+   an alternative to _ksba_ber_decoder_set_reader which avoids the
+   overhead of the reader and the copying of the data into the image:
+   The image returned by _ksba_ber_decoder_decode is a pointer into
+   BUFFER and the caller must thus make sure that BUFFER is valid as
+   long as the image is in use.  */
+gpg_error_t
+_ksba_ber_decoder_set_buffer (BerDecoder d,
+                              const void *buffer, size_t length)
+{
+  if (!d || !buffer || !length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (d->reader || d->input.buf)
+    return gpg_error (GPG_ERR_CONFLICT); /* input already set */
+
+  d->input.buf = buffer;
+  d->input.length = length;
+  d->input.pos = 0;
+  return 0;
+}
+
 
 /**********************************************
  ***********  decoding machinery  *************
  **********************************************/
 
+/* Return the current offset into the input.  */
+static unsigned long
+decoder_tell (BerDecoder d)
+{
+  if (d->input.buf)
+    return d->input.pos;
+  return ksba_reader_tell (d->reader);
+}
+
+/* Read the next tag and length from the input into TI.  */
+static gpg_error_t
+read_tl (BerDecoder d, struct tag_info *ti)
+{
+  const unsigned char *p;
+  size_t n;
+  gpg_error_t err;
+
+  if (!d->input.buf)
+    return _ksba_ber_read_tl (d->reader, ti);
+
+  p = d->input.buf + d->input.pos;
+  n = d->input.length - d->input.pos;
+  err = _ksba_ber_parse_tl (&p, &n, ti);
+  if (!err)
+    d->input.pos = p - d->input.buf;
+  else if (d->input.pos == d->input.length)
+    err = gpg_error (GPG_ERR_EOF); /* Regular end of the buffer.  */
+  return err;
+}
+
+/* Push back the header stored in TI which has just been read.  */
+static void
+unread_tl (BerDecoder d, const struct tag_info *ti)
+{
+  if (d->input.buf)
+    d->input.pos -= ti->nhdr;
+  else
+    ksba_reader_unread (d->reader, ti->buf, ti->nhdr);
+}
+
 /* Read one byte, return that byte or -1 on error or EOF. */
 static int
-read_byte (ksba_reader_t reader)
+read_byte (BerDecoder d)
 {
-  unsigned char buf;
-  size_t nread;
-  int rc;
+  if (d->input.buf)
+    {
+      if (d->input.pos >= d->input.length)
+        return -1;
+      return d->input.buf[d->input.pos++];
+    }
 
-  do
-    rc = ksba_reader_read (reader, &buf, 1, &nread);
-  while (!rc && !nread);
-  return rc? -1: buf;
+  return _ksba_reader_getc (d->reader);
 }
 
 /* Read COUNT bytes into buffer.  BUFFER may be NULL to skip over
    COUNT bytes.  Return 0 on success or -1 on error. */
 static int
-read_buffer (ksba_reader_t reader, char *buffer, size_t count)
+read_buffer (BerDecoder d, char *buffer, size_t count)
 {
+  ksba_reader_t reader = d->reader;
+  const unsigned char *p;
   size_t nread;
 
-  if (buffer)
+  if (d->input.buf)
+    {
+      if (count > d->input.length - d->input.pos)
+        return -1;
+      if (buffer)
+        memcpy (buffer, d->input.buf + d->input.pos, count);
+      d->input.pos += count;
+      return 0;
+    }
+
+  while (count)
     {
-      while (count)
+      /* Take the bytes directly from the reader's window if it has
+         one; skipping then does not touch the data at all.  */
+      p = _ksba_reader_window (reader, &nread);
+      if (nread)
+        {
+          if (nread > count)
+            nread = count;
+          if (buffer)
+            {
+              memcpy (buffer, p, nread);
+              buffer += nread;
+            }
+          _ksba_reader_skip (reader, nread);
+        }
+      else if (buffer)
         {
           if (ksba_reader_read (reader, buffer, count, &nread))
             return -1;
           buffer += nread;
-          count -= nread;
         }
-    }
-  else
-    {
-      char dummy[256];
-      size_t n;
-
-      while (count)
+      else
         {
-          n = count > DIM(dummy) ? DIM(dummy): count;
-          if (ksba_reader_read (reader, dummy, n, &nread))
+          char dummy[256];
+
+          nread = count > DIM(dummy) ? DIM(dummy): count;
+          if (ksba_reader_read (reader, dummy, nread, &nread))
             return -1;
-          count -= nread;
         }
+      count -= nread;
     }
   return 0;
 }
@@ -555,6 +648,15 @@ match_der (AsnNode root, const struct tag_info *ti,
               while (node->left && node->left->right == node)
                 node = node->left;
               node = node->left; /* this is the up pointer */
+              if (node && !node->right && node->flags.in_choice)
+                {
+                  /* The tag is the last alternative of a choice (e.g.
+                     the subjectKeyIdentifier of a SignerIdentifier);
+                     continue after the choice.  */
+                  while (node->left && node->left->right == node)
+                    node = node->left;
+                  node = node->left;
+                }
               if (node)
                 node = node->right;
             }
@@ -780,7 +882,7 @@ decoder_init (BerDecoder d, const char *start_name)
 {
   d->ds = new_decoder_state ();
 
-  d->root = _ksba_asn_expand_tree (d->module, start_name);
+  d->root = _ksba_asn_expand_module (d->module, start_name);
   clear_help_flags (d->root);
   d->bypass = 0;
   if (d->debug)
@@ -821,7 +923,7 @@ decoder_next (BerDecoder d)
       return gpg_error (GPG_ERR_EOF);
     }
 
-  err = _ksba_ber_read_tl (d->reader, &ti);
+  err = read_tl (d, &ti);
   if (err)
     {
       if (debug)
@@ -859,7 +961,16 @@ decoder_next (BerDecoder d)
   /* Store stuff in the image buffer. */
   if (d->use_image)
     {
-      if (!d->image.buf)
+      if (!d->image.buf && d->input.buf)
+        {
+          /* The image is the input buffer starting at this tag.  Note
+           * that we never write to it.  */
+          d->image.used = 0;
+          d->image.length = d->input.length - d->input.pos + ti.nhdr;
+          d->image.buf = ((unsigned char *)d->input.buf
+                          + d->input.pos - ti.nhdr);
+        }
+      else if (!d->image.buf)
         {
           /* We need some extra bytes to store the stuff we read ahead
            * at the end of the module which is later pushed back.  We
@@ -882,7 +993,8 @@ decoder_next (BerDecoder d)
       if (sum_a1_a2_ge_b (ti.nhdr, d->image.used, d->image.length))
         return set_error (d, NULL, "image buffer too short to store the tag");
 
-      memcpy (d->image.buf + d->image.used, ti.buf, ti.nhdr);
+      if (!d->input.buf)
+        memcpy (d->image.buf + d->image.used, ti.buf, ti.nhdr);
       d->image.used += ti.nhdr;
     }
 
@@ -908,7 +1020,7 @@ decoder_next (BerDecoder d)
               if (d->honor_module_end)
                 {
                   /* We must push back the stuff we already read */
-                  ksba_reader_unread (d->reader, ti.buf, ti.nhdr);
+                  unread_tl (d, &ti);
                   return gpg_error (GPG_ERR_EOF);
                 }
               else
@@ -1037,7 +1149,7 @@ decoder_skip (BerDecoder d)
 {
   if (d->val.primitive)
     {
-      if (read_buffer (d->reader, NULL, d->val.length))
+      if (read_buffer (d, NULL, d->val.length))
         return eof_or_error (d, 1);
     }
   return 0;
@@ -1101,7 +1213,7 @@ _ksba_ber_decoder_dump (BerDecoder d, FILE *fp)
         depth = distance (d->root, node);
 
       fprintf (fp, "%4lu %4lu:%*s",
-               ksba_reader_tell (d->reader) - d->val.nhdr,
+               decoder_tell (d) - d->val.nhdr,
                (unsigned long)d->val.length,
                depth*2, "");
       if (node)
@@ -1134,7 +1246,7 @@ _ksba_ber_decoder_dump (BerDecoder d, FILE *fp)
 
           for (n=0; !err && n < d->val.length; n++)
             {
-              if ( (c=read_byte (d->reader)) == -1)
+              if ( (c=read_byte (d)) == -1)
                 err = eof_or_error (d, 1);
               buf[n] = c;
             }
@@ -1209,7 +1321,7 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
   d->image.buf = NULL;
   d->fast_stop = !!(flags & BER_DECODER_FLAG_FAST_STOP);
 
-  startoff = ksba_reader_tell (d->reader);
+  startoff = decoder_tell (d);
 
   err = decoder_init (d, start_name);
   if (err)
@@ -1225,8 +1337,7 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
         {
           if (node && !d->val.is_endtag)
             { /* We don't have nodes for the end tag - so don't store it */
-              node->off = (ksba_reader_tell (d->reader)
-                           - d->val.nhdr - startoff);
+              node->off = (decoder_tell (d) - d->val.nhdr - startoff);
               node->nhdr = d->val.nhdr;
               node->len = d->val.length;
               if (node->type == TYPE_ANY)
@@ -1236,8 +1347,11 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
             err = set_error(d, NULL, "TLV length too large");
           else if (d->val.primitive)
             {
-              if( read_buffer (d->reader,
-                               d->image.buf + d->image.used, d->val.length))
+              /* With a direct input buffer the value is already in
+                 the image and we only need to skip it.  */
+              if (read_buffer (d, (d->input.buf? NULL
+                                   : d->image.buf + d->image.used),
+                               d->val.length))
                 err = eof_or_error (d, 1);
               else
                 {
@@ -1273,7 +1387,7 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
 
           for (n=0; !err && n < d->val.length; n++)
             {
-              if ( (c=read_byte (d->reader)) == -1)
+              if ( (c=read_byte (d)) == -1)
                 err = eof_or_error (d, 1);
               buf[n] = c;
             }
@@ -1297,8 +1411,13 @@ _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
   if (gpg_err_code (err) == GPG_ERR_EOF)
     err = 0;
 
-  if (err)
+  if (err && !d->input.buf)
     xfree (d->image.buf);
+  if (err)
+    {
+      _ksba_asn_release_nodes (d->root);
+      d->root = NULL;
+    }
 
   if (r_root && !err)
     {
@@ -41,6 +41,8 @@ void       _ksba_ber_decoder_release (BerDecoder d);
 
 gpg_error_t _ksba_ber_decoder_set_module (BerDecoder d, ksba_asn_tree_t module);
 gpg_error_t _ksba_ber_decoder_set_reader (BerDecoder d, ksba_reader_t r);
+gpg_error_t _ksba_ber_decoder_set_buffer (BerDecoder d,
+                                          const void *buffer, size_t length);
 
 gpg_error_t _ksba_ber_decoder_dump (BerDecoder d, FILE *fp);
 gpg_error_t _ksba_ber_decoder_decode (BerDecoder d, const char *start_name,
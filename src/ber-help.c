@@ -37,6 +37,7 @@
 
 #include "asn1-func.h" /* need some constants */
 #include "ber-help.h"
+#include "reader.h"
 
 /* Fixme: The parser functions should check that primitive types don't
    have the constructed bit set (which is not allowed).  This saves us
@@ -45,14 +46,7 @@
 static int
 read_byte (ksba_reader_t reader)
 {
-  unsigned char buf;
-  size_t nread;
-  int rc;
-
-  do
-    rc = ksba_reader_read (reader, &buf, 1, &nread);
-  while (!rc && !nread);
-  return rc? -1: buf;
+  return _ksba_reader_getc (reader);
 }
 
 
@@ -93,6 +87,8 @@ _ksba_ber_read_tl (ksba_reader_t reader, struct tag_info *ti)
 {
   int c;
   unsigned long tag;
+  const unsigned char *p;
+  size_t n, avail;
 
   ti->length = 0;
   ti->ndef = 0;
@@ -100,6 +96,45 @@ _ksba_ber_read_tl (ksba_reader_t reader, struct tag_info *ti)
   ti->err_string = NULL;
   ti->non_der = 0;
 
+  /* Fast path: If the entire header of a low tag number is already
+     buffered, take it in one go.  All other cases, including all
+     errors, are handled by the byte oriented code below.  */
+  p = _ksba_reader_window (reader, &avail);
+  if (avail < 2 && !_ksba_reader_fill (reader))
+    p = _ksba_reader_window (reader, &avail);
+  if (avail >= 2 && (p[0] & 0x1f) != 0x1f && p[1] != 0xff)
+    {
+      n = (p[1] & 0x80)? (p[1] & 0x7f) : 0;
+      if (n <= sizeof (unsigned long) && n <= sizeof (size_t)
+          && 2 + n <= avail)
+        {
+          ti->class = (p[0] & 0xc0) >> 6;
+          ti->is_constructed = !!(p[0] & 0x20);
+          ti->tag = p[0] & 0x1f;
+          if (p[1] == 0x80)
+            ti->ndef = ti->non_der = 1;
+          else if (!n)
+            ti->length = p[1];
+          else
+            {
+              unsigned long len = 0;
+              size_t i;
+
+              for (i=0; i < n; i++)
+                len = (len << 8) | p[2+i];
+              ti->length = len;
+            }
+          ti->nhdr = 2 + n;
+          memcpy (ti->buf, p, ti->nhdr);
+          _ksba_reader_skip (reader, ti->nhdr);
+
+          /* Without this kludge some example certs can't be parsed */
+          if (ti->class == CLASS_UNIVERSAL && !ti->tag)
+            ti->length = 0;
+          return 0;
+        }
+    }
+
   /* Get the tag */
   c = read_byte (reader);
   if (c==-1)
@@ -475,3 +510,138 @@ _ksba_ber_count_tl (unsigned long tag,
 
   return buflen;
 }
+
+
+/* States of the BER scanner.  */
+enum {
+  SCAN_TAG = 0,   /* Expecting the first byte of a tag.  */
+  SCAN_TAG_MORE,  /* Expecting more bytes of a high tag number.  */
+  SCAN_LEN,       /* Expecting the first byte of the length.  */
+  SCAN_LEN_MORE,  /* Expecting more bytes of the length.  */
+  SCAN_VALUE,     /* Skipping the value.  */
+  SCAN_DONE       /* The object is complete.  */
+};
+
+
+/* Initialize SCAN to find the end of a BER encoded object.  */
+void
+_ksba_ber_scan_init (struct ber_scan_s *scan)
+{
+  memset (scan, 0, sizeof *scan);
+  scan->state = SCAN_TAG;
+}
+
+
+/* Return true if the object scanned by SCAN is complete.  */
+int
+_ksba_ber_scan_done (struct ber_scan_s *scan)
+{
+  return scan->state == SCAN_DONE;
+}
+
+
+/* Called after a complete header has been scanned.  */
+static gpg_error_t
+scan_header_done (struct ber_scan_s *scan, int ndef)
+{
+  if (ndef)
+    {
+      if (!scan->is_constructed)
+        return gpg_error (GPG_ERR_BAD_BER);
+      scan->depth++;
+      scan->state = SCAN_TAG;
+    }
+  else if (scan->class == CLASS_UNIVERSAL && scan->tag_is_zero)
+    {
+      /* End of contents; see the kludge in _ksba_ber_read_tl.  */
+      if (!scan->depth)
+        return gpg_error (GPG_ERR_BAD_BER);
+      scan->depth--;
+      scan->state = scan->depth? SCAN_TAG : SCAN_DONE;
+    }
+  else if (scan->length)
+    scan->state = SCAN_VALUE;
+  else
+    scan->state = scan->depth? SCAN_TAG : SCAN_DONE;
+  return 0;
+}
+
+
+/* Feed LENGTH bytes from BUFFER to the BER scanner SCAN.  This may be
+   called with any pieces of the encoding; the state is kept in SCAN.
+   Returns the number of bytes which belong to the object; this is
+   less than LENGTH only if the object is complete or on error.  An
+   error is stored at R_ERR.  */
+size_t
+_ksba_ber_scan (struct ber_scan_s *scan,
+                const unsigned char *buffer, size_t length,
+                gpg_error_t *r_err)
+{
+  const unsigned char *p = buffer;
+  size_t n;
+  int c;
+
+  *r_err = 0;
+  while (length && scan->state != SCAN_DONE)
+    {
+      if (scan->state == SCAN_VALUE)
+        {
+          n = length < scan->length? length : scan->length;
+          p += n;
+          length -= n;
+          scan->length -= n;
+          if (!scan->length)
+            scan->state = scan->depth? SCAN_TAG : SCAN_DONE;
+          continue;
+        }
+
+      c = *p++;
+      length--;
+      switch (scan->state)
+        {
+        case SCAN_TAG:
+          scan->class = (c & 0xc0) >> 6;
+          scan->is_constructed = !!(c & 0x20);
+          scan->tag_is_zero = !(c & 0x1f);
+          scan->length = 0;
+          scan->state = (c & 0x1f) == 0x1f? SCAN_TAG_MORE : SCAN_LEN;
+          break;
+
+        case SCAN_TAG_MORE:
+          if (!(c & 0x80))
+            scan->state = SCAN_LEN;
+          break;
+
+        case SCAN_LEN:
+          if (!(c & 0x80))
+            {
+              scan->length = c;
+              *r_err = scan_header_done (scan, 0);
+            }
+          else if (c == 0x80)
+            *r_err = scan_header_done (scan, 1);
+          else if (c == 0xff)
+            *r_err = gpg_error (GPG_ERR_BAD_BER);
+          else
+            {
+              scan->count = c & 0x7f;
+              if (scan->count > sizeof (unsigned long)
+                  || scan->count > sizeof (size_t))
+                *r_err = gpg_error (GPG_ERR_BAD_BER);
+              else
+                scan->state = SCAN_LEN_MORE;
+            }
+          break;
+
+        case SCAN_LEN_MORE:
+          scan->length = (scan->length << 8) | c;
+          if (!--scan->count)
+            *r_err = scan_header_done (scan, 0);
+          break;
+        }
+      if (*r_err)
+        break;
+    }
+
+  return p - buffer;
+}
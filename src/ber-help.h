@@ -45,6 +45,20 @@ struct tag_info {
 };
 
 
+/* State of a resumable scan over a BER encoded object.  The scan
+   follows the tag and length headers only and finds the end of the
+   first object; the values are skipped.  */
+struct ber_scan_s {
+  int state;
+  enum tag_class class;
+  int is_constructed;
+  int tag_is_zero;       /* The tag number is 0.  */
+  int count;             /* Remaining length bytes.  */
+  unsigned long length;  /* Length or remaining bytes of the value.  */
+  int depth;             /* Open indefinite length encodings.  */
+};
+
+
 gpg_error_t _ksba_ber_read_tl (ksba_reader_t reader, struct tag_info *ti);
 gpg_error_t _ksba_ber_parse_tl (unsigned char const **buffer, size_t *size,
                                 struct tag_info *ti);
@@ -62,6 +76,11 @@ size_t _ksba_ber_count_tl (unsigned long tag,
                            enum tag_class class,
                            int constructed,
                            unsigned long length);
+void _ksba_ber_scan_init (struct ber_scan_s *scan);
+size_t _ksba_ber_scan (struct ber_scan_s *scan,
+                       const unsigned char *buffer, size_t length,
+                       gpg_error_t *r_err);
+int _ksba_ber_scan_done (struct ber_scan_s *scan);
 
 
 #endif /*BER_HELP_H*/
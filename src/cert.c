@@ -46,15 +46,77 @@
 
 static const char oidstr_subjectKeyIdentifier[] = "2.5.29.14";
 static const char oidstr_keyUsage[]         = "2.5.29.15";
+static const char oidstr_privateKeyUsagePeriod[] = "2.5.29.16";
 static const char oidstr_subjectAltName[]   = "2.5.29.17";
 static const char oidstr_issuerAltName[]    = "2.5.29.18";
 static const char oidstr_basicConstraints[] = "2.5.29.19";
+static const char oidstr_nameConstraints[]  = "2.5.29.30";
 static const char oidstr_crlDistributionPoints[] = "2.5.29.31";
 static const char oidstr_certificatePolicies[] = "2.5.29.32";
 static const char oidstr_authorityKeyIdentifier[] = "2.5.29.35";
+static const char oidstr_policyConstraints[] = "2.5.29.36";
 static const char oidstr_extKeyUsage[] = "2.5.29.37";
+static const char oidstr_inhibitAnyPolicy[] = "2.5.29.54";
 static const char oidstr_authorityInfoAccess[] = "1.3.6.1.5.5.7.1.1";
 static const char oidstr_subjectInfoAccess[]   = "1.3.6.1.5.5.7.1.11";
+static const char oidstr_signedCertTimestamps[] = "1.3.6.1.4.1.11129.2.4.2";
+static const char oidstr_netscapeCertType[] = "2.16.840.1.113730.1.1";
+static const char oidstr_sha1[] = "1.3.14.3.2.26";
+
+/* The paths to the values used by the accessors; they are compiled
+   at first use.  */
+static struct asn_path_s path_cert = ASN_PATH ("Certificate");
+static struct asn_path_s path_tbs = ASN_PATH ("Certificate.tbsCertificate");
+static struct asn_path_s path_sigalgo
+  = ASN_PATH ("Certificate.signatureAlgorithm");
+static struct asn_path_s path_serial
+  = ASN_PATH ("Certificate.tbsCertificate.serialNumber");
+static struct asn_path_s path_issuer
+  = ASN_PATH ("Certificate.tbsCertificate.issuer");
+static struct asn_path_s path_subject
+  = ASN_PATH ("Certificate.tbsCertificate.subject");
+static struct asn_path_s path_not_before
+  = ASN_PATH ("Certificate.tbsCertificate.validity.notBefore");
+static struct asn_path_s path_not_after
+  = ASN_PATH ("Certificate.tbsCertificate.validity.notAfter");
+static struct asn_path_s path_spki
+  = ASN_PATH ("Certificate.tbsCertificate.subjectPublicKeyInfo");
+static struct asn_path_s path_extensions
+  = ASN_PATH ("Certificate.tbsCertificate.extensions..");
+
+/* The DER encoding of frequently used extensions.  Using this table
+   avoids the allocation of a string for the OID.  */
+static const struct
+{
+  const char *oid;
+  const char *der;
+  int derlen;
+} known_extns[] = {
+  { oidstr_subjectKeyIdentifier,    "\x55\x1d\x0e", 3 },
+  { oidstr_keyUsage,                "\x55\x1d\x0f", 3 },
+  { oidstr_privateKeyUsagePeriod,   "\x55\x1d\x10", 3 },
+  { oidstr_subjectAltName,          "\x55\x1d\x11", 3 },
+  { oidstr_issuerAltName,           "\x55\x1d\x12", 3 },
+  { oidstr_basicConstraints,        "\x55\x1d\x13", 3 },
+  { oidstr_nameConstraints,         "\x55\x1d\x1e", 3 },
+  { oidstr_crlDistributionPoints,   "\x55\x1d\x1f", 3 },
+  { oidstr_certificatePolicies,     "\x55\x1d\x20", 3 },
+  { oidstr_authorityKeyIdentifier,  "\x55\x1d\x23", 3 },
+  { oidstr_policyConstraints,       "\x55\x1d\x24", 3 },
+  { oidstr_extKeyUsage,             "\x55\x1d\x25", 3 },
+  { oidstr_inhibitAnyPolicy,        "\x55\x1d\x36", 3 },
+  { oidstr_authorityInfoAccess,     "\x2b\x06\x01\x05\x05\x07\x01\x01", 8 },
+  { oidstr_subjectInfoAccess,       "\x2b\x06\x01\x05\x05\x07\x01\x0b", 8 },
+  { oidstr_signedCertTimestamps,
+    "\x2b\x06\x01\x04\x01\xd6\x79\x02\x04\x02", 10 },
+  { oidstr_netscapeCertType,
+    "\x60\x86\x48\x01\x86\xf8\x42\x01\x01", 9 },
+  { NULL }
+};
+
+
+static void build_index (ksba_cert_t cert);
+static void release_extns (struct cert_extns *extns);
 
 
 /**
@@ -72,7 +134,7 @@ ksba_cert_new (ksba_cert_t *acert)
   *acert = xtrycalloc (1, sizeof **acert);
   if (!*acert)
     return gpg_error_from_errno (errno);
-  (*acert)->ref_count++;
+  (*acert)->ref_count = 1;
 
   return 0;
 }
@@ -83,7 +145,7 @@ ksba_cert_ref (ksba_cert_t cert)
   if (!cert)
     fprintf (stderr, "BUG: ksba_cert_ref for NULL\n");
   else
-    ++cert->ref_count;
+    atomic_add_int (&cert->ref_count, 1);
 }
 
 /**
@@ -95,16 +157,17 @@ ksba_cert_ref (ksba_cert_t cert)
 void
 ksba_cert_release (ksba_cert_t cert)
 {
-  int i;
+  int n;
 
   if (!cert)
     return;
-  if (cert->ref_count < 1)
+  n = atomic_add_int (&cert->ref_count, -1);
+  if (n < 0)
     {
       fprintf (stderr, "BUG: trying to release an already released cert\n");
       return;
     }
-  if (--cert->ref_count)
+  if (n)
     return;
 
   if (cert->udata)
@@ -123,17 +186,19 @@ ksba_cert_release (ksba_cert_t cert)
     }
 
   xfree (cert->cache.digest_algo);
-  if (cert->cache.extns_valid)
+  release_extns (cert->cache.extns);
+  while (cert->cache.certid_hashes)
     {
-      for (i=0; i < cert->cache.n_extns; i++)
-        xfree (cert->cache.extns[i].oid);
-      xfree (cert->cache.extns);
+      struct cert_certid_hash *h = cert->cache.certid_hashes;
+      cert->cache.certid_hashes = h->next;
+      xfree (h);
     }
 
-  _ksba_asn_release_nodes (cert->root);
+  _ksba_asn_release_vtree (cert->vtree);
   ksba_asn_tree_release (cert->asn_tree);
 
-  xfree (cert->image);
+  if (!cert->image_borrowed)
+    xfree (cert->image);
 
   xfree (cert);
 }
@@ -252,35 +317,27 @@ ksba_cert_get_user_data (ksba_cert_t cert, const char *key,
 }
 
 
-/**
- * ksba_cert_read_der:
- * @cert: An unitialized certificate object
- * @reader: A KSBA Reader object
- *
- * Read the next certificate from the reader and store it in the
- * certificate object for future access.  The certificate is parsed
- * and rejected if it has any syntactical or semantical error
- * (i.e. does not match the ASN.1 description).
- *
- * Return value: 0 on success or an error value
- **/
-gpg_error_t
-ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader)
+/* Common code for ksba_cert_read_der and
+   ksba_cert_init_from_mem_nocopy.  If READER is NULL the certificate
+   is parsed directly from BUFFER of LENGTH bytes and the image of the
+   certificate will point into BUFFER.  */
+static gpg_error_t
+read_der (ksba_cert_t cert, ksba_reader_t reader,
+          const void *buffer, size_t length)
 {
   gpg_error_t err = 0;
   BerDecoder decoder = NULL;
+  AsnNode root = NULL;
 
-  if (!cert || !reader)
-    return gpg_error (GPG_ERR_INV_VALUE);
   if (cert->initialized)
     return gpg_error (GPG_ERR_CONFLICT); /* Fixme: should remove the old one */
 
-  _ksba_asn_release_nodes (cert->root);
+  _ksba_asn_release_vtree (cert->vtree);
   ksba_asn_tree_release (cert->asn_tree);
-  cert->root = NULL;
+  cert->vtree = NULL;
   cert->asn_tree = NULL;
 
-  err = ksba_asn_create_tree ("tmttv2", &cert->asn_tree);
+  err = _ksba_asn_get_shared_tree ("tmttv2", &cert->asn_tree);
   if (err)
     goto leave;
 
@@ -291,7 +348,10 @@ ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader)
       goto leave;
     }
 
-  err = _ksba_ber_decoder_set_reader (decoder, reader);
+  if (reader)
+    err = _ksba_ber_decoder_set_reader (decoder, reader);
+  else
+    err = _ksba_ber_decoder_set_buffer (decoder, buffer, length);
   if (err)
     goto leave;
 
@@ -300,17 +360,51 @@ ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader)
      goto leave;
 
   err = _ksba_ber_decoder_decode (decoder, "TMTTv2.Certificate", 0,
-                                  &cert->root, &cert->image, &cert->imagelen);
+                                  &root, &cert->image, &cert->imagelen);
+  if (err)
+    goto leave;
+  cert->image_borrowed = !reader;
+
+  /* We only need to keep the values; the compact tree is much
+     smaller than the decoded one.  */
+  err = _ksba_asn_compact_tree (cert->asn_tree, "TMTTv2.Certificate",
+                                root, &cert->vtree);
   if (!err)
+    {
       cert->initialized = 1;
+      build_index (cert);
+    }
 
  leave:
+  _ksba_asn_release_nodes (root);
   _ksba_ber_decoder_release (decoder);
 
   return err;
 }
 
 
+/**
+ * ksba_cert_read_der:
+ * @cert: An unitialized certificate object
+ * @reader: A KSBA Reader object
+ *
+ * Read the next certificate from the reader and store it in the
+ * certificate object for future access.  The certificate is parsed
+ * and rejected if it has any syntactical or semantical error
+ * (i.e. does not match the ASN.1 description).
+ *
+ * Return value: 0 on success or an error value
+ **/
+gpg_error_t
+ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader)
+{
+  if (!cert || !reader)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  return read_der (cert, reader, NULL, 0);
+}
+
+
 gpg_error_t
 ksba_cert_init_from_mem (ksba_cert_t cert, const void *buffer, size_t length)
 {
@@ -332,18 +426,54 @@ ksba_cert_init_from_mem (ksba_cert_t cert, const void *buffer, size_t length)
 }
 
 
+/* Parse the DER encoded certificate in BUFFER of LENGTH bytes and
+   initialize CERT with it.  In contrast to ksba_cert_init_from_mem
+   BUFFER is not copied; instead CERT references the bytes in BUFFER
+   directly.  The caller must make sure that BUFFER is neither
+   modified nor released as long as CERT (or any reference to it)
+   exists.  */
+gpg_error_t
+ksba_cert_init_from_mem_nocopy (ksba_cert_t cert,
+                                const void *buffer, size_t length)
+{
+  if (!cert || !buffer || !length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  return read_der (cert, NULL, buffer, length);
+}
+
+
+/* Same as ksba_cert_init_from_mem_nocopy but on success CERT takes
+   over BUFFER, which must have been allocated with xtrymalloc and
+   must start with the certificate.  On error the caller still owns
+   BUFFER.  */
+gpg_error_t
+_ksba_cert_init_from_mem_take (ksba_cert_t cert, void *buffer, size_t length)
+{
+  gpg_error_t err;
+
+  err = ksba_cert_init_from_mem_nocopy (cert, buffer, length);
+  if (err)
+    return err;
+  if (cert->image != buffer)
+    return gpg_error (GPG_ERR_BUG);
+  cert->image_borrowed = 0;
+  return 0;
+}
+
+
 
 const unsigned char *
 ksba_cert_get_image (ksba_cert_t cert, size_t *r_length )
 {
-  AsnNode n;
+  AsnValue n;
 
   if (!cert)
     return NULL;
   if (!cert->initialized)
     return NULL;
 
-  n = _ksba_asn_find_node (cert->root, "Certificate");
+  n = cert->idx.cert;
   if (!n)
     return NULL;
 
@@ -395,16 +525,14 @@ ksba_cert_hash (ksba_cert_t cert, int what,
                 void (*hasher)(void *, const void *, size_t length),
                 void *hasher_arg)
 {
-  AsnNode n;
+  AsnValue n;
 
   if (!cert /*|| !hasher*/)
     return gpg_error (GPG_ERR_INV_VALUE);
   if (!cert->initialized)
     return gpg_error (GPG_ERR_NO_DATA);
 
-  n = _ksba_asn_find_node (cert->root,
-                           what == 1? "Certificate.tbsCertificate"
-                                    : "Certificate");
+  n = what == 1? cert->idx.tbs : cert->idx.cert;
   if (!n)
     return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
   if (n->off == -1)
@@ -438,7 +566,7 @@ const char *
 ksba_cert_get_digest_algo (ksba_cert_t cert)
 {
   gpg_error_t err;
-  AsnNode n;
+  AsnValue n;
   char *algo;
   size_t nread;
 
@@ -447,7 +575,7 @@ ksba_cert_get_digest_algo (ksba_cert_t cert)
 
   if (!cert->initialized)
     {
-       cert->last_error = gpg_error (GPG_ERR_NO_DATA);
+       atomic_set_int (&cert->last_error, gpg_error (GPG_ERR_NO_DATA));
        return NULL;
     }
 
@@ -462,7 +590,7 @@ ksba_cert_get_digest_algo (ksba_cert_t cert)
 /*   else  */
 /*     cert->cache.digest_algo = algo; */
 
-  n = _ksba_asn_find_node (cert->root, "Certificate.signatureAlgorithm");
+  n = cert->idx.sigalgo;
   if (!n || n->off == -1)
     {
       algo = NULL;
@@ -472,9 +600,13 @@ ksba_cert_get_digest_algo (ksba_cert_t cert)
     err = _ksba_parse_algorithm_identifier (cert->image + n->off,
                                             n->nhdr + n->len, &nread, &algo);
   if (err)
-    cert->last_error = err;
-  else
-    cert->cache.digest_algo = algo;
+    atomic_set_int (&cert->last_error, err);
+  else if (!atomic_cas_ptr (&cert->cache.digest_algo, NULL, algo))
+    {
+      /* Another thread was faster.  */
+      xfree (algo);
+      algo = cert->cache.digest_algo;
+    }
 
   return algo;
 }
@@ -495,7 +627,7 @@ ksba_cert_get_digest_algo (ksba_cert_t cert)
 ksba_sexp_t
 ksba_cert_get_serial (ksba_cert_t cert)
 {
-  AsnNode n;
+  AsnValue n;
   char *p;
   char numbuf[22];
   int numbuflen;
@@ -503,8 +635,7 @@ ksba_cert_get_serial (ksba_cert_t cert)
   if (!cert || !cert->initialized)
     return NULL;
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.tbsCertificate.serialNumber");
+  n = cert->idx.serial;
   if (!n)
     return NULL; /* oops - should be there */
 
@@ -534,12 +665,11 @@ gpg_error_t
 _ksba_cert_get_serial_ptr (ksba_cert_t cert,
                            unsigned char const **ptr, size_t *length)
 {
-  asn_node_t n;
+  AsnValue n;
 
   if (!cert || !cert->initialized || !ptr || !length)
     return gpg_error (GPG_ERR_INV_VALUE);
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.tbsCertificate.serialNumber");
+  n = cert->idx.serial;
   if (!n || n->off == -1)
     return gpg_error (GPG_ERR_NO_VALUE);
 
@@ -556,16 +686,13 @@ gpg_error_t
 _ksba_cert_get_subject_dn_ptr (ksba_cert_t cert,
                                unsigned char const **ptr, size_t *length)
 {
-  asn_node_t n;
+  AsnValue n;
 
   if (!cert || !cert->initialized || !ptr || !length)
     return gpg_error (GPG_ERR_INV_VALUE);
 
-  n = _ksba_asn_find_node (cert->root, "Certificate.tbsCertificate.subject");
-  if (!n || !n->down)
-    return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
-  n = n->down; /* dereference the choice node */
-  if (n->off == -1)
+  n = cert->idx.subject;
+  if (!n || n->off == -1)
     return gpg_error (GPG_ERR_NO_VALUE);
   *ptr = cert->image + n->off;
   *length = n->nhdr + n->len;
@@ -594,19 +721,13 @@ get_name (ksba_cert_t cert, int idx, int use_subject, char **result)
   *result = NULL;
   if (!idx)
     { /* Get the required DN */
-      AsnNode n;
-
-      n = _ksba_asn_find_node (cert->root,
-                               (use_subject?
-                                "Certificate.tbsCertificate.subject":
-                                "Certificate.tbsCertificate.issuer") );
-      if (!n || !n->down)
-        return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
-      n = n->down; /* dereference the choice node */
-      if (n->off == -1)
+      AsnValue n;
+
+      n = use_subject? cert->idx.subject : cert->idx.issuer;
+      if (!n || n->off == -1)
         return gpg_error (GPG_ERR_NO_VALUE);
 
-      err = _ksba_dn_to_str (cert->image, n, &p);
+      err = _ksba_dn_value_to_str (cert->image, n, &p);
       if (err)
         return err;
       *result = p;
@@ -744,7 +865,7 @@ ksba_cert_get_issuer (ksba_cert_t cert, int idx)
   err = get_name (cert, idx, 0, &name);
   if (err)
     {
-      cert->last_error = err;
+      atomic_set_int (&cert->last_error, err);
       return NULL;
     }
   return name;
@@ -760,7 +881,7 @@ ksba_cert_get_subject (ksba_cert_t cert, int idx)
   err = get_name (cert, idx, 1, &name);
   if (err)
     {
-      cert->last_error = err;
+      atomic_set_int (&cert->last_error, err);
       return NULL;
     }
   return name;
@@ -783,7 +904,7 @@ ksba_cert_get_subject (ksba_cert_t cert, int idx)
 gpg_error_t
 ksba_cert_get_validity (ksba_cert_t cert, int what, ksba_isotime_t timebuf)
 {
-  AsnNode n, n2;
+  AsnValue n;
 
   if (!cert || what < 0 || what > 1)
     return gpg_error (GPG_ERR_INV_VALUE);
@@ -791,20 +912,7 @@ ksba_cert_get_validity (ksba_cert_t cert, int what, ksba_isotime_t timebuf)
   if (!cert->initialized)
     return gpg_error (GPG_ERR_NO_DATA);
 
-  n = _ksba_asn_find_node (cert->root,
-        what == 0? "Certificate.tbsCertificate.validity.notBefore"
-                 : "Certificate.tbsCertificate.validity.notAfter");
-  if (!n)
-    return 0; /* no value available */
-
-  /* Fixme: We should remove the choice node and don't use this ugly hack */
-  for (n2=n->down; n2; n2 = n2->right)
-    {
-      if ((n2->type == TYPE_UTC_TIME || n2->type == TYPE_GENERALIZED_TIME)
-          && n2->off != -1)
-        break;
-    }
-  n = n2;
+  n = what == 0? cert->idx.not_before : cert->idx.not_after;
   if (!n)
     return 0; /* no value available */
 
@@ -819,7 +927,7 @@ ksba_cert_get_validity (ksba_cert_t cert, int what, ksba_isotime_t timebuf)
 ksba_sexp_t
 ksba_cert_get_public_key (ksba_cert_t cert)
 {
-  AsnNode n;
+  AsnValue n;
   gpg_error_t err;
   ksba_sexp_t string;
 
@@ -828,12 +936,10 @@ ksba_cert_get_public_key (ksba_cert_t cert)
   if (!cert->initialized)
     return NULL;
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate"
-                           ".tbsCertificate.subjectPublicKeyInfo");
+  n = cert->idx.spki;
   if (!n)
     {
-      cert->last_error = gpg_error (GPG_ERR_NO_VALUE);
+      atomic_set_int (&cert->last_error, gpg_error (GPG_ERR_NO_VALUE));
       return NULL;
     }
 
@@ -841,7 +947,7 @@ ksba_cert_get_public_key (ksba_cert_t cert)
                                &string);
   if (err)
     {
-      cert->last_error = err;
+      atomic_set_int (&cert->last_error, err);
       return NULL;
     }
 
@@ -855,16 +961,16 @@ gpg_error_t
 _ksba_cert_get_public_key_ptr (ksba_cert_t cert,
                                unsigned char const **ptr, size_t *length)
 {
-  asn_node_t n;
+  AsnValue n;
 
   if (!cert || !cert->initialized || !ptr || !length)
     return gpg_error (GPG_ERR_INV_VALUE);
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.tbsCertificate.subjectPublicKeyInfo");
-  if (!n || !n->down || !n->down->right)
+  n = cert->idx.spki;
+  if (!n || !_ksba_asn_value_down (n)
+      || !_ksba_asn_value_right (_ksba_asn_value_down (n)))
     return gpg_error (GPG_ERR_NO_VALUE); /* oops - should be there */
-  n = n->down->right;
+  n = _ksba_asn_value_right (_ksba_asn_value_down (n));
   if (n->off == -1)
     return gpg_error (GPG_ERR_NO_VALUE);
   *ptr = cert->image + n->off + n->nhdr;
@@ -881,11 +987,76 @@ _ksba_cert_get_public_key_ptr (ksba_cert_t cert,
 }
 
 
+/* Return the hashes of the subject DN and of the public key of CERT
+   as used in OCSP CertIDs.  ALGO is the OID of the hash algorithm and
+   must be a static string; HASHLEN is the length of its output.  The
+   hashes are computed only once and the returned pointers are valid
+   as long as CERT.  This may be called by several threads.  */
+gpg_error_t
+_ksba_cert_get_certid_hashes (ksba_cert_t cert,
+                              const char *algo, size_t hashlen,
+                              unsigned char const **r_name_hash,
+                              unsigned char const **r_key_hash)
+{
+  gpg_error_t err;
+  struct cert_certid_hash *h;
+  const unsigned char *ptr;
+  const char *hashoid;
+  size_t length, n1, n2;
+
+  if (!cert || !algo || !hashlen || !r_name_hash || !r_key_hash)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  for (h = cert->cache.certid_hashes; h; h = h->next)
+    if (h->hashlen == hashlen && !strcmp (h->algo, algo))
+      {
+        *r_name_hash = h->hashes;
+        *r_key_hash = h->hashes + hashlen;
+        return 0;
+      }
+
+  h = xtrymalloc (sizeof *h + 2 * hashlen);
+  if (!h)
+    return gpg_error_from_syserror ();
+  h->algo = algo;
+  h->hashlen = hashlen;
+
+  /* The hash function uses SHA-1 if no OID is given.  We pass no OID
+     for SHA-1 so that existing hash functions keep working.  */
+  hashoid = strcmp (algo, oidstr_sha1)? algo : NULL;
+  err = _ksba_cert_get_subject_dn_ptr (cert, &ptr, &length);
+  if (!err)
+    err = _ksba_hash_buffer (hashoid, ptr, length, hashlen, h->hashes, &n1);
+  if (!err)
+    err = _ksba_cert_get_public_key_ptr (cert, &ptr, &length);
+  if (!err)
+    err = _ksba_hash_buffer (hashoid, ptr, length, hashlen,
+                             h->hashes + hashlen, &n2);
+  if (!err && (n1 != hashlen || n2 != hashlen))
+    err = gpg_error (GPG_ERR_BUG);
+  if (err)
+    {
+      xfree (h);
+      return err;
+    }
+
+  /* If another thread added the same hashes in the meantime, we end
+     up with two identical entries which is harmless.  */
+  do
+    h->next = cert->cache.certid_hashes;
+  while (!atomic_cas_ptr (&cert->cache.certid_hashes, h->next, h));
+
+  *r_name_hash = h->hashes;
+  *r_key_hash = h->hashes + hashlen;
+  return 0;
+}
+
+
 
 ksba_sexp_t
 ksba_cert_get_sig_val (ksba_cert_t cert)
 {
-  AsnNode n, n2;
+  AsnValue n, n2;
   gpg_error_t err;
   ksba_sexp_t string;
 
@@ -894,29 +1065,28 @@ ksba_cert_get_sig_val (ksba_cert_t cert)
   if (!cert->initialized)
     return NULL;
 
-  n = _ksba_asn_find_node (cert->root,
-                           "Certificate.signatureAlgorithm");
+  n = cert->idx.sigalgo;
   if (!n)
     {
-      cert->last_error = gpg_error (GPG_ERR_NO_VALUE);
+      atomic_set_int (&cert->last_error, gpg_error (GPG_ERR_NO_VALUE));
       return NULL;
     }
   if (n->off == -1)
     {
 /*        fputs ("ksba_cert_get_sig_val problem at node:\n", stderr); */
 /*        _ksba_asn_node_dump_all (n, stderr); */
-      cert->last_error = gpg_error (GPG_ERR_NO_VALUE);
+      atomic_set_int (&cert->last_error, gpg_error (GPG_ERR_NO_VALUE));
       return NULL;
     }
 
-  n2 = n->right;
+  n2 = _ksba_asn_value_right (n);
   err = _ksba_sigval_to_sexp (cert->image + n->off,
                               n->nhdr + n->len
                               + ((!n2||n2->off == -1)? 0:(n2->nhdr+n2->len)),
                               &string);
   if (err)
     {
-      cert->last_error = err;
+      atomic_set_int (&cert->last_error, err);
       return NULL;
     }
 
@@ -924,68 +1094,138 @@ ksba_cert_get_sig_val (ksba_cert_t cert)
 }
 
 
-/* Read all extensions into the cache */
+/* Release the extension info EXTNS.  */
+static void
+release_extns (struct cert_extns *extns)
+{
+  int i;
+
+  if (!extns)
+    return;
+  for (i=0; i < extns->count; i++)
+    if (!extns->items[i].oid_static)
+      xfree (extns->items[i].oid);
+  xfree (extns);
+}
+
+
+/* Read all extensions into the cache.  If another thread did this at
+   the same time, its result is used.  */
 static gpg_error_t
 read_extensions (ksba_cert_t cert)
 {
-  AsnNode start, n;
-  int count;
-
-  assert (!cert->cache.extns_valid);
-  assert (!cert->cache.extns);
+  AsnValue start, n;
+  struct cert_extns *extns;
+  int count, i;
 
-  start = _ksba_asn_find_node (cert->root,
-                               "Certificate.tbsCertificate.extensions..");
-  for (count=0, n=start; n; n = n->right)
+  start = _ksba_asn_find_path (cert->vtree, &path_extensions);
+  for (count=0, n=start; n; n = _ksba_asn_value_right (n))
     count++;
-  if (!count || start->off == -1)
+  if (count && start->off == -1)
+    count = 0; /* No extensions at all.  */
+  extns = xtrycalloc (1, sizeof *extns
+                      + (count? count - 1 : 0) * sizeof *extns->items);
+  if (!extns)
+    return gpg_error (GPG_ERR_ENOMEM);
+
+  for (; extns->count < count; start = _ksba_asn_value_right (start))
     {
-      cert->cache.n_extns = 0;
-      cert->cache.extns_valid = 1;
-      return 0; /* no extensions at all */
+      struct cert_extn_info *item = extns->items + extns->count;
+
+      n = _ksba_asn_value_down (start);
+      if (!n || n->type != TYPE_OBJECT_ID || n->off == -1)
+        goto no_value;
+
+      for (i=0; known_extns[i].oid; i++)
+        if (known_extns[i].derlen == n->len
+            && !memcmp (known_extns[i].der,
+                        cert->image + n->off + n->nhdr, n->len))
+          break;
+      if (known_extns[i].oid)
+        {
+          item->oid = (char*)known_extns[i].oid;
+          item->oid_static = 1;
+        }
+      else
+        item->oid = _ksba_oid_value_to_str (cert->image, n);
+      if (!item->oid)
+        goto no_value;
+      extns->count++;
+
+      n = _ksba_asn_value_right (n);
+      if (n && n->type == TYPE_BOOLEAN)
+        {
+          if (n->off != -1 && n->len && cert->image[n->off + n->nhdr])
+            item->crit = 1;
+          n = _ksba_asn_value_right (n);
+        }
+
+      if (!n || n->type != TYPE_OCTET_STRING || n->off == -1)
+        goto no_value;
+
+      item->off = n->off + n->nhdr;
+      item->len = n->len;
     }
-  cert->cache.extns = xtrycalloc (count, sizeof *cert->cache.extns);
-  if (!cert->cache.extns)
-    return gpg_error (GPG_ERR_ENOMEM);
-  cert->cache.n_extns = count;
 
-  {
-    for (count=0; start; start = start->right, count++)
-      {
-        n = start->down;
-        if (!n || n->type != TYPE_OBJECT_ID)
-          goto no_value;
-
-        cert->cache.extns[count].oid = _ksba_oid_node_to_str (cert->image, n);
-        if (!cert->cache.extns[count].oid)
-          goto no_value;
-
-        n = n->right;
-        if (n && n->type == TYPE_BOOLEAN)
-          {
-            if (n->off != -1 && n->len && cert->image[n->off + n->nhdr])
-              cert->cache.extns[count].crit = 1;
-            n = n->right;
-          }
+  if (!atomic_cas_ptr (&cert->cache.extns, NULL, extns))
+    release_extns (extns);
+  return 0;
 
-        if (!n || n->type != TYPE_OCTET_STRING || n->off == -1)
-          goto no_value;
+ no_value:
+  release_extns (extns);
+  return gpg_error (GPG_ERR_NO_VALUE);
+}
 
-        cert->cache.extns[count].off = n->off + n->nhdr;
-        cert->cache.extns[count].len = n->len;
-      }
 
-    assert (count == cert->cache.n_extns);
-    cert->cache.extns_valid = 1;
-    return 0;
+/* Return the actual time value of the Time choice at N or NULL.  */
+static AsnValue
+time_value (AsnValue n)
+{
+  /* Fixme: We should remove the choice node and don't use this ugly hack */
+  for (n = n? _ksba_asn_value_down (n) : NULL; n;
+       n = _ksba_asn_value_right (n))
+    {
+      if ((n->type == TYPE_UTC_TIME || n->type == TYPE_GENERALIZED_TIME)
+          && n->off != -1)
+        break;
+    }
+  return n;
+}
 
-  no_value:
-    for (count=0; count < cert->cache.n_extns; count++)
-      xfree (cert->cache.extns[count].oid);
-    xfree (cert->cache.extns);
-    cert->cache.extns = NULL;
-    return gpg_error (GPG_ERR_NO_VALUE);
-  }
+
+/* Locate the frequently used values of the just parsed CERT and read
+   the extensions, so that the accessors neither need to search the
+   tree nor to allocate memory.  Errors are ignored here; they will be
+   returned by the accessors.  */
+static void
+build_index (ksba_cert_t cert)
+{
+  AsnValue n;
+  char *algo;
+  size_t nread;
+
+  cert->idx.cert = _ksba_asn_find_path (cert->vtree, &path_cert);
+  cert->idx.tbs = _ksba_asn_find_path (cert->vtree, &path_tbs);
+  cert->idx.serial = _ksba_asn_find_path (cert->vtree, &path_serial);
+  n = _ksba_asn_find_path (cert->vtree, &path_issuer);
+  cert->idx.issuer = n? _ksba_asn_value_down (n) : NULL;
+  n = _ksba_asn_find_path (cert->vtree, &path_subject);
+  cert->idx.subject = n? _ksba_asn_value_down (n) : NULL;
+  cert->idx.not_before
+    = time_value (_ksba_asn_find_path (cert->vtree, &path_not_before));
+  cert->idx.not_after
+    = time_value (_ksba_asn_find_path (cert->vtree, &path_not_after));
+  cert->idx.spki = _ksba_asn_find_path (cert->vtree, &path_spki);
+  cert->idx.sigalgo = _ksba_asn_find_path (cert->vtree, &path_sigalgo);
+
+  n = cert->idx.sigalgo;
+  if (n && n->off != -1
+      && !_ksba_parse_algorithm_identifier (cert->image + n->off,
+                                            n->nhdr + n->len,
+                                            &nread, &algo))
+    cert->cache.digest_algo = algo;
+
+  read_extensions (cert);
 }
 
 
@@ -996,34 +1236,36 @@ ksba_cert_get_extension (ksba_cert_t cert, int idx,
                          size_t *r_deroff, size_t *r_derlen)
 {
   gpg_error_t err;
+  struct cert_extns *extns;
 
   if (!cert)
     return gpg_error (GPG_ERR_INV_VALUE);
   if (!cert->initialized)
     return gpg_error (GPG_ERR_NO_DATA);
 
-  if (!cert->cache.extns_valid)
+  if (!cert->cache.extns)
     {
       err = read_extensions (cert);
       if (err)
         return err;
-      assert (cert->cache.extns_valid);
+      assert (cert->cache.extns);
     }
+  extns = cert->cache.extns;
 
-  if (idx == cert->cache.n_extns)
+  if (idx == extns->count)
     return gpg_error (GPG_ERR_EOF); /* No more extensions. */
 
-  if (idx < 0 || idx >= cert->cache.n_extns)
+  if (idx < 0 || idx >= extns->count)
     return gpg_error (GPG_ERR_INV_INDEX);
 
   if (r_oid)
-    *r_oid = cert->cache.extns[idx].oid;
+    *r_oid = extns->items[idx].oid;
   if (r_crit)
-    *r_crit = cert->cache.extns[idx].crit;
+    *r_crit = extns->items[idx].crit;
   if (r_deroff)
-    *r_deroff = cert->cache.extns[idx].off;
+    *r_deroff = extns->items[idx].off;
   if (r_derlen)
-    *r_derlen = cert->cache.extns[idx].len;
+    *r_derlen = extns->items[idx].len;
   return 0;
 }
 
@@ -37,10 +37,31 @@
 struct cert_extn_info
 {
   char *oid;
+  int oid_static;  /* OID is a constant string and must not be freed. */
   int crit;
   int off, len;
 };
 
+/* The extensions of a certificate.  */
+struct cert_extns
+{
+  int count;
+  struct cert_extn_info items[1];
+};
+
+
+/* The hashes of the subject DN and of the public key of a certificate
+   as used in OCSP CertIDs.  They are computed on demand and kept until
+   the certificate is released.  */
+struct cert_certid_hash
+{
+  struct cert_certid_hash *next;
+  const char *algo;         /* The OID of the hash algorithm; a static
+                               string.  */
+  size_t hashlen;           /* Length of one hash.  */
+  unsigned char hashes[1];  /* The name hash followed by the key hash.  */
+};
+
 
 /* An object to store user supplied data to be associated with a
    certificates.  This is implemented as a linked list with the
@@ -85,21 +106,43 @@ struct ksba_cert_s
   /* Because we often need to pass certificate objects to other
      functions, we use reference counting to keep resource overhead
      low.  Note, that this object usually gets only read and not
-     modified. */
+     modified.  The counter is changed atomically so that a
+     certificate can be shared by several threads. */
   int ref_count;
 
   ksba_asn_tree_t asn_tree;
-  AsnNode root;              /* Root of the tree with the values */
+  AsnVTree vtree;            /* Compact tree with the values.  */
 
   unsigned char *image;
   size_t imagelen;
+  int image_borrowed;   /* IMAGE points into a buffer owned by the
+                           caller; see ksba_cert_init_from_mem_nocopy. */
 
+  /* Frequently used values located right after parsing.  */
+  struct {
+    AsnValue cert;        /* The entire certificate.  */
+    AsnValue tbs;         /* The tbsCertificate.  */
+    AsnValue serial;
+    AsnValue issuer;      /* The rdnSequence of the issuer.  */
+    AsnValue subject;     /* The rdnSequence of the subject.  */
+    AsnValue not_before;  /* The actual time value or NULL.  */
+    AsnValue not_after;   /* The actual time value or NULL.  */
+    AsnValue spki;        /* The subjectPublicKeyInfo.  */
+    AsnValue sigalgo;     /* The signatureAlgorithm.  */
+  } idx;
+
+  /* The error of the last failed accessor.  The accessors may be
+     called by several threads at the same time and thus store it
+     only with atomic_set_int.  */
   gpg_error_t last_error;
+
+  /* Values computed on demand.  Each pointer is set only once; if two
+     threads compute a value at the same time, the value of the loser
+     is released.  */
   struct {
     char *digest_algo;
-    int  extns_valid;
-    int  n_extns;
-    struct cert_extn_info *extns;
+    struct cert_extns *extns;
+    struct cert_certid_hash *certid_hashes;
   } cache;
 };
 
@@ -108,6 +151,9 @@ struct ksba_cert_s
 
 int _ksba_cert_cmp (ksba_cert_t a, ksba_cert_t b);
 
+gpg_error_t _ksba_cert_init_from_mem_take (ksba_cert_t cert,
+                                           void *buffer, size_t length);
+
 gpg_error_t _ksba_cert_get_serial_ptr (ksba_cert_t cert,
                                        unsigned char const **ptr,
                                        size_t *length);
@@ -117,6 +163,10 @@ gpg_error_t _ksba_cert_get_subject_dn_ptr (ksba_cert_t cert,
 gpg_error_t _ksba_cert_get_public_key_ptr (ksba_cert_t cert,
                                            unsigned char const **ptr,
                                            size_t *length);
+gpg_error_t _ksba_cert_get_certid_hashes (ksba_cert_t cert,
+                                          const char *algo, size_t hashlen,
+                                          unsigned char const **r_name_hash,
+                                          unsigned char const **r_key_hash);
 
 
 #endif /*CERT_H*/
@@ -42,6 +42,8 @@
 #include "keyinfo.h"
 #include "der-encoder.h"
 #include "ber-help.h"
+#include "der-builder.h"
+#include "hasher.h"
 #include "certreq.h"
 
 static const char oidstr_subjectAltName[] = "2.5.29.17";
@@ -122,10 +124,25 @@ ksba_certreq_set_hash_function (ksba_certreq_t cr,
     {
       cr->hash_fnc = hash_fnc;
       cr->hash_fnc_arg = hash_fnc_arg;
+      cr->hasher = NULL;
     }
 }
 
 
+/* Same as ksba_certreq_set_hash_function but using a hasher
+   object.  */
+gpg_error_t
+ksba_certreq_set_hasher (ksba_certreq_t cr, ksba_hasher_t hasher)
+{
+  if (!cr)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  cr->hasher = hasher;
+  cr->hash_fnc = hasher? _ksba_hasher_hash_cb : NULL;
+  cr->hash_fnc_arg = hasher;
+  return 0;
+}
+
+
 
 /* Store the serial number.  If this function is used, a real X.509
    certificate will be built instead of a pkcs#10 certificate signing
@@ -498,402 +515,207 @@ ksba_certreq_set_sig_val (ksba_certreq_t cr, ksba_const_sexp_t sigval)
 
 
 
-/* Build the extension block and return it in R_DER and R_DERLEN.  IF
-   CERTMODE is true build X.509 certificate extension instead.  */
-static gpg_error_t
-build_extensions (ksba_certreq_t cr, int certmode,
-                  void **r_der, size_t *r_derlen)
+/* Add the extension block to D.  If CERTMODE is true add X.509
+   certificate extensions instead of the extension request
+   attribute.  */
+static void
+add_extensions (DerBuilder d, ksba_certreq_t cr, int certmode)
 {
-  gpg_error_t err;
-  ksba_writer_t writer, w=NULL;
   struct extn_list_s *e;
-  unsigned char *value = NULL;
-  size_t valuelen;
-  unsigned char *p;
-  size_t n;
-
-  *r_der = NULL;
-  *r_derlen = 0;
-  err = ksba_writer_new (&writer);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (writer, 2048);
-  if (err)
-    goto leave;
-  err = ksba_writer_new (&w);
-  if (err)
-    goto leave;
 
+  if (!certmode)
+    {
+      /* The extension request attribute.  Note that the implicit SET
+         OF is REQUIRED.  */
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+      _ksba_der_add_oid (d, oidstr_extensionReq);
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SET);
+    }
+
+  /* All extensions are embedded into another sequence.  */
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
   for (e=cr->extn_list; e; e = e->next)
     {
-      err = ksba_writer_set_mem (w, e->derlen + 100);
-      if (err)
-        goto leave;
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+      _ksba_der_add_oid (d, e->oid);
+      if (e->critical)
+        _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_BOOLEAN, "\xff", 1);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING,
+                         e->der, e->derlen);
+      _ksba_der_add_end (d);
+    }
+  _ksba_der_add_end (d);
 
-      err = ksba_oid_from_str (e->oid, &p, &n);
-      if(err)
-        goto leave;
-      err = _ksba_ber_write_tl (w, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, n);
-      if (!err)
-        err = ksba_writer_write (w, p, n);
-      xfree (p);
+  if (!certmode)
+    {
+      _ksba_der_add_end (d);
+      _ksba_der_add_end (d);
+    }
+}
 
-      if (e->critical)
-        {
-          err = _ksba_ber_write_tl (w, TYPE_BOOLEAN, CLASS_UNIVERSAL, 0, 1);
-          if (!err)
-            err = ksba_writer_write (w, "\xff", 1);
-          if(err)
-            goto leave;
-        }
 
-      err = _ksba_ber_write_tl (w, TYPE_OCTET_STRING, CLASS_UNIVERSAL,
-                                0, e->derlen);
-      if (!err)
-        err = ksba_writer_write (w, e->der, e->derlen);
-      if(err)
-        goto leave;
+/* Build the Validity of a certificate from the stored times into the
+   buffer TEMPL and return its length.  */
+static size_t
+build_validity (ksba_certreq_t cr, unsigned char *templ)
+{
+  unsigned char *tp;
 
-      p = ksba_writer_snatch_mem (w, &n);
-      if (!p)
-        {
-          err = gpg_error (GPG_ERR_ENOMEM);
-          goto leave;
-        }
-      err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                                1, n);
-      if (!err)
-        err = ksba_writer_write (writer, p, n);
-      xfree (p); p = NULL;
-      if (err)
-        goto leave;
-    }
+  tp = templ;
+  *tp++ = 0x30;
+  *tp++ = 0x22;
 
-  /* Embed all the sequences into another sequence */
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
+  *tp++ = TYPE_GENERALIZED_TIME;
+  *tp++ = 15;
+  if (cr->x509.not_before[0])
     {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
+      if (_ksba_cmp_time (cr->x509.not_before, "20500101T000000") >= 0)
+        {
+          memcpy (tp, cr->x509.not_before, 8);
+          tp += 8;
+          memcpy (tp, cr->x509.not_before+9, 6);
+          tp += 6;
+        }
+      else
+        {
+          tp[-2] = TYPE_UTC_TIME;
+          tp[-1] = 13;
+          memcpy (tp, cr->x509.not_before+2, 6);
+          tp += 6;
+          memcpy (tp, cr->x509.not_before+9, 6);
+          tp += 6;
+        }
     }
-  err = ksba_writer_set_mem (writer, valuelen+10);
-  if (err)
-    goto leave;
-  err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, valuelen);
-  if (!err)
-    err = ksba_writer_write (writer, value, valuelen);
-  if (err)
-    goto leave;
-
-  xfree (value);
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
+  else
     {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
+      tp[-2] = TYPE_UTC_TIME;
+      tp[-1] = 13;
+      memcpy (tp, "110101000000", 12);
+      tp += 12;
     }
+  *tp++ = 'Z';
 
-  if (!certmode)
+  *tp++ = TYPE_GENERALIZED_TIME;
+  *tp++ = 15;
+  if (cr->x509.not_after[0])
     {
-      /* Now create the extension request sequence content */
-      err = ksba_writer_set_mem (writer, valuelen+100);
-      if (err)
-        goto leave;
-      err = ksba_oid_from_str (oidstr_extensionReq, &p, &n);
-      if(err)
-        goto leave;
-      err = _ksba_ber_write_tl (writer, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, n);
-      if (!err)
-        err = ksba_writer_write (writer, p, n);
-      xfree (p); p = NULL;
-      if (err)
-        return err;
-      err = _ksba_ber_write_tl (writer, TYPE_SET, CLASS_UNIVERSAL, 1, valuelen);
-      if (!err)
-        err = ksba_writer_write (writer, value, valuelen);
-
-      /* Put this all into a SEQUENCE */
-      xfree (value);
-      value = ksba_writer_snatch_mem (writer, &valuelen);
-      if (!value)
+      if (_ksba_cmp_time (cr->x509.not_after, "20500101T000000") >= 0)
         {
-          err = gpg_error (GPG_ERR_ENOMEM);
-          goto leave;
+          memcpy (tp, cr->x509.not_after, 8);
+          tp += 8;
+          memcpy (tp, cr->x509.not_after+9, 6);
+          tp += 6;
         }
-      err = ksba_writer_set_mem (writer, valuelen+10);
-      if (err)
-        goto leave;
-      err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                                1, valuelen);
-      if (!err)
-        err = ksba_writer_write (writer, value, valuelen);
-      if (err)
-        goto leave;
-
-      xfree (value);
-      value = ksba_writer_snatch_mem (writer, &valuelen);
-      if (!value)
+      else
         {
-          err = gpg_error (GPG_ERR_ENOMEM);
-          goto leave;
+          tp[-2] = TYPE_UTC_TIME;
+          tp[-1] = 13;
+          memcpy (tp, cr->x509.not_after+2, 6);
+          tp += 6;
+          memcpy (tp, cr->x509.not_after+9, 6);
+          tp += 6;
         }
     }
+  else
+    {
+      memcpy (tp,"20630405170000", 14);
+      tp += 14;
+    }
+  *tp++ = 'Z';
+  assert (tp - templ <= 36);
+  templ[1] = tp - templ - 2;  /* Fixup the sequence length.  */
 
-  *r_der = value;
-  *r_derlen = valuelen;
-  value = NULL;
-
-
- leave:
-  ksba_writer_release (writer);
-  ksba_writer_release (w);
-  xfree (value);
-  return err;
+  return tp - templ;
 }
 
 
-/* Build a value tree from the already stored values. */
+/* Build the cri from the already stored values. */
 static gpg_error_t
 build_cri (ksba_certreq_t cr)
 {
   gpg_error_t err;
-  ksba_writer_t writer;
-  void *value = NULL;
-  size_t valuelen;
+  DerBuilder d;
+  unsigned char templ[36];
   int certmode;
 
   /* If a serial number has been set, we don't create a CSR but a
      proper certificate.  */
   certmode = !!cr->x509.serial.der;
 
-  err = ksba_writer_new (&writer);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (writer, 2048);
-  if (err)
-    goto leave;
+  if (!cr->key.der || !cr->subject.der)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
+  if (certmode && !cr->x509.siginfo.der)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
 
-  if (!cr->key.der)
+  /* Copy generalNames objects to the extension list. */
+  if (cr->subject_alt_names)
     {
-      err = gpg_error (GPG_ERR_MISSING_VALUE);
-      goto leave;
+      err = add_general_names_to_extn (cr, cr->subject_alt_names,
+                                       oidstr_subjectAltName);
+      if (err)
+        return err;
+      while (cr->subject_alt_names)
+        {
+          struct general_names_s *tmp = cr->subject_alt_names->next;
+          xfree (cr->subject_alt_names);
+          cr->subject_alt_names = tmp;
+        }
+      cr->subject_alt_names = NULL;
     }
 
-  /* We write all stuff out to a temporary writer object, then use
-     this object to create the cri and store the cri image */
+  d = _ksba_der_builder_new (0);
+  if (!d)
+    return gpg_error_from_syserror ();
+
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
 
   if (certmode)
     {
       /* Store the version structure; version is 3 (encoded as 2):
          [0] { INTEGER 2 }  */
-      err = ksba_writer_write (writer, "\xa0\x03\x02\x01\x02", 5);
+      _ksba_der_add_der (d, "\xa0\x03\x02\x01\x02", 5);
     }
   else
     {
       /* Store version v1 (which is a 0).  */
-      err = _ksba_ber_write_tl (writer, TYPE_INTEGER, CLASS_UNIVERSAL, 0, 1);
-      if (!err)
-        err = ksba_writer_write (writer, "", 1);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_INTEGER, "", 1);
     }
-  if (err)
-    goto leave;
 
   /* For a certificate we need to store the s/n, the signature
      algorithm identifier, the issuer DN and the validity.  */
   if (certmode)
     {
-      /* Store the serial number. */
-      err = _ksba_ber_write_tl (writer, TYPE_INTEGER, CLASS_UNIVERSAL, 0,
-                                cr->x509.serial.derlen);
-      if (!err)
-        err = ksba_writer_write (writer,
-                                 cr->x509.serial.der, cr->x509.serial.derlen);
-      if (err)
-        goto leave;
-
-      /* Store the signature algorithm identifier.  */
-      if (!cr->x509.siginfo.der)
-        err = gpg_error (GPG_ERR_MISSING_VALUE);
-      else
-        err = ksba_writer_write (writer,
-                                 cr->x509.siginfo.der, cr->x509.siginfo.derlen);
-      if (err)
-        goto leave;
-
-
-      /* Store the issuer DN.  If no issuer DN has been set we use the
-         subject DN.  */
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_INTEGER,
+                         cr->x509.serial.der, cr->x509.serial.derlen);
+      _ksba_der_add_der (d, cr->x509.siginfo.der, cr->x509.siginfo.derlen);
+      /* If no issuer DN has been set we use the subject DN.  */
       if (cr->x509.issuer.der)
-        err = ksba_writer_write (writer,
-                                 cr->x509.issuer.der, cr->x509.issuer.derlen);
-      else if (cr->subject.der)
-        err = ksba_writer_write (writer, cr->subject.der, cr->subject.derlen);
+        _ksba_der_add_der (d, cr->x509.issuer.der, cr->x509.issuer.derlen);
       else
-        err = gpg_error (GPG_ERR_MISSING_VALUE);
-      if (err)
-        goto leave;
-
-      /* Store the Validity.  */
-      {
-        unsigned char templ[36];
-        unsigned char *tp;
-
-        tp = templ;
-        *tp++ = 0x30;
-        *tp++ = 0x22;
-
-        *tp++ = TYPE_GENERALIZED_TIME;
-        *tp++ = 15;
-        if (cr->x509.not_before[0])
-          {
-            if (_ksba_cmp_time (cr->x509.not_before, "20500101T000000") >= 0)
-              {
-                memcpy (tp, cr->x509.not_before, 8);
-                tp += 8;
-                memcpy (tp, cr->x509.not_before+9, 6);
-                tp += 6;
-              }
-            else
-              {
-                tp[-2] = TYPE_UTC_TIME;
-                tp[-1] = 13;
-                memcpy (tp, cr->x509.not_before+2, 6);
-                tp += 6;
-                memcpy (tp, cr->x509.not_before+9, 6);
-                tp += 6;
-              }
-          }
-        else
-          {
-            tp[-2] = TYPE_UTC_TIME;
-            tp[-1] = 13;
-            memcpy (tp, "110101000000", 12);
-            tp += 12;
-          }
-        *tp++ = 'Z';
-
-        *tp++ = TYPE_GENERALIZED_TIME;
-        *tp++ = 15;
-        if (cr->x509.not_after[0])
-          {
-            if (_ksba_cmp_time (cr->x509.not_after, "20500101T000000") >= 0)
-              {
-                memcpy (tp, cr->x509.not_after, 8);
-                tp += 8;
-                memcpy (tp, cr->x509.not_after+9, 6);
-                tp += 6;
-              }
-            else
-              {
-                tp[-2] = TYPE_UTC_TIME;
-                tp[-1] = 13;
-                memcpy (tp, cr->x509.not_after+2, 6);
-                tp += 6;
-                memcpy (tp, cr->x509.not_after+9, 6);
-                tp += 6;
-              }
-          }
-        else
-          {
-            memcpy (tp,"20630405170000", 14);
-            tp += 14;
-          }
-        *tp++ = 'Z';
-        assert (tp - templ <= 36);
-        templ[1] = tp - templ - 2;  /* Fixup the sequence length.  */
-
-        err = ksba_writer_write (writer, templ, tp - templ);
-        if (err)
-          goto leave;
-      }
-    }
-
-  /* store the subject */
-  if (!cr->subject.der)
-    {
-      err = gpg_error (GPG_ERR_MISSING_VALUE);
-      goto leave;
-    }
-  err = ksba_writer_write (writer, cr->subject.der, cr->subject.derlen);
-  if (err)
-    goto leave;
-
-  /* store the public key info */
-  err = ksba_writer_write (writer, cr->key.der, cr->key.derlen);
-  if (err)
-    goto leave;
-
-  /* Copy generalNames objects to the extension list. */
-  if (cr->subject_alt_names)
-    {
-      err = add_general_names_to_extn (cr, cr->subject_alt_names,
-                                       oidstr_subjectAltName);
-      if (err)
-        goto leave;
-      while (cr->subject_alt_names)
-        {
-          struct general_names_s *tmp = cr->subject_alt_names->next;
-          xfree (cr->subject_alt_names);
-          cr->subject_alt_names = tmp;
-        }
-      cr->subject_alt_names = NULL;
+        _ksba_der_add_der (d, cr->subject.der, cr->subject.derlen);
+      _ksba_der_add_der (d, templ, build_validity (cr, templ));
     }
 
+  /* Store the subject and the public key info.  */
+  _ksba_der_add_der (d, cr->subject.der, cr->subject.derlen);
+  _ksba_der_add_der (d, cr->key.der, cr->key.derlen);
 
-  /* Write the extensions.  Note that the implicit SET OF is REQUIRED */
-  xfree (value); value = NULL;
-  valuelen = 0;
+  /* Store the extensions.  Without extensions we write an empty
+     sequence.  */
+  _ksba_der_add_tag (d, CLASS_CONTEXT, certmode? 3:0);
   if (cr->extn_list)
-    {
-      err = build_extensions (cr, certmode, &value, &valuelen);
-      if (err)
-        goto leave;
-      err = _ksba_ber_write_tl (writer, certmode? 3:0,
-                                CLASS_CONTEXT, 1, valuelen);
-      if (!err)
-        err = ksba_writer_write (writer, value, valuelen);
-      if (err)
-        goto leave;
-    }
+    add_extensions (d, cr, certmode);
   else
-    { /* We can't write an object of length zero using our ber_write
-         function.  So we must open encode it. */
-      err = ksba_writer_write (writer,
-                               certmode? "\xa3\x02\x30":"\xa0\x02\x30", 4);
-      if (err)
-        goto leave;
-    }
-
-
-  /* pack it into the sequence */
-  xfree (value);
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
     {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+      _ksba_der_add_end (d);
     }
-  /* reinitialize the buffer to create the outer sequence */
-  err = ksba_writer_set_mem (writer, valuelen+10);
-  if (err)
-    goto leave;
-  /* write outer sequence */
-  err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, valuelen);
-  if (!err)
-    err = ksba_writer_write (writer, value, valuelen);
-  if (err)
-    goto leave;
+  _ksba_der_add_end (d);
 
-  /* and store the final result */
-  cr->cri.der = ksba_writer_snatch_mem (writer, &cr->cri.derlen);
-  if (!cr->cri.der)
-    err = gpg_error (GPG_ERR_ENOMEM);
+  _ksba_der_add_end (d);
 
- leave:
-  ksba_writer_release (writer);
-  xfree (value);
+  err = _ksba_der_builder_get (d, &cr->cri.der, &cr->cri.derlen);
+  _ksba_der_builder_release (d);
   return err;
 }
 
@@ -905,6 +727,7 @@ hash_cri (ksba_certreq_t cr)
   if (!cr->cri.der)
     return gpg_error (GPG_ERR_INV_STATE);
   cr->hash_fnc (cr->hash_fnc_arg, cr->cri.der, cr->cri.derlen);
+  ksba_hasher_flush (cr->hasher);
   return 0;
 }
 
@@ -915,81 +738,43 @@ static gpg_error_t
 sign_and_write (ksba_certreq_t cr)
 {
   gpg_error_t err;
-  ksba_writer_t writer;
-  void *value = NULL;
-  size_t valuelen;
+  DerBuilder d;
+  unsigned char hdr[6];
 
-  err = ksba_writer_new (&writer);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (writer, 2048);
-  if (err)
-    goto leave;
+  if (!cr->cri.der || !cr->sig_val.algo)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
+  if (!cr->writer)
+    return gpg_error (GPG_ERR_MISSING_ACTION);
 
-  /* store the cri */
-  if (!cr->cri.der)
-    {
-      err = gpg_error (GPG_ERR_MISSING_VALUE);
-      goto leave;
-    }
-  err = ksba_writer_write (writer, cr->cri.der, cr->cri.derlen);
-  if (err)
-    goto leave;
+  d = _ksba_der_builder_new (0);
+  if (!d)
+    return gpg_error_from_syserror ();
 
-  /* store the signatureAlgorithm */
-  if (!cr->sig_val.algo)
-    return gpg_error (GPG_ERR_MISSING_VALUE);
-  err = _ksba_der_write_algorithm_identifier (writer,
-                                              cr->sig_val.algo, NULL, 0);
-  if (err)
-    goto leave;
-
-  /* write the signature */
-  err = _ksba_ber_write_tl (writer, TYPE_BIT_STRING, CLASS_UNIVERSAL, 0,
-                            1 + cr->sig_val.valuelen);
-  if (!err)
-    err = ksba_writer_write (writer, "", 1);
-  if (!err)
-    err = ksba_writer_write (writer, cr->sig_val.value, cr->sig_val.valuelen);
-  if (err)
-    goto leave;
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+  _ksba_der_add_der (d, cr->cri.der, cr->cri.derlen);
 
-  /* pack it into the outer sequence */
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
-    {
-      err = gpg_error (GPG_ERR_ENOMEM);
-      goto leave;
-    }
-  err = ksba_writer_set_mem (writer, valuelen+10);
-  if (err)
-    goto leave;
-  /* write outer sequence */
-  err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, valuelen);
-  if (!err)
-    err = ksba_writer_write (writer, value, valuelen);
-  if (err)
-    goto leave;
-
-  /* and finally write the result */
-  xfree (value);
-  value = ksba_writer_snatch_mem (writer, &valuelen);
-  if (!value)
-    err = gpg_error (GPG_ERR_ENOMEM);
-  else if (!cr->writer)
-    err = gpg_error (GPG_ERR_MISSING_ACTION);
-  else
-    err = ksba_writer_write (cr->writer, value, valuelen);
+  /* The signatureAlgorithm.  */
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+  _ksba_der_add_oid (d, cr->sig_val.algo);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_NULL, NULL, 0);
+  _ksba_der_add_end (d);
 
- leave:
-  ksba_writer_release (writer);
-  xfree (value);
+  /* The signature as a BIT STRING with no unused bits.  */
+  _ksba_der_add_der (d, hdr,
+                     _ksba_der_put_tl (hdr, TYPE_BIT_STRING, CLASS_UNIVERSAL,
+                                       0, 1 + cr->sig_val.valuelen) - hdr);
+  _ksba_der_add_der (d, "", 1);
+  _ksba_der_add_der (d, cr->sig_val.value, cr->sig_val.valuelen);
+
+  _ksba_der_add_end (d);
+
+  err = _ksba_der_builder_write (d, cr->writer);
+  _ksba_der_builder_release (d);
   return err;
 }
 
 
-
+
 /* The main function to build a certificate request.  It used used in
    a loop so allow for interaction between the function and the caller */
 gpg_error_t
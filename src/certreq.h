@@ -69,6 +69,7 @@ struct ksba_certreq_s
 
   void (*hash_fnc)(void *, const void *, size_t);
   void *hash_fnc_arg;
+  ksba_hasher_t hasher;  /* Set by ksba_certreq_set_hasher or NULL.  */
 
   int any_build_done;
 
@@ -49,18 +49,12 @@
 #include "ber-decoder.h"
 #include "ber-help.h"
 #include "keyinfo.h"
+#include "reader.h"
 
 static int
 read_byte (ksba_reader_t reader)
 {
-  unsigned char buf;
-  size_t nread;
-  int rc;
-
-  do
-    rc = ksba_reader_read (reader, &buf, 1, &nread);
-  while (!rc && !nread);
-  return rc? -1: buf;
+  return _ksba_reader_getc (reader);
 }
 
 /* read COUNT bytes into buffer.  Return 0 on success */
@@ -79,6 +73,39 @@ read_buffer (ksba_reader_t reader, char *buffer, size_t count)
   return 0;
 }
 
+/* Check the outer structure of a certificate with the value DER of
+   length DERLEN as stored in lazy mode: It must consist of exactly
+   the two sequences and the bit string of a certificate.  The inner
+   parts are checked when the certificate is parsed.  */
+static gpg_error_t
+check_cert_image (const unsigned char *der, size_t derlen)
+{
+  static const int tags[3] = { TYPE_SEQUENCE, TYPE_SEQUENCE,
+                               TYPE_BIT_STRING };
+  gpg_error_t err;
+  struct tag_info ti;
+  int i;
+
+  for (i=0; i < 3; i++)
+    {
+      err = _ksba_ber_parse_tl (&der, &derlen, &ti);
+      if (err)
+        return err;
+      if (!(ti.class == CLASS_UNIVERSAL && ti.tag == tags[i]
+            && ti.is_constructed == (tags[i] == TYPE_SEQUENCE)))
+        return gpg_error (GPG_ERR_INV_CERT_OBJ);
+      if (ti.ndef)
+        return gpg_error (GPG_ERR_NOT_DER_ENCODED);
+      if (ti.length > derlen)
+        return gpg_error (GPG_ERR_BAD_BER);
+      der += ti.length;
+      derlen -= ti.length;
+    }
+  if (derlen)
+    return gpg_error (GPG_ERR_BAD_BER);
+  return 0;
+}
+
 /* Create a new decoder and run it for the given element */
 static gpg_error_t
 create_and_run_decoder (ksba_reader_t reader, const char *elem_name,
@@ -90,7 +117,7 @@ create_and_run_decoder (ksba_reader_t reader, const char *elem_name,
   ksba_asn_tree_t cms_tree;
   BerDecoder decoder;
 
-  err = ksba_asn_create_tree ("cms", &cms_tree);
+  err = _ksba_asn_get_shared_tree ("cms", &cms_tree);
   if (err)
     return err;
 
@@ -665,6 +692,42 @@ _ksba_cms_parse_signed_data_part_2 (ksba_cms_t cms)
                 && ti.is_constructed))
             break; /* not a sequence, so we are ready with the set */
 
+          if (cms->lazy_certs && !ti.ndef)
+            {
+              /* Only store the encoding; ksba_cms_get_cert parses it
+                 when it is requested.  */
+              if (!ti.length || ti.length > (size_t)(-1) - ti.nhdr)
+                return gpg_error (GPG_ERR_BAD_BER);
+              cl = xtrycalloc (1, sizeof *cl);
+              if (!cl)
+                return gpg_error (GPG_ERR_ENOMEM);
+              cl->imagelen = ti.nhdr + ti.length;
+              cl->image = xtrymalloc (cl->imagelen);
+              if (!cl->image)
+                {
+                  xfree (cl);
+                  return gpg_error (GPG_ERR_ENOMEM);
+                }
+              memcpy (cl->image, ti.buf, ti.nhdr);
+              if (read_buffer (cms->reader, (char*)cl->image + ti.nhdr,
+                               ti.length))
+                {
+                  xfree (cl->image);
+                  xfree (cl);
+                  return gpg_error (GPG_ERR_BAD_BER);
+                }
+              err = check_cert_image (cl->image + ti.nhdr, ti.length);
+              if (err)
+                {
+                  xfree (cl->image);
+                  xfree (cl);
+                  return err;
+                }
+              cl->next = cms->cert_list;
+              cms->cert_list = cl;
+              continue;
+            }
+
           /* We must unread so that the standard parser sees the sequence */
           err = ksba_reader_unread (cms->reader, ti.buf, ti.nhdr);
           if (err)
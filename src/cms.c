@@ -41,9 +41,12 @@
 #include "convert.h"
 #include "keyinfo.h"
 #include "der-encoder.h"
+#include "der-builder.h"
 #include "ber-help.h"
+#include "hasher.h"
+#include "reader.h"
 #include "sexp-parse.h"
-#include "cert.h" /* need to access cert->root and cert->image */
+#include "cert.h" /* need to access cert->vtree and cert->image */
 
 static gpg_error_t ct_parse_data (ksba_cms_t cms);
 static gpg_error_t ct_parse_signed_data (ksba_cms_t cms);
@@ -87,29 +90,62 @@ static const char oid_signingTime[9] = "\x2A\x86\x48\x86\xF7\x0D\x01\x09\x05";
 
 static const char oidstr_smimeCapabilities[] = "1.2.840.113549.1.9.15";
 
+/* The default, minimum and maximum size of the chunks used to copy
+   and to write the content data.  */
+#define DEFAULT_CHUNK_SIZE 4096
+#define MIN_CHUNK_SIZE 512
+#define MAX_CHUNK_SIZE (16*1024*1024)
+
 
+/* Return the buffer used to copy and to write the data of CMS.  The
+   buffer has a size of CMS->CHUNK_SIZE and is allocated on first use.
+   Returns NULL with ERRNO set on error.  */
+static unsigned char *
+get_chunk_buffer (ksba_cms_t cms)
+{
+  if (!cms->chunk_buf)
+    cms->chunk_buf = xtrymalloc (cms->chunk_size);
+  return cms->chunk_buf;
+}
 
-/* Helper for read_and_hash_cont().  */
+
+/* Helper for read_and_hash_cont().  Data available in the window of
+   the reader is hashed and written in place; other data is read in
+   chunks into the chunk buffer.  */
 static gpg_error_t
 read_hash_block (ksba_cms_t cms, unsigned long nleft)
 {
   gpg_error_t err;
-  char buffer[4096];
+  const unsigned char *p;
+  unsigned char *buffer = NULL;
   size_t n, nread;
 
   while (nleft)
     {
-      n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
-      err = ksba_reader_read (cms->reader, buffer, n, &nread);
-      if (err)
-        return err;
-      nleft -= nread;
+      p = _ksba_reader_window (cms->reader, &nread);
+      if (nread)
+        {
+          if (nread > nleft)
+            nread = nleft;
+        }
+      else
+        {
+          if (!buffer && !(buffer = get_chunk_buffer (cms)))
+            return gpg_error_from_syserror ();
+          n = nleft < cms->chunk_size? nleft : cms->chunk_size;
+          err = ksba_reader_read (cms->reader, buffer, n, &nread);
+          if (err)
+            return err;
+          p = buffer;
+        }
       if (cms->hash_fnc)
-        cms->hash_fnc (cms->hash_fnc_arg, buffer, nread);
-      if (cms->writer)
-        err = ksba_writer_write (cms->writer, buffer, nread);
+        cms->hash_fnc (cms->hash_fnc_arg, p, nread);
+      err = cms->writer? ksba_writer_write (cms->writer, p, nread) : 0;
+      if (p != buffer)
+        _ksba_reader_skip (cms->reader, nread);
       if (err)
         return err;
+      nleft -= nread;
     }
   return 0;
 }
@@ -237,9 +273,13 @@ read_encrypted_cont (ksba_cms_t cms)
 {
   gpg_error_t err = 0;
   unsigned long nleft;
-  char buffer[4096];
+  unsigned char *buffer;
   size_t n, nread;
 
+  buffer = get_chunk_buffer (cms);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+
   if (cms->inner_cont_ndef)
     {
       struct tag_info ti;
@@ -258,7 +298,7 @@ read_encrypted_cont (ksba_cms_t cms)
               nleft = ti.length;
               while (nleft)
                 {
-                  n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
+                  n = nleft < cms->chunk_size? nleft : cms->chunk_size;
                   err = ksba_reader_read (cms->reader, buffer, n, &nread);
                   if (err)
                     return err;
@@ -283,7 +323,7 @@ read_encrypted_cont (ksba_cms_t cms)
                       nleft = ti.length;
                       while (nleft)
                         {
-                          n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
+                          n = nleft < cms->chunk_size? nleft : cms->chunk_size;
                           err = ksba_reader_read (cms->reader, buffer, n, &nread);
                           if (err)
                             return err;
@@ -313,7 +353,7 @@ read_encrypted_cont (ksba_cms_t cms)
       nleft = cms->inner_cont_len;
       while (nleft)
         {
-          n = nleft < sizeof (buffer)? nleft : sizeof (buffer);
+          n = nleft < cms->chunk_size? nleft : cms->chunk_size;
           err = ksba_reader_read (cms->reader, buffer, n, &nread);
           if (err)
             return err;
@@ -332,9 +372,13 @@ static gpg_error_t
 write_encrypted_cont (ksba_cms_t cms)
 {
   gpg_error_t err = 0;
-  char buffer[4096];
+  unsigned char *buffer;
   size_t nread;
 
+  buffer = get_chunk_buffer (cms);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+
   /* we do it the simple way: the parts are made up from the chunks we
      got from the read function.
 
@@ -342,7 +386,7 @@ write_encrypted_cont (ksba_cms_t cms)
      header if everything fits into our local buffer.  Actually pretty
      simple to do, but I am too lazy right now. */
   while (!(err = ksba_reader_read (cms->reader, buffer,
-                                   sizeof buffer, &nread)) )
+                                   cms->chunk_size, &nread)) )
     {
       err = _ksba_ber_write_tl (cms->writer, TYPE_OCTET_STRING,
                                 CLASS_UNIVERSAL, 0, nread);
@@ -458,6 +502,7 @@ ksba_cms_new (ksba_cms_t *r_cms)
   *r_cms = xtrycalloc (1, sizeof **r_cms);
   if (!*r_cms)
     return gpg_error_from_errno (errno);
+  (*r_cms)->chunk_size = DEFAULT_CHUNK_SIZE;
   return 0;
 }
 
@@ -498,6 +543,7 @@ ksba_cms_release (ksba_cms_t cms)
     {
       struct certlist_s *cl = cms->cert_list->next;
       ksba_cert_release (cms->cert_list->cert);
+      xfree (cms->cert_list->image);
       xfree (cms->cert_list->enc_val.algo);
       xfree (cms->cert_list->enc_val.value);
       xfree (cms->cert_list);
@@ -541,6 +587,7 @@ ksba_cms_release (ksba_cms_t cms)
       xfree (cms->capability_list);
       cms->capability_list = tmp;
     }
+  xfree (cms->chunk_buf);
 
   xfree (cms);
 }
@@ -883,6 +930,34 @@ ksba_cms_get_digest_algo (ksba_cms_t cms, int idx)
 }
 
 
+/* Parse the certificate of CL recorded in lazy mode.  The image is
+   handed over to the certificate object.  On error the error code is
+   kept in CL and the entry is skipped from then on.  */
+static void
+parse_lazy_cert (struct certlist_s *cl)
+{
+  gpg_error_t err;
+  ksba_cert_t cert;
+
+  err = ksba_cert_new (&cert);
+  if (err)
+    {
+      cl->parse_err = err;
+      return;
+    }
+  err = _ksba_cert_init_from_mem_take (cert, cl->image, cl->imagelen);
+  if (err)
+    {
+      ksba_cert_release (cert);
+      cl->parse_err = err;
+      xfree (cl->image);
+    }
+  else
+    cl->cert = cert;
+  cl->image = NULL;
+}
+
+
 /**
  * ksba_cms_get_cert:
  * @cms: CMS object
@@ -891,7 +966,8 @@ ksba_cms_get_digest_algo (ksba_cms_t cms, int idx)
  * Get the certificate out of a CMS.  The caller should use this in a
  * loop to get all certificates.  The returned certificate is a
  * shallow copy of the original one; the caller must still use
- * ksba_cert_release() to free it.
+ * ksba_cert_release() to free it.  In lazy mode a certificate which
+ * can't be parsed is skipped and not counted by @idx.
  *
  * Return value: A Certificate object or NULL for end of list or error
  **/
@@ -903,8 +979,15 @@ ksba_cms_get_cert (ksba_cms_t cms, int idx)
   if (!cms || idx < 0)
     return NULL;
 
-  for (cl=cms->cert_list; cl && idx; cl = cl->next, idx--)
-    ;
+  for (cl=cms->cert_list; cl; cl = cl->next)
+    {
+      if (!cl->cert && cl->image)
+        parse_lazy_cert (cl);
+      if (!cl->cert)
+        continue;
+      if (!idx--)
+        break;
+    }
   if (!cl)
     return NULL;
   ksba_cert_ref (cl->cert);
@@ -1243,10 +1326,173 @@ ksba_cms_set_hash_function (ksba_cms_t cms,
     {
       cms->hash_fnc = hash_fnc;
       cms->hash_fnc_arg = hash_fnc_arg;
+      cms->hasher = NULL;
     }
 }
 
 
+/* Use the hash functions of HASHER instead of a single hash function.
+   HASHER is not owned by CMS and must be valid as long as it is
+   used.  Passing NULL removes the hash functions.  */
+gpg_error_t
+ksba_cms_set_hasher (ksba_cms_t cms, ksba_hasher_t hasher)
+{
+  if (!cms)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  cms->hasher = hasher;
+  cms->hash_fnc = hasher? _ksba_hasher_hash_cb : NULL;
+  cms->hash_fnc_arg = hasher;
+  return 0;
+}
+
+
+/* If LAZY is true, the parser stores only the encoding of the
+   certificates of a signed object; they are parsed by
+   ksba_cms_get_cert when requested.  This must be set before the
+   parsing starts.  */
+gpg_error_t
+ksba_cms_set_lazy_certs (ksba_cms_t cms, int lazy)
+{
+  if (!cms)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  cms->lazy_certs = !!lazy;
+  return 0;
+}
+
+
+/* Set the size of the chunks used to copy the content data and to
+   write it as parts of a constructed octet string.  A SIZE of 0
+   selects the default.  */
+gpg_error_t
+ksba_cms_set_chunk_size (ksba_cms_t cms, size_t size)
+{
+  if (!cms)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!size)
+    size = DEFAULT_CHUNK_SIZE;
+  if (size < MIN_CHUNK_SIZE || size > MAX_CHUNK_SIZE)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (cms->chunk_used || cms->data_open)
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  if (size != cms->chunk_size)
+    {
+      xfree (cms->chunk_buf);
+      cms->chunk_buf = NULL;
+      cms->chunk_size = size;
+    }
+  return 0;
+}
+
+
+/* Write LENGTH bytes from BUFFER as one primitive octet string of
+   the content data.  The constructed octet string is started on the
+   first call.  */
+static gpg_error_t
+write_data_chunk (ksba_cms_t cms, const void *buffer, size_t length)
+{
+  gpg_error_t err;
+
+  if (!cms->data_open)
+    {
+      err = _ksba_ber_write_tl (cms->writer, TYPE_OCTET_STRING,
+                                CLASS_UNIVERSAL, 1, 0);
+      if (err)
+        return err;
+      cms->data_open = 1;
+    }
+  err = _ksba_ber_write_tl (cms->writer, TYPE_OCTET_STRING,
+                            CLASS_UNIVERSAL, 0, length);
+  if (!err)
+    err = ksba_writer_write (cms->writer, buffer, length);
+  return err;
+}
+
+
+/* Write the pending data and the end tag of the constructed octet
+   string started by ksba_cms_write_data.  */
+static gpg_error_t
+finish_data (ksba_cms_t cms)
+{
+  gpg_error_t err = 0;
+
+  if (cms->chunk_used)
+    {
+      err = write_data_chunk (cms, cms->chunk_buf, cms->chunk_used);
+      cms->chunk_used = 0;
+    }
+  if (!err && cms->data_open)
+    err = _ksba_ber_write_tl (cms->writer, 0, 0, 0, 0);
+  cms->data_open = 0;
+  return err;
+}
+
+
+/* Pass LENGTH bytes of content data from BUFFER to a signed data
+   object which is being built.  The data is hashed with the hash
+   function set by ksba_cms_set_hash_function and, unless a detached
+   signature is built, written as a constructed octet string made up
+   of chunks of the configured size.  Whole chunks are written
+   directly from BUFFER; only a remainder is copied to the internal
+   buffer.  The function may be called any number of times after
+   ksba_cms_build returned KSBA_SR_BEGIN_DATA, or KSBA_SR_END_DATA for
+   a detached signature; the next call of ksba_cms_build finishes the
+   data.  */
+gpg_error_t
+ksba_cms_write_data (ksba_cms_t cms, const void *buffer, size_t length)
+{
+  gpg_error_t err;
+  const unsigned char *p = buffer;
+  unsigned char *chunk;
+  size_t n;
+
+  if (!cms || (!buffer && length))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (cms->content.handler != ct_build_signed_data)
+    return gpg_error (GPG_ERR_UNSUPPORTED_CMS_OBJ);
+  if (!(cms->stop_reason == KSBA_SR_BEGIN_DATA
+        || (cms->stop_reason == KSBA_SR_END_DATA && cms->detached_data)))
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  if (cms->hash_fnc && length)
+    cms->hash_fnc (cms->hash_fnc_arg, p, length);
+  if (cms->detached_data)
+    return 0;
+
+  while (length)
+    {
+      if (cms->chunk_used || length < cms->chunk_size)
+        {
+          chunk = get_chunk_buffer (cms);
+          if (!chunk)
+            return gpg_error_from_syserror ();
+          n = cms->chunk_size - cms->chunk_used;
+          if (n > length)
+            n = length;
+          memcpy (chunk + cms->chunk_used, p, n);
+          cms->chunk_used += n;
+          if (cms->chunk_used == cms->chunk_size)
+            {
+              cms->chunk_used = 0;
+              err = write_data_chunk (cms, chunk, cms->chunk_size);
+              if (err)
+                return err;
+            }
+        }
+      else
+        {
+          n = cms->chunk_size;
+          err = write_data_chunk (cms, p, n);
+          if (err)
+            return err;
+        }
+      p += n;
+      length -= n;
+    }
+  return 0;
+}
+
+
 /* hash the signed attributes of the given signer */
 gpg_error_t
 ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx)
@@ -1274,10 +1520,291 @@ ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx)
   cms->hash_fnc (cms->hash_fnc_arg, "\x31", 1);
   cms->hash_fnc (cms->hash_fnc_arg,
                  si->image + n->off + 1, n->nhdr + n->len - 1);
+  ksba_hasher_flush (cms->hasher);
+
+  return 0;
+}
+
+
+/* Release a snapshot of the signer infos.  */
+void
+ksba_cms_signers_release (ksba_cms_signers_t signers)
+{
+  int i;
+
+  if (!signers)
+    return;
+  for (i=0; i < signers->count; i++)
+    {
+      struct signer_snapshot_s *ss = signers->signers + i;
 
+      xfree (ss->issuer);
+      xfree (ss->serial);
+      xfree (ss->keyid);
+      xfree (ss->digest_algo);
+      xfree (ss->signed_attrs);
+      xfree (ss->msg_digest);
+      xfree (ss->sig_val);
+    }
+  xfree (signers);
+}
+
+
+/* Copy the values of the signer info SI, which is signer IDX of CMS,
+   to SS.  */
+static gpg_error_t
+take_signer_snapshot (ksba_cms_t cms, int idx, struct signer_info_s *si,
+                      struct signer_snapshot_s *ss)
+{
+  gpg_error_t err;
+  const char *algo;
+  AsnNode n;
+  char numbuf[22];
+  size_t numbuflen;
+
+  /* A signer may also be identified by the subjectKeyIdentifier of
+     its certificate; we store it as a simple S-expression.  */
+  n = _ksba_asn_find_node (si->root, "SignerInfo.sid.subjectKeyIdentifier");
+  if (n && n->off != -1)
+    {
+      sprintf (numbuf, "(%u:", (unsigned int)n->len);
+      numbuflen = strlen (numbuf);
+      ss->keyid = xtrymalloc (numbuflen + n->len + 2);
+      if (!ss->keyid)
+        return gpg_error_from_syserror ();
+      memcpy (ss->keyid, numbuf, numbuflen);
+      memcpy (ss->keyid + numbuflen, si->image + n->off + n->nhdr, n->len);
+      ss->keyid[numbuflen + n->len] = ')';
+      ss->keyid[numbuflen + n->len + 1] = 0;
+    }
+  else
+    {
+      err = ksba_cms_get_issuer_serial (cms, idx, &ss->issuer, &ss->serial);
+      if (err)
+        return err;
+    }
+
+  algo = ksba_cms_get_digest_algo (cms, idx);
+  if (!algo)
+    return gpg_error (GPG_ERR_DIGEST_ALGO);
+  ss->digest_algo = xtrystrdup (algo);
+  if (!ss->digest_algo)
+    return gpg_error_from_syserror ();
+
+  n = _ksba_asn_find_node (si->root, "SignerInfo.signedAttrs");
+  if (n && n->off != -1)
+    {
+      /* As in ksba_cms_hash_signed_attrs we replace the implicit
+         tag [0] by a SET tag.  */
+      ss->signed_attrs_len = n->nhdr + n->len;
+      ss->signed_attrs = xtrymalloc (ss->signed_attrs_len);
+      if (!ss->signed_attrs)
+        return gpg_error_from_syserror ();
+      memcpy (ss->signed_attrs, si->image + n->off, ss->signed_attrs_len);
+      ss->signed_attrs[0] = 0x31;
+    }
+
+  err = ksba_cms_get_message_digest (cms, idx,
+                                     &ss->msg_digest, &ss->msg_digest_len);
+  if (err)
+    return err;
+  err = ksba_cms_get_signing_time (cms, idx, ss->signing_time);
+  if (err)
+    return err;
+
+  ss->sig_val = ksba_cms_get_sig_val (cms, idx);
   return 0;
 }
 
+
+/* Return a snapshot of the signer infos of CMS at R_SIGNERS.  The
+   snapshot is a copy which does not change anymore; it may thus be
+   used by several threads at the same time and even after CMS has
+   been released.  */
+gpg_error_t
+ksba_cms_get_signers (ksba_cms_t cms, ksba_cms_signers_t *r_signers)
+{
+  gpg_error_t err;
+  ksba_cms_signers_t signers;
+  struct signer_info_s *si;
+  int count;
+
+  if (!cms || !r_signers)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_signers = NULL;
+  if (!cms->signer_info)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  for (count=0, si=cms->signer_info; si; si = si->next)
+    count++;
+  signers = xtrycalloc (1, sizeof *signers
+                        + (count - 1) * sizeof *signers->signers);
+  if (!signers)
+    return gpg_error_from_syserror ();
+
+  for (si=cms->signer_info; si; si = si->next)
+    {
+      err = take_signer_snapshot (cms, signers->count, si,
+                                  signers->signers + signers->count);
+      signers->count++;
+      if (err)
+        {
+          ksba_cms_signers_release (signers);
+          return err;
+        }
+    }
+
+  *r_signers = signers;
+  return 0;
+}
+
+
+/* Return the number of signers in SIGNERS.  */
+int
+ksba_cms_signers_count (ksba_cms_signers_t signers)
+{
+  return signers? signers->count : 0;
+}
+
+
+/* Return the signer IDX of SIGNERS or NULL.  */
+static struct signer_snapshot_s *
+get_signer (ksba_cms_signers_t signers, int idx)
+{
+  if (!signers || idx < 0 || idx >= signers->count)
+    return NULL;
+  return signers->signers + idx;
+}
+
+
+/* Return the issuer and the serial number of signer IDX of SIGNERS.
+   The values are valid as long as SIGNERS.  GPG_ERR_NO_DATA is
+   returned if the signer is identified by a subjectKeyIdentifier.  */
+gpg_error_t
+ksba_cms_signers_get_issuer_serial (ksba_cms_signers_t signers, int idx,
+                                    const char **r_issuer,
+                                    ksba_const_sexp_t *r_serial)
+{
+  struct signer_snapshot_s *ss = get_signer (signers, idx);
+
+  if (r_issuer)
+    *r_issuer = NULL;
+  if (r_serial)
+    *r_serial = NULL;
+  if (!ss)
+    return gpg_error (GPG_ERR_INV_INDEX);
+  if (!ss->issuer)
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (r_issuer)
+    *r_issuer = ss->issuer;
+  if (r_serial)
+    *r_serial = ss->serial;
+  return 0;
+}
+
+
+/* Store the subjectKeyIdentifier of signer IDX of SIGNERS as a simple
+   S-expression at R_KEYID.  The value is valid as long as SIGNERS.
+   GPG_ERR_NO_DATA is returned if the signer is identified by issuer
+   and serial number.  */
+gpg_error_t
+ksba_cms_signers_get_subj_key_id (ksba_cms_signers_t signers, int idx,
+                                  ksba_const_sexp_t *r_keyid)
+{
+  struct signer_snapshot_s *ss = get_signer (signers, idx);
+
+  if (!r_keyid)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_keyid = NULL;
+  if (!ss)
+    return gpg_error (GPG_ERR_INV_INDEX);
+  if (!ss->keyid)
+    return gpg_error (GPG_ERR_NO_DATA);
+  *r_keyid = ss->keyid;
+  return 0;
+}
+
+
+/* Return the OID of the digest algorithm of signer IDX of SIGNERS or
+   NULL for an invalid IDX.  */
+const char *
+ksba_cms_signers_get_digest_algo (ksba_cms_signers_t signers, int idx)
+{
+  struct signer_snapshot_s *ss = get_signer (signers, idx);
+
+  return ss? ss->digest_algo : NULL;
+}
+
+
+/* Return the DER encoded signed attributes of signer IDX of SIGNERS
+   at R_DER and R_DERLEN.  The SET tag is already in place so that the
+   data can directly be hashed.  GPG_ERR_NO_DATA is returned if the
+   signer has no signed attributes.  */
+gpg_error_t
+ksba_cms_signers_get_signed_attrs (ksba_cms_signers_t signers, int idx,
+                                   const unsigned char **r_der,
+                                   size_t *r_derlen)
+{
+  struct signer_snapshot_s *ss = get_signer (signers, idx);
+
+  if (!r_der || !r_derlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!ss)
+    return gpg_error (GPG_ERR_INV_INDEX);
+  if (!ss->signed_attrs)
+    return gpg_error (GPG_ERR_NO_DATA);
+  *r_der = ss->signed_attrs;
+  *r_derlen = ss->signed_attrs_len;
+  return 0;
+}
+
+
+/* Return the messageDigest attribute of signer IDX of SIGNERS.
+   GPG_ERR_NO_DATA is returned if there is no such attribute.  */
+gpg_error_t
+ksba_cms_signers_get_message_digest (ksba_cms_signers_t signers, int idx,
+                                     const unsigned char **r_digest,
+                                     size_t *r_digestlen)
+{
+  struct signer_snapshot_s *ss = get_signer (signers, idx);
+
+  if (!r_digest || !r_digestlen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!ss)
+    return gpg_error (GPG_ERR_INV_INDEX);
+  if (!ss->msg_digest)
+    return gpg_error (GPG_ERR_NO_DATA);
+  *r_digest = (const unsigned char *)ss->msg_digest;
+  *r_digestlen = ss->msg_digest_len;
+  return 0;
+}
+
+
+/* Store the signing time of signer IDX of SIGNERS at R_SIGTIME.  It is
+   set to an empty string if there is no signing time.  */
+gpg_error_t
+ksba_cms_signers_get_signing_time (ksba_cms_signers_t signers, int idx,
+                                   ksba_isotime_t r_sigtime)
+{
+  struct signer_snapshot_s *ss = get_signer (signers, idx);
+
+  if (!ss)
+    return gpg_error (GPG_ERR_INV_INDEX);
+  _ksba_copy_time (r_sigtime, ss->signing_time);
+  return 0;
+}
+
+
+/* Return the signature value of signer IDX of SIGNERS in the same
+   format as ksba_cms_get_sig_val or NULL.  */
+ksba_const_sexp_t
+ksba_cms_signers_get_sig_val (ksba_cms_signers_t signers, int idx)
+{
+  struct signer_snapshot_s *ss = get_signer (signers, idx);
+
+  return ss? ss->sig_val : NULL;
+}
+
 
 /*
   Code to create CMS structures
@@ -1942,7 +2469,10 @@ ct_parse_signed_data (ksba_cms_t cms)
   else if (state == sGOT_HASH)
     err = _ksba_cms_parse_signed_data_part_2 (cms);
   else if (state == sIN_DATA)
-    err = read_and_hash_cont (cms);
+    {
+      err = read_and_hash_cont (cms);
+      ksba_hasher_flush (cms->hasher);
+    }
   else
     err = gpg_error (GPG_ERR_INV_STATE);
 
@@ -2122,20 +2652,13 @@ build_signed_data_header (ksba_cms_t cms)
 
   /* SET OF DigestAlgorithmIdentifier */
   {
-    unsigned char *value;
-    size_t valuelen;
-    ksba_writer_t tmpwrt;
+    DerBuilder d;
 
-    err = ksba_writer_new (&tmpwrt);
-    if (err)
-      return err;
-    err = ksba_writer_set_mem (tmpwrt, 512);
-    if (err)
-      {
-        ksba_writer_release (tmpwrt);
-        return err;
-      }
+    d = _ksba_der_builder_new (0);
+    if (!d)
+      return gpg_error_from_syserror ();
 
+    _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SET);
     for (i=0; (s = ksba_cms_get_digest_algo_list (cms, i)); i++)
       {
         int j;
@@ -2149,27 +2672,16 @@ build_signed_data_header (ksba_cms_t cms)
           }
         if (j == i)
           {
-            err = _ksba_der_write_algorithm_identifier (tmpwrt, s, NULL, 0);
-            if (err)
-              {
-                ksba_writer_release (tmpwrt);
-                return err;
-              }
+            _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+            _ksba_der_add_oid (d, s);
+            _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_NULL, NULL, 0);
+            _ksba_der_add_end (d);
           }
       }
+    _ksba_der_add_end (d);
 
-    value = ksba_writer_snatch_mem (tmpwrt, &valuelen);
-    ksba_writer_release (tmpwrt);
-    if (!value)
-      {
-        err = gpg_error (GPG_ERR_ENOMEM);
-        return err;
-      }
-    err = _ksba_ber_write_tl (cms->writer, TYPE_SET, CLASS_UNIVERSAL,
-                              1, valuelen);
-    if (!err)
-      err = ksba_writer_write (cms->writer, value, valuelen);
-    xfree (value);
+    err = _ksba_der_builder_write (d, cms->writer);
+    _ksba_der_builder_release (d);
     if (err)
       return err;
   }
@@ -2203,6 +2715,12 @@ build_signed_data_header (ksba_cms_t cms)
   return err;
 }
 
+/* The paths to the issuer and serial in a certificate.  */
+static struct asn_path_s path_cert_serial
+  = ASN_PATH ("Certificate.tbsCertificate.serialNumber");
+static struct asn_path_s path_cert_issuer
+  = ASN_PATH ("Certificate.tbsCertificate.issuer");
+
 /* Set the issuer/serial from the cert to the node.
    mode 0: sid
    mode 1: rid
@@ -2211,28 +2729,27 @@ static gpg_error_t
 set_issuer_serial (AsnNode info, ksba_cert_t cert, int mode)
 {
   gpg_error_t err;
-  AsnNode dst, src;
+  AsnNode dst;
+  AsnValue src;
 
   if (!info || !cert)
     return gpg_error (GPG_ERR_INV_VALUE);
 
-  src = _ksba_asn_find_node (cert->root,
-                             "Certificate.tbsCertificate.serialNumber");
+  src = _ksba_asn_find_path (cert->vtree, &path_cert_serial);
   dst = _ksba_asn_find_node (info,
                              mode?
                              "rid.issuerAndSerialNumber.serialNumber":
                              "sid.issuerAndSerialNumber.serialNumber");
-  err = _ksba_der_copy_tree (dst, src, cert->image);
+  err = _ksba_der_copy_value_tree (dst, cert->vtree, src, cert->image);
   if (err)
     return err;
 
-  src = _ksba_asn_find_node (cert->root,
-                             "Certificate.tbsCertificate.issuer");
+  src = _ksba_asn_find_path (cert->vtree, &path_cert_issuer);
   dst = _ksba_asn_find_node (info,
                              mode?
                              "rid.issuerAndSerialNumber.issuer":
                              "sid.issuerAndSerialNumber.issuer");
-  err = _ksba_der_copy_tree (dst, src, cert->image);
+  err = _ksba_der_copy_value_tree (dst, cert->vtree, src, cert->image);
   if (err)
     return err;
 
@@ -2249,17 +2766,11 @@ store_smime_capability_sequence (AsnNode node,
   struct oidparmlist_s *cap, *cap2;
   unsigned char *value;
   size_t valuelen;
-  ksba_writer_t tmpwrt;
+  DerBuilder d;
 
-  err = ksba_writer_new (&tmpwrt);
-  if (err)
-    return err;
-  err = ksba_writer_set_mem (tmpwrt, 512);
-  if (err)
-    {
-      ksba_writer_release (tmpwrt);
-      return err;
-    }
+  d = _ksba_der_builder_new (0);
+  if (!d)
+    return gpg_error_from_syserror ();
 
   for (cap=capabilities; cap; cap = cap->next)
     {
@@ -2278,24 +2789,20 @@ store_smime_capability_sequence (AsnNode node,
              of the algorithm identifier where ist is allowed and in
              some profiles (e.g. tmttv2) even explicitly suggested to
              use NULL.  */
-          err = _ksba_der_write_algorithm_identifier
-                 (tmpwrt, cap->oid,
-                  cap->parmlen?cap->parm:(const void*)"", cap->parmlen);
-          if (err)
-            {
-              ksba_writer_release (tmpwrt);
-              return err;
-            }
+          _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+          _ksba_der_add_oid (d, cap->oid);
+          if (cap->parmlen)
+            _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING,
+                               cap->parm, cap->parmlen);
+          _ksba_der_add_end (d);
         }
     }
 
-  value = ksba_writer_snatch_mem (tmpwrt, &valuelen);
-  if (!value)
-    err = gpg_error (GPG_ERR_ENOMEM);
+  err = _ksba_der_builder_get (d, &value, &valuelen);
+  _ksba_der_builder_release (d);
   if (!err)
     err = _ksba_der_store_sequence (node, value, valuelen);
   xfree (value);
-  ksba_writer_release (tmpwrt);
   return err;
 }
 
@@ -2393,7 +2900,7 @@ build_signed_data_attributes (ksba_cms_t cms)
 
   /* Now we have to prepare the signer info.  For now we will just build the
      signedAttributes, so that the user can do the signature calculation */
-  err = ksba_asn_create_tree ("cms", &cms_tree);
+  err = _ksba_asn_get_shared_tree ("cms", &cms_tree);
   if (err)
     return err;
 
@@ -2440,8 +2947,8 @@ build_signed_data_attributes (ksba_cms_t cms)
 	}
 
       /* Include the pretty important message digest. */
-      attr = _ksba_asn_expand_tree (cms_tree->parse_tree,
-                                    "CryptographicMessageSyntax.Attribute");
+      attr = _ksba_asn_expand_module (cms_tree,
+                                      "CryptographicMessageSyntax.Attribute");
       if (!attr)
         {
 	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
@@ -2474,8 +2981,8 @@ build_signed_data_attributes (ksba_cms_t cms)
       attridx++;
 
       /* Include the content-type attribute. */
-      attr = _ksba_asn_expand_tree (cms_tree->parse_tree,
-                                    "CryptographicMessageSyntax.Attribute");
+      attr = _ksba_asn_expand_module (cms_tree,
+                                      "CryptographicMessageSyntax.Attribute");
       if (!attr)
         {
 	  err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
@@ -2511,7 +3018,7 @@ build_signed_data_attributes (ksba_cms_t cms)
       /* Include the signing time */
       if (certlist->signing_time)
         {
-          attr = _ksba_asn_expand_tree (cms_tree->parse_tree,
+          attr = _ksba_asn_expand_module (cms_tree,
                                      "CryptographicMessageSyntax.Attribute");
           if (!attr)
             {
@@ -2550,8 +3057,8 @@ build_signed_data_attributes (ksba_cms_t cms)
       /* Include the S/MIME capabilities with the first signer. */
       if (cms->capability_list && !signer)
         {
-          attr = _ksba_asn_expand_tree (cms_tree->parse_tree,
-                                    "CryptographicMessageSyntax.Attribute");
+          attr = _ksba_asn_expand_module (cms_tree,
+                                     "CryptographicMessageSyntax.Attribute");
           if (!attr)
             {
 	      err = gpg_error (GPG_ERR_ELEMENT_NOT_FOUND);
@@ -2592,8 +3099,8 @@ build_signed_data_attributes (ksba_cms_t cms)
 
       /* Now copy them to an SignerInfo tree.  This tree is not
          complete but suitable for ksba_cms_hash_signed_attributes() */
-      root = _ksba_asn_expand_tree (cms_tree->parse_tree,
-                                    "CryptographicMessageSyntax.SignerInfo");
+      root = _ksba_asn_expand_module (cms_tree,
+                                      "CryptographicMessageSyntax.SignerInfo");
       n = _ksba_asn_find_node (root, "SignerInfo.signedAttrs");
       if (!n || !n->down)
         {
@@ -2671,11 +3178,11 @@ build_signed_data_rest (ksba_cms_t cms)
   struct oidlist_s *digestlist;
   struct signer_info_s *si;
   struct sig_val_s *sv;
-  ksba_writer_t tmpwrt = NULL;
+  DerBuilder d = NULL;
   AsnNode root = NULL;
 
   /* Now we can really write the signer info */
-  err = ksba_asn_create_tree ("cms", &cms_tree);
+  err = _ksba_asn_get_shared_tree ("cms", &cms_tree);
   if (err)
     return err;
 
@@ -2686,13 +3193,15 @@ build_signed_data_rest (ksba_cms_t cms)
       return err;
     }
 
-  /* To construct the set we use a temporary writer object. */
-  err = ksba_writer_new (&tmpwrt);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (tmpwrt, 2048);
-  if (err)
-    goto leave;
+  /* The set is constructed from the encoded signer infos and written
+     in one go.  */
+  d = _ksba_der_builder_new (0);
+  if (!d)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SET);
 
   digestlist = cms->digest_algos;
   si = cms->signer_info;
@@ -2720,8 +3229,8 @@ build_signed_data_rest (ksba_cms_t cms)
 	  goto leave;
 	}
 
-      root = _ksba_asn_expand_tree (cms_tree->parse_tree,
-                                    "CryptographicMessageSyntax.SignerInfo");
+      root = _ksba_asn_expand_module (cms_tree,
+                                      "CryptographicMessageSyntax.SignerInfo");
 
       /* We store a version of 1 because we use the issuerAndSerialNumber */
       n = _ksba_asn_find_node (root, "SignerInfo.version");
@@ -2829,36 +3338,18 @@ build_signed_data_rest (ksba_cms_t cms)
       if (err)
 	goto leave;
 
-      /* Make the DER encoding and write it out. */
+      /* Make the DER encoding and add it to the set. */
       err = _ksba_der_encode_tree (root, &image, &imagelen);
       if (err)
 	goto leave;
-
-      err = ksba_writer_write (tmpwrt, image, imagelen);
-      xfree (image);
-      if (err)
-	goto leave;
+      _ksba_der_take_der (d, image, imagelen);
     }
 
   /* Write out the SET filled with all signer infos */
-  {
-    unsigned char *value;
-    size_t valuelen;
-
-    value = ksba_writer_snatch_mem (tmpwrt, &valuelen);
-    if (!value)
-      {
-        err = gpg_error (GPG_ERR_ENOMEM);
-	goto leave;
-      }
-    err = _ksba_ber_write_tl (cms->writer, TYPE_SET, CLASS_UNIVERSAL,
-                              1, valuelen);
-    if (!err)
-      err = ksba_writer_write (cms->writer, value, valuelen);
-    xfree (value);
-    if (err)
-      goto leave;
-  }
+  _ksba_der_add_end (d);
+  err = _ksba_der_builder_write (d, cms->writer);
+  if (err)
+    goto leave;
 
   /* Write 3 end tags */
   err = _ksba_ber_write_tl (cms->writer, 0, 0, 0, 0);
@@ -2870,7 +3361,7 @@ build_signed_data_rest (ksba_cms_t cms)
  leave:
   ksba_asn_tree_release (cms_tree);
   _ksba_asn_release_nodes (root);
-  ksba_writer_release (tmpwrt);
+  _ksba_der_builder_release (d);
 
   return err;
 }
@@ -2933,7 +3424,11 @@ ct_build_signed_data (ksba_cms_t cms)
   else if (state == sDATAREADY)
     {
       if (!cms->detached_data)
-        err = _ksba_ber_write_tl (cms->writer, 0, 0, 0, 0);
+        {
+          err = finish_data (cms);
+          if (!err)
+            err = _ksba_ber_write_tl (cms->writer, 0, 0, 0, 0);
+        }
       if (!err)
         err = build_signed_data_attributes (cms);
     }
@@ -2974,7 +3469,7 @@ build_enveloped_data_header (ksba_cms_t cms)
   unsigned char *buf;
   const char *s;
   size_t len;
-  ksba_writer_t tmpwrt = NULL;
+  DerBuilder d = NULL;
 
   /* Write the outer contentInfo */
   /* fixme: code is shared with signed_data_header */
@@ -3024,7 +3519,7 @@ build_enveloped_data_header (ksba_cms_t cms)
      for SPHINX */
 
   /* Now we write the recipientInfo */
-  err = ksba_asn_create_tree ("cms", &cms_tree);
+  err = _ksba_asn_get_shared_tree ("cms", &cms_tree);
   if (err)
     return err;
 
@@ -3035,13 +3530,15 @@ build_enveloped_data_header (ksba_cms_t cms)
       goto leave;
     }
 
-  /* To construct the set we use a temporary writer object */
-  err = ksba_writer_new (&tmpwrt);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (tmpwrt, 2048);
-  if (err)
-    goto leave;
+  /* The set is constructed from the encoded recipient infos and
+     written in one go.  */
+  d = _ksba_der_builder_new (0);
+  if (!d)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SET);
 
   for (recpno=0; certlist; recpno++, certlist = certlist->next)
     {
@@ -3055,8 +3552,8 @@ build_enveloped_data_header (ksba_cms_t cms)
           goto leave;
         }
 
-      root = _ksba_asn_expand_tree (cms_tree->parse_tree,
-                                "CryptographicMessageSyntax.RecipientInfo");
+      root = _ksba_asn_expand_module (cms_tree,
+                                      "CryptographicMessageSyntax.RecipientInfo");
 
       /* We store a version of 0 because we are only allowed to use
          the issuerAndSerialNumber for SPHINX */
@@ -3151,16 +3648,12 @@ build_enveloped_data_header (ksba_cms_t cms)
         goto leave;
 
 
-      /* Make the DER encoding and write it out */
+      /* Make the DER encoding and add it to the set */
       err = _ksba_der_encode_tree (root, &image, &imagelen);
       if (err)
           goto leave;
+      _ksba_der_take_der (d, image, imagelen);
 
-      err = ksba_writer_write (tmpwrt, image, imagelen);
-      if (err)
-        goto leave;
-
-      xfree (image);
       _ksba_asn_release_nodes (root);
     }
 
@@ -3168,26 +3661,10 @@ build_enveloped_data_header (ksba_cms_t cms)
   cms_tree = NULL;
 
   /* Write out the SET filled with all recipient infos */
-  {
-    unsigned char *value;
-    size_t valuelen;
-
-    value = ksba_writer_snatch_mem (tmpwrt, &valuelen);
-    if (!value)
-      {
-        err = gpg_error (GPG_ERR_ENOMEM);
-        goto leave;
-      }
-    ksba_writer_release (tmpwrt);
-    tmpwrt = NULL;
-    err = _ksba_ber_write_tl (cms->writer, TYPE_SET, CLASS_UNIVERSAL,
-                              1, valuelen);
-    if (!err)
-      err = ksba_writer_write (cms->writer, value, valuelen);
-    xfree (value);
-    if (err)
-      goto leave;
-  }
+  _ksba_der_add_end (d);
+  err = _ksba_der_builder_write (d, cms->writer);
+  if (err)
+    goto leave;
 
 
   /* Write the (inner) encryptedContentInfo */
@@ -3222,7 +3699,7 @@ build_enveloped_data_header (ksba_cms_t cms)
   /* Now the encrypted data should be written */
 
  leave:
-  ksba_writer_release (tmpwrt);
+  _ksba_der_builder_release (d);
   ksba_asn_tree_release (cms_tree);
   return err;
 }
@@ -72,6 +72,9 @@ struct oidparmlist_s {
 struct certlist_s {
   struct certlist_s *next;
   ksba_cert_t cert;
+  unsigned char *image;  /* The encoding of a not yet parsed CERT.  */
+  size_t imagelen;
+  gpg_error_t parse_err; /* Set if IMAGE could not be parsed.  */
   int  msg_digest_len;  /* used length of .. */
   char msg_digest[64];  /* enough space to store a SHA-512 hash */
   ksba_isotime_t signing_time;
@@ -93,6 +96,26 @@ struct signer_info_s {
   } cache;
 };
 
+/* The values of one signer in a ksba_cms_signers_t snapshot.  */
+struct signer_snapshot_s {
+  char *issuer;                 /* NULL if identified by KEYID.  */
+  ksba_sexp_t serial;           /* NULL if identified by KEYID.  */
+  ksba_sexp_t keyid;            /* The subjectKeyIdentifier or NULL.  */
+  char *digest_algo;
+  unsigned char *signed_attrs;  /* DER with a SET tag or NULL.  */
+  size_t signed_attrs_len;
+  char *msg_digest;             /* NULL if not available.  */
+  size_t msg_digest_len;
+  ksba_isotime_t signing_time;
+  ksba_sexp_t sig_val;          /* NULL if not available.  */
+};
+
+/* An immutable copy of the signer infos.  */
+struct ksba_cms_signers_s {
+  int count;
+  struct signer_snapshot_s signers[1];
+};
+
 struct sig_val_s {
   struct sig_val_s *next;
   char *algo;
@@ -108,6 +131,14 @@ struct ksba_cms_s {
 
   void (*hash_fnc)(void *, const void *, size_t);
   void *hash_fnc_arg;
+  ksba_hasher_t hasher;  /* Set by ksba_cms_set_hasher or NULL.  */
+
+  size_t chunk_size;        /* Size of the data chunks.  */
+  unsigned char *chunk_buf; /* Allocated buffer of CHUNK_SIZE or NULL.  */
+  size_t chunk_used;        /* Bytes pending in CHUNK_BUF.  */
+  int data_open;            /* ksba_cms_write_data has started the
+                               constructed octet string.  */
+  int lazy_certs;           /* Parse certificates on first access.  */
 
   ksba_stop_reason_t stop_reason;
 
@@ -45,12 +45,15 @@ void _ksba_current_time (ksba_isotime_t timebuf);
 /*-- dn.c --*/
 gpg_error_t _ksba_dn_to_str (const unsigned char *image, AsnNode node,
                            char **r_string);
+gpg_error_t _ksba_dn_value_to_str (const unsigned char *image, AsnValue value,
+                                   char **r_string);
 gpg_error_t _ksba_derdn_to_str (const unsigned char *der, size_t derlen,
                               char **r_string);
 gpg_error_t _ksba_dn_from_str (const char *string, char **rbuf, size_t *rlength);
 
 /*-- oid.c --*/
 char *_ksba_oid_node_to_str (const unsigned char *image, AsnNode node);
+char *_ksba_oid_value_to_str (const unsigned char *image, AsnValue value);
 gpg_error_t _ksba_oid_from_buf (const void *buffer, size_t buflen,
                                 unsigned char **rbuf, size_t *rlength);
 
@@ -0,0 +1,1299 @@
+/* crl-index.c - Sorted index of the entries of a CRL
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The index is kept in the same flat format used to store it, so
+   that an image created by ksba_crl_index_get_image or written by
+   ksba_crl_index_write can be used again without any parsing; in
+   particular a file may simply be mapped into memory.  All integers
+   are stored in big endian byte order:
+
+     Header:
+       byte  0  Magic "KSBACRLI"
+       byte  8  u32 Version (1)
+       byte 12  u32 Length of the header
+       byte 16  u32 Number of entries
+       byte 20  u32 Length of an entry
+       byte 24  u32 Offset of the serial number pool
+       byte 28  u32 Length of the serial number pool
+       byte 32  u32 Flags; bit 0 is set if the CRL info is present,
+                bit 1 if delta CRLs have been merged into the index
+       byte 36  thisUpdate as ksba_isotime_t
+       byte 52  nextUpdate as ksba_isotime_t
+       byte 68  u32 High and u32 low part of the offset of the
+                tbsCertList relative to the start of the CRL
+       byte 76  u32 High and u32 low part of the length of the
+                tbsCertList
+       byte 84  u32 Offset and u32 length of the issuer DN string
+       byte 92  u32 Offset and u32 length of the CRL number
+       byte 100 u32 Offset and u32 length of the digest algorithm OID
+       byte 108 u32 Offset and u32 length of the signature value
+       byte 116 u32 Offset and u32 length of the base CRL number of a
+                delta CRL
+       byte 124 Reserved
+
+   The CRL info fields are stored after the serial number pool.  The
+   issuer and the OID are strings including the terminating Nul; the
+   CRL number and the signature value are canonical S-expressions.
+   The span of the tbsCertList allows to verify the signature later
+   using the original CRL.
+
+     Entries, sorted by serial number:
+       byte  0  u32 Offset of the serial number in the pool
+       byte  4  u16 Length of the serial number
+       byte  6  u16 Reason flags (ksba_crl_reason_t)
+       byte  8  The first 8 bytes of the serial number, zero padded
+       byte 16  u32 High part of the offset of the entry extensions
+       byte 20  u32 Low part of the offset of the entry extensions
+       byte 24  Revocation date as ksba_isotime_t
+
+   The serial numbers are stored without leading zero bytes.  The
+   copy of their first bytes in the entry allows a lookup to touch
+   the pool only for long serial numbers with a common prefix.  The
+   offset of the entry extensions is relative to the start of the CRL
+   and 0 if the entry has no extensions.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#include "util.h"
+#include "convert.h"
+#include "sexp-parse.h"
+#include "ber-help.h"
+#include "crl.h"
+
+#define INDEX_MAGIC      "KSBACRLI"
+#define INDEX_VERSION    1
+#define INDEX_HDRLEN    128
+#define INDEX_ENTRYLEN   40
+#define INDEX_PREFIXLEN   8
+
+#define INDEX_FLAG_INFO   1
+#define INDEX_FLAG_MERGED 2
+
+/* The CRL info fields; each is described by an offset and a length
+   in the header starting at byte 84.  */
+enum
+  {
+    FIELD_ISSUER = 0,
+    FIELD_CRL_NUMBER,
+    FIELD_DIGEST_ALGO,
+    FIELD_SIG_VAL,
+    FIELD_BASE_NUMBER,
+    INDEX_NFIELDS
+  };
+#define FIELD_HDROFF(a) (84 + 8 * (a))
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_FAILED)
+# define USE_MMAP 1
+#endif
+
+/* The CRL info to be stored in an image.  */
+struct info_s
+{
+  unsigned long flags;
+  const char *this_update;
+  const char *next_update;
+  unsigned long tbs_off;
+  unsigned long tbs_len;
+  struct {
+    const void *data;
+    size_t length;
+  } fields[INDEX_NFIELDS];
+};
+
+/* An entry while the index is being built.  */
+struct build_entry_s
+{
+  const unsigned char *serial;  /* Only valid while sorting.  */
+  size_t serialoff;
+  unsigned short seriallen;
+  unsigned short reason;
+  unsigned long extoff;
+  ksba_isotime_t revocation_date;
+};
+
+struct ksba_crl_index_s
+{
+  /* The collected entries while building the index.  */
+  struct {
+    struct build_entry_s *entries;
+    size_t nentries;
+    size_t allocated;
+    unsigned char *pool;
+    size_t poollen;
+    size_t poolsize;
+  } build;
+
+  /* The image of the index and the parsed header fields.  */
+  unsigned char *image;
+  size_t imagelen;
+  int mapped;        /* The image is a mapped file.  */
+  size_t nentries;
+  size_t entrylen;
+  const unsigned char *entries;
+  const unsigned char *pool;
+  size_t poollen;
+};
+
+
+static inline unsigned long
+get32 (const unsigned char *p)
+{
+  return (((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+          | ((unsigned long)p[2] << 8) | p[3]);
+}
+
+static inline void
+put32 (unsigned char *p, unsigned long val)
+{
+  p[0] = val >> 24;
+  p[1] = val >> 16;
+  p[2] = val >> 8;
+  p[3] = val;
+}
+
+static inline unsigned long
+get64 (const unsigned char *p)
+{
+#if SIZEOF_UNSIGNED_LONG > 4
+  return ((unsigned long)get32 (p) << 32) | get32 (p+4);
+#else
+  return get32 (p+4);
+#endif
+}
+
+static inline void
+put64 (unsigned char *p, unsigned long val)
+{
+#if SIZEOF_UNSIGNED_LONG > 4
+  put32 (p, val >> 32);
+#else
+  put32 (p, 0);
+#endif
+  put32 (p+4, val);
+}
+
+
+/* Strip the leading zero bytes from the serial number at *SERIAL of
+   length *LENGTH but keep at least one byte.  */
+static void
+strip_serial (const unsigned char **serial, size_t *length)
+{
+  while (*length > 1 && !**serial)
+    {
+      (*serial)++;
+      (*length)--;
+    }
+}
+
+
+/* Compare two serial numbers.  Serial numbers are ordered by length
+   first, which is the numerical order for stripped positive
+   numbers.  */
+static int
+compare_serials (const unsigned char *a, size_t alen,
+                 const unsigned char *b, size_t blen)
+{
+  if (alen != blen)
+    return alen < blen? -1 : 1;
+  return memcmp (a, b, alen);
+}
+
+
+static int
+compare_build_entries (const void *a_arg, const void *b_arg)
+{
+  const struct build_entry_s *a = a_arg;
+  const struct build_entry_s *b = b_arg;
+  int cmp;
+
+  cmp = compare_serials (a->serial, a->seriallen, b->serial, b->seriallen);
+  if (!cmp)  /* Keep the order of the CRL for duplicates.  */
+    cmp = a->serialoff < b->serialoff? -1 : a->serialoff > b->serialoff;
+  return cmp;
+}
+
+
+/* Create a new index to be filled by _ksba_crl_index_add.  */
+gpg_error_t
+_ksba_crl_index_new (ksba_crl_index_t *r_index)
+{
+  *r_index = xtrycalloc (1, sizeof **r_index);
+  if (!*r_index)
+    return gpg_error_from_errno (errno);
+  return 0;
+}
+
+
+/* Add a new entry with SERIAL of length SERIALLEN to INDEX.  The
+   other values of the entry are set by _ksba_crl_index_set_item.  */
+gpg_error_t
+_ksba_crl_index_add (ksba_crl_index_t index,
+                     const unsigned char *serial, size_t seriallen)
+{
+  struct build_entry_s *entry;
+
+  if (index->image)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  strip_serial (&serial, &seriallen);
+  if (!seriallen || seriallen > 0xffff)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  if (index->build.nentries == index->build.allocated)
+    {
+      size_t n = index->build.allocated? 2 * index->build.allocated : 256;
+
+      entry = xtryrealloc (index->build.entries, n * sizeof *entry);
+      if (!entry)
+        return gpg_error_from_errno (errno);
+      index->build.entries = entry;
+      index->build.allocated = n;
+    }
+  if (index->build.poollen + seriallen > index->build.poolsize)
+    {
+      size_t n = index->build.poolsize? 2 * index->build.poolsize : 4096;
+      unsigned char *p;
+
+      while (n < index->build.poollen + seriallen)
+        n *= 2;
+      p = xtryrealloc (index->build.pool, n);
+      if (!p)
+        return gpg_error_from_errno (errno);
+      index->build.pool = p;
+      index->build.poolsize = n;
+    }
+
+  entry = index->build.entries + index->build.nentries++;
+  memset (entry, 0, sizeof *entry);
+  entry->serialoff = index->build.poollen;
+  entry->seriallen = seriallen;
+  memcpy (index->build.pool + index->build.poollen, serial, seriallen);
+  index->build.poollen += seriallen;
+  return 0;
+}
+
+
+/* Set the revocation date RDATE, the REASON and the offset EXTOFF of
+   the entry extensions of the last entry added to INDEX.  */
+void
+_ksba_crl_index_set_item (ksba_crl_index_t index, const char *rdate,
+                          ksba_crl_reason_t reason, unsigned long extoff)
+{
+  struct build_entry_s *entry;
+
+  if (index->image || !index->build.nentries)
+    return;
+  entry = index->build.entries + index->build.nentries - 1;
+  _ksba_copy_time (entry->revocation_date, rdate);
+  entry->reason = reason;
+  entry->extoff = extoff;
+}
+
+
+/* Parse the header of the image of INDEX.  */
+static gpg_error_t
+parse_image (ksba_crl_index_t index)
+{
+  const unsigned char *p = index->image;
+  size_t hdrlen, off;
+
+  if (index->imagelen < INDEX_HDRLEN
+      || memcmp (p, INDEX_MAGIC, 8))
+    return gpg_error (GPG_ERR_INV_OBJ);
+  if (get32 (p+8) != INDEX_VERSION)
+    return gpg_error (GPG_ERR_UNSUPPORTED_PROTOCOL);
+  hdrlen = get32 (p+12);
+  index->nentries = get32 (p+16);
+  index->entrylen = get32 (p+20);
+  off = get32 (p+24);
+  index->poollen = get32 (p+28);
+  if (hdrlen < INDEX_HDRLEN || hdrlen > index->imagelen
+      || index->entrylen < INDEX_ENTRYLEN
+      || (index->imagelen - hdrlen) / index->entrylen < index->nentries
+      || off > index->imagelen
+      || index->poollen > index->imagelen - off)
+    return gpg_error (GPG_ERR_INV_OBJ);
+  index->entries = p + hdrlen;
+  index->pool = p + off;
+  return 0;
+}
+
+
+/* Sort the collected entries of INDEX and create the image.  */
+gpg_error_t
+_ksba_crl_index_finish (ksba_crl_index_t index)
+{
+  struct build_entry_s *entry;
+  unsigned char *p;
+  size_t n, pooloff;
+
+  if (index->image)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  n = index->build.nentries;
+  if (n > (0xffffffff - INDEX_HDRLEN - index->build.poollen) / INDEX_ENTRYLEN)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  pooloff = INDEX_HDRLEN + n * INDEX_ENTRYLEN;
+
+  index->imagelen = pooloff + index->build.poollen;
+  index->image = xtrymalloc (index->imagelen);
+  if (!index->image)
+    return gpg_error_from_errno (errno);
+
+  for (entry = index->build.entries; n; entry++, n--)
+    entry->serial = index->build.pool + entry->serialoff;
+  n = index->build.nentries;
+  if (n)
+    qsort (index->build.entries, n, sizeof *entry, compare_build_entries);
+
+  p = index->image;
+  memset (p, 0, INDEX_HDRLEN);
+  memcpy (p, INDEX_MAGIC, 8);
+  put32 (p+8, INDEX_VERSION);
+  put32 (p+12, INDEX_HDRLEN);
+  put32 (p+16, n);
+  put32 (p+20, INDEX_ENTRYLEN);
+  put32 (p+24, pooloff);
+  put32 (p+28, index->build.poollen);
+  p += INDEX_HDRLEN;
+  for (entry = index->build.entries; n; entry++, n--, p += INDEX_ENTRYLEN)
+    {
+      put32 (p, entry->serialoff);
+      p[4] = entry->seriallen >> 8;
+      p[5] = entry->seriallen;
+      p[6] = entry->reason >> 8;
+      p[7] = entry->reason;
+      memset (p+8, 0, INDEX_PREFIXLEN);
+      memcpy (p+8, entry->serial, (entry->seriallen < INDEX_PREFIXLEN
+                                   ? entry->seriallen : INDEX_PREFIXLEN));
+      put64 (p+16, entry->extoff);
+      memcpy (p+24, entry->revocation_date, 16);
+    }
+  if (index->build.poollen)
+    memcpy (p, index->build.pool, index->build.poollen);
+
+  xfree (index->build.entries);
+  xfree (index->build.pool);
+  memset (&index->build, 0, sizeof index->build);
+
+  return parse_image (index);
+}
+
+
+/* Return the length of the canonical S-expression SEXP or 0 if it
+   is not valid.  */
+static size_t
+sexp_length (const unsigned char *sexp)
+{
+  const unsigned char *p = sexp;
+  int depth = 1;
+
+  if (!p || *p != '(')
+    return 0;
+  p++;
+  if (sskip (&p, &depth))
+    return 0;
+  return p - sexp;
+}
+
+
+/* Append the CRL info described by INFO to the image of INDEX.  */
+static gpg_error_t
+add_info (ksba_crl_index_t index, const struct info_s *info)
+{
+  size_t n, off;
+  unsigned char *p;
+  int i;
+
+  for (n=i=0; i < INDEX_NFIELDS; i++)
+    n += info->fields[i].length;
+  if (n > 0xffffffff - index->imagelen)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  p = xtryrealloc (index->image, index->imagelen + n);
+  if (!p)
+    return gpg_error_from_errno (errno);
+  index->image = p;
+
+  off = index->imagelen;
+  put32 (p+32, info->flags | INDEX_FLAG_INFO);
+  memcpy (p+36, info->this_update, 16);
+  memcpy (p+52, info->next_update, 16);
+  put64 (p+68, info->tbs_off);
+  put64 (p+76, info->tbs_len);
+  for (i=0; i < INDEX_NFIELDS; i++)
+    {
+      put32 (p + FIELD_HDROFF (i), info->fields[i].length? off : 0);
+      put32 (p + FIELD_HDROFF (i) + 4, info->fields[i].length);
+      if (info->fields[i].length)
+        memcpy (p + off, info->fields[i].data, info->fields[i].length);
+      off += info->fields[i].length;
+    }
+  index->imagelen = off;
+  return parse_image (index);
+}
+
+
+/* Add the information about the CRL, which is available after
+   parsing has been completed, to INDEX.  */
+gpg_error_t
+_ksba_crl_index_set_info (ksba_crl_index_t index, ksba_crl_t crl)
+{
+  gpg_error_t err;
+  char *issuer = NULL;
+  ksba_sexp_t number = NULL;
+  ksba_sexp_t base_number = NULL;
+  const char *algo;
+  struct info_s info;
+
+  if (!index->image || index->mapped)
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  err = ksba_crl_get_issuer (crl, &issuer);
+  if (err)
+    return err;
+  err = ksba_crl_get_crl_number (crl, &number);
+  if (err && gpg_err_code (err) != GPG_ERR_NO_DATA)
+    goto leave;
+  err = ksba_crl_get_delta_indicator (crl, &base_number);
+  if (err && gpg_err_code (err) != GPG_ERR_NO_DATA)
+    goto leave;
+  algo = ksba_crl_get_digest_algo (crl);
+
+  memset (&info, 0, sizeof info);
+  info.this_update = crl->this_update;
+  info.next_update = crl->next_update;
+  info.tbs_off = crl->state.tbs_off;
+  info.tbs_len = crl->state.tbs_end - crl->state.tbs_off;
+  info.fields[FIELD_ISSUER].data = issuer;
+  info.fields[FIELD_ISSUER].length = strlen (issuer) + 1;
+  info.fields[FIELD_CRL_NUMBER].data = number;
+  info.fields[FIELD_CRL_NUMBER].length = sexp_length (number);
+  info.fields[FIELD_DIGEST_ALGO].data = algo;
+  info.fields[FIELD_DIGEST_ALGO].length = algo? strlen (algo) + 1 : 0;
+  info.fields[FIELD_SIG_VAL].data = crl->sigval;
+  info.fields[FIELD_SIG_VAL].length = sexp_length (crl->sigval);
+  info.fields[FIELD_BASE_NUMBER].data = base_number;
+  info.fields[FIELD_BASE_NUMBER].length = sexp_length (base_number);
+  err = add_info (index, &info);
+
+ leave:
+  xfree (issuer);
+  xfree (number);
+  xfree (base_number);
+  return err;
+}
+
+
+/* Return the info FIELD of INDEX and store its length at R_LENGTH.
+   Returns NULL if the field is not available.  */
+static const unsigned char *
+get_info_field (ksba_crl_index_t index, int field, size_t *r_length)
+{
+  const unsigned char *p = index->image;
+  size_t off, len;
+
+  if (!(get32 (p+32) & INDEX_FLAG_INFO))
+    return NULL;
+  off = get32 (p + FIELD_HDROFF (field));
+  len = get32 (p + FIELD_HDROFF (field) + 4);
+  if (!len || off > index->imagelen || len > index->imagelen - off)
+    return NULL;
+  *r_length = len;
+  return p + off;
+}
+
+
+/**
+ * ksba_crl_index_new_from_mem:
+ * @r_index: Returns the new index object
+ * @buffer: An image as returned by ksba_crl_index_get_image
+ * @length: The length of that image
+ *
+ * Create a new CRL index object from an image previously retrieved
+ * with ksba_crl_index_get_image.  The image is copied.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_new_from_mem (ksba_crl_index_t *r_index,
+                             const void *buffer, size_t length)
+{
+  gpg_error_t err;
+  ksba_crl_index_t index;
+
+  if (!r_index || !buffer)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_index = NULL;
+
+  err = _ksba_crl_index_new (&index);
+  if (err)
+    return err;
+  index->image = xtrymalloc (length? length : 1);
+  if (!index->image)
+    {
+      err = gpg_error_from_errno (errno);
+      xfree (index);
+      return err;
+    }
+  memcpy (index->image, buffer, length);
+  index->imagelen = length;
+  err = parse_image (index);
+  if (err)
+    {
+      ksba_crl_index_release (index);
+      return err;
+    }
+  *r_index = index;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_new_from_fd:
+ * @r_index: Returns the new index object
+ * @fd: A file descriptor open for reading
+ *
+ * Create a new CRL index object from the file @fd, which has been
+ * written by ksba_crl_index_write.  If possible the file is mapped
+ * into memory so that all processes using the same file share one
+ * copy of it; the file must then not be modified as long as the
+ * object is in use.  @fd may be closed after this call.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_new_from_fd (ksba_crl_index_t *r_index, int fd)
+{
+  gpg_error_t err;
+  ksba_crl_index_t index;
+  struct stat st;
+  size_t n;
+  ssize_t nread;
+
+  if (!r_index || fd == -1)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_index = NULL;
+
+  if (fstat (fd, &st))
+    return gpg_error_from_errno (errno);
+  if (!S_ISREG (st.st_mode))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if ((unsigned long long)st.st_size > (size_t)(-1))
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  if (st.st_size < INDEX_HDRLEN)
+    return gpg_error (GPG_ERR_INV_OBJ);
+
+  err = _ksba_crl_index_new (&index);
+  if (err)
+    return err;
+  index->imagelen = st.st_size;
+
+#ifdef USE_MMAP
+  {
+    void *map = mmap (NULL, index->imagelen, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (map != MAP_FAILED)
+      {
+        index->image = map;
+        index->mapped = 1;
+      }
+  }
+#endif
+  if (!index->image)
+    {
+      index->image = xtrymalloc (index->imagelen);
+      if (!index->image)
+        {
+          err = gpg_error_from_errno (errno);
+          goto leave;
+        }
+      for (n=0; n < index->imagelen; n += nread)
+        {
+          do
+            nread = pread (fd, index->image + n, index->imagelen - n, n);
+          while (nread == -1 && errno == EINTR);
+          if (nread <= 0)
+            {
+              err = nread? gpg_error_from_errno (errno)
+                         : gpg_error (GPG_ERR_TOO_SHORT);
+              goto leave;
+            }
+        }
+    }
+
+  err = parse_image (index);
+
+ leave:
+  if (err)
+    ksba_crl_index_release (index);
+  else
+    *r_index = index;
+  return err;
+}
+
+
+/**
+ * ksba_crl_index_write:
+ * @index: A CRL index object
+ * @w: A writer object
+ *
+ * Write the image of @index to @w.  The written data may later be
+ * loaded using ksba_crl_index_new_from_fd or
+ * ksba_crl_index_new_from_mem.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_write (ksba_crl_index_t index, ksba_writer_t w)
+{
+  if (!index || !index->image || !w)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  return ksba_writer_write (w, index->image, index->imagelen);
+}
+
+
+/**
+ * ksba_crl_index_release:
+ * @index: A CRL index object or NULL
+ *
+ * Release the CRL index object.
+ **/
+void
+ksba_crl_index_release (ksba_crl_index_t index)
+{
+  if (!index)
+    return;
+  xfree (index->build.entries);
+  xfree (index->build.pool);
+#ifdef USE_MMAP
+  if (index->mapped)
+    munmap (index->image, index->imagelen);
+  else
+#endif
+    xfree (index->image);
+  xfree (index);
+}
+
+
+/**
+ * ksba_crl_index_get_image:
+ * @index: A CRL index object
+ * @r_length: Returns the length of the image
+ *
+ * Return the image of the index suitable to be stored and later
+ * passed to ksba_crl_index_new_from_mem.  The image is valid as long
+ * as @index is valid.
+ *
+ * Return value: The image or NULL on error.
+ **/
+const unsigned char *
+ksba_crl_index_get_image (ksba_crl_index_t index, size_t *r_length)
+{
+  if (!index || !index->image || !r_length)
+    return NULL;
+  *r_length = index->imagelen;
+  return index->image;
+}
+
+
+/**
+ * ksba_crl_index_get_count:
+ * @index: A CRL index object
+ *
+ * Return value: The number of entries in @index.
+ **/
+size_t
+ksba_crl_index_get_count (ksba_crl_index_t index)
+{
+  return (index && index->image)? index->nentries : 0;
+}
+
+
+/* Compare the serial number of the index entry ENTRY from the pool
+   POOL of length POOLLEN with the serial number S of length N.  */
+static gpg_error_t
+compare_entry (const unsigned char *entry,
+               const unsigned char *pool, size_t poollen,
+               const unsigned char *s, size_t n, int *r_cmp)
+{
+  size_t off, len;
+  int cmp;
+
+  len = (entry[4] << 8) | entry[5];
+  if (n != len)
+    cmp = n < len? -1 : 1;
+  else
+    {
+      cmp = memcmp (s, entry+8, n < INDEX_PREFIXLEN? n : INDEX_PREFIXLEN);
+      if (!cmp && n > INDEX_PREFIXLEN)
+        {
+          off = get32 (entry);
+          if (off > poollen || len > poollen - off)
+            return gpg_error (GPG_ERR_INV_OBJ);
+          cmp = memcmp (s + INDEX_PREFIXLEN, pool + off + INDEX_PREFIXLEN,
+                        n - INDEX_PREFIXLEN);
+        }
+    }
+  *r_cmp = cmp;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_lookup:
+ * @index: A CRL index object
+ * @serial: The serial number as canonical S-expression
+ * @r_revocation_date: Returns the revocation date or NULL
+ * @r_reason: Returns the reason or NULL
+ * @r_extoff: Returns the offset of the entry extensions or NULL
+ *
+ * Check whether the certificate with @serial is listed in the CRL
+ * described by @index.  The serial number is expected in the same
+ * format as returned by ksba_cert_get_serial.  If it is listed, the
+ * details of the entry are returned; @r_extoff receives the offset
+ * of the entry extensions relative to the start of the CRL or 0 if
+ * there are none.
+ *
+ * Return value: 0 if listed, GPG_ERR_NOT_FOUND if not or another
+ * error code.
+ **/
+gpg_error_t
+ksba_crl_index_lookup (ksba_crl_index_t index, ksba_const_sexp_t serial,
+                       ksba_isotime_t r_revocation_date,
+                       ksba_crl_reason_t *r_reason,
+                       unsigned long *r_extoff)
+{
+  gpg_error_t err;
+  const unsigned char *s = serial;
+  const unsigned char *entry;
+  size_t n, lo, hi, mid;
+  int cmp;
+
+  if (r_revocation_date)
+    *r_revocation_date = 0;
+  if (r_reason)
+    *r_reason = 0;
+  if (r_extoff)
+    *r_extoff = 0;
+  if (!index || !index->image || !s)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (*s != '(')
+    return gpg_error (GPG_ERR_INV_SEXP);
+  s++;
+  n = snext (&s);
+  if (!n)
+    return gpg_error (GPG_ERR_INV_SEXP);
+  strip_serial (&s, &n);
+
+  lo = 0;
+  hi = index->nentries;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      entry = index->entries + mid * index->entrylen;
+      err = compare_entry (entry, index->pool, index->poollen, s, n, &cmp);
+      if (err)
+        return err;
+      if (!cmp)
+        {
+          if (r_revocation_date)
+            {
+              memcpy (r_revocation_date, entry+24, 15);
+              r_revocation_date[15] = 0;
+            }
+          if (r_reason)
+            *r_reason = (entry[6] << 8) | entry[7];
+          if (r_extoff)
+            *r_extoff = get64 (entry+16);
+          return 0;
+        }
+      if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return gpg_error (GPG_ERR_NOT_FOUND);
+}
+
+
+/**
+ * ksba_crl_index_get_issuer:
+ * @index: A CRL index object
+ * @r_issuer: Returns the issuer
+ *
+ * Return the issuer of the CRL as a string in the format used by
+ * ksba_crl_get_issuer.  The caller must release the string.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_get_issuer (ksba_crl_index_t index, char **r_issuer)
+{
+  const unsigned char *p;
+  size_t n;
+
+  if (!index || !index->image || !r_issuer)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_issuer = NULL;
+  p = get_info_field (index, FIELD_ISSUER, &n);
+  if (!p || p[n-1])
+    return gpg_error (GPG_ERR_NO_DATA);
+  *r_issuer = xtrystrdup ((const char*)p);
+  if (!*r_issuer)
+    return gpg_error_from_errno (errno);
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_get_update_times:
+ * @index: A CRL index object
+ * @this: Returns the thisUpdate value of the CRL
+ * @next: Returns the nextUpdate value of the CRL or an empty string
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_get_update_times (ksba_crl_index_t index,
+                                 ksba_isotime_t this, ksba_isotime_t next)
+{
+  const unsigned char *p;
+
+  if (this)
+    *this = 0;
+  if (next)
+    *next = 0;
+  if (!index || !index->image)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  p = index->image;
+  if (!(get32 (p+32) & INDEX_FLAG_INFO))
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (this)
+    {
+      memcpy (this, p+36, 15);
+      this[15] = 0;
+    }
+  if (next)
+    {
+      memcpy (next, p+52, 15);
+      next[15] = 0;
+    }
+  return 0;
+}
+
+
+/* Return a copy of the S-expression in the info FIELD of INDEX at
+   R_SEXP.  */
+static gpg_error_t
+get_sexp_field (ksba_crl_index_t index, int field, ksba_sexp_t *r_sexp)
+{
+  const unsigned char *p;
+  size_t n;
+
+  *r_sexp = NULL;
+  p = get_info_field (index, field, &n);
+  if (!p)
+    return gpg_error (GPG_ERR_NO_DATA);
+  *r_sexp = xtrymalloc (n + 1);
+  if (!*r_sexp)
+    return gpg_error_from_errno (errno);
+  memcpy (*r_sexp, p, n);
+  (*r_sexp)[n] = 0;
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_get_crl_number:
+ * @index: A CRL index object
+ * @r_number: Returns the CRL number
+ *
+ * Return the CRL number as canonical S-expression.  The caller must
+ * release it.  GPG_ERR_NO_DATA is returned if the CRL does not have
+ * a number.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_get_crl_number (ksba_crl_index_t index, ksba_sexp_t *r_number)
+{
+  if (!index || !index->image || !r_number)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  return get_sexp_field (index, FIELD_CRL_NUMBER, r_number);
+}
+
+
+/**
+ * ksba_crl_index_get_digest_algo:
+ * @index: A CRL index object
+ *
+ * Return the OID of the digest algorithm used for the signature of
+ * the CRL.  The string is valid as long as @index is valid.
+ *
+ * Return value: The OID or NULL if not available.
+ **/
+const char *
+ksba_crl_index_get_digest_algo (ksba_crl_index_t index)
+{
+  const unsigned char *p;
+  size_t n;
+
+  if (!index || !index->image)
+    return NULL;
+  p = get_info_field (index, FIELD_DIGEST_ALGO, &n);
+  if (!p || p[n-1])
+    return NULL;
+  return (const char*)p;
+}
+
+
+/**
+ * ksba_crl_index_get_sig_val:
+ * @index: A CRL index object
+ * @r_tbs_off: Returns the offset of the signed data
+ * @r_tbs_len: Returns the length of the signed data
+ * @r_sigval: Returns the signature value
+ *
+ * Return the signature value of the CRL in the same format as
+ * ksba_crl_get_sig_val and the span of the signed data, i.e. the
+ * tbsCertList, relative to the start of the CRL.  This allows to
+ * verify the signature using the original CRL.  Any of the arguments
+ * may be NULL.  The caller must release the signature value.
+ * GPG_ERR_NO_DATA is returned for an index into which delta CRLs
+ * have been merged.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_get_sig_val (ksba_crl_index_t index,
+                            unsigned long *r_tbs_off,
+                            unsigned long *r_tbs_len,
+                            ksba_sexp_t *r_sigval)
+{
+  gpg_error_t err;
+  size_t n;
+
+  if (r_sigval)
+    *r_sigval = NULL;
+  if (!index || !index->image)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!get_info_field (index, FIELD_SIG_VAL, &n))
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (r_sigval)
+    {
+      err = get_sexp_field (index, FIELD_SIG_VAL, r_sigval);
+      if (err)
+        return err;
+    }
+  if (r_tbs_off)
+    *r_tbs_off = get64 (index->image+68);
+  if (r_tbs_len)
+    *r_tbs_len = get64 (index->image+76);
+  return 0;
+}
+
+
+/**
+ * ksba_crl_index_get_delta_indicator:
+ * @index: A CRL index object
+ * @r_number: Returns the number of the base CRL
+ *
+ * Return the number of the base CRL as canonical S-expression if
+ * @index has been created from a delta CRL.  GPG_ERR_NO_DATA is
+ * returned for other indices.  The caller must release @r_number.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_index_get_delta_indicator (ksba_crl_index_t index,
+                                    ksba_sexp_t *r_number)
+{
+  if (!index || !index->image || !r_number)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  return get_sexp_field (index, FIELD_BASE_NUMBER, r_number);
+}
+
+
+/* Return the stripped value of the integer in the info FIELD of
+   INDEX at R_NUMBER and R_LENGTH.  */
+static gpg_error_t
+get_number_field (ksba_crl_index_t index, int field,
+                  const unsigned char **r_number, size_t *r_length)
+{
+  const unsigned char *s;
+  size_t n;
+
+  s = get_info_field (index, field, &n);
+  if (!s)
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (*s != '(')
+    return gpg_error (GPG_ERR_INV_SEXP);
+  s++;
+  n = snext (&s);
+  if (!n)
+    return gpg_error (GPG_ERR_INV_SEXP);
+  strip_serial (&s, &n);
+  *r_number = s;
+  *r_length = n;
+  return 0;
+}
+
+
+/* Copy COUNT entries of INDEX starting at entry FROM to DST and
+   return the new end of DST.  */
+static unsigned char *
+copy_entries (unsigned char *dst, ksba_crl_index_t index,
+              size_t from, size_t count)
+{
+  const unsigned char *src = index->entries + from * index->entrylen;
+
+  if (index->entrylen == INDEX_ENTRYLEN)
+    {
+      memcpy (dst, src, count * INDEX_ENTRYLEN);
+      return dst + count * INDEX_ENTRYLEN;
+    }
+  for (; count; count--, src += index->entrylen, dst += INDEX_ENTRYLEN)
+    memcpy (dst, src, INDEX_ENTRYLEN);
+  return dst;
+}
+
+
+/**
+ * ksba_crl_index_apply_delta:
+ * @base: The index of the base CRL
+ * @delta: The index of a delta CRL
+ * @r_index: Returns the updated index
+ *
+ * Merge the entries of the delta CRL described by @delta into the
+ * entries of @base and return the result as a new index.  Both
+ * indices must have been retrieved after the complete CRL has been
+ * parsed.  Entries of the delta CRL replace those of the base CRL
+ * with the same serial number; entries with the reason
+ * %KSBA_CRLREASON_REMOVE_FROM_CRL remove them.  The new index takes
+ * the CRL number and the update times of the delta CRL and can be
+ * used as the base for further delta CRLs.  It does not carry a
+ * signature and the offsets of the extensions of entries taken from
+ * the delta CRL are set to 0.  The signature of the delta CRL should
+ * be verified before calling this function.
+ *
+ * The base CRL entries are copied in blocks without looking at
+ * them; thus the cost depends mainly on the size of the delta CRL.
+ *
+ * Return value: 0 on success, GPG_ERR_CONFLICT if @delta can't be
+ * applied to @base, GPG_ERR_CRL_TOO_OLD if @delta is not newer than
+ * @base or another error code.
+ **/
+gpg_error_t
+ksba_crl_index_apply_delta (ksba_crl_index_t base, ksba_crl_index_t delta,
+                            ksba_crl_index_t *r_index)
+{
+  gpg_error_t err;
+  ksba_crl_index_t index;
+  const unsigned char *a, *b, *s, *entry, *issuer;
+  size_t alen, blen, n, len, issuerlen, off;
+  size_t i, pos, lo, hi, mid, nresult, maxentries, pooloff, poollen;
+  unsigned char *p, *dst;
+  struct info_s info;
+  int cmp;
+
+  if (!base || !base->image || !delta || !delta->image || !r_index)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_index = NULL;
+
+  /* Check that DELTA may be applied to BASE.  The base CRL must not
+     be older than the CRL referenced by the delta CRL and the delta
+     CRL must be newer than the base CRL.  */
+  if (!(get32 (base->image+32) & INDEX_FLAG_INFO)
+      || !(get32 (delta->image+32) & INDEX_FLAG_INFO))
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (get_info_field (base, FIELD_BASE_NUMBER, &n)
+      || !get_info_field (delta, FIELD_BASE_NUMBER, &n))
+    return gpg_error (GPG_ERR_CONFLICT);
+  issuer = get_info_field (base, FIELD_ISSUER, &issuerlen);
+  s = get_info_field (delta, FIELD_ISSUER, &n);
+  if (!issuer || !s || n != issuerlen || memcmp (issuer, s, n))
+    return gpg_error (GPG_ERR_CONFLICT);
+  err = get_number_field (base, FIELD_CRL_NUMBER, &a, &alen);
+  if (!err)
+    err = get_number_field (delta, FIELD_BASE_NUMBER, &b, &blen);
+  if (err)
+    return err;
+  if (compare_serials (a, alen, b, blen) < 0)
+    return gpg_error (GPG_ERR_CONFLICT);
+  err = get_number_field (delta, FIELD_CRL_NUMBER, &b, &blen);
+  if (err)
+    return err;
+  if (compare_serials (a, alen, b, blen) >= 0)
+    return gpg_error (GPG_ERR_CRL_TOO_OLD);
+
+  /* Allocate the image for the worst case and put the pool after the
+     largest possible entry table; it is moved down at the end.  */
+  maxentries = base->nentries + delta->nentries;
+  if (maxentries > ((0xffffffff - INDEX_HDRLEN - base->poollen
+                     - delta->poollen) / INDEX_ENTRYLEN))
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  err = _ksba_crl_index_new (&index);
+  if (err)
+    return err;
+  pooloff = INDEX_HDRLEN + maxentries * INDEX_ENTRYLEN;
+  index->image = xtrymalloc (pooloff + base->poollen + delta->poollen);
+  if (!index->image)
+    {
+      err = gpg_error_from_errno (errno);
+      goto leave;
+    }
+  p = index->image;
+  memset (p, 0, INDEX_HDRLEN);
+  memcpy (p, INDEX_MAGIC, 8);
+  put32 (p+8, INDEX_VERSION);
+  put32 (p+12, INDEX_HDRLEN);
+  put32 (p+20, INDEX_ENTRYLEN);
+  if (base->poollen)
+    memcpy (p + pooloff, base->pool, base->poollen);
+  poollen = base->poollen;
+
+  dst = p + INDEX_HDRLEN;
+  nresult = 0;
+  pos = 0;
+  for (i=0; i < delta->nentries; i++)
+    {
+      entry = delta->entries + i * delta->entrylen;
+      len = (entry[4] << 8) | entry[5];
+      off = get32 (entry);
+      if (off > delta->poollen || len > delta->poollen - off)
+        {
+          err = gpg_error (GPG_ERR_INV_OBJ);
+          goto leave;
+        }
+      s = delta->pool + off;
+
+      /* Only the last of several entries for the same serial number
+         counts.  */
+      if (i + 1 < delta->nentries)
+        {
+          err = compare_entry (entry + delta->entrylen,
+                               delta->pool, delta->poollen, s, len, &cmp);
+          if (err)
+            goto leave;
+          if (!cmp)
+            continue;
+        }
+
+      /* Find the first base entry not less than S.  */
+      lo = pos;
+      hi = base->nentries;
+      while (lo < hi)
+        {
+          mid = lo + (hi - lo) / 2;
+          err = compare_entry (base->entries + mid * base->entrylen,
+                               base->pool, base->poollen, s, len, &cmp);
+          if (err)
+            goto leave;
+          if (cmp > 0)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      /* Copy the base entries before it.  */
+      dst = copy_entries (dst, base, pos, lo - pos);
+      nresult += lo - pos;
+      pos = lo;
+
+      /* Skip the base entries replaced by this one.  */
+      while (pos < base->nentries)
+        {
+          err = compare_entry (base->entries + pos * base->entrylen,
+                               base->pool, base->poollen, s, len, &cmp);
+          if (err)
+            goto leave;
+          if (cmp)
+            break;
+          pos++;
+        }
+
+      if ((((entry[6] << 8) | entry[7]) & KSBA_CRLREASON_REMOVE_FROM_CRL))
+        continue;
+
+      memcpy (dst, entry, INDEX_ENTRYLEN);
+      put32 (dst, poollen);
+      put64 (dst+16, 0);
+      memcpy (p + pooloff + poollen, s, len);
+      poollen += len;
+      dst += INDEX_ENTRYLEN;
+      nresult++;
+    }
+  copy_entries (dst, base, pos, base->nentries - pos);
+  nresult += base->nentries - pos;
+
+  /* Move the pool behind the entries.  */
+  n = INDEX_HDRLEN + nresult * INDEX_ENTRYLEN;
+  memmove (p + n, p + pooloff, poollen);
+  put32 (p+16, nresult);
+  put32 (p+24, n);
+  put32 (p+28, poollen);
+  index->imagelen = n + poollen;
+  err = parse_image (index);
+  if (err)
+    goto leave;
+
+  /* The merged index describes the CRL which would have been issued
+     along with the delta CRL.  */
+  memset (&info, 0, sizeof info);
+  info.flags = INDEX_FLAG_MERGED;
+  info.this_update = (const char*)delta->image + 36;
+  info.next_update = (const char*)delta->image + 52;
+  info.fields[FIELD_ISSUER].data = issuer;
+  info.fields[FIELD_ISSUER].length = issuerlen;
+  info.fields[FIELD_CRL_NUMBER].data
+    = get_info_field (delta, FIELD_CRL_NUMBER,
+                      &info.fields[FIELD_CRL_NUMBER].length);
+  err = add_info (index, &info);
+
+ leave:
+  if (err)
+    ksba_crl_index_release (index);
+  else
+    *r_index = index;
+  return err;
+}
@@ -41,20 +41,29 @@
 #include "keyinfo.h"
 #include "der-encoder.h"
 #include "ber-help.h"
+#include "hasher.h"
+#include "reader.h"
 #include "ber-decoder.h"
 #include "crl.h"
 
 
 static const char oidstr_crlNumber[] = "2.5.29.20";
 static const char oidstr_crlReason[] = "2.5.29.21";
+static const char oidstr_deltaCRLIndicator[] = "2.5.29.27";
 static const char oidstr_issuingDistributionPoint[] = "2.5.29.28";
 static const char oidstr_certificateIssuer[] = "2.5.29.29";
 static const char oidstr_authorityKeyIdentifier[] = "2.5.29.35";
 
-/* We better buffer the hashing. */
+/* We better buffer the hashing.  A hasher object does its own
+   buffering. */
 static inline void
 do_hash (ksba_crl_t crl, const void *buffer, size_t length)
 {
+  if (crl->hasher)
+    {
+      ksba_hasher_write (crl->hasher, buffer, length);
+      return;
+    }
   while (length)
     {
       size_t n = length;
@@ -209,6 +218,7 @@ ksba_crl_release (ksba_crl_t crl)
   xfree (crl->issuer.image);
 
   xfree (crl->item.serial);
+  ksba_crl_index_release (crl->index);
 
   xfree (crl->sigval);
   while (crl->extension_list)
@@ -243,10 +253,25 @@ ksba_crl_set_hash_function (ksba_crl_t crl,
     {
       crl->hash_fnc = hash_fnc;
       crl->hash_fnc_arg = hash_fnc_arg;
+      crl->hasher = NULL;
     }
 }
 
 
+/* Pass the data to be hashed to the hash functions of HASHER.  See
+   ksba_cms_set_hasher.  */
+gpg_error_t
+ksba_crl_set_hasher (ksba_crl_t crl, ksba_hasher_t hasher)
+{
+  if (!crl)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  crl->hasher = hasher;
+  crl->hash_fnc = hasher? _ksba_hasher_hash_cb : NULL;
+  crl->hash_fnc_arg = hasher;
+  return 0;
+}
+
+
 
 /*
    access functions
@@ -497,11 +522,10 @@ ksba_crl_get_auth_key_id (ksba_crl_t crl,
 }
 
 
-/* Return the optional crlNumber in NUMBER or GPG_ERR_NO_DATA if it is
-   not available.  Caller must release NUMBER if the fuction retruned
-   with success. */
-gpg_error_t
-ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
+/* Return the integer value of the CRL extension OID in NUMBER or
+   GPG_ERR_NO_DATA if it is not available.  */
+static gpg_error_t
+get_number_extension (ksba_crl_t crl, const char *oid, ksba_sexp_t *number)
 {
   gpg_error_t err;
   size_t derlen;
@@ -516,7 +540,7 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
   *number = NULL;
 
   for (e=crl->extension_list; e; e = e->next)
-    if (!strcmp (e->oid, oidstr_crlNumber))
+    if (!strcmp (e->oid, oid))
       break;
   if (!e)
     return gpg_error (GPG_ERR_NO_DATA); /* not available */
@@ -526,7 +550,7 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
     crl_extn_t e2;
 
     for (e2 = e->next; e2; e2 = e2->next)
-      if (!strcmp (e2->oid, oidstr_crlNumber))
+      if (!strcmp (e2->oid, oid))
         return gpg_error (GPG_ERR_DUP_VALUE);
   }
 
@@ -551,6 +575,34 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
 }
 
 
+/* Return the optional crlNumber in NUMBER or GPG_ERR_NO_DATA if it is
+   not available.  Caller must release NUMBER if the fuction retruned
+   with success. */
+gpg_error_t
+ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
+{
+  return get_number_extension (crl, oidstr_crlNumber, number);
+}
+
+
+/**
+ * ksba_crl_get_delta_indicator:
+ * @crl: CRL object
+ * @r_number: Returns the number of the base CRL
+ *
+ * Return the CRL number of the base CRL from the deltaCRLIndicator
+ * extension of a delta CRL.  GPG_ERR_NO_DATA is returned if @crl is
+ * not a delta CRL.  The caller must release @r_number.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_get_delta_indicator (ksba_crl_t crl, ksba_sexp_t *r_number)
+{
+  return get_number_extension (crl, oidstr_deltaCRLIndicator, r_number);
+}
+
+
 
 
 /**
@@ -652,6 +704,62 @@ ksba_crl_get_sig_val (ksba_crl_t crl)
 }
 
 
+/**
+ * ksba_crl_start_index:
+ * @crl: CRL object
+ *
+ * Collect the entries of the CRL into an index instead of returning
+ * them one by one.  This function must be called before the first
+ * call to ksba_crl_parse, which will then not stop with
+ * %KSBA_SR_GOT_ITEM.  After %KSBA_SR_END_ITEMS has been returned the
+ * index can be retrieved using ksba_crl_get_index.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_start_index (ksba_crl_t crl)
+{
+  if (!crl)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (crl->any_parse_done || crl->index)
+    return gpg_error (GPG_ERR_CONFLICT);
+  return _ksba_crl_index_new (&crl->index);
+}
+
+
+/**
+ * ksba_crl_get_index:
+ * @crl: CRL object
+ * @r_index: Returns the index
+ *
+ * Return the index of the entries of the CRL requested by
+ * ksba_crl_start_index.  The caller takes ownership of the index and
+ * must release it using ksba_crl_index_release.  Note that the index
+ * is available as soon as %KSBA_SR_END_ITEMS has been returned; the
+ * signature of the CRL has not been checked at that point.  If the
+ * index is retrieved after %KSBA_SR_READY has been returned, it
+ * additionally carries the issuer, the update times, the CRL number
+ * and the signature of the CRL so that it can be used later without
+ * parsing the CRL again.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_crl_get_index (ksba_crl_t crl, ksba_crl_index_t *r_index)
+{
+  if (!crl || !r_index)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_index = NULL;
+  if (!crl->index)
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (!crl->index_ready)
+    return gpg_error (GPG_ERR_INV_STATE);
+  *r_index = crl->index;
+  crl->index = NULL;
+  return 0;
+}
+
+
 
 /*
   Parser functions
@@ -661,25 +769,27 @@ ksba_crl_get_sig_val (ksba_crl_t crl)
 static int
 read_byte (ksba_reader_t reader)
 {
-  unsigned char buf;
-  size_t nread;
-  int rc;
-
-  do
-    rc = ksba_reader_read (reader, &buf, 1, &nread);
-  while (!rc && !nread);
-  return rc? -1: buf;
+  return _ksba_reader_getc (reader);
 }
 
 /* read COUNT bytes into buffer.  Return 0 on success */
 static int
 read_buffer (ksba_reader_t reader, char *buffer, size_t count)
 {
+  const unsigned char *p;
   size_t nread;
 
   while (count)
     {
-      if (ksba_reader_read (reader, buffer, count, &nread))
+      p = _ksba_reader_window (reader, &nread);
+      if (nread)
+        {
+          if (nread > count)
+            nread = count;
+          memcpy (buffer, p, nread);
+          _ksba_reader_skip (reader, nread);
+        }
+      else if (ksba_reader_read (reader, buffer, count, &nread))
         return -1;
       buffer += nread;
       count -= nread;
@@ -698,7 +808,7 @@ create_and_run_decoder (ksba_reader_t reader, const char *elem_name,
   ksba_asn_tree_t crl_tree;
   BerDecoder decoder;
 
-  err = ksba_asn_create_tree ("tmttv2", &crl_tree);
+  err = _ksba_asn_get_shared_tree ("tmttv2", &crl_tree);
   if (err)
     return err;
 
@@ -857,6 +967,7 @@ parse_to_next_update (ksba_crl_t crl)
     return gpg_error (GPG_ERR_TOO_SHORT);
 
   /* read the tbs sequence */
+  crl->state.tbs_off = ksba_reader_tell (crl->reader) - crl->state.start_off;
   err = _ksba_ber_read_tl (crl->reader, &ti);
   if (err)
     return err;
@@ -1169,6 +1280,7 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
   unsigned char tmpbuf[4096]; /* for time, serial number and extensions */
   char numbuf[22];
   int numbuflen;
+  unsigned long extoff = 0;
 
   /* Check the length to see whether we are at the end of the seq but do
      this only when we know that we have this optional seq of seq. */
@@ -1219,16 +1331,25 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
     return err;
   HASH (tmpbuf, ti.nhdr+ti.length);
 
-  xfree (crl->item.serial);
-  sprintf (numbuf,"(%u:", (unsigned int)ti.length);
-  numbuflen = strlen (numbuf);
-  crl->item.serial = xtrymalloc (numbuflen + ti.length + 2);
-  if (!crl->item.serial)
-    return gpg_error (GPG_ERR_ENOMEM);
-  strcpy (crl->item.serial, numbuf);
-  memcpy (crl->item.serial+numbuflen, tmpbuf+ti.nhdr, ti.length);
-  crl->item.serial[numbuflen + ti.length] = ')';
-  crl->item.serial[numbuflen + ti.length + 1] = 0;
+  if (crl->index)
+    {
+      err = _ksba_crl_index_add (crl->index, tmpbuf+ti.nhdr, ti.length);
+      if (err)
+        return err;
+    }
+  else
+    {
+      xfree (crl->item.serial);
+      sprintf (numbuf,"(%u:", (unsigned int)ti.length);
+      numbuflen = strlen (numbuf);
+      crl->item.serial = xtrymalloc (numbuflen + ti.length + 2);
+      if (!crl->item.serial)
+        return gpg_error (GPG_ERR_ENOMEM);
+      strcpy (crl->item.serial, numbuf);
+      memcpy (crl->item.serial+numbuflen, tmpbuf+ti.nhdr, ti.length);
+      crl->item.serial[numbuflen + ti.length] = ')';
+      crl->item.serial[numbuflen + ti.length + 1] = 0;
+    }
   crl->item.reason = 0;
 
   /* get the revocation time */
@@ -1264,6 +1385,8 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
     return gpg_error (GPG_ERR_UNSUPPORTED_ENCODING);
   else if (len)
     {
+      extoff = ksba_reader_tell (crl->reader) - crl->state.start_off;
+
       /* read the outer sequence */
       err = _ksba_ber_read_tl (crl->reader, &ti);
       if (err)
@@ -1310,6 +1433,10 @@ parse_crl_entry (ksba_crl_t crl, int *got_entry)
         }
     }
 
+  if (crl->index)
+    _ksba_crl_index_set_item (crl->index, crl->item.revocation_date,
+                              crl->item.reason, extoff);
+
   /* read ahead */
   err = _ksba_ber_read_tl (crl->reader, &ti);
   if (err)
@@ -1500,10 +1627,23 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
   switch (state)
     {
     case sSTART:
+      crl->state.start_off = ksba_reader_tell (crl->reader);
       err = parse_to_next_update (crl);
       break;
     case sCRLENTRY:
-      err = parse_crl_entry (crl, &got_entry);
+      /* When building an index we do not stop after each entry.  */
+      do
+        {
+          got_entry = 0;
+          err = parse_crl_entry (crl, &got_entry);
+        }
+      while (!err && got_entry && crl->index);
+      if (!err && crl->index && !crl->index_ready)
+        {
+          err = _ksba_crl_index_finish (crl->index);
+          if (!err)
+            crl->index_ready = 1;
+        }
       break;
     case sCRLEXT:
       err = parse_crl_extensions (crl);
@@ -1513,8 +1653,13 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
             crl->hash_fnc (crl->hash_fnc_arg,
                            crl->hashbuf.buffer, crl->hashbuf.used);
           crl->hashbuf.used = 0;
+          ksba_hasher_flush (crl->hasher);
+          crl->state.tbs_end = (ksba_reader_tell (crl->reader)
+                                - crl->state.start_off - crl->state.ti.nhdr);
           err = parse_signature (crl);
         }
+      if (!err && crl->index)
+        err = _ksba_crl_index_set_info (crl->index, crl);
       break;
     default:
       err = gpg_error (GPG_ERR_INV_STATE);
@@ -56,12 +56,16 @@ struct ksba_crl_s {
 
   void (*hash_fnc)(void *, const void *, size_t);
   void *hash_fnc_arg;
+  ksba_hasher_t hasher;  /* Set by ksba_crl_set_hasher or NULL.  */
 
   struct {
     struct tag_info ti;
     unsigned long outer_len, tbs_len, seqseq_len;
     int outer_ndef, tbs_ndef, seqseq_ndef;
     int have_seqseq;
+    unsigned long start_off;  /* Reader offset of the CRL.  */
+    unsigned long tbs_off;    /* Offsets of the start and the end of */
+    unsigned long tbs_end;    /* the tbsCertList relative to START_OFF.  */
   } state;
 
   int crl_version;
@@ -87,6 +91,9 @@ struct ksba_crl_s {
   crl_extn_t extension_list;
   ksba_sexp_t sigval;
 
+  ksba_crl_index_t index;  /* The index being built or NULL.  */
+  int index_ready;         /* The index has been completed.  */
+
   struct {
     int used;
     char buffer[8192];
@@ -95,7 +102,16 @@ struct ksba_crl_s {
 };
 
 
-/*-- crl.c --*/
+/*-- crl-index.c --*/
+gpg_error_t _ksba_crl_index_new (ksba_crl_index_t *r_index);
+gpg_error_t _ksba_crl_index_add (ksba_crl_index_t index,
+                                 const unsigned char *serial,
+                                 size_t seriallen);
+void _ksba_crl_index_set_item (ksba_crl_index_t index, const char *rdate,
+                               ksba_crl_reason_t reason,
+                               unsigned long extoff);
+gpg_error_t _ksba_crl_index_finish (ksba_crl_index_t index);
+gpg_error_t _ksba_crl_index_set_info (ksba_crl_index_t index, ksba_crl_t crl);
 
 
 #endif /*CRL_H*/
@@ -0,0 +1,501 @@
+/* der-builder.c - Two-pass DER builder
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The builder collects the elements of a DER object in a flat list
+   of items.  Constructed elements are opened with _ksba_der_add_tag
+   and closed with _ksba_der_add_end.  The lengths of all elements are
+   computed in one pass over the list; a second pass writes the
+   complete encoding to a buffer of the exact size or to a writer.
+   Errors are recorded in the builder and returned by the final get
+   or write so that callers do not need to check each add call.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "ksba.h"
+#include "asn1-func.h"
+#include "der-builder.h"
+
+/* The maximum nesting of constructed elements.  */
+#define MAX_DEPTH 32
+
+/* Values up to this length are copied to the staging buffer by
+   _ksba_der_builder_write; larger ones are written directly.  */
+#define SMALL_VALUE 64
+
+struct der_item_s
+{
+  const void *value;
+  size_t len;         /* Length of VALUE or, for a constructed element,
+                         the computed length of its content.  */
+  unsigned char class;
+  unsigned char tag;
+  unsigned int constructed:1; /* Started by _ksba_der_add_tag.  */
+  unsigned int end:1;         /* Added by _ksba_der_add_end.  */
+  unsigned int verbatim:1;    /* VALUE is already DER encoded.  */
+  unsigned int owned:1;       /* VALUE is to be released.  */
+};
+
+struct der_builder_s
+{
+  gpg_error_t error;        /* The first error or 0.  */
+  unsigned int nitems;      /* Number of used items.  */
+  unsigned int nallocated;  /* Number of allocated items.  */
+  struct der_item_s *items;
+};
+
+
+/* The largest length we can encode.  */
+#define MAX_LENGTH 0xffffffffUL
+
+
+/* Return the number of bytes required for a low tag number and a
+   definite length of LENGTH, which may not be larger than
+   MAX_LENGTH.  */
+size_t
+_ksba_der_count_tl (size_t length)
+{
+  return (length < 0x80? 2 :
+          length <= 0xff? 3 :
+          length <= 0xffff? 4 :
+          length <= 0xffffff? 5 : 6);
+}
+
+
+/* Write the low tag number TAG of CLASS and the definite LENGTH to P
+   and return the pointer behind it.  P must have room for
+   _ksba_der_count_tl (LENGTH) bytes.  Other than _ksba_ber_encode_tl
+   this function encodes a length of zero as such.  */
+unsigned char *
+_ksba_der_put_tl (unsigned char *p, int tag, int class, int constructed,
+                  size_t length)
+{
+  int i;
+
+  *p++ = (class << 6) | (constructed? 0x20:0) | tag;
+  if (length < 0x80)
+    *p++ = length;
+  else
+    {
+      i = _ksba_der_count_tl (length) - 2;
+      *p++ = 0x80 | i;
+      while (i--)
+        *p++ = length >> (8 * i);
+    }
+  return p;
+}
+
+
+/* Write the header of ITEM to P and return the pointer behind it.  */
+static unsigned char *
+put_tl (unsigned char *p, const struct der_item_s *item)
+{
+  return _ksba_der_put_tl (p, item->tag, item->class, item->constructed,
+                           item->len);
+}
+
+
+/* Create a new builder with an initial room for NITEMS items; 0
+   selects a default.  The list grows as needed.  Returns NULL if we
+   are out of core.  */
+DerBuilder
+_ksba_der_builder_new (unsigned int nitems)
+{
+  DerBuilder d;
+
+  d = xtrycalloc (1, sizeof *d);
+  if (!d)
+    return NULL;
+  d->nallocated = nitems? nitems : 32;
+  d->items = xtrycalloc (d->nallocated, sizeof *d->items);
+  if (!d->items)
+    {
+      xfree (d);
+      return NULL;
+    }
+  return d;
+}
+
+
+/* Release all values owned by D and clear the list of items.  */
+void
+_ksba_der_builder_reset (DerBuilder d)
+{
+  unsigned int i;
+
+  if (!d)
+    return;
+  for (i=0; i < d->nitems; i++)
+    if (d->items[i].owned)
+      xfree ((void*)d->items[i].value);
+  d->nitems = 0;
+  d->error = 0;
+}
+
+
+void
+_ksba_der_builder_release (DerBuilder d)
+{
+  if (!d)
+    return;
+  _ksba_der_builder_reset (d);
+  xfree (d->items);
+  xfree (d);
+}
+
+
+/* Return a new item of D or NULL on error.  */
+static struct der_item_s *
+new_item (DerBuilder d)
+{
+  struct der_item_s *item;
+
+  if (d->error)
+    return NULL;
+  if (d->nitems == d->nallocated)
+    {
+      item = xtryrealloc (d->items, 2 * d->nallocated * sizeof *item);
+      if (!item)
+        {
+          d->error = gpg_error_from_syserror ();
+          return NULL;
+        }
+      d->items = item;
+      d->nallocated *= 2;
+    }
+  item = d->items + d->nitems++;
+  memset (item, 0, sizeof *item);
+  return item;
+}
+
+
+/* Set CLASS and TAG of ITEM.  */
+static void
+set_tag (DerBuilder d, struct der_item_s *item, int class, int tag)
+{
+  if (tag < 0 || tag >= 0x1f)
+    {
+      d->error = gpg_error (GPG_ERR_NOT_SUPPORTED);
+      return;
+    }
+  item->class = class;
+  item->tag = tag;
+}
+
+
+/* Add a primitive element with CLASS and TAG and the value VALUE of
+   length VALUELEN to D.  VALUE is not copied and must be valid until
+   D has been written.  */
+void
+_ksba_der_add_ptr (DerBuilder d, int class, int tag,
+                   const void *value, size_t valuelen)
+{
+  struct der_item_s *item;
+
+  if (!(item = new_item (d)))
+    return;
+  set_tag (d, item, class, tag);
+  item->value = value;
+  item->len = valuelen;
+}
+
+
+/* Same as _ksba_der_add_ptr but VALUE is copied.  */
+void
+_ksba_der_add_val (DerBuilder d, int class, int tag,
+                   const void *value, size_t valuelen)
+{
+  struct der_item_s *item;
+  void *p;
+
+  if (!(item = new_item (d)))
+    return;
+  set_tag (d, item, class, tag);
+  if (valuelen)
+    {
+      p = xtrymalloc (valuelen);
+      if (!p)
+        {
+          d->error = gpg_error_from_syserror ();
+          d->nitems--;
+          return;
+        }
+      memcpy (p, value, valuelen);
+      item->value = p;
+      item->owned = 1;
+    }
+  item->len = valuelen;
+}
+
+
+/* Add the OBJECT IDENTIFIER OIDSTR given in dotted form to D.  */
+void
+_ksba_der_add_oid (DerBuilder d, const char *oidstr)
+{
+  struct der_item_s *item;
+  unsigned char *buf;
+  size_t len;
+  gpg_error_t err;
+
+  if (!(item = new_item (d)))
+    return;
+  err = ksba_oid_from_str (oidstr, &buf, &len);
+  if (err)
+    {
+      d->error = err;
+      d->nitems--;
+      return;
+    }
+  set_tag (d, item, CLASS_UNIVERSAL, TYPE_OBJECT_ID);
+  item->value = buf;
+  item->len = len;
+  item->owned = 1;
+}
+
+
+/* Add the already DER encoded element DER of length DERLEN to D.  DER
+   is not copied and must be valid until D has been written.  */
+void
+_ksba_der_add_der (DerBuilder d, const void *der, size_t derlen)
+{
+  struct der_item_s *item;
+
+  if (!(item = new_item (d)))
+    return;
+  item->value = der;
+  item->len = derlen;
+  item->verbatim = 1;
+}
+
+
+/* Same as _ksba_der_add_der but D takes over the allocated buffer
+   DER.  It is released even if an error occurs.  */
+void
+_ksba_der_take_der (DerBuilder d, void *der, size_t derlen)
+{
+  struct der_item_s *item;
+
+  if (!(item = new_item (d)))
+    {
+      xfree (der);
+      return;
+    }
+  item->value = der;
+  item->len = derlen;
+  item->verbatim = 1;
+  item->owned = 1;
+}
+
+
+/* Start a constructed element with CLASS and TAG.  All elements up to
+   the matching _ksba_der_add_end are its content.  */
+void
+_ksba_der_add_tag (DerBuilder d, int class, int tag)
+{
+  struct der_item_s *item;
+
+  if (!(item = new_item (d)))
+    return;
+  set_tag (d, item, class, tag);
+  item->constructed = 1;
+}
+
+
+/* Close the last constructed element.  */
+void
+_ksba_der_add_end (DerBuilder d)
+{
+  struct der_item_s *item;
+
+  if (!(item = new_item (d)))
+    return;
+  item->end = 1;
+}
+
+
+/* Compute the length of all constructed elements of D and store the
+   length of the entire encoding at R_LENGTH.  */
+static gpg_error_t
+compute_lengths (DerBuilder d, size_t *r_length)
+{
+  struct der_item_s *item;
+  unsigned int i, stack[MAX_DEPTH];
+  int depth = 0;
+  size_t n, total = 0;
+
+  if (d->error)
+    return d->error;
+  if (!d->nitems)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  for (i=0; i < d->nitems; i++)
+    {
+      item = d->items + i;
+      if (item->constructed)
+        {
+          if (depth == MAX_DEPTH)
+            return gpg_error (GPG_ERR_TOO_LARGE);
+          item->len = 0;
+          stack[depth++] = i;
+          continue;
+        }
+      else if (item->end)
+        {
+          if (!depth)
+            return gpg_error (GPG_ERR_INV_STATE);
+          item = d->items + stack[--depth];
+          if (item->len > MAX_LENGTH)
+            return gpg_error (GPG_ERR_TOO_LARGE);
+          n = _ksba_der_count_tl (item->len) + item->len;
+        }
+      else if (item->verbatim)
+        n = item->len;
+      else
+        {
+          if (item->len > MAX_LENGTH)
+            return gpg_error (GPG_ERR_TOO_LARGE);
+          n = _ksba_der_count_tl (item->len) + item->len;
+        }
+
+      if (depth)
+        d->items[stack[depth-1]].len += n;
+      else
+        total += n;
+    }
+  if (depth)
+    return gpg_error (GPG_ERR_INV_STATE);  /* Missing end.  */
+
+  *r_length = total;
+  return 0;
+}
+
+
+/* Return the DER encoding of all elements added to D in a newly
+   allocated buffer at R_OBJ and its length at R_OBJLEN.  D may be
+   reused after a call to _ksba_der_builder_reset.  */
+gpg_error_t
+_ksba_der_builder_get (DerBuilder d, unsigned char **r_obj, size_t *r_objlen)
+{
+  gpg_error_t err;
+  struct der_item_s *item;
+  unsigned char *buffer, *p;
+  size_t length;
+  unsigned int i;
+
+  *r_obj = NULL;
+  *r_objlen = 0;
+  err = compute_lengths (d, &length);
+  if (err)
+    return err;
+
+  buffer = xtrymalloc (length);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  for (p=buffer, i=0; i < d->nitems; i++)
+    {
+      item = d->items + i;
+      if (item->end)
+        continue;
+      if (!item->verbatim)
+        p = put_tl (p, item);
+      if (!item->constructed && item->len)
+        {
+          memcpy (p, item->value, item->len);
+          p += item->len;
+        }
+    }
+  assert ((size_t)(p - buffer) == length);
+
+  *r_obj = buffer;
+  *r_objlen = length;
+  return 0;
+}
+
+
+/* Write the DER encoding of all elements added to D to the writer W.
+   Headers and small values are collected in a buffer so that the
+   writer sees only a few calls; large values are written directly
+   without copying them.  */
+gpg_error_t
+_ksba_der_builder_write (DerBuilder d, ksba_writer_t w)
+{
+  gpg_error_t err;
+  struct der_item_s *item;
+  unsigned char buffer[512], *p;
+  size_t length;
+  unsigned int i;
+
+  err = compute_lengths (d, &length);
+  if (err)
+    return err;
+
+  for (p=buffer, i=0; i < d->nitems; i++)
+    {
+      item = d->items + i;
+      if (item->end)
+        continue;
+      if ((size_t)(p - buffer) > sizeof buffer - 6 - SMALL_VALUE)
+        {
+          err = ksba_writer_write (w, buffer, p - buffer);
+          if (err)
+            return err;
+          p = buffer;
+        }
+      if (!item->verbatim)
+        p = put_tl (p, item);
+      if (item->constructed || !item->len)
+        ;
+      else if (item->len <= SMALL_VALUE)
+        {
+          memcpy (p, item->value, item->len);
+          p += item->len;
+        }
+      else
+        {
+          if (p > buffer)
+            {
+              err = ksba_writer_write (w, buffer, p - buffer);
+              if (err)
+                return err;
+              p = buffer;
+            }
+          err = ksba_writer_write (w, item->value, item->len);
+          if (err)
+            return err;
+        }
+    }
+  if (p > buffer)
+    err = ksba_writer_write (w, buffer, p - buffer);
+  return err;
+}
@@ -0,0 +1,69 @@
+/* der-builder.h - Definitions for the two-pass DER builder
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DER_BUILDER_H
+#define DER_BUILDER_H 1
+
+struct der_builder_s;
+typedef struct der_builder_s *DerBuilder;
+
+/* The functions marked as visible are used by the regression
+   tests.  */
+DerBuilder  _ksba_der_builder_new (unsigned int nitems)
+     _KSBA_VISIBILITY_DEFAULT;
+void        _ksba_der_builder_release (DerBuilder d)
+     _KSBA_VISIBILITY_DEFAULT;
+void        _ksba_der_builder_reset (DerBuilder d);
+
+void _ksba_der_add_ptr (DerBuilder d, int class, int tag,
+                        const void *value, size_t valuelen)
+     _KSBA_VISIBILITY_DEFAULT;
+void _ksba_der_add_val (DerBuilder d, int class, int tag,
+                        const void *value, size_t valuelen);
+void _ksba_der_add_oid (DerBuilder d, const char *oidstr);
+void _ksba_der_add_der (DerBuilder d, const void *der, size_t derlen);
+void _ksba_der_take_der (DerBuilder d, void *der, size_t derlen);
+void _ksba_der_add_tag (DerBuilder d, int class, int tag)
+     _KSBA_VISIBILITY_DEFAULT;
+void _ksba_der_add_end (DerBuilder d)
+     _KSBA_VISIBILITY_DEFAULT;
+
+size_t _ksba_der_count_tl (size_t length);
+unsigned char *_ksba_der_put_tl (unsigned char *p, int tag, int class,
+                                 int constructed, size_t length);
+
+gpg_error_t _ksba_der_builder_get (DerBuilder d,
+                                   unsigned char **r_obj, size_t *r_objlen)
+     _KSBA_VISIBILITY_DEFAULT;
+gpg_error_t _ksba_der_builder_write (DerBuilder d, ksba_writer_t w)
+     _KSBA_VISIBILITY_DEFAULT;
+
+
+#endif /*DER_BUILDER_H*/
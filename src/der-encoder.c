@@ -242,6 +242,61 @@ _ksba_der_copy_tree (AsnNode dst_root,
 }
 
 
+/* Same as _ksba_der_copy_tree but the source is the value SRC of the
+   compact tree SRCTREE.  A source subtree without any values clears
+   all values of the corresponding subtree of DST.  */
+gpg_error_t
+_ksba_der_copy_value_tree (AsnNode dst_root, AsnVTree srctree,
+                           AsnValue src, const unsigned char *src_image)
+{
+  AsnValue s, s_end;
+  AsnNode d, d2, dlast = NULL;
+
+  if (!srctree || !srctree->schema)
+    return gpg_error (GPG_ERR_BUG);
+
+  s = src;
+  s_end = src? src + src->size : NULL;
+  d = dst_root;
+  while (s && s < s_end && d && (s->type == d->type || d->flags.is_any))
+    {
+      if (d->flags.is_any)
+        d->type = s->type;
+
+      if (srctree->schema[s->snode].flags.in_array && s->right)
+        {
+          if (!_ksba_asn_insert_copy (d))
+            return gpg_error (GPG_ERR_ENOMEM);
+        }
+
+      if ( !_ksba_asn_is_primitive (s->type) )
+        ;
+      else if (s->off == -1)
+        clear_value (d);
+      else
+        store_value (d, src_image + s->off + s->nhdr, s->len);
+
+      if (s->off == -1 && s->size == 1 && d->down)
+        { /* Collapsed subtree; clear and skip the destination.  */
+          for (d2 = d->down; d2; d2 = _ksba_asn_walk_tree (d, d2))
+            {
+              if (_ksba_asn_is_primitive (d2->type))
+                clear_value (d2);
+              dlast = d2;
+            }
+          d = dlast;
+        }
+
+      s++;
+      d = _ksba_asn_walk_tree (dst_root, d);
+    }
+
+  if ((s && s < s_end) || d)
+    return gpg_error (GPG_ERR_ENCODING_PROBLEM);
+  return 0;
+}
+
+
 
 /*********************************************
  ********** Store data in a tree *************
@@ -554,21 +609,14 @@ _ksba_der_encode_tree (AsnNode root,
   unsigned char *image;
   size_t imagelen, len;
 
-  /* clear out all fields */
+  /* Clear out all fields and calculate the length of the headers.
+     These are the tag and length fields of all primitive elements.
+     Both is done in one walk over the tree.  */
   for (n=root; n ; n = _ksba_asn_walk_tree (root, n))
     {
       n->off = -1;
       n->len = 0;
       n->nhdr = 0;
-    }
-
-  /* Set default values */
-  /* FIXME */
-
-  /* calculate the length of the headers.  These are the tag and
-     length fields of all primitive elements */
-  for (n=root; n ; n = _ksba_asn_walk_tree (root, n))
-    {
       if (_ksba_asn_is_primitive (n->type)
           && !n->flags.is_implicit
           && ((n->valuetype == VALTYPE_MEM && n->value.v_mem.len)
@@ -576,6 +624,9 @@ _ksba_der_encode_tree (AsnNode root,
         set_nhdr_and_len (n, n->value.v_mem.len);
     }
 
+  /* Set default values */
+  /* FIXME */
+
   /* Now calculate the length of all constructed types */
   imagelen = sum_up_lengths (root);
 
@@ -52,6 +52,9 @@ gpg_error_t _ksba_der_write_algorithm_identifier (
 
 gpg_error_t _ksba_der_copy_tree (AsnNode dst,
                                AsnNode src, const unsigned char *srcimage);
+gpg_error_t _ksba_der_copy_value_tree (AsnNode dst, AsnVTree srctree,
+                                      AsnValue src,
+                                      const unsigned char *srcimage);
 
 
 
@@ -538,27 +538,56 @@ append_ucs2_value (const unsigned char *value, size_t length,
 }
 
 
-/* Append attribute and value.  ROOT is the sequence */
+/* Parse the next TLV of BUFFER with LENGTH bytes.  On success the
+   buffer and length are advanced to the value and TI describes it;
+   the value is then available with TI->LENGTH bytes.  */
 static gpg_error_t
-append_atv (const unsigned char *image, AsnNode root, struct stringbuf *sb)
+parse_tlv (const unsigned char **buffer, size_t *length, struct tag_info *ti)
 {
-  AsnNode node = root->down;
+  gpg_error_t err;
+
+  err = _ksba_ber_parse_tl (buffer, length, ti);
+  if (err)
+    return err;
+  if (ti->ndef)
+    return gpg_error (GPG_ERR_UNSUPPORTED_ENCODING);
+  if (ti->length > *length)
+    return gpg_error (GPG_ERR_BAD_BER);
+  return 0;
+}
+
+
+/* Append attribute and value.  DER is the content of the
+   AttributeTypeAndValue sequence with DERLEN bytes.  */
+static gpg_error_t
+append_atv (const unsigned char *der, size_t derlen, struct stringbuf *sb)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *oid;
+  size_t oidlen;
   const char *name;
   int use_hex = 0;
+  int type;
   int i;
 
-  if (!node || node->type != TYPE_OBJECT_ID)
+  err = parse_tlv (&der, &derlen, &ti);
+  if (err)
+    return err;
+  if (!(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID
+        && !ti.is_constructed))
     return gpg_error (GPG_ERR_UNEXPECTED_TAG);
-  if (node->off == -1)
-    return gpg_error (GPG_ERR_NO_VALUE); /* Hmmm, this might lead to misunderstandings */
+  oid = der;
+  oidlen = ti.length;
+  der += oidlen;
+  derlen -= oidlen;
 
   name = NULL;
   for (i=0; oid_name_tbl[i].name; i++)
     {
       if (oid_name_tbl[i].source == 1
-          && node->len == oid_name_tbl[i].oidlen
-          && !memcmp (image+node->off+node->nhdr,
-                      oid_name_tbl[i].oid, node->len))
+          && oidlen == oid_name_tbl[i].oidlen
+          && !memcmp (oid, oid_name_tbl[i].oid, oidlen))
         {
           name = oid_name_tbl[i].name;
           break;
@@ -572,7 +601,7 @@ append_atv (const unsigned char *image, AsnNode root, struct stringbuf *sb)
          again and use the string as last resort.  */
       char *p;
 
-      p = ksba_oid_to_str (image+node->off+node->nhdr, node->len);
+      p = ksba_oid_to_str (oid, oidlen);
       if (!p)
         return gpg_error (GPG_ERR_ENOMEM);
 
@@ -595,37 +624,45 @@ append_atv (const unsigned char *image, AsnNode root, struct stringbuf *sb)
       xfree (p);
     }
   put_stringbuf (sb, "=");
-  node = node->right;
-  if (!node || node->off == -1)
+  if (!derlen)
     return gpg_error (GPG_ERR_NO_VALUE);
+  err = parse_tlv (&der, &derlen, &ti);
+  if (err)
+    return err;
 
-  switch (use_hex? 0 : node->type)
+  /* The tag numbers of the universal string types are the same as
+     our type constants.  */
+  if (use_hex || ti.class != CLASS_UNIVERSAL || ti.is_constructed)
+    type = 0;
+  else
+    type = ti.tag;
+  switch (type)
     {
     case TYPE_UTF8_STRING:
-      append_utf8_value (image+node->off+node->nhdr, node->len, sb);
+      append_utf8_value (der, ti.length, sb);
       break;
     case TYPE_PRINTABLE_STRING:
     case TYPE_IA5_STRING:
       /* we assume that wrong encodings are latin-1 */
     case TYPE_TELETEX_STRING: /* Not correct, but mostly used as latin-1 */
-      append_latin1_value (image+node->off+node->nhdr, node->len, sb);
+      append_latin1_value (der, ti.length, sb);
       break;
 
     case TYPE_UNIVERSAL_STRING:
-      append_ucs4_value (image+node->off+node->nhdr, node->len, sb);
+      append_ucs4_value (der, ti.length, sb);
       break;
 
     case TYPE_BMP_STRING:
-      append_ucs2_value (image+node->off+node->nhdr, node->len, sb);
+      append_ucs2_value (der, ti.length, sb);
       break;
 
     case 0: /* forced usage of hex */
     default:
       put_stringbuf (sb, "#");
-      for (i=0; i < node->len; i++)
+      for (i=0; i < ti.length; i++)
         {
           char tmp[3];
-          snprintf (tmp, sizeof tmp, "%02X", image[node->off+node->nhdr+i]);
+          snprintf (tmp, sizeof tmp, "%02X", der[i]);
           put_stringbuf (sb, tmp);
         }
       break;
@@ -634,62 +671,89 @@ append_atv (const unsigned char *image, AsnNode root, struct stringbuf *sb)
   return 0;
 }
 
+
+/* Convert the RDNSequence DER with DERLEN bytes.  DER is the content
+   of the sequence; the encoding is walked directly so that no tree is
+   required.  */
 static gpg_error_t
-dn_to_str (const unsigned char *image, AsnNode root, struct stringbuf *sb)
+dn_to_str (const unsigned char *der, size_t derlen, struct stringbuf *sb)
 {
-  gpg_error_t err;
-  AsnNode nset;
-
-  if (!root )
-    return 0; /* empty DN */
-  nset = root->down;
-  if (!nset)
-    return 0; /* consider this as empty */
-  if (nset->type != TYPE_SET_OF)
-    return gpg_error (GPG_ERR_UNEXPECTED_TAG);
-
-  /* output in reverse order */
-  while (nset->right)
-    nset = nset->right;
-
-  for (;;)
+  gpg_error_t err = 0;
+  struct tag_info ti;
+  const unsigned char *p, *rdn;
+  size_t n, rdnlen;
+  struct {
+    const unsigned char *der;
+    size_t len;
+  } fixedbuf[32], *rdns;
+  int count, i;
+
+  /* Collect the RDNs so that we can output them in reverse order.  */
+  for (count=0, p = der, n = derlen; n; count++)
     {
-      AsnNode nseq;
-
-      if (nset->type != TYPE_SET_OF)
+      err = parse_tlv (&p, &n, &ti);
+      if (err)
+        return err;
+      if (!(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SET
+            && ti.is_constructed))
         return gpg_error (GPG_ERR_UNEXPECTED_TAG);
-      for (nseq = nset->down; nseq; nseq = nseq->right)
+      p += ti.length;
+      n -= ti.length;
+    }
+  if (count <= DIM (fixedbuf))
+    rdns = fixedbuf;
+  else if (!(rdns = xtrymalloc (count * sizeof *rdns)))
+    return gpg_error_from_syserror ();
+  for (i=0, p = der, n = derlen; i < count; i++)
+    {
+      parse_tlv (&p, &n, &ti);
+      rdns[i].der = p;
+      rdns[i].len = ti.length;
+      p += ti.length;
+      n -= ti.length;
+    }
+
+  while (!err && count--)
+    {
+      rdn = rdns[count].der;
+      rdnlen = rdns[count].len;
+      for (i=0; rdnlen && !err; i++)
         {
-          if (nseq->type != TYPE_SEQUENCE)
-            return gpg_error (GPG_ERR_UNEXPECTED_TAG);
-          if (nseq != nset->down)
-            put_stringbuf (sb, "+");
-          err = append_atv (image, nseq, sb);
+          err = parse_tlv (&rdn, &rdnlen, &ti);
           if (err)
-            return err;
+            break;
+          if (!(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_SEQUENCE
+                && ti.is_constructed))
+            {
+              err = gpg_error (GPG_ERR_UNEXPECTED_TAG);
+              break;
+            }
+          if (i)
+            put_stringbuf (sb, "+");
+          err = append_atv (rdn, ti.length, sb);
+          rdn += ti.length;
+          rdnlen -= ti.length;
         }
-      if (nset == root->down)
-        break;
-      put_stringbuf (sb, ",");
-      nset = nset->left;
+      if (!err && count)
+        put_stringbuf (sb, ",");
     }
 
-  return 0;
+  if (rdns != fixedbuf)
+    xfree (rdns);
+  return err;
 }
 
 
-gpg_error_t
-_ksba_dn_to_str (const unsigned char *image, AsnNode node, char **r_string)
+/* Convert the DN at DER with DERLEN bytes into a string and store it
+   at R_STRING.  DER is the content of the RDNSequence.  */
+static gpg_error_t
+der_dn_to_str (const unsigned char *der, size_t derlen, char **r_string)
 {
   gpg_error_t err;
   struct stringbuf sb;
 
-  *r_string = NULL;
-  if (!node || node->type != TYPE_SEQUENCE_OF)
-    return gpg_error (GPG_ERR_INV_VALUE);
-
   init_stringbuf (&sb, 100);
-  err = dn_to_str (image, node, &sb);
+  err = dn_to_str (der, derlen, &sb);
   if (!err)
     {
       *r_string = get_stringbuf (&sb);
@@ -701,7 +765,36 @@ _ksba_dn_to_str (const unsigned char *image, AsnNode node, char **r_string)
   return err;
 }
 
-
+
+/* Convert the DN at VALUE of IMAGE into a string and store it at
+   R_STRING.  */
+gpg_error_t
+_ksba_dn_value_to_str (const unsigned char *image, AsnValue value,
+                       char **r_string)
+{
+  *r_string = NULL;
+  if (!value || value->type != TYPE_SEQUENCE_OF)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (value->off == -1)
+    return der_dn_to_str (NULL, 0, r_string);
+  return der_dn_to_str (image + value->off + value->nhdr, value->len,
+                        r_string);
+}
+
+
+/* Same as _ksba_dn_value_to_str but for a NODE of a decoded tree.  */
+gpg_error_t
+_ksba_dn_to_str (const unsigned char *image, AsnNode node, char **r_string)
+{
+  *r_string = NULL;
+  if (!node || node->type != TYPE_SEQUENCE_OF)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (node->off == -1)
+    return der_dn_to_str (NULL, 0, r_string);
+  return der_dn_to_str (image + node->off + node->nhdr, node->len, r_string);
+}
+
+
 /* Create a new decoder and run it for the given element */
 /* Fixme: this code is duplicated from cms-parser.c */
 static gpg_error_t
@@ -713,7 +806,7 @@ create_and_run_decoder (ksba_reader_t reader, const char *elem_name,
   ksba_asn_tree_t crl_tree;
   BerDecoder decoder;
 
-  err = ksba_asn_create_tree ("tmttv2", &crl_tree);
+  err = _ksba_asn_get_shared_tree ("tmttv2", &crl_tree);
   if (err)
     return err;
 
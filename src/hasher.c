@@ -0,0 +1,218 @@
+/* hasher.c - Sets of incremental hash functions
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A hasher object passes the data to be hashed to one or more hash
+   functions, for example to compute a SHA-256 and a GOST R 34.11-2012
+   digest in one pass over a signed object.  Small updates are
+   collected in a buffer so that the hash functions are not called
+   for each of the many small parts of a DER encoding.  The hash
+   functions are not owned by the hasher; the caller initializes and
+   finalizes its hash contexts and needs to flush the hasher before
+   finalizing them.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "util.h"
+#include "hasher.h"
+
+/* The default size of the buffer used to coalesce small updates.  */
+#define DEFAULT_BUFSIZE 4096
+
+
+/* Pass LENGTH bytes from BUFFER to all hash functions of HASHER.  */
+static void
+call_fncs (ksba_hasher_t hasher, const void *buffer, size_t length)
+{
+  int i;
+
+  for (i=0; i < hasher->nfncs; i++)
+    hasher->fncs[i].fnc (hasher->fncs[i].arg, buffer, length);
+}
+
+
+/* Create a new hasher object and return it at R_HASHER.  The object
+   has no hash functions yet.  */
+gpg_error_t
+ksba_hasher_new (ksba_hasher_t *r_hasher)
+{
+  ksba_hasher_t hasher;
+
+  *r_hasher = NULL;
+  hasher = xtrycalloc (1, sizeof *hasher);
+  if (!hasher)
+    return gpg_error_from_syserror ();
+  hasher->buffer = xtrymalloc (DEFAULT_BUFSIZE);
+  if (!hasher->buffer)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      xfree (hasher);
+      return err;
+    }
+  hasher->bufsize = DEFAULT_BUFSIZE;
+  *r_hasher = hasher;
+  return 0;
+}
+
+
+/* Release HASHER.  Pending data is not hashed.  */
+void
+ksba_hasher_release (ksba_hasher_t hasher)
+{
+  if (!hasher)
+    return;
+  xfree (hasher->fncs);
+  xfree (hasher->buffer);
+  xfree (hasher);
+}
+
+
+/* Add the hash function HASH_FNC with its first argument HASH_FNC_ARG
+   to HASHER.  All data is passed to all hash functions in the order
+   they have been added.  */
+gpg_error_t
+ksba_hasher_add (ksba_hasher_t hasher,
+                 void (*hash_fnc)(void *, const void *, size_t),
+                 void *hash_fnc_arg)
+{
+  if (!hasher || !hash_fnc)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (hasher->used)
+    return gpg_error (GPG_ERR_INV_STATE);
+
+  if (hasher->nfncs == hasher->fncssize)
+    {
+      struct hasher_fnc_s *tmp;
+      int newsize = hasher->fncssize? 2 * hasher->fncssize : 4;
+
+      tmp = xtryrealloc (hasher->fncs, newsize * sizeof *tmp);
+      if (!tmp)
+        return gpg_error_from_syserror ();
+      hasher->fncs = tmp;
+      hasher->fncssize = newsize;
+    }
+  hasher->fncs[hasher->nfncs].fnc = hash_fnc;
+  hasher->fncs[hasher->nfncs].arg = hash_fnc_arg;
+  hasher->nfncs++;
+  return 0;
+}
+
+
+/* Set the size of the buffer used to coalesce small updates to SIZE.
+   A SIZE of 0 disables the buffering.  Pending data is flushed
+   first.  */
+gpg_error_t
+ksba_hasher_set_buffer_size (ksba_hasher_t hasher, size_t size)
+{
+  unsigned char *buffer = NULL;
+
+  if (!hasher)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (size > 16*1024*1024)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  ksba_hasher_flush (hasher);
+  if (size != hasher->bufsize)
+    {
+      if (size)
+        {
+          buffer = xtrymalloc (size);
+          if (!buffer)
+            return gpg_error_from_syserror ();
+        }
+      xfree (hasher->buffer);
+      hasher->buffer = buffer;
+      hasher->bufsize = size;
+    }
+  return 0;
+}
+
+
+/* Hash LENGTH bytes from BUFFER.  Data which fits into the buffer is
+   only copied; larger parts are passed directly to the hash
+   functions.  */
+void
+ksba_hasher_write (ksba_hasher_t hasher, const void *buffer, size_t length)
+{
+  if (!hasher || !length)
+    return;
+
+  if (hasher->used + length <= hasher->bufsize)
+    {
+      memcpy (hasher->buffer + hasher->used, buffer, length);
+      hasher->used += length;
+      if (hasher->used == hasher->bufsize)
+        ksba_hasher_flush (hasher);
+      return;
+    }
+
+  ksba_hasher_flush (hasher);
+  if (length < hasher->bufsize)
+    {
+      memcpy (hasher->buffer, buffer, length);
+      hasher->used = length;
+    }
+  else
+    call_fncs (hasher, buffer, length);
+}
+
+
+/* Pass all pending data of HASHER to the hash functions.  This must
+   be called before the hash contexts are finalized.  */
+void
+ksba_hasher_flush (ksba_hasher_t hasher)
+{
+  if (!hasher || !hasher->used)
+    return;
+  call_fncs (hasher, hasher->buffer, hasher->used);
+  hasher->used = 0;
+}
+
+
+/* Discard the pending data of HASHER.  This may be used when the
+   hash contexts are reset.  */
+void
+ksba_hasher_reset (ksba_hasher_t hasher)
+{
+  if (hasher)
+    hasher->used = 0;
+}
+
+
+/* The hash callback used internally when a hasher has been set for an
+   object.  */
+void
+_ksba_hasher_hash_cb (void *hasher, const void *buffer, size_t length)
+{
+  ksba_hasher_write (hasher, buffer, length);
+}
@@ -0,0 +1,56 @@
+/* hasher.h - Internal definitions for hash sets
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * KSBA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copies of the GNU General Public License
+ * and the GNU Lesser General Public License along with this program;
+ * if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASHER_H
+#define HASHER_H 1
+
+#include "ksba.h"
+
+struct hasher_fnc_s
+{
+  void (*fnc)(void *, const void *, size_t);
+  void *arg;
+};
+
+struct ksba_hasher_s
+{
+  struct hasher_fnc_s *fncs;  /* Array with the hash functions.  */
+  int nfncs;                  /* Number of used items in FNCS.  */
+  int fncssize;               /* Allocated items in FNCS.  */
+  unsigned char *buffer;      /* Buffer to coalesce small updates.  */
+  size_t bufsize;             /* Size of BUFFER; 0 to disable it.  */
+  size_t used;                /* Bytes pending in BUFFER.  */
+};
+
+
+/* A hash callback to be used with a hasher object as its argument.  */
+void _ksba_hasher_hash_cb (void *hasher, const void *buffer, size_t length);
+
+#endif /*HASHER_H*/
@@ -44,6 +44,7 @@
 #include "shared.h"
 #include "convert.h"
 #include "ber-help.h"
+#include "der-builder.h"
 
 
 /* Constants used for the public key algorithms.  */
@@ -817,7 +818,7 @@ cryptval_from_sexp (int mode, ksba_const_sexp_t sexp,
   gpg_error_t err;
   const unsigned char *s;
   char *endp;
-  unsigned long n, n1;
+  unsigned long n;
   const unsigned char *oid;
   int oidlen;
   unsigned char *curve_oid = NULL;
@@ -836,10 +837,8 @@ cryptval_from_sexp (int mode, ksba_const_sexp_t sexp,
   int idxtbl[10];
   int idxtbllen;
   const char *parmdesc, *algoparmdesc;
-  ksba_writer_t writer = NULL;
-  void *algoparmseq_value = NULL;
-  size_t algoparmseq_len;
-  void *bitstr_value = NULL;
+  DerBuilder d = NULL;
+  unsigned char *bitstr_value = NULL;
   size_t bitstr_len;
 
   if (!sexp)
@@ -998,14 +997,6 @@ cryptval_from_sexp (int mode, ksba_const_sexp_t sexp,
     }
 
 
-  /* Create write object. */
-  err = ksba_writer_new (&writer);
-  if (err)
-    goto leave;
-  err = ksba_writer_set_mem (writer, 1024);
-  if (err)
-    goto leave;
-
   /* We create the keyinfo in 2 steps:
 
      1. We build the inner one and encapsulate it in a bit string.
@@ -1015,103 +1006,68 @@ cryptval_from_sexp (int mode, ksba_const_sexp_t sexp,
    */
   if (!mode)
     {
+      d = _ksba_der_builder_new (0);
+      if (!d)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      /* The number of unused bits.  */
+      _ksba_der_add_der (d, "", 1);
       if (pkalgo == PKALGO_ECC)
         {
-          /* Write the bit string header and the number of unused bits. */
-          err = _ksba_ber_write_tl (writer, TYPE_BIT_STRING, CLASS_UNIVERSAL,
-                                    0, parm[idxtbl[1]].valuelen + 1);
-          if (!err)
-            err = ksba_writer_write (writer, "", 1);
-          /* And the actual raw value.  */
-          if (!err)
-            err = ksba_writer_write (writer, parm[idxtbl[1]].value,
-                                     parm[idxtbl[1]].valuelen);
-          if (err)
-            goto leave;
-
+          /* The raw value.  */
+          _ksba_der_add_der (d, parm[idxtbl[1]].value,
+                             parm[idxtbl[1]].valuelen);
+        }
+      else if (pkalgo == PKALGO_GOST)
+        {
+          int halflen = parm[idxtbl[2]].valuelen/2;
+          char tmp[0x80];
+
+          for (n = 0; n < halflen; n++)
+            tmp[halflen-1-n] = parm[idxtbl[2]].value[1+n];
+          for (n = 0; n < halflen; n++)
+            tmp[halflen + halflen-1-n] = parm[idxtbl[2]].value[1 + halflen + n];
+          _ksba_der_add_val (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING,
+                             tmp, parm[idxtbl[2]].valuelen - 1);
         }
-  else if (pkalgo == PKALGO_GOST)
-    {
-      int halflen = parm[idxtbl[2]].valuelen/2;
-      char tmp[0x80];
-      n = 1; /* # of unused bits.  */
-      n += _ksba_ber_count_tl (TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,
-                               parm[idxtbl[2]].valuelen);
-      n += parm[idxtbl[2]].valuelen - 1;
-
-      /* Write the bit string header and the number of unused bits. */
-      err = _ksba_ber_write_tl (writer, TYPE_BIT_STRING, CLASS_UNIVERSAL, 0,
-                                n);
-      if (!err)
-        err = ksba_writer_write (writer, "", 1);
-      if (err)
-        goto leave;
-
-      for (n = 0; n < halflen; n++)
-        tmp[halflen-1-n] = parm[idxtbl[2]].value[1+n];
-      for (n = 0; n < halflen; n++)
-        tmp[halflen + halflen-1-n] = parm[idxtbl[2]].value[1 + halflen + n];
-      err  = _ksba_ber_write_tl (writer, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,
-                                 parm[idxtbl[2]].valuelen - 1);
-      if (!err)
-        err = ksba_writer_write (writer, tmp,
-                                 parm[idxtbl[2]].valuelen - 1);
-    }
       else /* RSA and DSA */
         {
-          /* Calculate the size of the sequence value and the size of the
-             bit string value.  NOt ethat in case there is only one
-             integer to write, no sequence is used.  */
-          for (n=0, i=0; i < idxtbllen; i++ )
-            {
-              n += _ksba_ber_count_tl (TYPE_INTEGER, CLASS_UNIVERSAL, 0,
-                                       parm[idxtbl[i]].valuelen);
-              n += parm[idxtbl[i]].valuelen;
-            }
-
-          n1 = 1; /* # of unused bits.  */
+          /* Note that in case there is only one integer to write, no
+             sequence is used.  */
           if (idxtbllen > 1)
-            n1 += _ksba_ber_count_tl (TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n);
-          n1 += n;
-
-          /* Write the bit string header and the number of unused bits. */
-          err = _ksba_ber_write_tl (writer, TYPE_BIT_STRING, CLASS_UNIVERSAL,
-                                    0, n1);
-          if (!err)
-            err = ksba_writer_write (writer, "", 1);
-          if (err)
-            goto leave;
-
-          /* Write the sequence tag and the integers. */
-          if (idxtbllen > 1)
-            err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1,n);
-          if (err)
-            goto leave;
+            _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
           for (i=0; i < idxtbllen; i++)
             {
               /* fixme: we should make sure that the integer conforms to the
                  ASN.1 encoding rules. */
-              err  = _ksba_ber_write_tl (writer, TYPE_INTEGER, CLASS_UNIVERSAL, 0,
-                                         parm[idxtbl[i]].valuelen);
-              if (!err)
-                err = ksba_writer_write (writer, parm[idxtbl[i]].value,
-                                         parm[idxtbl[i]].valuelen);
-              if (err)
-                goto leave;
+              _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_INTEGER,
+                                 parm[idxtbl[i]].value,
+                                 parm[idxtbl[i]].valuelen);
             }
+          if (idxtbllen > 1)
+            _ksba_der_add_end (d);
         }
 
-      /* Get the encoded bit string. */
-      bitstr_value = ksba_writer_snatch_mem (writer, &bitstr_len);
-      if (!bitstr_value)
+      /* Get the value of the bit string. */
+      err = _ksba_der_builder_get (d, &bitstr_value, &bitstr_len);
+      if (err)
+        goto leave;
+      _ksba_der_builder_reset (d);
+    }
+  else
+    {
+      d = _ksba_der_builder_new (0);
+      if (!d)
         {
-          err = gpg_error (GPG_ERR_ENOMEM);
+          err = gpg_error_from_syserror ();
           goto leave;
         }
     }
 
   /* If the algorithmIdentifier requires a sequence with parameters,
-     build them now.  We can reuse the IDXTBL for that.  */
+     find them now.  We can reuse the IDXTBL for that.  */
   if (algoparmdesc)
     {
       idxtbllen = 0;
@@ -1128,167 +1084,60 @@ cryptval_from_sexp (int mode, ksba_const_sexp_t sexp,
             }
         }
       if (idxtbllen != strlen (algoparmdesc))
-        return gpg_error (GPG_ERR_UNKNOWN_SEXP);
-
-      err = ksba_writer_set_mem (writer, 1024);
-      if (err)
-        goto leave;
-
-      /* Calculate the size of the sequence.  */
-      for (n=0, i=0; i < idxtbllen; i++ )
-        {
-          n += _ksba_ber_count_tl (TYPE_INTEGER, CLASS_UNIVERSAL, 0,
-                                   parm[idxtbl[i]].valuelen);
-          n += parm[idxtbl[i]].valuelen;
-        }
-      /*  n += _ksba_ber_count_tl (TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n); */
-
-      /* Write the sequence tag followed by the integers. */
-      err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n);
-      if (err)
-        goto leave;
-      for (i=0; i < idxtbllen; i++)
-        {
-          err = _ksba_ber_write_tl (writer, TYPE_INTEGER, CLASS_UNIVERSAL, 0,
-                                    parm[idxtbl[i]].valuelen);
-          if (!err)
-            err = ksba_writer_write (writer, parm[idxtbl[i]].value,
-                                     parm[idxtbl[i]].valuelen);
-          if (err)
-            goto leave;
-        }
-
-      /* Get the encoded sequence.  */
-      algoparmseq_value = ksba_writer_snatch_mem (writer, &algoparmseq_len);
-      if (!algoparmseq_value)
         {
-          err = gpg_error (GPG_ERR_ENOMEM);
+          err = gpg_error (GPG_ERR_UNKNOWN_SEXP);
           goto leave;
         }
     }
-  else
-    algoparmseq_len = 0;
-
-  /* Reinitialize the buffer to create the outer sequence. */
-  err = ksba_writer_set_mem (writer, 1024);
-  if (err)
-    goto leave;
-
-  /* Calulate lengths. */
-  n  = _ksba_ber_count_tl (TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, oidlen);
-  n += oidlen;
-  if (algoparmseq_len)
-    {
-      n += algoparmseq_len;
-    }
-  else if (pkalgo == PKALGO_ECC)
-    {
-      n += _ksba_ber_count_tl (TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                               0, curve_oidlen);
-      n += curve_oidlen;
-    }
-  else if (pkalgo == PKALGO_GOST)
-    {
-      n += _ksba_ber_count_tl (TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                               0, curve_oidlen);
-      n += curve_oidlen;
-      n += _ksba_ber_count_tl (TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                               0, digest_oidlen);
-      n += digest_oidlen;
-      n += _ksba_ber_count_tl (TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                               1, curve_oidlen + digest_oidlen);
-    }
-  else if (pkalgo == PKALGO_RSA)
-    {
-      n += _ksba_ber_count_tl (TYPE_NULL, CLASS_UNIVERSAL, 0, 0);
-    }
 
+  /* The outer sequence.  */
   if (!mode)
-    {
-      n1 = n;
-      n1 += _ksba_ber_count_tl (TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n);
-      n1 += bitstr_len;
-
-      /* The outer sequence.  */
-      err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n1);
-      if (err)
-        goto leave;
-    }
-
-  /* The sequence.  */
-  err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n);
-  if (err)
-    goto leave;
-
-  /* The object id.  */
-  err = _ksba_ber_write_tl (writer, TYPE_OBJECT_ID,CLASS_UNIVERSAL, 0, oidlen);
-  if (!err)
-    err = ksba_writer_write (writer, oid, oidlen);
-  if (err)
-    goto leave;
+    _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
 
-  /* The parameter. */
-  if (algoparmseq_len)
+  /* The algorithmIdentifier with the object id and the parameter.  */
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OBJECT_ID, oid, oidlen);
+  if (algoparmdesc)
     {
-      err = ksba_writer_write (writer, algoparmseq_value, algoparmseq_len);
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+      for (i=0; i < idxtbllen; i++)
+        _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_INTEGER,
+                           parm[idxtbl[i]].value, parm[idxtbl[i]].valuelen);
+      _ksba_der_add_end (d);
     }
   else if (pkalgo == PKALGO_ECC)
     {
-      err = _ksba_ber_write_tl (writer, TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                                0, curve_oidlen);
-      if (!err)
-        err = ksba_writer_write (writer, curve_oid, curve_oidlen);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OBJECT_ID,
+                         curve_oid, curve_oidlen);
     }
   else if (pkalgo == PKALGO_GOST)
     {
-      n  = _ksba_ber_count_tl (TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                               0, curve_oidlen);
-      n += curve_oidlen;
-      n += _ksba_ber_count_tl (TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                               0, digest_oidlen);
-      n += digest_oidlen;
-
-      err = _ksba_ber_write_tl (writer, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1,
-          n);
-      if (err)
-        goto leave;
-
-      err = _ksba_ber_write_tl (writer, TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                                0, curve_oidlen);
-      if (err)
-        goto leave;
-
-      err = ksba_writer_write (writer, curve_oid, curve_oidlen);
-      if (err)
-        goto leave;
-
-      err = _ksba_ber_write_tl (writer, TYPE_OBJECT_ID, CLASS_UNIVERSAL,
-                                0, digest_oidlen);
-      if (!err)
-        err = ksba_writer_write (writer, digest_oid, digest_oidlen);
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OBJECT_ID,
+                         curve_oid, curve_oidlen);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OBJECT_ID,
+                         digest_oid, digest_oidlen);
+      _ksba_der_add_end (d);
     }
   else if (pkalgo == PKALGO_RSA)
     {
-      err = _ksba_ber_write_tl (writer, TYPE_NULL, CLASS_UNIVERSAL, 0, 0);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_NULL, NULL, 0);
     }
-  if (err)
-    goto leave;
+  _ksba_der_add_end (d);
 
   /* Append the pre-constructed bit string.  */
   if (!mode)
     {
-      err = ksba_writer_write (writer, bitstr_value, bitstr_len);
-      if (err)
-        goto leave;
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_BIT_STRING,
+                         bitstr_value, bitstr_len);
+      _ksba_der_add_end (d);
     }
 
   /* Get the result. */
-  *r_der = ksba_writer_snatch_mem (writer, r_derlen);
-  if (!*r_der)
-    err = gpg_error (GPG_ERR_ENOMEM);
+  err = _ksba_der_builder_get (d, r_der, r_derlen);
 
  leave:
-  ksba_writer_release (writer);
+  _ksba_der_builder_release (d);
   xfree (bitstr_value);
   xfree (curve_oid);
   xfree (digest_oid);
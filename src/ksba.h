@@ -166,17 +166,37 @@ struct ksba_cms_s;
 typedef struct ksba_cms_s *ksba_cms_t;
 typedef struct ksba_cms_s *KsbaCMS _KSBA_DEPRECATED;
 
+/* A read-only snapshot of the signer infos of a CMS object.
+   ksba_cms_get_signers() creates it. */
+struct ksba_cms_signers_s;
+typedef struct ksba_cms_signers_s *ksba_cms_signers_t;
+
 /* CRL objects are controlled by this object.
    ksba_crl_new() creates it */
 struct ksba_crl_s;
 typedef struct ksba_crl_s *ksba_crl_t;
 typedef struct ksba_crl_s *KsbaCRL _KSBA_DEPRECATED;
 
+/* A sorted index of the entries of a CRL.  ksba_crl_get_index()
+   creates it.  */
+struct ksba_crl_index_s;
+typedef struct ksba_crl_index_s *ksba_crl_index_t;
+
 /* OCSP objects are controlled by this object.
    ksba_ocsp_new() creates it. */
 struct ksba_ocsp_s;
 typedef struct ksba_ocsp_s *ksba_ocsp_t;
 
+/* A cache for OCSP status information which may be shared by several
+   ksba_ocsp_t objects.  ksba_ocsp_cache_new() creates it. */
+struct ksba_ocsp_cache_s;
+typedef struct ksba_ocsp_cache_s *ksba_ocsp_cache_t;
+
+/* The responder side of OCSP is controlled by this object.
+   ksba_ocsp_responder_new() creates it. */
+struct ksba_ocsp_responder_s;
+typedef struct ksba_ocsp_responder_s *ksba_ocsp_responder_t;
+
 /* PKCS-10 creation is controlled by this object.
    ksba_certreq_new() creates it */
 struct ksba_certreq_s;
@@ -195,6 +215,11 @@ struct ksba_writer_s;
 typedef struct ksba_writer_s *ksba_writer_t;
 typedef struct ksba_writer_s *KsbaWriter _KSBA_DEPRECATED;
 
+/* This object passes data to one or more hash functions.
+   ksba_hasher_new() creates it. */
+struct ksba_hasher_s;
+typedef struct ksba_hasher_s *ksba_hasher_t;
+
 /* This is an object to store an ASN.1 parse tree as
    create by ksba_asn_parse_file() */
 struct ksba_asn_tree_s;
@@ -233,6 +258,8 @@ gpg_error_t ksba_cert_get_user_data (ksba_cert_t cert, const char *key,
 gpg_error_t ksba_cert_read_der (ksba_cert_t cert, ksba_reader_t reader);
 gpg_error_t ksba_cert_init_from_mem (ksba_cert_t cert,
                                      const void *buffer, size_t length);
+gpg_error_t ksba_cert_init_from_mem_nocopy (ksba_cert_t cert,
+                                            const void *buffer, size_t length);
 const unsigned char *ksba_cert_get_image (ksba_cert_t cert, size_t *r_length);
 gpg_error_t ksba_cert_hash (ksba_cert_t cert,
                             int what,
@@ -310,8 +337,42 @@ void ksba_cms_set_hash_function (ksba_cms_t cms,
                                  void (*hash_fnc)(void *, const void *, size_t),
                                  void *hash_fnc_arg);
 
+gpg_error_t ksba_cms_set_hasher (ksba_cms_t cms, ksba_hasher_t hasher);
+
 gpg_error_t ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx);
 
+gpg_error_t ksba_cms_get_signers (ksba_cms_t cms,
+                                  ksba_cms_signers_t *r_signers);
+void        ksba_cms_signers_release (ksba_cms_signers_t signers);
+int         ksba_cms_signers_count (ksba_cms_signers_t signers);
+gpg_error_t ksba_cms_signers_get_issuer_serial (ksba_cms_signers_t signers,
+                                                int idx,
+                                                const char **r_issuer,
+                                                ksba_const_sexp_t *r_serial);
+gpg_error_t ksba_cms_signers_get_subj_key_id (ksba_cms_signers_t signers,
+                                              int idx,
+                                              ksba_const_sexp_t *r_keyid);
+const char *ksba_cms_signers_get_digest_algo (ksba_cms_signers_t signers,
+                                              int idx);
+gpg_error_t ksba_cms_signers_get_signed_attrs (ksba_cms_signers_t signers,
+                                               int idx,
+                                               const unsigned char **r_der,
+                                               size_t *r_derlen);
+gpg_error_t ksba_cms_signers_get_message_digest (ksba_cms_signers_t signers,
+                                                 int idx,
+                                                 const unsigned char **r_digest,
+                                                 size_t *r_digestlen);
+gpg_error_t ksba_cms_signers_get_signing_time (ksba_cms_signers_t signers,
+                                               int idx,
+                                               ksba_isotime_t r_sigtime);
+ksba_const_sexp_t ksba_cms_signers_get_sig_val (ksba_cms_signers_t signers,
+                                                int idx);
+
+gpg_error_t ksba_cms_set_chunk_size (ksba_cms_t cms, size_t size);
+gpg_error_t ksba_cms_set_lazy_certs (ksba_cms_t cms, int lazy);
+gpg_error_t ksba_cms_write_data (ksba_cms_t cms,
+                                 const void *buffer, size_t length);
+
 
 gpg_error_t ksba_cms_set_content_type (ksba_cms_t cms, int what,
                                        ksba_content_type_t type);
@@ -346,6 +407,7 @@ void        ksba_crl_set_hash_function (ksba_crl_t crl,
                                         void (*hash_fnc)(void *,
                                                          const void *, size_t),
                                         void *hash_fnc_arg);
+gpg_error_t ksba_crl_set_hasher (ksba_crl_t crl, ksba_hasher_t hasher);
 const char *ksba_crl_get_digest_algo (ksba_crl_t crl);
 gpg_error_t ksba_crl_get_issuer (ksba_crl_t crl, char **r_issuer);
 gpg_error_t ksba_crl_get_extension (ksba_crl_t crl, int idx,
@@ -356,6 +418,8 @@ gpg_error_t ksba_crl_get_auth_key_id (ksba_crl_t crl,
                                       ksba_name_t *r_name,
                                       ksba_sexp_t *r_serial);
 gpg_error_t ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number);
+gpg_error_t ksba_crl_get_delta_indicator (ksba_crl_t crl,
+                                          ksba_sexp_t *r_number);
 gpg_error_t ksba_crl_get_update_times (ksba_crl_t crl,
                                        ksba_isotime_t this_update,
                                        ksba_isotime_t next_update);
@@ -365,6 +429,41 @@ gpg_error_t ksba_crl_get_item (ksba_crl_t crl,
                                ksba_crl_reason_t *r_reason);
 ksba_sexp_t ksba_crl_get_sig_val (ksba_crl_t crl);
 gpg_error_t ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason);
+gpg_error_t ksba_crl_start_index (ksba_crl_t crl);
+gpg_error_t ksba_crl_get_index (ksba_crl_t crl, ksba_crl_index_t *r_index);
+
+
+/*-- crl-index.c --*/
+gpg_error_t ksba_crl_index_new_from_mem (ksba_crl_index_t *r_index,
+                                         const void *buffer, size_t length);
+void        ksba_crl_index_release (ksba_crl_index_t index);
+const unsigned char *ksba_crl_index_get_image (ksba_crl_index_t index,
+                                               size_t *r_length);
+size_t      ksba_crl_index_get_count (ksba_crl_index_t index);
+gpg_error_t ksba_crl_index_lookup (ksba_crl_index_t index,
+                                   ksba_const_sexp_t serial,
+                                   ksba_isotime_t r_revocation_date,
+                                   ksba_crl_reason_t *r_reason,
+                                   unsigned long *r_extoff);
+gpg_error_t ksba_crl_index_new_from_fd (ksba_crl_index_t *r_index, int fd);
+gpg_error_t ksba_crl_index_write (ksba_crl_index_t index, ksba_writer_t w);
+gpg_error_t ksba_crl_index_get_issuer (ksba_crl_index_t index,
+                                       char **r_issuer);
+gpg_error_t ksba_crl_index_get_update_times (ksba_crl_index_t index,
+                                             ksba_isotime_t this,
+                                             ksba_isotime_t next);
+gpg_error_t ksba_crl_index_get_crl_number (ksba_crl_index_t index,
+                                           ksba_sexp_t *r_number);
+const char *ksba_crl_index_get_digest_algo (ksba_crl_index_t index);
+gpg_error_t ksba_crl_index_get_sig_val (ksba_crl_index_t index,
+                                        unsigned long *r_tbs_off,
+                                        unsigned long *r_tbs_len,
+                                        ksba_sexp_t *r_sigval);
+gpg_error_t ksba_crl_index_get_delta_indicator (ksba_crl_index_t index,
+                                                ksba_sexp_t *r_number);
+gpg_error_t ksba_crl_index_apply_delta (ksba_crl_index_t base,
+                                        ksba_crl_index_t delta,
+                                        ksba_crl_index_t *r_index);
 
 
 
@@ -418,6 +517,83 @@ gpg_error_t ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert,
                                      unsigned char const **r_der,
                                      size_t *r_derlen);
 
+gpg_error_t ksba_ocsp_cache_new (ksba_ocsp_cache_t *r_cache,
+                                 unsigned int size);
+void ksba_ocsp_cache_release (ksba_ocsp_cache_t cache);
+gpg_error_t ksba_ocsp_cache_lookup (ksba_ocsp_cache_t cache,
+                                    ksba_cert_t cert, ksba_cert_t issuer_cert,
+                                    const ksba_isotime_t now,
+                                    ksba_status_t *r_status,
+                                    ksba_isotime_t r_this_update,
+                                    ksba_isotime_t r_next_update,
+                                    ksba_isotime_t r_revocation_time,
+                                    ksba_crl_reason_t *r_reason,
+                                    unsigned char **r_response,
+                                    size_t *r_responselen);
+gpg_error_t ksba_ocsp_set_cache (ksba_ocsp_t ocsp, ksba_ocsp_cache_t cache);
+gpg_error_t ksba_ocsp_update_cache (ksba_ocsp_t ocsp);
+gpg_error_t ksba_ocsp_set_certid_algo (ksba_ocsp_t ocsp, const char *oid);
+gpg_error_t ksba_ocsp_build_request_into (ksba_ocsp_t ocsp,
+                                          unsigned char *buffer,
+                                          size_t bufsize, size_t *r_buflen);
+
+gpg_error_t ksba_ocsp_responder_new (ksba_ocsp_responder_t *r_resp);
+void ksba_ocsp_responder_release (ksba_ocsp_responder_t resp);
+gpg_error_t ksba_ocsp_responder_set_responder_id (ksba_ocsp_responder_t resp,
+                                                  ksba_cert_t cert,
+                                                  int by_key);
+gpg_error_t ksba_ocsp_responder_add_cert (ksba_ocsp_responder_t resp,
+                                          ksba_cert_t cert);
+gpg_error_t ksba_ocsp_responder_add_issuer (ksba_ocsp_responder_t resp,
+                                            ksba_cert_t issuer);
+gpg_error_t ksba_ocsp_responder_set_signer (ksba_ocsp_responder_t resp,
+                                            const char *sig_algo,
+                                            size_t maxsiglen,
+                                            gpg_error_t (*signer)(void *arg,
+                                                  const unsigned char *tbs,
+                                                  size_t tbslen,
+                                                  unsigned char *sigbuf,
+                                                  size_t *r_siglen),
+                                            void *signer_arg);
+void ksba_ocsp_responder_reset (ksba_ocsp_responder_t resp);
+gpg_error_t ksba_ocsp_responder_parse_request (ksba_ocsp_responder_t resp,
+                                               const unsigned char *msg,
+                                               size_t msglen);
+int ksba_ocsp_responder_get_count (ksba_ocsp_responder_t resp);
+gpg_error_t ksba_ocsp_responder_get_request (ksba_ocsp_responder_t resp,
+                                             int idx,
+                                             const char **r_hash_algo,
+                                             const unsigned char **r_name_hash,
+                                             size_t *r_name_hash_len,
+                                             const unsigned char **r_key_hash,
+                                             size_t *r_key_hash_len,
+                                             const unsigned char **r_serial,
+                                             size_t *r_serial_len,
+                                             int *r_issuer);
+gpg_error_t ksba_ocsp_responder_get_nonce (ksba_ocsp_responder_t resp,
+                                           const unsigned char **r_nonce,
+                                           size_t *r_noncelen);
+gpg_error_t ksba_ocsp_responder_set_certid_algo (ksba_ocsp_responder_t resp,
+                                                 const char *oid);
+gpg_error_t ksba_ocsp_responder_add_target (ksba_ocsp_responder_t resp,
+                                            ksba_cert_t cert,
+                                            ksba_cert_t issuer_cert,
+                                            int *r_idx);
+gpg_error_t ksba_ocsp_responder_set_status (ksba_ocsp_responder_t resp,
+                                            int idx, ksba_status_t status,
+                                            const ksba_isotime_t this_update,
+                                            const ksba_isotime_t next_update,
+                                            const ksba_isotime_t revocation_time,
+                                            ksba_crl_reason_t reason);
+gpg_error_t ksba_ocsp_responder_build_response (ksba_ocsp_responder_t resp,
+                                             const ksba_isotime_t produced_at,
+                                             const unsigned char **r_buf,
+                                             size_t *r_buflen);
+gpg_error_t ksba_ocsp_responder_build_error (ksba_ocsp_responder_t resp,
+                                      ksba_ocsp_response_status_t status,
+                                      const unsigned char **r_buf,
+                                      size_t *r_buflen);
+
 
 /*-- certreq.c --*/
 gpg_error_t ksba_certreq_new (ksba_certreq_t *r_cr);
@@ -427,6 +603,7 @@ void         ksba_certreq_set_hash_function (
                                ksba_certreq_t cr,
                                void (*hash_fnc)(void *, const void *, size_t),
                                void *hash_fnc_arg);
+gpg_error_t ksba_certreq_set_hasher (ksba_certreq_t cr, ksba_hasher_t hasher);
 gpg_error_t ksba_certreq_add_subject (ksba_certreq_t cr, const char *name);
 gpg_error_t ksba_certreq_set_public_key (ksba_certreq_t cr,
                                          ksba_const_sexp_t key);
@@ -476,6 +653,13 @@ gpg_error_t ksba_reader_set_cb (ksba_reader_t r,
 gpg_error_t ksba_reader_read (ksba_reader_t r,
                             char *buffer, size_t length, size_t *nread);
 gpg_error_t ksba_reader_unread (ksba_reader_t r, const void *buffer, size_t count);
+gpg_error_t ksba_reader_peek (ksba_reader_t r,
+                              const void **r_buffer, size_t *r_length);
+gpg_error_t ksba_reader_advance (ksba_reader_t r, size_t count);
+gpg_error_t ksba_reader_set_push (ksba_reader_t r, size_t maxlen);
+gpg_error_t ksba_reader_push (ksba_reader_t r,
+                              const void *buffer, size_t length,
+                              size_t *r_nused);
 unsigned long ksba_reader_tell (ksba_reader_t r);
 
 /*-- writer.c --*/
@@ -492,7 +676,9 @@ gpg_error_t ksba_writer_set_cb (ksba_writer_t w,
                                 int (*cb)(void*,const void *,size_t),
                                 void *cb_value);
 gpg_error_t ksba_writer_set_mem (ksba_writer_t w, size_t initial_size);
+gpg_error_t ksba_writer_set_mem_chunked (ksba_writer_t w, size_t chunk_size);
 const void *ksba_writer_get_mem (ksba_writer_t w, size_t *nbytes);
+const void *ksba_writer_get_chunk (ksba_writer_t w, int idx, size_t *r_length);
 void *      ksba_writer_snatch_mem (ksba_writer_t w, size_t *nbytes);
 gpg_error_t ksba_writer_set_filter (ksba_writer_t w,
                                     gpg_error_t (*filter)(void*,
@@ -501,10 +687,23 @@ gpg_error_t ksba_writer_set_filter (ksba_writer_t w,
                                     void *filter_arg);
 
 gpg_error_t ksba_writer_write (ksba_writer_t w, const void *buffer, size_t length);
+gpg_error_t ksba_writer_flush (ksba_writer_t w);
 gpg_error_t ksba_writer_write_octet_string (ksba_writer_t w,
                                           const void *buffer, size_t length,
                                           int flush);
 
+/*-- hasher.c --*/
+gpg_error_t ksba_hasher_new (ksba_hasher_t *r_hasher);
+void        ksba_hasher_release (ksba_hasher_t hasher);
+gpg_error_t ksba_hasher_add (ksba_hasher_t hasher,
+                             void (*hash_fnc)(void *, const void *, size_t),
+                             void *hash_fnc_arg);
+gpg_error_t ksba_hasher_set_buffer_size (ksba_hasher_t hasher, size_t size);
+void        ksba_hasher_write (ksba_hasher_t hasher,
+                               const void *buffer, size_t length);
+void        ksba_hasher_flush (ksba_hasher_t hasher);
+void        ksba_hasher_reset (ksba_hasher_t hasher);
+
 /*-- asn1-parse.y --*/
 int ksba_asn_parse_file (const char *filename, ksba_asn_tree_t *result,
                          int debug);
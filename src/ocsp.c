@@ -40,6 +40,7 @@
 #include "convert.h"
 #include "keyinfo.h"
 #include "der-encoder.h"
+#include "der-builder.h"
 #include "ber-help.h"
 #include "ocsp.h"
 
@@ -48,6 +49,61 @@ static const char oidstr_sha1[] = "1.3.14.3.2.26";
 static const char oidstr_ocsp_basic[] = "1.3.6.1.5.5.7.48.1.1";
 static const char oidstr_ocsp_nonce[] = "1.3.6.1.5.5.7.48.1.2";
 
+/* The DER encoded OIDs used to build requests and responses.  These
+   are needed for every request or response and thus not converted at
+   runtime.  */
+static const unsigned char der_oid_ocsp_basic[] =
+  { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01, 0x01 };
+static const unsigned char der_oid_ocsp_nonce[] =
+  { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x30, 0x01, 0x02 };
+
+/* The hash algorithms we support for the CertID.  The actual hashing
+   is done by the hash function registered with
+   ksba_set_hash_buffer_function.  */
+static const struct certid_algo_s
+{
+  const char *oid;
+  const char *der;          /* The DER encoded OID.  */
+  size_t derlen;
+  size_t hashlen;
+} certid_algos[] = {
+  { oidstr_sha1,
+    "\x2b\x0e\x03\x02\x1a", 5, 20 },
+  { "2.16.840.1.101.3.4.2.1",  /* SHA-256 */
+    "\x60\x86\x48\x01\x65\x03\x04\x02\x01", 9, 32 },
+  { "2.16.840.1.101.3.4.2.2",  /* SHA-384 */
+    "\x60\x86\x48\x01\x65\x03\x04\x02\x02", 9, 48 },
+  { "2.16.840.1.101.3.4.2.3",  /* SHA-512 */
+    "\x60\x86\x48\x01\x65\x03\x04\x02\x03", 9, 64 },
+  { "1.2.643.2.2.9",           /* GOST R 34.11-94 */
+    "\x2a\x85\x03\x02\x02\x09", 6, 32 },
+  { "1.2.643.7.1.1.2.2",       /* GOST R 34.11-2012 (256 bit) */
+    "\x2a\x85\x03\x07\x01\x01\x02\x02", 8, 32 },
+  { "1.2.643.7.1.1.2.3",       /* GOST R 34.11-2012 (512 bit) */
+    "\x2a\x85\x03\x07\x01\x01\x02\x03", 8, 64 },
+  { NULL, NULL, 0, 0 }
+};
+
+
+/* Return the entry of OID in the table of CertID hash algorithms or
+   -1 if it is not supported.  */
+static int
+find_certid_algo (const char *oid)
+{
+  int i;
+
+  for (i=0; certid_algos[i].oid; i++)
+    if (!strcmp (certid_algos[i].oid, oid))
+      return i;
+  return -1;
+}
+
+
+/* Short names for the header helpers of the DER builder.  */
+#define tl_size(length)  _ksba_der_count_tl ((length))
+#define put_tl(p,tag,class,constructed,length) \
+          _ksba_der_put_tl ((p), (tag), (class), (constructed), (length))
+
 
 #if 0
 static void
@@ -269,6 +325,8 @@ ksba_ocsp_new (ksba_ocsp_t *r_ocsp)
   *r_ocsp = xtrycalloc (1, sizeof **r_ocsp);
   if (!*r_ocsp)
     return gpg_error_from_syserror ();
+  (*r_ocsp)->certid_algo = oidstr_sha1;
+  (*r_ocsp)->certid_hashlen = 20;
   return 0;
 }
 
@@ -298,6 +356,147 @@ release_ocsp_extensions (struct ocsp_extension_s *ex)
 }
 
 
+/* Return the hash value for a CertID.  */
+static unsigned int
+certid_hash (const unsigned char *name_hash, const unsigned char *key_hash,
+             const unsigned char *serialno, size_t serialnolen)
+{
+  unsigned int h;
+  size_t n;
+
+  /* The hashes are already well distributed, thus we take a few
+     bytes of them and run FNV-1a only over the serial number.  */
+  h = (((unsigned int)name_hash[0] << 24) | (name_hash[1] << 16)
+       | (key_hash[0] << 8) | key_hash[1]);
+  h ^= 2166136261u;
+  for (n=0; n < serialnolen; n++)
+    {
+      h ^= serialno[n];
+      h *= 16777619;
+    }
+  return h;
+}
+
+
+/* Return the hash value for the certificate object CERT.  */
+static unsigned int
+cert_ptr_hash (ksba_cert_t cert)
+{
+  size_t v = (size_t)(void*)cert;
+
+  return (unsigned int)((v >> 4) ^ (v >> 16)) * 2654435761u;
+}
+
+
+/* Release the index of the request items of OCSP.  */
+static void
+release_request_index (ksba_ocsp_t ocsp)
+{
+  xfree (ocsp->certid_index);
+  ocsp->certid_index = NULL;
+  ocsp->cert_index = NULL;
+  ocsp->index_mask = 0;
+}
+
+
+/* Build the hash tables to find the request items of OCSP by CertID
+   and by certificate.  The CertIDs of the items must have been
+   computed.  Within a bucket the items keep the order of the request
+   list so that lookups return the first matching item.  */
+static gpg_error_t
+build_request_index (ksba_ocsp_t ocsp)
+{
+  struct ocsp_reqitem_s *ri, **pp;
+  unsigned int size, n;
+
+  release_request_index (ocsp);
+
+  for (n=0, ri=ocsp->requestlist; ri; ri = ri->next)
+    n++;
+  for (size=8; size < 2*n; size <<= 1)
+    ;
+  ocsp->certid_index = xtrycalloc (2 * size, sizeof *ocsp->certid_index);
+  if (!ocsp->certid_index)
+    return gpg_error_from_syserror ();
+  ocsp->cert_index = ocsp->certid_index + size;
+  ocsp->index_mask = size - 1;
+
+  for (ri=ocsp->requestlist; ri; ri = ri->next)
+    {
+      ri->certid_hash = certid_hash (ri->issuer_name_hash,
+                                     ri->issuer_key_hash,
+                                     ri->serialno, ri->serialnolen);
+      ri->next_by_certid = NULL;
+      for (pp = ocsp->certid_index + (ri->certid_hash & ocsp->index_mask);
+           *pp; pp = &(*pp)->next_by_certid)
+        ;
+      *pp = ri;
+
+      ri->next_by_cert = NULL;
+      for (pp = ocsp->cert_index + (cert_ptr_hash (ri->cert)
+                                    & ocsp->index_mask);
+           *pp; pp = &(*pp)->next_by_cert)
+        ;
+      *pp = ri;
+    }
+  return 0;
+}
+
+
+/* Return the first request item of OCSP for the certificate CERT or
+   NULL.  */
+static struct ocsp_reqitem_s *
+find_request_by_cert (ksba_ocsp_t ocsp, ksba_cert_t cert)
+{
+  struct ocsp_reqitem_s *ri;
+
+  if (!ocsp->cert_index)
+    {
+      for (ri=ocsp->requestlist; ri; ri = ri->next)
+        if (ri->cert == cert)
+          break;
+      return ri;
+    }
+
+  for (ri = ocsp->cert_index[cert_ptr_hash (cert) & ocsp->index_mask];
+       ri; ri = ri->next_by_cert)
+    if (ri->cert == cert)
+      break;
+  return ri;
+}
+
+
+/* Return the first request item of OCSP which has not been answered
+   from the cache and matches the CertID given by the hashes NAME_HASH
+   and KEY_HASH and the serial number SERIALNO or NULL.  The hashes
+   must have been computed with the algorithm of the request.  */
+static struct ocsp_reqitem_s *
+find_request_by_certid (ksba_ocsp_t ocsp,
+                        const unsigned char *name_hash,
+                        const unsigned char *key_hash,
+                        const unsigned char *serialno, size_t serialnolen)
+{
+  struct ocsp_reqitem_s *ri;
+  unsigned int hash;
+  size_t hashlen = ocsp->certid_hashlen;
+
+  if (!ocsp->certid_index)
+    return NULL;  /* No request has been prepared.  */
+
+  hash = certid_hash (name_hash, key_hash, serialno, serialnolen);
+  for (ri = ocsp->certid_index[hash & ocsp->index_mask];
+       ri; ri = ri->next_by_certid)
+    if (ri->certid_hash == hash
+        && !ri->cached
+        && ri->serialnolen == serialnolen
+        && !memcmp (ri->serialno, serialno, serialnolen)
+        && !memcmp (ri->issuer_key_hash, key_hash, hashlen)
+        && !memcmp (ri->issuer_name_hash, name_hash, hashlen))
+      break;
+  return ri;
+}
+
+
 /* Release the OCSP object and all its resources. Passing NULL for
    OCSP is a valid nop. */
 void
@@ -315,13 +514,15 @@ ksba_ocsp_release (ksba_ocsp_t ocsp)
       ksba_cert_release (ri->cert);
       ksba_cert_release (ri->issuer_cert);
       release_ocsp_extensions (ri->single_extensions);
-      xfree (ri->serialno);
+      xfree (ri);
     }
   xfree (ocsp->sigval);
   xfree (ocsp->responder_id.name);
   xfree (ocsp->responder_id.keyid);
   release_ocsp_certlist (ocsp->received_certs);
   release_ocsp_extensions (ocsp->response_extensions);
+  xfree (ocsp->response);
+  release_request_index (ocsp);
   xfree (ocsp);
 }
 
@@ -344,6 +545,26 @@ ksba_ocsp_set_digest_algo (ksba_ocsp_t ocsp, const char *oid)
 }
 
 
+/* Set the hash algorithm used for the CertIDs of the request to OID.
+   The default is SHA-1.  The hash function registered with
+   ksba_set_hash_buffer_function must support this algorithm.  Returns
+   GPG_ERR_DIGEST_ALGO if we do not know the algorithm.  */
+gpg_error_t
+ksba_ocsp_set_certid_algo (ksba_ocsp_t ocsp, const char *oid)
+{
+  int i;
+
+  if (!ocsp || !oid)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  i = find_certid_algo (oid);
+  if (i < 0)
+    return gpg_error (GPG_ERR_DIGEST_ALGO);
+  ocsp->certid_algo = certid_algos[i].oid;
+  ocsp->certid_hashlen = certid_algos[i].hashlen;
+  return 0;
+}
+
+
 gpg_error_t
 ksba_ocsp_set_requestor (ksba_ocsp_t ocsp, ksba_cert_t cert)
 {
@@ -376,6 +597,7 @@ ksba_ocsp_add_target (ksba_ocsp_t ocsp,
 
   ri->next = ocsp->requestlist;
   ocsp->requestlist = ri;
+  release_request_index (ocsp);
 
   return 0;
 }
@@ -407,378 +629,730 @@ ksba_ocsp_set_nonce (ksba_ocsp_t ocsp, unsigned char *nonce, size_t noncelen)
 }
 
 
-/* Compute the SHA-1 nameHash for the certificate CERT and put it in
-   the buffer SHA1_BUFFER which must have been allocated to at least
-   20 bytes. */
-static gpg_error_t
-issuer_name_hash (ksba_cert_t cert, unsigned char *sha1_buffer)
-{
-  gpg_error_t err;
-  const unsigned char *ptr;
-  size_t length, dummy;
-
-  err = _ksba_cert_get_subject_dn_ptr (cert, &ptr, &length);
-  if (!err)
-    {
-      err = _ksba_hash_buffer (NULL, ptr, length, 20, sha1_buffer, &dummy);
-      if (!err && dummy != 20)
-        err = gpg_error (GPG_ERR_BUG);
-    }
-  return err;
-}
-
-/* Compute the SHA-1 hash of the public key of CERT and put it in teh
-   buffer SHA1_BUFFER which must have been allocated with at least 20
-   bytes. */
+/* Return the SHA-1 nameHash and keyHash for the issuer certificate
+   CERT.  The hashes are computed only once per certificate and the
+   returned pointers are valid as long as CERT.  */
 static gpg_error_t
-issuer_key_hash (ksba_cert_t cert, unsigned char *sha1_buffer)
+issuer_sha1_hashes (ksba_cert_t cert, const unsigned char **r_name_hash,
+                    const unsigned char **r_key_hash)
 {
-  gpg_error_t err;
-  const unsigned char *ptr;
-  size_t length, dummy;
-
-  err = _ksba_cert_get_public_key_ptr (cert, &ptr, &length);
-  if (!err)
-    {
-      err = _ksba_hash_buffer (NULL, ptr, length, 20, sha1_buffer, &dummy);
-      if (!err && dummy != 20)
-        err = gpg_error (GPG_ERR_BUG);
-    }
-  return err;
+  return _ksba_cert_get_certid_hashes (cert, oidstr_sha1, 20,
+                                       r_name_hash, r_key_hash);
 }
 
 
-/* Write the extensions for a request to WOUT. */
-static gpg_error_t
-write_request_extensions (ksba_ocsp_t ocsp, ksba_writer_t wout)
+/* Return the length of the requestExtensions of OCSP including the
+   explicit context tag or 0 if there are none.  */
+static size_t
+request_extensions_len (ksba_ocsp_t ocsp)
 {
-  gpg_error_t err;
-  unsigned char *buf;
-  size_t buflen;
-  unsigned char *p;
-  size_t derlen;
-  ksba_writer_t w1 = NULL;
-  ksba_writer_t w2 = NULL;
+  size_t n;
 
   if (!ocsp->noncelen)
     return 0; /* We do only support the nonce extension.  */
 
-  /* Create writer objects for construction of the extension. */
-  err = ksba_writer_new (&w2);
-  if (!err)
-    err = ksba_writer_set_mem (w2, 256);
-  if (!err)
-    err = ksba_writer_new (&w1);
-  if (!err)
-    err = ksba_writer_set_mem (w1, 256);
-  if (err)
-    goto leave;
+  n = tl_size (ocsp->noncelen) + ocsp->noncelen;  /* The extnValue.  */
+  n = tl_size (n) + n;
+  n += tl_size (sizeof der_oid_ocsp_nonce) + sizeof der_oid_ocsp_nonce;
+  n = tl_size (n) + n;   /* The Extension.  */
+  n = tl_size (n) + n;   /* The Extensions.  */
+  return tl_size (n) + n;
+}
 
-  /* Write OID and and nonce.  */
-  err = ksba_oid_from_str (oidstr_ocsp_nonce, &buf, &buflen);
-  if (err)
-    goto leave;
-  err = _ksba_ber_write_tl (w1, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, buflen);
-  if (!err)
-    err = ksba_writer_write (w1, buf, buflen);
-  xfree (buf); buf = NULL;
-  /* We known that the nonce is short enough to put the tag into 2 bytes, thus
-     we write the encapsulating octet string directly with a fixed length. */
-  if (!err)
-    err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,
-                              2+ocsp->noncelen);
-  if (!err)
-    err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,
-                              ocsp->noncelen);
-  if (!err)
-    err = ksba_writer_write (w1, ocsp->nonce, ocsp->noncelen);
 
-  /* Put a sequence around. */
-  p = ksba_writer_snatch_mem (w1, &derlen);
-  if (!p)
-    {
-      err = ksba_writer_error (w1);
-      goto leave;
-    }
-  err = _ksba_ber_write_tl (w2, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, derlen);
-  if (!err)
-    err = ksba_writer_write (w2, p, derlen);
-  xfree (p); p = NULL;
+/* Write the requestExtensions of OCSP to P and return the pointer
+   behind them.  */
+static unsigned char *
+put_request_extensions (ksba_ocsp_t ocsp, unsigned char *p)
+{
+  size_t valuelen, extnlen;
 
-  /* Put the sequence around all extensions.  */
-  err = ksba_writer_set_mem (w1, 256);
-  if (err)
-    goto leave;
-  p = ksba_writer_snatch_mem (w2, &derlen);
-  if (!p)
-    {
-      err = ksba_writer_error (w2);
-      goto leave;
-    }
-  err = _ksba_ber_write_tl (w1, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, derlen);
-  if (!err)
-    err = ksba_writer_write (w1, p, derlen);
-  xfree (p); p = NULL;
+  if (!ocsp->noncelen)
+    return p;
+
+  valuelen = tl_size (ocsp->noncelen) + ocsp->noncelen;
+  extnlen = (tl_size (sizeof der_oid_ocsp_nonce) + sizeof der_oid_ocsp_nonce
+             + tl_size (valuelen) + valuelen);
+  p = put_tl (p, 2, CLASS_CONTEXT, 1,
+              tl_size (tl_size (extnlen) + extnlen)
+              + tl_size (extnlen) + extnlen);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1,
+              tl_size (extnlen) + extnlen);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, extnlen);
+  p = put_tl (p, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0,
+              sizeof der_oid_ocsp_nonce);
+  memcpy (p, der_oid_ocsp_nonce, sizeof der_oid_ocsp_nonce);
+  p += sizeof der_oid_ocsp_nonce;
+  p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, valuelen);
+  p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, ocsp->noncelen);
+  memcpy (p, ocsp->nonce, ocsp->noncelen);
+  return p + ocsp->noncelen;
+}
 
-  /* And put a context tag around everything.  */
-  p = ksba_writer_snatch_mem (w1, &derlen);
-  if (!p)
-    {
-      err = ksba_writer_error (w1);
-      goto leave;
-    }
-  err = _ksba_ber_write_tl (wout, 2, CLASS_CONTEXT, 1, derlen);
-  if (!err)
-    err = ksba_writer_write (wout, p, derlen);
-  xfree (p); p = NULL;
 
+/* Return the length of the CertID of RI using the hash algorithm
+   ALGO without its tag and length.  */
+static size_t
+certid_len (const struct certid_algo_s *algo, struct ocsp_reqitem_s *ri)
+{
+  size_t n;
 
- leave:
-  ksba_writer_release (w2);
-  ksba_writer_release (w1);
-  return err;
+  n = tl_size (algo->derlen) + algo->derlen + 2;  /* The OID and NULL.  */
+  n = tl_size (n) + n;
+  n += 2 * (tl_size (algo->hashlen) + algo->hashlen);
+  return n + tl_size (ri->serialnolen) + ri->serialnolen;
 }
 
 
-/* Build a request from the current context.  The function checks that
-   all necessary information have been set and stores the prepared
-   request in the context.  A subsequent ksba_ocsp_build_request may
-   then be used to retrieve this request.  Optional the requestmay be
-   signed beofre calling ksba_ocsp_build_request.
- */
-gpg_error_t
-ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
+/* Write the Request for RI using the hash algorithm ALGO to P and
+   return the pointer behind it.  */
+static unsigned char *
+put_single_request (const struct certid_algo_s *algo,
+                    struct ocsp_reqitem_s *ri, unsigned char *p)
 {
-  gpg_error_t err;
-  struct ocsp_reqitem_s *ri;
-  unsigned char *p;
-  const unsigned char *der;
-  size_t derlen;
-  ksba_writer_t w1 = NULL;
-  ksba_writer_t w2 = NULL;
-  ksba_writer_t w3 = NULL;
-  ksba_writer_t w4, w5, w6, w7; /* Used as aliases. */
-
-  if (!ocsp)
-    return gpg_error (GPG_ERR_INV_VALUE);
+  size_t n = certid_len (algo, ri);
+
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, tl_size (n) + n);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n);
+
+  /* The AlgorithmIdentifier.  */
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1,
+              tl_size (algo->derlen) + algo->derlen + 2);
+  p = put_tl (p, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, algo->derlen);
+  memcpy (p, algo->der, algo->derlen);
+  p += algo->derlen;
+  p = put_tl (p, TYPE_NULL, CLASS_UNIVERSAL, 0, 0);
+
+  /* The issuerNameHash, the issuerKeyHash and the serialNumber.  */
+  p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, algo->hashlen);
+  memcpy (p, ri->issuer_name_hash, algo->hashlen);
+  p += algo->hashlen;
+  p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, algo->hashlen);
+  memcpy (p, ri->issuer_key_hash, algo->hashlen);
+  p += algo->hashlen;
+  p = put_tl (p, TYPE_INTEGER, CLASS_UNIVERSAL, 0, ri->serialnolen);
+  memcpy (p, ri->serialno, ri->serialnolen);
+  p += ri->serialnolen;
+
+  /* Here we would write singleRequestExtensions. */
 
-  xfree (ocsp->request_buffer);
-  ocsp->request_buffer = NULL;
-  ocsp->request_buflen = 0;
+  return p;
+}
 
-  if (!ocsp->requestlist)
-    return gpg_error (GPG_ERR_MISSING_ACTION);
 
-  /* Create three writer objects for construction of the request. */
-  err = ksba_writer_new (&w3);
-  if (!err)
-    err = ksba_writer_set_mem (w3, 2048);
-  if (!err)
-    err = ksba_writer_new (&w2);
-  if (!err)
-    err = ksba_writer_new (&w1);
-  if (err)
-    goto leave;
+/*
+   The status cache.
+*/
 
+/* The number of slots probed for a CertID.  */
+#define CACHE_MAX_PROBES 16
 
-  /* Loop over all single requests. */
-  for (ri=ocsp->requestlist; ri; ri = ri->next)
-    {
-      err = ksba_writer_set_mem (w2, 256);
-      if (!err)
-        err = ksba_writer_set_mem (w1, 256);
-      if (err)
-        goto leave;
 
-      /* Write the AlgorithmIdentifier. */
-      err = _ksba_der_write_algorithm_identifier (w1, oidstr_sha1, NULL, 0);
-      if (err)
-        goto leave;
+/* Return true if ENTRY is for the given CertID.  */
+static int
+cache_entry_matches (struct ocsp_cache_entry_s *entry, unsigned int hash,
+                     const unsigned char *name_hash,
+                     const unsigned char *key_hash,
+                     const unsigned char *serialno, size_t serialnolen)
+{
+  return (entry->hash == hash
+          && entry->serialnolen == serialnolen
+          && !memcmp (entry->serialno, serialno, serialnolen)
+          && !memcmp (entry->issuer_key_hash, key_hash, 20)
+          && !memcmp (entry->issuer_name_hash, name_hash, 20));
+}
 
-      /* Compute the issuerNameHash and write it into the CertID object. */
-      err = issuer_name_hash (ri->issuer_cert, ri->issuer_name_hash);
-      if (!err)
-        err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,20);
-      if (!err)
-        err = ksba_writer_write (w1, ri->issuer_name_hash, 20);
-      if(err)
-        goto leave;
 
-      /* Compute the issuerKeyHash and write it. */
-      err = issuer_key_hash (ri->issuer_cert, ri->issuer_key_hash);
-      if (!err)
-        err = _ksba_ber_write_tl (w1, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,20);
-      if (!err)
-        err = ksba_writer_write (w1, ri->issuer_key_hash, 20);
-      if (err)
-        goto leave;
+/* Drop a reference to the cached response BLOB.  */
+static void
+cache_release_blob (struct ocsp_cache_blob_s *blob)
+{
+  if (!atomic_add_int (&blob->refcount, -1))
+    xfree (blob);
+}
 
-      /* Write the serialNumber of the certificate to be checked. */
-      err = _ksba_cert_get_serial_ptr (ri->cert, &der, &derlen);
-      if (!err)
-        err = _ksba_ber_write_tl (w1, TYPE_INTEGER, CLASS_UNIVERSAL, 0, derlen);
-      if (!err)
-        err = ksba_writer_write (w1, der, derlen);
-      if (err)
-        goto leave;
-      xfree (ri->serialno);
-      ri->serialno = xtrymalloc (derlen);
-      if (!ri->serialno)
-        {
-          err = gpg_error_from_syserror ();
-          goto leave;
-        }
-      memcpy (ri->serialno, der, derlen);
-      ri->serialnolen = derlen;
 
+/* Release the cache entry ENTRY.  */
+static void
+cache_release_entry (struct ocsp_cache_entry_s *entry)
+{
+  cache_release_blob (entry->response);
+  xfree (entry);
+}
 
-      /* Now write it out as a sequence to the outer certID object. */
-      p = ksba_writer_snatch_mem (w1, &derlen);
-      if (!p)
-        {
-          err = ksba_writer_error (w1);
-          goto leave;
-        }
-      err = _ksba_ber_write_tl (w2, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                                1, derlen);
-      if (!err)
-        err = ksba_writer_write (w2, p, derlen);
-      xfree (p); p = NULL;
-      if (err)
-        goto leave;
 
-      /* Here we would write singleRequestExtensions. */
+/* Create a new cache for OCSP status information with SIZE slots and
+   store it at R_CACHE.  SIZE is rounded up to a power of 2; 0 selects
+   a default.  The cache may be used by several threads at the same
+   time if the compiler supports atomic operations.  */
+gpg_error_t
+ksba_ocsp_cache_new (ksba_ocsp_cache_t *r_cache, unsigned int size)
+{
+  unsigned int n;
 
-      /* Now write it out as a sequence to the outer Request object. */
-      p = ksba_writer_snatch_mem (w2, &derlen);
-      if (!p)
-        {
-          err = ksba_writer_error (w2);
-          goto leave;
-        }
-      err = _ksba_ber_write_tl (w3, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                                1, derlen);
-      if (!err)
-        err = ksba_writer_write (w3, p, derlen);
-      xfree (p); p = NULL;
-      if (err)
-        goto leave;
+  if (!r_cache)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_cache = NULL;
+  if (!size)
+    size = 1024;
+  if (size > (1u << 24))
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  for (n = CACHE_MAX_PROBES; n < size; n <<= 1)
+    ;
+  *r_cache = xtrycalloc (1, (sizeof **r_cache
+                             + (n - 1) * sizeof (*r_cache)->slots[0]));
+  if (!*r_cache)
+    return gpg_error_from_syserror ();
+  (*r_cache)->mask = n - 1;
+  return 0;
+}
 
-    } /* End of looping over single requests. */
 
-  /* Reuse writers; for clarity, use new names. */
-  w4 = w1;
-  w5 = w2;
-  err = ksba_writer_set_mem (w4, 2048);
-  if (!err)
-    err = ksba_writer_set_mem (w5, 2048);
-  if (err)
-    goto leave;
+/* Release CACHE.  The cache must not be used anymore by any thread or
+   OCSP object.  Passing NULL is a valid nop.  */
+void
+ksba_ocsp_cache_release (ksba_ocsp_cache_t cache)
+{
+  struct ocsp_cache_entry_s *entry;
+  unsigned int i;
 
-  /* Put a sequence tag before the requestList. */
-  p = ksba_writer_snatch_mem (w3, &derlen);
-  if (!p)
+  if (!cache)
+    return;
+  for (i=0; i <= cache->mask; i++)
+    if (cache->slots[i])
+      cache_release_entry (cache->slots[i]);
+  while ((entry = cache->retired))
     {
-      err = ksba_writer_error (w3);
-      goto leave;
+      cache->retired = entry->next_retired;
+      cache_release_entry (entry);
     }
-  err = _ksba_ber_write_tl (w4, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, derlen);
-  if (!err)
-    err = ksba_writer_write (w4, p, derlen);
-  xfree (p); p = NULL;
-  if (err)
-    goto leave;
-
-  /* The requestExtensions go here. */
-  err = write_request_extensions (ocsp, w4);
-
-  /* Write the tbsRequest. */
+  xfree (cache);
+}
 
-  /* The version is default, thus we don't write it. */
 
-  /* The requesterName would go here. */
+/* Register a reader of CACHE and return its epoch which needs to be
+   passed to cache_leave.  */
+static unsigned int
+cache_enter (ksba_ocsp_cache_t cache)
+{
+  unsigned int epoch;
 
-  /* Write the requestList. */
-  p = ksba_writer_snatch_mem (w4, &derlen);
-  if (!p)
+  for (;;)
     {
-      err = ksba_writer_error (w4);
-      goto leave;
+      epoch = atomic_add_int (&cache->epoch, 0);
+      atomic_add_int (&cache->readers[epoch & 1], 1);
+      /* If the epoch advanced in the meantime we may have been
+         counted for an old epoch which the writers consider done.  */
+      if (atomic_add_int (&cache->epoch, 0) == epoch)
+        return epoch;
+      atomic_add_int (&cache->readers[epoch & 1], -1);
     }
-  err = _ksba_ber_write_tl (w5, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, derlen);
-  if (!err)
-    err = ksba_writer_write (w5, p, derlen);
-  xfree (p); p = NULL;
-  if (err)
-    goto leave;
+}
 
-  /* Reuse writers; for clarity, use new names. */
-  w6 = w3;
-  w7 = w4;
-  err = ksba_writer_set_mem (w6, 2048);
-  if (!err)
-    err = ksba_writer_set_mem (w7, 2048);
-  if (err)
-    goto leave;
 
-  /* Prepend a sequence tag. */
-  p = ksba_writer_snatch_mem (w5, &derlen);
-  if (!p)
-    {
-      err = ksba_writer_error (w5);
-      goto leave;
-    }
-  err = _ksba_ber_write_tl (w6, TYPE_SEQUENCE, CLASS_UNIVERSAL,
-                            1, derlen);
-  if (!err)
-    err = ksba_writer_write (w6, p, derlen);
-  xfree (p); p = NULL;
-  if (err)
-    goto leave;
+/* Unregister the reader of CACHE which registered for EPOCH.  */
+static void
+cache_leave (ksba_ocsp_cache_t cache, unsigned int epoch)
+{
+  atomic_add_int (&cache->readers[epoch & 1], -1);
+}
 
-  /* Write the ocspRequest. */
-
-  /* Note that we do not support the optional signature, because this
-     saves us one writer object. */
-
-  /* Prepend a sequence tag. */
-/*   p = ksba_writer_snatch_mem (w6, &derlen); */
-/*   if (!p) */
-/*     { */
-/*       err = ksba_writer_error (w6); */
-/*       goto leave; */
-/*     } */
-/*   err = _ksba_ber_write_tl (w7, TYPE_SEQUENCE, CLASS_UNIVERSAL, */
-/*                             1, derlen); */
-/*   if (!err) */
-/*     err = ksba_writer_write (w7, p, derlen); */
-/*   xfree (p); p = NULL; */
-/*   if (err) */
-/*     goto leave; */
-
-
-  /* Read out the entire request. */
-  p = ksba_writer_snatch_mem (w6, &derlen);
-  if (!p)
+
+/* Put the replaced ENTRY on the retired list of CACHE, advance the
+   epoch if possible and free all retired entries which can't be seen
+   by a reader anymore.  */
+static void
+cache_retire (ksba_ocsp_cache_t cache, struct ocsp_cache_entry_s *entry)
+{
+  struct ocsp_cache_entry_s *list, *keep, *tail;
+  unsigned int epoch;
+
+  entry->retire_epoch = atomic_add_int (&cache->epoch, 0);
+  do
+    entry->next_retired = cache->retired;
+  while (!atomic_cas_ptr (&cache->retired, entry->next_retired, entry));
+
+  epoch = atomic_add_int (&cache->epoch, 0);
+  if (!atomic_add_int (&cache->readers[(epoch + 1) & 1], 0)
+      && atomic_cas_int (&cache->epoch, epoch, epoch + 1))
+    epoch++;
+  else
+    epoch = atomic_add_int (&cache->epoch, 0);
+
+  do
+    list = cache->retired;
+  while (list && !atomic_cas_ptr (&cache->retired, list, NULL));
+
+  keep = tail = NULL;
+  while ((entry = list))
     {
-      err = ksba_writer_error (w6);
-      goto leave;
+      list = entry->next_retired;
+      /* Entries retired by others after we read the epoch may have a
+         later epoch; thus the difference is taken as signed.  */
+      if ((int)(epoch - entry->retire_epoch) >= 2)
+        cache_release_entry (entry);
+      else
+        {
+          entry->next_retired = keep;
+          keep = entry;
+          if (!tail)
+            tail = entry;
+        }
     }
-  ocsp->request_buffer = p;
-  ocsp->request_buflen = derlen;
-  /* Ready. */
+  if (!keep)
+    return;
 
- leave:
-  ksba_writer_release (w3);
-  ksba_writer_release (w2);
-  ksba_writer_release (w1);
-  return err;
+  do
+    tail->next_retired = cache->retired;
+  while (!atomic_cas_ptr (&cache->retired, tail->next_retired, keep));
 }
 
 
-gpg_error_t
+/* Store the status of the request item RI along with the response
+   BLOB in CACHE.  */
+static gpg_error_t
+cache_insert (ksba_ocsp_cache_t cache, struct ocsp_reqitem_s *ri,
+              struct ocsp_cache_blob_s *blob)
+{
+  struct ocsp_cache_entry_s *entry, *old, *victim;
+  unsigned int i, n, victim_idx, epoch;
+
+  entry = xtrymalloc (sizeof *entry + ri->serialnolen);
+  if (!entry)
+    return gpg_error_from_syserror ();
+  entry->next_retired = NULL;
+  entry->hash = certid_hash (ri->sha1_name_hash, ri->sha1_key_hash,
+                             ri->serialno, ri->serialnolen);
+  memcpy (entry->issuer_name_hash, ri->sha1_name_hash, 20);
+  memcpy (entry->issuer_key_hash, ri->sha1_key_hash, 20);
+  entry->status = ri->status;
+  _ksba_copy_time (entry->this_update, ri->this_update);
+  _ksba_copy_time (entry->next_update, ri->next_update);
+  _ksba_copy_time (entry->revocation_time, ri->revocation_time);
+  entry->revocation_reason = ri->revocation_reason;
+  entry->serialnolen = ri->serialnolen;
+  memcpy (entry->serialno, ri->serialno, ri->serialnolen);
+  atomic_add_int (&blob->refcount, 1);
+  entry->response = blob;
+
+  /* We are a reader of the slots until the new entry has been
+     stored; this keeps the entries we look at, and thus their
+     addresses, from being reused by a concurrent retire.  */
+  epoch = cache_enter (cache);
+ retry:
+  victim = NULL;
+  victim_idx = 0;
+  for (n=0, i = entry->hash & cache->mask; n < CACHE_MAX_PROBES;
+       n++, i = (i + 1) & cache->mask)
+    {
+      old = cache->slots[i];
+      if (!old)
+        {
+          if (!atomic_cas_ptr (&cache->slots[i], NULL, entry))
+            goto retry;
+          victim = NULL;
+          goto leave;
+        }
+      if (cache_entry_matches (old, entry->hash,
+                               entry->issuer_name_hash,
+                               entry->issuer_key_hash,
+                               entry->serialno, entry->serialnolen))
+        {
+          if (strcmp (old->this_update, entry->this_update) > 0)
+            {
+              /* We already have a newer status.  ENTRY has never
+                 been visible to others.  */
+              cache_leave (cache, epoch);
+              cache_release_entry (entry);
+              return 0;
+            }
+          victim = old;
+          victim_idx = i;
+          break;
+        }
+      /* Prefer to replace the entry which expires first.  */
+      if (!victim || strcmp (old->next_update, victim->next_update) < 0)
+        {
+          victim = old;
+          victim_idx = i;
+        }
+    }
+
+  if (!atomic_cas_ptr (&cache->slots[victim_idx], victim, entry))
+    goto retry;
+
+ leave:
+  cache_leave (cache, epoch);
+  /* Retire only after leaving so that we do not hold back the epoch
+     on which the reclamation of the victim depends.  */
+  if (victim)
+    cache_retire (cache, victim);
+  return 0;
+}
+
+
+/* Look up the status of the CertID in CACHE.  The entry is only
+   returned if it has not expired at NOW.  On success the status is
+   copied to RI and if R_RESPONSE is not NULL a copy of the response
+   is stored there.  */
+static gpg_error_t
+cache_lookup (ksba_ocsp_cache_t cache, const ksba_isotime_t now,
+              const unsigned char *name_hash, const unsigned char *key_hash,
+              const unsigned char *serialno, size_t serialnolen,
+              struct ocsp_reqitem_s *ri,
+              unsigned char **r_response, size_t *r_responselen)
+{
+  gpg_error_t err = gpg_error (GPG_ERR_NOT_FOUND);
+  struct ocsp_cache_entry_s *entry;
+  unsigned int hash, i, n, epoch;
+
+  hash = certid_hash (name_hash, key_hash, serialno, serialnolen);
+
+  epoch = cache_enter (cache);
+  for (n=0, i = hash & cache->mask; n < CACHE_MAX_PROBES;
+       n++, i = (i + 1) & cache->mask)
+    {
+      entry = cache->slots[i];
+      if (!entry)
+        break;
+      if (!cache_entry_matches (entry, hash, name_hash, key_hash,
+                                serialno, serialnolen))
+        continue;
+      if (strcmp (now, entry->next_update) >= 0)
+        break; /* Expired.  */
+
+      ri->status = entry->status;
+      _ksba_copy_time (ri->this_update, entry->this_update);
+      _ksba_copy_time (ri->next_update, entry->next_update);
+      _ksba_copy_time (ri->revocation_time, entry->revocation_time);
+      ri->revocation_reason = entry->revocation_reason;
+      err = 0;
+      if (r_response)
+        {
+          *r_response = xtrymalloc (entry->response->length);
+          if (!*r_response)
+            err = gpg_error_from_syserror ();
+          else
+            {
+              memcpy (*r_response, entry->response->data,
+                      entry->response->length);
+              *r_responselen = entry->response->length;
+            }
+        }
+      break;
+    }
+  cache_leave (cache, epoch);
+
+  return err;
+}
+
+
+/* Look up the status of CERT issued by ISSUER_CERT in CACHE.  NOW is
+   the current time or NULL to use the system time; expired entries
+   are not returned.  The values are returned like
+   ksba_ocsp_get_status does.  If R_RESPONSE is not NULL a copy of the
+   encoded response which carried the status is stored there and its
+   length at R_RESPONSELEN.  GPG_ERR_NOT_FOUND is returned if the
+   cache has no fresh status for CERT.  */
+gpg_error_t
+ksba_ocsp_cache_lookup (ksba_ocsp_cache_t cache,
+                        ksba_cert_t cert, ksba_cert_t issuer_cert,
+                        const ksba_isotime_t now,
+                        ksba_status_t *r_status,
+                        ksba_isotime_t r_this_update,
+                        ksba_isotime_t r_next_update,
+                        ksba_isotime_t r_revocation_time,
+                        ksba_crl_reason_t *r_reason,
+                        unsigned char **r_response,
+                        size_t *r_responselen)
+{
+  gpg_error_t err;
+  struct ocsp_reqitem_s ri;
+  ksba_isotime_t curtime;
+  const unsigned char *name_hash, *key_hash;
+  const unsigned char *serialno;
+  size_t serialnolen;
+
+  if (!cache || !cert || !issuer_cert || !r_status
+      || (r_response && !r_responselen))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (r_response)
+    {
+      *r_response = NULL;
+      *r_responselen = 0;
+    }
+
+  if (!now)
+    {
+      _ksba_current_time (curtime);
+      now = curtime;
+    }
+
+  memset (&ri, 0, sizeof ri);
+  err = issuer_sha1_hashes (issuer_cert, &name_hash, &key_hash);
+  if (!err)
+    err = _ksba_cert_get_serial_ptr (cert, &serialno, &serialnolen);
+  if (!err)
+    err = cache_lookup (cache, now, name_hash, key_hash,
+                        serialno, serialnolen, &ri, r_response, r_responselen);
+  if (err)
+    return err;
+
+  *r_status = ri.status;
+  if (r_this_update)
+    _ksba_copy_time (r_this_update, ri.this_update);
+  if (r_next_update)
+    _ksba_copy_time (r_next_update, ri.next_update);
+  if (r_revocation_time)
+    _ksba_copy_time (r_revocation_time, ri.revocation_time);
+  if (r_reason)
+    *r_reason = ri.revocation_reason;
+  return 0;
+}
+
+
+/* Use CACHE for OCSP.  Targets with a fresh status in the cache are
+   not included in the request; their status is taken from the cache.
+   CACHE must not be released before OCSP.  Passing NULL for CACHE
+   stops using a cache.  */
+gpg_error_t
+ksba_ocsp_set_cache (ksba_ocsp_t ocsp, ksba_ocsp_cache_t cache)
+{
+  if (!ocsp)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  ocsp->cache = cache;
+  return 0;
+}
+
+
+/* Store the status of the targets from the last parsed response in
+   the cache of OCSP.  Only a successful response is used and only
+   targets with a nextUpdate time are stored.  This function must
+   only be called after the signature of the response has been
+   verified.  */
+gpg_error_t
+ksba_ocsp_update_cache (ksba_ocsp_t ocsp)
+{
+  gpg_error_t err = 0;
+  struct ocsp_reqitem_s *ri;
+  struct ocsp_cache_blob_s *blob;
+
+  if (!ocsp)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!ocsp->cache || !ocsp->response)
+    return gpg_error (GPG_ERR_MISSING_ACTION);
+  if (ocsp->response_status != KSBA_OCSP_RSPSTATUS_SUCCESS
+      || ocsp->bad_nonce || (ocsp->noncelen && !ocsp->good_nonce))
+    return gpg_error (GPG_ERR_INV_RESPONSE);
+
+  /* The response is stored only once for all its entries.  */
+  blob = xtrymalloc (sizeof *blob + ocsp->responselen);
+  if (!blob)
+    return gpg_error_from_syserror ();
+  blob->refcount = 1;
+  blob->length = ocsp->responselen;
+  memcpy (blob->data, ocsp->response, ocsp->responselen);
+
+  for (ri=ocsp->requestlist; ri && !err; ri = ri->next)
+    {
+      if (ri->cached || ri->status == KSBA_STATUS_NONE || !*ri->next_update)
+        continue;
+      err = cache_insert (ocsp->cache, ri, blob);
+    }
+  cache_release_blob (blob);
+  return err;
+}
+
+
+
+/* Compute the CertIDs of all targets of OCSP and look them up in the
+   cache.  Store the length of the requestList at R_LISTLEN and the
+   length of the entire request at R_LENGTH.  This is the first pass
+   of encoding a request; put_request does the second one.  */
+static gpg_error_t
+prepare_targets (ksba_ocsp_t ocsp, size_t *r_listlen, size_t *r_length)
+{
+  gpg_error_t err;
+  struct ocsp_reqitem_s *ri;
+  const struct certid_algo_s *algo;
+  ksba_isotime_t now;
+  size_t n, listlen, tbslen;
+  int nrequests;
+
+  if (!ocsp->requestlist)
+    return gpg_error (GPG_ERR_MISSING_ACTION);
+
+  algo = certid_algos + find_certid_algo (ocsp->certid_algo);
+  _ksba_current_time (now);
+  nrequests = 0;
+  listlen = 0;
+  for (ri=ocsp->requestlist; ri; ri = ri->next)
+    {
+      /* Get the issuerNameHash, the issuerKeyHash and the serial
+         number.  The hashes are memoized by the issuer certificate
+         and thus computed only once for all targets of an issuer.
+         The cache is keyed by the SHA-1 hashes.  */
+      err = _ksba_cert_get_certid_hashes (ri->issuer_cert,
+                                          algo->oid, algo->hashlen,
+                                          &ri->issuer_name_hash,
+                                          &ri->issuer_key_hash);
+      if (!err)
+        err = issuer_sha1_hashes (ri->issuer_cert,
+                                  &ri->sha1_name_hash, &ri->sha1_key_hash);
+      if (!err)
+        err = _ksba_cert_get_serial_ptr (ri->cert, &ri->serialno,
+                                         &ri->serialnolen);
+      if (err)
+        return err;
+
+      /* Skip the target if the cache has a fresh status.  */
+      ri->cached = (ocsp->cache
+                    && !cache_lookup (ocsp->cache, now,
+                                      ri->sha1_name_hash,
+                                      ri->sha1_key_hash,
+                                      ri->serialno, ri->serialnolen,
+                                      ri, NULL, NULL));
+      if (ri->cached)
+        continue;
+      nrequests++;
+
+      n = certid_len (algo, ri);
+      n = tl_size (n) + n;
+      listlen += tl_size (n) + n;
+    }
+
+  err = build_request_index (ocsp);
+  if (err)
+    return err;
+
+  if (!nrequests)
+    return gpg_error (GPG_ERR_NO_DATA); /* All answered from the cache. */
+
+  tbslen = tl_size (listlen) + listlen + request_extensions_len (ocsp);
+  *r_listlen = listlen;
+  *r_length = tl_size (tl_size (tbslen) + tbslen) + tl_size (tbslen) + tbslen;
+  return 0;
+}
+
+
+/* Write the request of OCSP to P and return the pointer behind it.
+   LISTLEN is the length of the requestList as computed by
+   prepare_targets.  */
+static unsigned char *
+put_request (ksba_ocsp_t ocsp, size_t listlen, unsigned char *p)
+{
+  struct ocsp_reqitem_s *ri;
+  const struct certid_algo_s *algo;
+  size_t tbslen;
+
+  algo = certid_algos + find_certid_algo (ocsp->certid_algo);
+  tbslen = tl_size (listlen) + listlen + request_extensions_len (ocsp);
+
+  /* Write the ocspRequest and the tbsRequest.  Note that we do not
+     support the optional signature.  */
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1,
+              tl_size (tbslen) + tbslen);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, tbslen);
+
+  /* The version is default, thus we don't write it. */
+
+  /* The requesterName would go here. */
+
+  /* Write the requestList. */
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, listlen);
+  for (ri=ocsp->requestlist; ri; ri = ri->next)
+    if (!ri->cached)
+      p = put_single_request (algo, ri, p);
+
+  /* The requestExtensions go here. */
+  return put_request_extensions (ocsp, p);
+}
+
+
+/* Build a request from the current context.  The function checks that
+   all necessary information have been set and stores the prepared
+   request in the context.  A subsequent ksba_ocsp_build_request may
+   then be used to retrieve this request.  Optional the requestmay be
+   signed beofre calling ksba_ocsp_build_request.  If a cache is used
+   and all targets have a fresh status in the cache, GPG_ERR_NO_DATA
+   is returned; no request needs to be sent then.
+
+   The length of the request is computed first so that it can be
+   written to a buffer of the exact size.
+ */
+gpg_error_t
+ksba_ocsp_prepare_request (ksba_ocsp_t ocsp)
+{
+  gpg_error_t err;
+  unsigned char *buffer, *p;
+  size_t listlen, length;
+
+  if (!ocsp)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  xfree (ocsp->request_buffer);
+  ocsp->request_buffer = NULL;
+  ocsp->request_buflen = 0;
+
+  err = prepare_targets (ocsp, &listlen, &length);
+  if (err)
+    return err;
+
+  buffer = xtrymalloc (length);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  p = put_request (ocsp, listlen, buffer);
+  assert (p - buffer == length);
+
+  ocsp->request_buffer = buffer;
+  ocsp->request_buflen = length;
+  return 0;
+}
+
+
+/* Build a request like ksba_ocsp_build_request but write it to the
+   caller provided BUFFER of size BUFSIZE.  The length of the request
+   is stored at R_BUFLEN.  If BUFFER is NULL or too short,
+   GPG_ERR_BUFFER_TOO_SHORT is returned and R_BUFLEN gives the
+   required size.  No memory is allocated for the request.  */
+gpg_error_t
+ksba_ocsp_build_request_into (ksba_ocsp_t ocsp, unsigned char *buffer,
+                              size_t bufsize, size_t *r_buflen)
+{
+  gpg_error_t err;
+  unsigned char *p;
+  size_t listlen, length;
+
+  if (!ocsp || !r_buflen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_buflen = 0;
+
+  if (ocsp->request_buffer)
+    {
+      /* A request has already been prepared; hand it out.  */
+      *r_buflen = ocsp->request_buflen;
+      if (!buffer || bufsize < ocsp->request_buflen)
+        return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+      memcpy (buffer, ocsp->request_buffer, ocsp->request_buflen);
+      xfree (ocsp->request_buffer);
+      ocsp->request_buffer = NULL;
+      ocsp->request_buflen = 0;
+      return 0;
+    }
+
+  err = prepare_targets (ocsp, &listlen, &length);
+  if (err)
+    return err;
+  *r_buflen = length;
+  if (!buffer || bufsize < length)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+  p = put_request (ocsp, listlen, buffer);
+  assert (p - buffer == length);
+  return 0;
+}
+
+
+gpg_error_t
 ksba_ocsp_hash_request (ksba_ocsp_t ocsp,
                         void (*hasher)(void *, const void *,
                                        size_t length),
@@ -813,7 +1387,8 @@ ksba_ocsp_add_cert (ksba_ocsp_t ocsp, ksba_cert_t cert)
 
 /* Build a request from the current context.  The function checks that
    all necessary information have been set and then returns an
-   allocated buffer with the resulting request.
+   allocated buffer with the resulting request.  See
+   ksba_ocsp_prepare_request for the use of a cache.
  */
 gpg_error_t
 ksba_ocsp_build_request (ksba_ocsp_t ocsp,
@@ -1152,7 +1727,7 @@ parse_single_response (ksba_ocsp_t ocsp,
   *data += n;
   *datalen -= n;
   /*   fprintf (stderr, "algorithmIdentifier is `%s'\n", oid); */
-  look_for_request = !strcmp (oid, oidstr_sha1);
+  look_for_request = !strcmp (oid, ocsp->certid_algo);
   xfree (oid);
 
   err = parse_octet_string (data, datalen, &ti);
@@ -1162,8 +1737,8 @@ parse_single_response (ksba_ocsp_t ocsp,
 /*   fprintf (stderr, "issuerNameHash=");  */
 /*   dump_hex (*data, ti.length); */
 /*   putc ('\n', stderr); */
-  if (ti.length != 20)
-    look_for_request = 0; /* Can't be a SHA-1 digest. */
+  if (ti.length != ocsp->certid_hashlen)
+    look_for_request = 0; /* Can't be our digest. */
   parse_skip (data, datalen, &ti);
 
   err = parse_octet_string (data, datalen, &ti);
@@ -1173,8 +1748,8 @@ parse_single_response (ksba_ocsp_t ocsp,
 /*   fprintf (stderr, "issuerKeyHash=");  */
 /*   dump_hex (*data, ti.length); */
 /*   putc ('\n', stderr); */
-  if (ti.length != 20)
-    look_for_request = 0; /* Can't be a SHA-1 digest. */
+  if (ti.length != ocsp->certid_hashlen)
+    look_for_request = 0; /* Can't be our digest. */
   parse_skip (data, datalen, &ti);
 
   err= parse_integer (data, datalen, &ti);
@@ -1188,15 +1763,8 @@ parse_single_response (ksba_ocsp_t ocsp,
   parse_skip (data, datalen, &ti);
 
   if (look_for_request)
-    {
-      for (request_item = ocsp->requestlist;
-           request_item; request_item = request_item->next)
-        if (!memcmp (request_item->issuer_name_hash, name_hash, 20)
-             && !memcmp (request_item->issuer_key_hash, key_hash, 20)
-             && request_item->serialnolen == serialnolen
-            && !memcmp (request_item->serialno, serialno, serialnolen))
-          break; /* Got it. */
-    }
+    request_item = find_request_by_certid (ocsp, name_hash, key_hash,
+                                           serialno, serialnolen);
 
 
   /*
@@ -1637,8 +2205,13 @@ ksba_ocsp_parse_response (ksba_ocsp_t ocsp,
   ocsp->responder_id.name = NULL;
   xfree (ocsp->responder_id.keyid);
   ocsp->responder_id.keyid = NULL;
+  xfree (ocsp->response);
+  ocsp->response = NULL;
+  ocsp->responselen = 0;
   for (ri=ocsp->requestlist; ri; ri = ri->next)
     {
+      if (ri->cached)
+        continue;
       ri->status = KSBA_STATUS_NONE;
       *ri->this_update = 0;
       *ri->next_update = 0;
@@ -1658,6 +2231,19 @@ ksba_ocsp_parse_response (ksba_ocsp_t ocsp,
     if (ocsp->bad_nonce || (ocsp->noncelen && !ocsp->good_nonce))
       *response_status = KSBA_OCSP_RSPSTATUS_REPLAYED;
 
+  /* Keep a copy of the response for ksba_ocsp_update_cache.  */
+  if (!err && ocsp->cache && *response_status == KSBA_OCSP_RSPSTATUS_SUCCESS)
+    {
+      ocsp->response = xtrymalloc (msglen);
+      if (!ocsp->response)
+        err = gpg_error_from_syserror ();
+      else
+        {
+          memcpy (ocsp->response, msg, msglen);
+          ocsp->responselen = msglen;
+        }
+    }
+
   return err;
 }
 
@@ -1824,13 +2410,8 @@ ksba_ocsp_get_status (ksba_ocsp_t ocsp, ksba_cert_t cert,
     return gpg_error (GPG_ERR_MISSING_ACTION);
 
   /* Find the certificate.  We don't care about the issuer certificate
-     and stop at the first match.  The implementation may be optimized
-     by keeping track of the last certificate found to start with the
-     next one then.  Given that a usual request consists only of a few
-     certificates, this does not make much sense in reality. */
-  for (ri=ocsp->requestlist; ri; ri = ri->next)
-    if (ri->cert == cert)
-      break;
+     and stop at the first match. */
+  ri = find_request_by_cert (ocsp, cert);
   if (!ri)
     return gpg_error (GPG_ERR_NOT_FOUND);
   if (r_status)
@@ -1868,9 +2449,7 @@ ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert, int idx,
       /* Return extensions for the certificate (singleExtensions).  */
       struct ocsp_reqitem_s *ri;
 
-      for (ri=ocsp->requestlist; ri; ri = ri->next)
-        if (ri->cert == cert)
-          break;
+      ri = find_request_by_cert (ocsp, cert);
       if (!ri)
         return gpg_error (GPG_ERR_NOT_FOUND);
 
@@ -1899,3 +2478,1214 @@ ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert, int idx,
 
   return 0;
 }
+
+
+
+/*
+   The responder side of OCSP.
+*/
+
+/* Space left at the start of the response buffer for the headers of
+   the objects around the tbsResponseData.  */
+#define RESPONSE_HEADROOM 48
+
+
+/* Write ATIME as GeneralizedTime to P and return the pointer behind
+   it.  */
+static unsigned char *
+put_generalized_time (unsigned char *p, const ksba_isotime_t atime)
+{
+  p = put_tl (p, TYPE_GENERALIZED_TIME, CLASS_UNIVERSAL, 0, 15);
+  memcpy (p, atime, 8);
+  memcpy (p+8, atime+9, 6);
+  p[14] = 'Z';
+  return p + 15;
+}
+
+
+/* Map the CRL REASON to the value of the CRLReason enumeration or
+   return -1 if the reason should not be included.  */
+static int
+crl_reason_code (ksba_crl_reason_t reason)
+{
+  static const struct {
+    ksba_crl_reason_t reason;
+    int code;
+  } tbl[] = {
+    { KSBA_CRLREASON_KEY_COMPROMISE,         1 },
+    { KSBA_CRLREASON_CA_COMPROMISE,          2 },
+    { KSBA_CRLREASON_AFFILIATION_CHANGED,    3 },
+    { KSBA_CRLREASON_SUPERSEDED,             4 },
+    { KSBA_CRLREASON_CESSATION_OF_OPERATION, 5 },
+    { KSBA_CRLREASON_CERTIFICATE_HOLD,       6 },
+    { KSBA_CRLREASON_REMOVE_FROM_CRL,        8 },
+    { KSBA_CRLREASON_PRIVILEGE_WITHDRAWN,    9 },
+    { KSBA_CRLREASON_AA_COMPROMISE,         10 }
+  };
+  int i;
+
+  for (i=0; i < DIM (tbl); i++)
+    if ((reason & tbl[i].reason))
+      return tbl[i].code;
+  return -1;  /* Unspecified reasons are not included.  */
+}
+
+
+/* Release the list of hash algorithms HA.  */
+static void
+release_hash_algos (struct ocsp_hashalgo_s *ha)
+{
+  struct ocsp_hashalgo_s *next;
+
+  for (; ha; ha = next)
+    {
+      next = ha->next;
+      xfree (ha->oid);
+      xfree (ha);
+    }
+}
+
+
+/* Create a new OCSP responder object and return it at R_RESP.  */
+gpg_error_t
+ksba_ocsp_responder_new (ksba_ocsp_responder_t *r_resp)
+{
+  if (!r_resp)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_resp = xtrycalloc (1, sizeof **r_resp);
+  if (!*r_resp)
+    return gpg_error_from_syserror ();
+  return 0;
+}
+
+
+/* Release the OCSP responder object RESP.  Passing NULL is a valid
+   nop.  */
+void
+ksba_ocsp_responder_release (ksba_ocsp_responder_t resp)
+{
+  struct ocsp_issuer_s *is;
+
+  if (!resp)
+    return;
+  while ((is = resp->issuers))
+    {
+      resp->issuers = is->next;
+      ksba_cert_release (is->cert);
+      xfree (is);
+    }
+  release_hash_algos (resp->hash_algos);
+  release_hash_algos (resp->unknown_algos);
+  xfree (resp->responder_id);
+  xfree (resp->sig_algo);
+  xfree (resp->certs);
+  xfree (resp->sigbuf);
+  xfree (resp->items);
+  xfree (resp->pool);
+  xfree (resp->buffer);
+  xfree (resp);
+}
+
+
+/* Set the ResponderID of the responses created by RESP from the
+   responder's certificate CERT.  If BY_KEY is set the hash of the
+   public key is used, else the subject name.  */
+gpg_error_t
+ksba_ocsp_responder_set_responder_id (ksba_ocsp_responder_t resp,
+                                      ksba_cert_t cert, int by_key)
+{
+  gpg_error_t err;
+  const unsigned char *der;
+  size_t derlen, n;
+  unsigned char *p;
+  const unsigned char *name_hash, *key_hash;
+
+  if (!resp || !cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (by_key)
+    {
+      err = issuer_sha1_hashes (cert, &name_hash, &key_hash);
+      if (err)
+        return err;
+      der = key_hash;
+      derlen = 20;
+      n = tl_size (tl_size (derlen) + derlen) + tl_size (derlen) + derlen;
+    }
+  else
+    {
+      err = _ksba_cert_get_subject_dn_ptr (cert, &der, &derlen);
+      if (err)
+        return err;
+      n = tl_size (derlen) + derlen;
+    }
+
+  p = xtrymalloc (n);
+  if (!p)
+    return gpg_error_from_syserror ();
+  xfree (resp->responder_id);
+  resp->responder_id = p;
+  resp->responder_id_len = n;
+  if (by_key)
+    {
+      /* byKey [2] KeyHash */
+      p = put_tl (p, 2, CLASS_CONTEXT, 1, tl_size (derlen) + derlen);
+      p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, derlen);
+    }
+  else /* byName [1] Name */
+    p = put_tl (p, 1, CLASS_CONTEXT, 1, derlen);
+  memcpy (p, der, derlen);
+  return 0;
+}
+
+
+/* Add the certificate CERT to the certificates included in the
+   responses created by RESP.  Usually this is the certificate of the
+   responder.  */
+gpg_error_t
+ksba_ocsp_responder_add_cert (ksba_ocsp_responder_t resp, ksba_cert_t cert)
+{
+  const unsigned char *image;
+  size_t imagelen;
+  unsigned char *p;
+
+  if (!resp || !cert)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  image = ksba_cert_get_image (cert, &imagelen);
+  if (!image)
+    return gpg_error (GPG_ERR_INV_CERT_OBJ);
+  p = xtryrealloc (resp->certs, resp->certs_len + imagelen);
+  if (!p)
+    return gpg_error_from_syserror ();
+  memcpy (p + resp->certs_len, image, imagelen);
+  resp->certs = p;
+  resp->certs_len += imagelen;
+  return 0;
+}
+
+
+/* Add the certificate ISSUER of a CA for which RESP answers requests.
+   The CertIDs of parsed requests are matched against these
+   certificates.  The first issuer added has the index 0, the next 1
+   and so on.  */
+gpg_error_t
+ksba_ocsp_responder_add_issuer (ksba_ocsp_responder_t resp,
+                                ksba_cert_t issuer)
+{
+  gpg_error_t err;
+  struct ocsp_issuer_s *is, **tail;
+  const unsigned char *name_hash, *key_hash;
+
+  if (!resp || !issuer)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  /* Compute the SHA-1 hashes now; they are used by most clients.  */
+  err = issuer_sha1_hashes (issuer, &name_hash, &key_hash);
+  if (err)
+    return err;
+  is = xtrycalloc (1, sizeof *is);
+  if (!is)
+    return gpg_error_from_syserror ();
+  ksba_cert_ref (issuer);
+  is->cert = issuer;
+  is->idx = resp->nissuers++;
+  for (tail = &resp->issuers; *tail; tail = &(*tail)->next)
+    ;
+  *tail = is;
+  return 0;
+}
+
+
+/* Set the function used by RESP to sign responses.  SIG_ALGO is the
+   OID of the signature algorithm and MAXSIGLEN the maximum length of
+   a signature.  SIGNER is called with SIGNER_ARG, the DER encoded
+   tbsResponseData and its length, a buffer of MAXSIGLEN bytes for the
+   signature and a pointer to store the actual length of the
+   signature.  The signature is stored as the content of the
+   signature BIT STRING; e.g. for RSA this is the PKCS#1 signature
+   block.  */
+gpg_error_t
+ksba_ocsp_responder_set_signer (ksba_ocsp_responder_t resp,
+                                const char *sig_algo, size_t maxsiglen,
+                                gpg_error_t (*signer)(void *arg,
+                                                const unsigned char *tbs,
+                                                size_t tbslen,
+                                                unsigned char *sigbuf,
+                                                size_t *r_siglen),
+                                void *signer_arg)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  unsigned char *der, *sigbuf;
+  size_t derlen;
+
+  if (!resp || !sig_algo || !maxsiglen || !signer)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  err = ksba_writer_new (&w);
+  if (!err)
+    err = ksba_writer_set_mem (w, 64);
+  if (!err)
+    err = _ksba_der_write_algorithm_identifier (w, sig_algo, NULL, 0);
+  if (err)
+    {
+      ksba_writer_release (w);
+      return err;
+    }
+  der = ksba_writer_snatch_mem (w, &derlen);
+  if (!der)
+    err = ksba_writer_error (w);
+  ksba_writer_release (w);
+  if (err)
+    return err;
+
+  sigbuf = xtrymalloc (maxsiglen);
+  if (!sigbuf)
+    {
+      err = gpg_error_from_syserror ();
+      xfree (der);
+      return err;
+    }
+  xfree (resp->sig_algo);
+  resp->sig_algo = der;
+  resp->sig_algo_len = derlen;
+  xfree (resp->sigbuf);
+  resp->sigbuf = sigbuf;
+  resp->sigbufsize = maxsiglen;
+  resp->signer = signer;
+  resp->signer_arg = signer_arg;
+  return 0;
+}
+
+
+/* Clear the current request of RESP.  The allocated buffers are
+   kept for the next request.  */
+void
+ksba_ocsp_responder_reset (ksba_ocsp_responder_t resp)
+{
+  if (!resp)
+    return;
+  resp->nitems = 0;
+  resp->poollen = 0;
+  release_hash_algos (resp->unknown_algos);
+  resp->unknown_algos = NULL;
+  resp->have_nonce = 0;
+  resp->nonce_off = 0;
+  resp->nonce_len = 0;
+}
+
+
+/* Append LENGTH bytes of DATA to the pool of RESP and store their
+   offset at R_OFF.  */
+static gpg_error_t
+pool_append (ksba_ocsp_responder_t resp, const void *data, size_t length,
+             size_t *r_off)
+{
+  if (resp->poollen + length > resp->poolsize)
+    {
+      size_t n = resp->poolsize? 2 * resp->poolsize : 1024;
+      unsigned char *p;
+
+      while (n < resp->poollen + length)
+        n *= 2;
+      p = xtryrealloc (resp->pool, n);
+      if (!p)
+        return gpg_error_from_syserror ();
+      resp->pool = p;
+      resp->poolsize = n;
+    }
+  memcpy (resp->pool + resp->poollen, data, length);
+  *r_off = resp->poollen;
+  resp->poollen += length;
+  return 0;
+}
+
+
+/* Return a new item for the current request of RESP.  */
+static gpg_error_t
+new_respitem (ksba_ocsp_responder_t resp, struct ocsp_respitem_s **r_item)
+{
+  struct ocsp_respitem_s *item;
+
+  if (resp->nitems == resp->itemsalloc)
+    {
+      size_t n = resp->itemsalloc? 2 * resp->itemsalloc : 16;
+
+      item = xtryrealloc (resp->items, n * sizeof *item);
+      if (!item)
+        return gpg_error_from_syserror ();
+      resp->items = item;
+      resp->itemsalloc = n;
+    }
+  item = resp->items + resp->nitems++;
+  memset (item, 0, sizeof *item);
+  item->issuer = -1;
+  *r_item = item;
+  return 0;
+}
+
+
+/* Search the list HA for the DER encoded OID of length DERLEN.  */
+static struct ocsp_hashalgo_s *
+find_hash_algo (struct ocsp_hashalgo_s *ha,
+                const unsigned char *der, size_t derlen)
+{
+  for (; ha; ha = ha->next)
+    if (ha->derlen == derlen && !memcmp (ha->der, der, derlen))
+      return ha;
+  return NULL;
+}
+
+
+/* Return the hash algorithm with the DER encoded OID of length
+   DERLEN at R_ALGO.  Supported algorithms are cached for the life of
+   RESP, the others only for the current request.  */
+static gpg_error_t
+get_hash_algo (ksba_ocsp_responder_t resp,
+               const unsigned char *der, size_t derlen,
+               struct ocsp_hashalgo_s **r_algo)
+{
+  struct ocsp_hashalgo_s *ha;
+  int i;
+
+  ha = find_hash_algo (resp->hash_algos, der, derlen);
+  if (!ha)
+    ha = find_hash_algo (resp->unknown_algos, der, derlen);
+  if (ha)
+    {
+      *r_algo = ha;
+      return 0;
+    }
+
+  ha = xtrymalloc (sizeof *ha + derlen);
+  if (!ha)
+    return gpg_error_from_syserror ();
+  ha->oid = ksba_oid_to_str (der, derlen);
+  if (!ha->oid)
+    {
+      xfree (ha);
+      return gpg_error_from_syserror ();
+    }
+  i = find_certid_algo (ha->oid);
+  ha->certid_algo = i < 0? NULL : certid_algos[i].oid;
+  ha->hashlen = i < 0? 0 : certid_algos[i].hashlen;
+  ha->derlen = derlen;
+  memcpy (ha->der, der, derlen);
+  if (ha->certid_algo)
+    {
+      ha->next = resp->hash_algos;
+      resp->hash_algos = ha;
+    }
+  else
+    {
+      ha->next = resp->unknown_algos;
+      resp->unknown_algos = ha;
+    }
+  *r_algo = ha;
+  return 0;
+}
+
+
+/* Find the issuer matching ITEM.  The hashes of the issuers are
+   computed on first use for each hash algorithm.  */
+static void
+match_issuer (ksba_ocsp_responder_t resp, struct ocsp_respitem_s *item)
+{
+  struct ocsp_issuer_s *is;
+  const char *algo = item->hash_algo->certid_algo;
+  size_t hashlen = item->hash_algo->hashlen;
+  const unsigned char *name_hash, *key_hash;
+
+  item->issuer = -1;
+  if (!algo
+      || item->name_hash_len != hashlen || item->key_hash_len != hashlen)
+    return;
+  for (is = resp->issuers; is; is = is->next)
+    if (!_ksba_cert_get_certid_hashes (is->cert, algo, hashlen,
+                                       &name_hash, &key_hash)
+        && !memcmp (key_hash, resp->pool + item->key_hash_off, hashlen)
+        && !memcmp (name_hash, resp->pool + item->name_hash_off, hashlen))
+      {
+        item->issuer = is->idx;
+        break;
+      }
+}
+
+
+/* Parse the CertID at DATA and add it as a new item to RESP.  */
+static gpg_error_t
+parse_certid (ksba_ocsp_responder_t resp,
+              unsigned char const **data, size_t *datalen)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  struct ocsp_respitem_s *item;
+  const unsigned char *certid, *endptr, *oid;
+  size_t oidlen, certidoff;
+
+  certid = *data;
+  err = parse_sequence (data, datalen, &ti);
+  if (err)
+    return err;
+  err = pool_append (resp, certid, ti.nhdr + ti.length, &certidoff);
+  if (err)
+    return err;
+  err = new_respitem (resp, &item);
+  if (err)
+    return err;
+  item->certid_off = certidoff;
+  item->certid_len = ti.nhdr + ti.length;
+
+  /* hashAlgorithm.  */
+  err = parse_sequence (data, datalen, &ti);
+  if (err)
+    return err;
+  endptr = *data + ti.length;
+  err = _ksba_ber_parse_tl (data, datalen, &ti);
+  if (err)
+    return err;
+  if (!(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID
+        && !ti.is_constructed && ti.length))
+    return gpg_error (GPG_ERR_INV_OBJ);
+  if (ti.length > *datalen || *data + ti.length > endptr)
+    return gpg_error (GPG_ERR_BAD_BER);
+  oid = *data;
+  oidlen = ti.length;
+  *datalen -= endptr - *data;
+  *data = endptr;  /* Skip the parameters.  */
+  err = get_hash_algo (resp, oid, oidlen, &item->hash_algo);
+  if (err)
+    return err;
+
+  /* The offsets of the other fields are relative to the copy of the
+     CertID.  */
+  err = parse_octet_string (data, datalen, &ti);
+  if (err)
+    return err;
+  item->name_hash_off = certidoff + (*data - certid);
+  item->name_hash_len = ti.length;
+  parse_skip (data, datalen, &ti);
+
+  err = parse_octet_string (data, datalen, &ti);
+  if (err)
+    return err;
+  item->key_hash_off = certidoff + (*data - certid);
+  item->key_hash_len = ti.length;
+  parse_skip (data, datalen, &ti);
+
+  err = parse_integer (data, datalen, &ti);
+  if (err)
+    return err;
+  item->serial_off = certidoff + (*data - certid);
+  item->serial_len = ti.length;
+  parse_skip (data, datalen, &ti);
+
+  if (*data - certid != item->certid_len)
+    return gpg_error (GPG_ERR_INV_OBJ);
+
+  match_issuer (resp, item);
+  return 0;
+}
+
+
+/* Parse the requestExtensions at DATA of length DATALEN and store
+   the nonce.  */
+static gpg_error_t
+parse_request_extensions (ksba_ocsp_responder_t resp,
+                          const unsigned char *data, size_t datalen)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *endptr, *oid;
+  size_t length, oidlen;
+  int is_crit;
+
+  err = parse_sequence (&data, &datalen, &ti);
+  if (err)
+    return err;
+  length = ti.length;
+  while (length)
+    {
+      err = parse_sequence (&data, &datalen, &ti);
+      if (err)
+        return err;
+      if (length < ti.nhdr + ti.length)
+        return gpg_error (GPG_ERR_BAD_BER);
+      length -= ti.nhdr + ti.length;
+      endptr = data + ti.length;
+
+      err = _ksba_ber_parse_tl (&data, &datalen, &ti);
+      if (err)
+        return err;
+      if (!(ti.class == CLASS_UNIVERSAL && ti.tag == TYPE_OBJECT_ID
+            && !ti.is_constructed))
+        return gpg_error (GPG_ERR_INV_OBJ);
+      if (ti.length > datalen)
+        return gpg_error (GPG_ERR_BAD_BER);
+      oid = data;
+      oidlen = ti.length;
+      parse_skip (&data, &datalen, &ti);
+      is_crit = 0;
+      err = parse_optional_boolean (&data, &datalen, &is_crit);
+      if (err)
+        return err;
+      err = parse_octet_string (&data, &datalen, &ti);
+      if (err)
+        return err;
+      if (data + ti.length > endptr)
+        return gpg_error (GPG_ERR_BAD_BER);
+
+      if (oidlen == sizeof der_oid_ocsp_nonce
+          && !memcmp (oid, der_oid_ocsp_nonce, oidlen))
+        {
+          err = pool_append (resp, data, ti.length, &resp->nonce_off);
+          if (err)
+            return err;
+          resp->nonce_len = ti.length;
+          resp->have_nonce = 1;
+        }
+      else if (is_crit)
+        return gpg_error (GPG_ERR_UNSUPPORTED_CMS_OBJ);
+      datalen -= endptr - data;
+      data = endptr;
+    }
+  return 0;
+}
+
+
+/* Parse the request:
+
+     OCSPRequest ::= SEQUENCE {
+         tbsRequest                  TBSRequest,
+         optionalSignature   [0]     EXPLICIT Signature OPTIONAL }
+
+     TBSRequest ::= SEQUENCE {
+         version             [0]     EXPLICIT Version DEFAULT v1,
+         requestorName       [1]     EXPLICIT GeneralName OPTIONAL,
+         requestList                 SEQUENCE OF Request,
+         requestExtensions   [2]     EXPLICIT Extensions OPTIONAL }
+
+     Request ::= SEQUENCE {
+         reqCert                     CertID,
+         singleRequestExtensions [0] EXPLICIT Extensions OPTIONAL }
+*/
+static gpg_error_t
+parse_request (ksba_ocsp_responder_t resp,
+               const unsigned char *msg, size_t msglen)
+{
+  gpg_error_t err;
+  struct tag_info ti;
+  const unsigned char *savedata, *endptr, *reqend;
+  size_t savedatalen, listlen;
+  int tag;
+
+  err = parse_sequence (&msg, &msglen, &ti);
+  if (err)
+    return err;
+  err = parse_sequence (&msg, &msglen, &ti);
+  if (err)
+    return err;
+  endptr = msg + ti.length;
+
+  /* The optional version and requestorName.  */
+  for (tag=0; tag < 2; tag++)
+    {
+      savedata = msg;
+      savedatalen = msglen;
+      err = parse_context_tag (&msg, &msglen, &ti, tag);
+      if (!err)
+        parse_skip (&msg, &msglen, &ti);
+      else if (gpg_err_code (err) == GPG_ERR_INV_OBJ)
+        {
+          msg = savedata;
+          msglen = savedatalen;
+        }
+      else
+        return err;
+    }
+
+  /* The requestList.  */
+  err = parse_sequence (&msg, &msglen, &ti);
+  if (err)
+    return err;
+  listlen = ti.length;
+  if (!listlen)
+    return gpg_error (GPG_ERR_NO_DATA);
+  while (listlen)
+    {
+      savedatalen = msglen;
+      err = parse_sequence (&msg, &msglen, &ti);
+      if (err)
+        return err;
+      reqend = msg + ti.length;
+      err = parse_certid (resp, &msg, &msglen);
+      if (err)
+        return err;
+      if (msg > reqend)
+        return gpg_error (GPG_ERR_BAD_BER);
+      /* Skip the singleRequestExtensions.  */
+      msglen -= reqend - msg;
+      msg = reqend;
+      if (listlen < savedatalen - msglen)
+        return gpg_error (GPG_ERR_BAD_BER);
+      listlen -= savedatalen - msglen;
+    }
+
+  /* The optional requestExtensions.  */
+  if (msg < endptr)
+    {
+      err = parse_context_tag (&msg, &msglen, &ti, 2);
+      if (err)
+        return err;
+      err = parse_request_extensions (resp, msg, ti.length);
+      if (err)
+        return err;
+    }
+
+  /* We do not check the optionalSignature.  */
+  return 0;
+}
+
+
+/* Parse the DER encoded OCSP request MSG of length MSGLEN and make
+   its CertIDs the items of the next response of RESP.  The nonce of
+   the request is returned in the response.  Note that a signature of
+   the request is not checked.  */
+gpg_error_t
+ksba_ocsp_responder_parse_request (ksba_ocsp_responder_t resp,
+                                   const unsigned char *msg, size_t msglen)
+{
+  gpg_error_t err;
+
+  if (!resp || !msg || !msglen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  ksba_ocsp_responder_reset (resp);
+  err = parse_request (resp, msg, msglen);
+  if (err)
+    ksba_ocsp_responder_reset (resp);
+  return err;
+}
+
+
+/* Set the hash algorithm used for the CertIDs created by
+   ksba_ocsp_responder_add_target to OID.  The default is SHA-1.
+   Returns GPG_ERR_DIGEST_ALGO if we do not know the algorithm.  */
+gpg_error_t
+ksba_ocsp_responder_set_certid_algo (ksba_ocsp_responder_t resp,
+                                     const char *oid)
+{
+  int i;
+
+  if (!resp || !oid)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  i = find_certid_algo (oid);
+  if (i < 0)
+    return gpg_error (GPG_ERR_DIGEST_ALGO);
+  resp->certid_algo = certid_algos[i].oid;
+  return 0;
+}
+
+
+/* Add a CertID for the certificate CERT issued by ISSUER_CERT to the
+   items of the next response of RESP.  The hash algorithm is the one
+   set with ksba_ocsp_responder_set_certid_algo.  This may be used to
+   create responses without a request.  The index of the new item is
+   stored at R_IDX.  */
+gpg_error_t
+ksba_ocsp_responder_add_target (ksba_ocsp_responder_t resp,
+                                ksba_cert_t cert, ksba_cert_t issuer_cert,
+                                int *r_idx)
+{
+  gpg_error_t err;
+  const struct certid_algo_s *algo;
+  struct ocsp_respitem_s *item;
+  struct ocsp_hashalgo_s *hash_algo;
+  const unsigned char *serial;
+  size_t seriallen, algolen, certidlen, off, dummy;
+  /* Room for the CertID up to the value of the serial number with
+     OIDs of up to 16 and hashes of up to 64 bytes.  */
+  unsigned char *p, buf[4 + 2 + 2+16 + 2 + 2*(2+64) + 4];
+  const unsigned char *name_hash, *key_hash;
+  unsigned char *name_hash_p, *key_hash_p;
+
+  if (!resp || !cert || !issuer_cert || !r_idx)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  algo = certid_algos + find_certid_algo (resp->certid_algo
+                                          ? resp->certid_algo
+                                          : oidstr_sha1);
+  err = _ksba_cert_get_serial_ptr (cert, &serial, &seriallen);
+  if (!err)
+    err = _ksba_cert_get_certid_hashes (issuer_cert, algo->oid,
+                                        algo->hashlen,
+                                        &name_hash, &key_hash);
+  if (err)
+    return err;
+  algolen = tl_size (algo->derlen) + algo->derlen + 2;
+  certidlen = (tl_size (algolen) + algolen
+               + 2 * (tl_size (algo->hashlen) + algo->hashlen)
+               + tl_size (seriallen) + seriallen);
+
+  /* Write the CertID up to the value of the serial number.  */
+  p = put_tl (buf, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, certidlen);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, algolen);
+  p = put_tl (p, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0, algo->derlen);
+  memcpy (p, algo->der, algo->derlen);
+  p += algo->derlen;
+  p = put_tl (p, TYPE_NULL, CLASS_UNIVERSAL, 0, 0);
+  p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, algo->hashlen);
+  name_hash_p = p;
+  memcpy (p, name_hash, algo->hashlen);
+  p += algo->hashlen;
+  p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, algo->hashlen);
+  key_hash_p = p;
+  memcpy (p, key_hash, algo->hashlen);
+  p += algo->hashlen;
+  p = put_tl (p, TYPE_INTEGER, CLASS_UNIVERSAL, 0, seriallen);
+  assert (p - buf <= sizeof buf);
+
+  err = get_hash_algo (resp, (const unsigned char *)algo->der, algo->derlen,
+                       &hash_algo);
+  if (!err)
+    err = pool_append (resp, buf, p - buf, &off);
+  if (!err)
+    err = pool_append (resp, serial, seriallen, &dummy);
+  if (!err)
+    err = new_respitem (resp, &item);
+  if (err)
+    return err;  /* The unused pool space does not harm.  */
+  item->hash_algo = hash_algo;
+  item->certid_off = off;
+  item->certid_len = resp->poollen - off;
+  item->name_hash_off = off + (name_hash_p - buf);
+  item->name_hash_len = algo->hashlen;
+  item->key_hash_off = off + (key_hash_p - buf);
+  item->key_hash_len = algo->hashlen;
+  item->serial_off = off + (p - buf);
+  item->serial_len = seriallen;
+  match_issuer (resp, item);
+  *r_idx = resp->nitems - 1;
+  return 0;
+}
+
+
+/* Return the number of items of the next response of RESP.  */
+int
+ksba_ocsp_responder_get_count (ksba_ocsp_responder_t resp)
+{
+  return resp? resp->nitems : 0;
+}
+
+
+/* Return the CertID of the item IDX of RESP.  The OID of the hash
+   algorithm is stored at R_HASH_ALGO, the hashes of the issuer's name
+   and key and the serial number are returned as pointers into RESP
+   along with their lengths.  These pointers are valid until the next
+   request is parsed or a target added.  The index of the matching
+   issuer as added by ksba_ocsp_responder_add_issuer is stored at
+   R_ISSUER or -1 if no issuer matches.  Any of the return arguments
+   may be NULL.  */
+gpg_error_t
+ksba_ocsp_responder_get_request (ksba_ocsp_responder_t resp, int idx,
+                                 const char **r_hash_algo,
+                                 const unsigned char **r_name_hash,
+                                 size_t *r_name_hash_len,
+                                 const unsigned char **r_key_hash,
+                                 size_t *r_key_hash_len,
+                                 const unsigned char **r_serial,
+                                 size_t *r_serial_len,
+                                 int *r_issuer)
+{
+  struct ocsp_respitem_s *item;
+
+  if (!resp || idx < 0)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx >= resp->nitems)
+    return gpg_error (GPG_ERR_EOF);
+  item = resp->items + idx;
+
+  if (r_hash_algo)
+    *r_hash_algo = item->hash_algo->oid;
+  if (r_name_hash)
+    *r_name_hash = resp->pool + item->name_hash_off;
+  if (r_name_hash_len)
+    *r_name_hash_len = item->name_hash_len;
+  if (r_key_hash)
+    *r_key_hash = resp->pool + item->key_hash_off;
+  if (r_key_hash_len)
+    *r_key_hash_len = item->key_hash_len;
+  if (r_serial)
+    *r_serial = resp->pool + item->serial_off;
+  if (r_serial_len)
+    *r_serial_len = item->serial_len;
+  if (r_issuer)
+    *r_issuer = item->issuer;
+  return 0;
+}
+
+
+/* Return the value of the nonce extension of the last parsed request
+   at R_NONCE and R_NONCELEN.  GPG_ERR_NO_DATA is returned if the
+   request has no nonce.  */
+gpg_error_t
+ksba_ocsp_responder_get_nonce (ksba_ocsp_responder_t resp,
+                               const unsigned char **r_nonce,
+                               size_t *r_noncelen)
+{
+  const unsigned char *data;
+  size_t datalen;
+  struct tag_info ti;
+
+  if (!resp || !r_nonce || !r_noncelen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!resp->have_nonce)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  /* The nonce is commonly wrapped into another OCTET STRING; we
+     return the value of that one.  */
+  data = resp->pool + resp->nonce_off;
+  datalen = resp->nonce_len;
+  if (!parse_octet_string (&data, &datalen, &ti) && ti.length == datalen)
+    {
+      *r_nonce = data;
+      *r_noncelen = datalen;
+    }
+  else
+    {
+      *r_nonce = resp->pool + resp->nonce_off;
+      *r_noncelen = resp->nonce_len;
+    }
+  return 0;
+}
+
+
+/* Set the status of the item IDX of RESP.  THIS_UPDATE is the time
+   at which the status was known to be correct; if it is NULL the
+   producedAt time of the response is used.  NEXT_UPDATE is optional.
+   REVOCATION_TIME and REASON are only used with the status
+   KSBA_STATUS_REVOKED.  Items without a status are returned as
+   unknown.  */
+gpg_error_t
+ksba_ocsp_responder_set_status (ksba_ocsp_responder_t resp, int idx,
+                                ksba_status_t status,
+                                const ksba_isotime_t this_update,
+                                const ksba_isotime_t next_update,
+                                const ksba_isotime_t revocation_time,
+                                ksba_crl_reason_t reason)
+{
+  struct ocsp_respitem_s *item;
+
+  if (!resp || idx < 0)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (idx >= resp->nitems)
+    return gpg_error (GPG_ERR_EOF);
+  if (status != KSBA_STATUS_GOOD && status != KSBA_STATUS_UNKNOWN
+      && status != KSBA_STATUS_REVOKED)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if ((this_update && *this_update && _ksba_assert_time_format (this_update))
+      || (next_update && *next_update
+          && _ksba_assert_time_format (next_update)))
+    return gpg_error (GPG_ERR_INV_TIME);
+  if (status == KSBA_STATUS_REVOKED
+      && (!revocation_time || _ksba_assert_time_format (revocation_time)))
+    return gpg_error (GPG_ERR_INV_TIME);
+
+  item = resp->items + idx;
+  item->status = status;
+  if (this_update)
+    _ksba_copy_time (item->this_update, this_update);
+  else
+    *item->this_update = 0;
+  if (next_update)
+    _ksba_copy_time (item->next_update, next_update);
+  else
+    *item->next_update = 0;
+  if (status == KSBA_STATUS_REVOKED)
+    {
+      _ksba_copy_time (item->revocation_time, revocation_time);
+      item->revocation_reason = reason;
+    }
+  else
+    {
+      *item->revocation_time = 0;
+      item->revocation_reason = 0;
+    }
+  return 0;
+}
+
+
+/* Return the length of the RevokedInfo of ITEM without its header.  */
+static size_t
+revoked_info_size (struct ocsp_respitem_s *item)
+{
+  return 17 + (crl_reason_code (item->revocation_reason) != -1? 5 : 0);
+}
+
+
+/* Return the length of the certStatus of ITEM.  */
+static size_t
+cert_status_size (struct ocsp_respitem_s *item)
+{
+  size_t n;
+
+  if (item->status != KSBA_STATUS_REVOKED)
+    return 2;
+  n = revoked_info_size (item);
+  return tl_size (n) + n;
+}
+
+
+/* Return the length of the SingleResponse of ITEM without its
+   header.  */
+static size_t
+single_response_size (struct ocsp_respitem_s *item)
+{
+  return (item->certid_len + cert_status_size (item) + 17
+          + (*item->next_update? 19 : 0));
+}
+
+
+/* Make sure that the response buffer of RESP has at least LENGTH
+   bytes.  */
+static gpg_error_t
+reserve_buffer (ksba_ocsp_responder_t resp, size_t length)
+{
+  unsigned char *p;
+
+  if (resp->bufsize >= length)
+    return 0;
+  length += length / 4;
+  p = xtrymalloc (length);
+  if (!p)
+    return gpg_error_from_syserror ();
+  xfree (resp->buffer);
+  resp->buffer = p;
+  resp->bufsize = length;
+  return 0;
+}
+
+
+/* Build a signed response for the items of RESP.  PRODUCED_AT is the
+   time of the response; if it is NULL the current time is used.  On
+   success a pointer to the DER encoded response and its length is
+   stored at R_BUF and R_BUFLEN.  The buffer belongs to RESP and is
+   valid until the next response is built or RESP is released.  */
+gpg_error_t
+ksba_ocsp_responder_build_response (ksba_ocsp_responder_t resp,
+                                    const ksba_isotime_t produced_at,
+                                    const unsigned char **r_buf,
+                                    size_t *r_buflen)
+{
+  gpg_error_t err;
+  ksba_isotime_t now;
+  struct ocsp_respitem_s *item;
+  size_t idx, n, listlen, extlen, tbslen, siglen, certslen, basiclen;
+  size_t octlen, byteslen, ctxlen, hdrlen, total;
+  unsigned char *p, *tbs;
+  int code;
+
+  if (!resp || !r_buf || !r_buflen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_buf = NULL;
+  *r_buflen = 0;
+  if (!resp->responder_id || !resp->signer)
+    return gpg_error (GPG_ERR_MISSING_ACTION);
+  if (!resp->nitems)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  if (produced_at && *produced_at)
+    {
+      err = _ksba_assert_time_format (produced_at);
+      if (err)
+        return err;
+      _ksba_copy_time (now, produced_at);
+    }
+  else
+    _ksba_current_time (now);
+
+  /* Compute the length of the tbsResponseData.  */
+  listlen = 0;
+  for (idx=0; idx < resp->nitems; idx++)
+    {
+      n = single_response_size (resp->items + idx);
+      listlen += tl_size (n) + n;
+    }
+  extlen = 0;
+  if (resp->have_nonce)
+    {
+      n = 2 + sizeof der_oid_ocsp_nonce
+        + tl_size (resp->nonce_len) + resp->nonce_len;
+      n = tl_size (n) + n;   /* Extension */
+      n = tl_size (n) + n;   /* Extensions */
+      extlen = tl_size (n) + n;
+    }
+  tbslen = resp->responder_id_len + 17 + tl_size (listlen) + listlen + extlen;
+  certslen = resp->certs_len? tl_size (resp->certs_len) + resp->certs_len : 0;
+
+  err = reserve_buffer (resp, (RESPONSE_HEADROOM + tl_size (tbslen) + tbslen
+                               + resp->sig_algo_len
+                               + 6 + 1 + resp->sigbufsize
+                               + (certslen? tl_size (certslen) + certslen:0)));
+  if (err)
+    return err;
+
+  /* Write the tbsResponseData behind the room for the headers.  */
+  tbs = resp->buffer + RESPONSE_HEADROOM;
+  p = put_tl (tbs, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, tbslen);
+  memcpy (p, resp->responder_id, resp->responder_id_len);
+  p += resp->responder_id_len;
+  p = put_generalized_time (p, now);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, listlen);
+  for (idx=0; idx < resp->nitems; idx++)
+    {
+      item = resp->items + idx;
+      p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1,
+                  single_response_size (item));
+      memcpy (p, resp->pool + item->certid_off, item->certid_len);
+      p += item->certid_len;
+      switch (item->status)
+        {
+        case KSBA_STATUS_GOOD:
+          p = put_tl (p, 0, CLASS_CONTEXT, 0, 0);
+          break;
+        case KSBA_STATUS_REVOKED:
+          code = crl_reason_code (item->revocation_reason);
+          p = put_tl (p, 1, CLASS_CONTEXT, 1, revoked_info_size (item));
+          p = put_generalized_time (p, item->revocation_time);
+          if (code != -1)
+            {
+              p = put_tl (p, 0, CLASS_CONTEXT, 1, 3);
+              p = put_tl (p, TYPE_ENUMERATED, CLASS_UNIVERSAL, 0, 1);
+              *p++ = code;
+            }
+          break;
+        default:
+          p = put_tl (p, 2, CLASS_CONTEXT, 0, 0);
+          break;
+        }
+      p = put_generalized_time (p, *item->this_update? item->this_update:now);
+      if (*item->next_update)
+        {
+          p = put_tl (p, 0, CLASS_CONTEXT, 1, 17);
+          p = put_generalized_time (p, item->next_update);
+        }
+    }
+  if (resp->have_nonce)
+    {
+      n = 2 + sizeof der_oid_ocsp_nonce
+        + tl_size (resp->nonce_len) + resp->nonce_len;
+      p = put_tl (p, 1, CLASS_CONTEXT, 1, tl_size (tl_size (n) + n)
+                  + tl_size (n) + n);
+      p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, tl_size (n) + n);
+      p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n);
+      p = put_tl (p, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0,
+                  sizeof der_oid_ocsp_nonce);
+      memcpy (p, der_oid_ocsp_nonce, sizeof der_oid_ocsp_nonce);
+      p += sizeof der_oid_ocsp_nonce;
+      p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, resp->nonce_len);
+      memcpy (p, resp->pool + resp->nonce_off, resp->nonce_len);
+      p += resp->nonce_len;
+    }
+  assert (p - tbs == tl_size (tbslen) + tbslen);
+  tbslen = p - tbs;
+
+  /* Sign it.  */
+  siglen = resp->sigbufsize;
+  err = resp->signer (resp->signer_arg, tbs, tbslen, resp->sigbuf, &siglen);
+  if (err)
+    return err;
+  if (siglen > resp->sigbufsize)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+
+  /* Append the signatureAlgorithm, the signature and the
+     certificates.  */
+  memcpy (p, resp->sig_algo, resp->sig_algo_len);
+  p += resp->sig_algo_len;
+  p = put_tl (p, TYPE_BIT_STRING, CLASS_UNIVERSAL, 0, siglen + 1);
+  *p++ = 0; /* Number of unused bits.  */
+  memcpy (p, resp->sigbuf, siglen);
+  p += siglen;
+  if (certslen)
+    {
+      p = put_tl (p, 0, CLASS_CONTEXT, 1, certslen);
+      p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, resp->certs_len);
+      memcpy (p, resp->certs, resp->certs_len);
+      p += resp->certs_len;
+    }
+  basiclen = p - tbs;
+
+  /* Now prepend the headers:
+
+     OCSPResponse ::= SEQUENCE {
+        responseStatus         OCSPResponseStatus,
+        responseBytes          [0] EXPLICIT ResponseBytes OPTIONAL }
+
+     ResponseBytes ::= SEQUENCE {
+        responseType   OBJECT IDENTIFIER,
+        response       OCTET STRING }  -- BasicOCSPResponse
+  */
+  octlen = tl_size (basiclen) + basiclen;
+  byteslen = 2 + sizeof der_oid_ocsp_basic + tl_size (octlen) + octlen;
+  ctxlen = tl_size (byteslen) + byteslen;
+  n = 3 + tl_size (ctxlen) + ctxlen;
+  total = tl_size (n) + n;
+  hdrlen = total - basiclen;
+  assert (hdrlen <= RESPONSE_HEADROOM);
+
+  p = tbs - hdrlen;
+  *r_buf = p;
+  *r_buflen = total;
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, n);
+  p = put_tl (p, TYPE_ENUMERATED, CLASS_UNIVERSAL, 0, 1);
+  *p++ = 0; /* successful */
+  p = put_tl (p, 0, CLASS_CONTEXT, 1, ctxlen);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, byteslen);
+  p = put_tl (p, TYPE_OBJECT_ID, CLASS_UNIVERSAL, 0,
+              sizeof der_oid_ocsp_basic);
+  memcpy (p, der_oid_ocsp_basic, sizeof der_oid_ocsp_basic);
+  p += sizeof der_oid_ocsp_basic;
+  p = put_tl (p, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0, octlen);
+  p = put_tl (p, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, basiclen);
+  assert (p == tbs);
+
+  return 0;
+}
+
+
+/* Build an unsuccessful response with the STATUS for RESP.  On
+   success a pointer to the DER encoded response and its length is
+   stored at R_BUF and R_BUFLEN.  The buffer belongs to RESP and is
+   valid until the next response is built or RESP is released.  */
+gpg_error_t
+ksba_ocsp_responder_build_error (ksba_ocsp_responder_t resp,
+                                 ksba_ocsp_response_status_t status,
+                                 const unsigned char **r_buf,
+                                 size_t *r_buflen)
+{
+  gpg_error_t err;
+  unsigned char *p;
+
+  if (!resp || !r_buf || !r_buflen)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  switch (status)
+    {
+    case KSBA_OCSP_RSPSTATUS_MALFORMED:
+    case KSBA_OCSP_RSPSTATUS_INTERNAL:
+    case KSBA_OCSP_RSPSTATUS_TRYLATER:
+    case KSBA_OCSP_RSPSTATUS_SIGREQUIRED:
+    case KSBA_OCSP_RSPSTATUS_UNAUTHORIZED:
+      break;
+    default:
+      return gpg_error (GPG_ERR_INV_VALUE);
+    }
+  err = reserve_buffer (resp, 5);
+  if (err)
+    return err;
+  p = put_tl (resp->buffer, TYPE_SEQUENCE, CLASS_UNIVERSAL, 1, 3);
+  p = put_tl (p, TYPE_ENUMERATED, CLASS_UNIVERSAL, 0, 1);
+  *p++ = status;
+  *r_buf = resp->buffer;
+  *r_buflen = p - resp->buffer;
+  return 0;
+}
@@ -53,6 +53,48 @@ struct ocsp_extension_s
 };
 
 
+/* A response stored in the status cache.  It is shared by the
+   entries for all statuses it carries.  */
+struct ocsp_cache_blob_s {
+  int refcount;
+  size_t length;
+  unsigned char data[1];
+};
+
+/* An entry of the status cache.  Entries are not modified after they
+   have been entered into the cache.  */
+struct ocsp_cache_entry_s {
+  struct ocsp_cache_entry_s *next_retired; /* Used after replacement.  */
+  unsigned int retire_epoch;          /* Epoch of the replacement.  */
+  unsigned int hash;                  /* Hash value of the CertID.  */
+  unsigned char issuer_name_hash[20]; /* The cache is always keyed by */
+  unsigned char issuer_key_hash[20];  /* the SHA-1 CertID.  */
+  ksba_status_t  status;
+  ksba_isotime_t this_update;
+  ksba_isotime_t next_update;         /* The entry expires at this time.  */
+  ksba_isotime_t revocation_time;
+  ksba_crl_reason_t revocation_reason;
+  struct ocsp_cache_blob_s *response;
+  size_t serialnolen;
+  unsigned char serialno[1];
+};
+
+/* The status cache.  This is a hash table using linear probing.
+   Slots are never cleared but only replaced so that readers do not
+   need a lock.  Replaced entries are kept in the RETIRED list until
+   the readers which may still see them are done.  For this readers
+   register with the counter of the current EPOCH; the epoch advances
+   only when no reader of the previous epoch is left.  An entry
+   replaced during epoch E may thus be freed once the epoch is E+2.  */
+struct ksba_ocsp_cache_s {
+  unsigned int mask;       /* Number of slots minus 1.  */
+  unsigned int epoch;      /* The current epoch.  */
+  int readers[2];          /* Active readers by parity of their epoch.  */
+  struct ocsp_cache_entry_s *retired;
+  struct ocsp_cache_entry_s *slots[1];
+};
+
+
 /* A structure to keep a information about a single status request. */
 struct ocsp_reqitem_s {
   struct ocsp_reqitem_s *next;
@@ -60,11 +102,15 @@ struct ocsp_reqitem_s {
   ksba_cert_t cert;        /* The target certificate for the request. */
   ksba_cert_t issuer_cert; /* And the certificate of the issuer. */
 
-  /* The next 4 fields are used to match a response with a request. */
-  unsigned char issuer_name_hash[20]; /* The hash as used by the request. */
-  unsigned char issuer_key_hash[20];  /* The hash as used by the request. */
-  unsigned char *serialno; /* A malloced copy of the serial number. */
-  size_t serialnolen;      /* and its length. */
+  /* The next 4 fields are used to match a response with a request.
+     The hashes point into the memoized hashes of ISSUER_CERT.  */
+  const unsigned char *issuer_name_hash; /* The hash as used by the */
+  const unsigned char *issuer_key_hash;  /* request.  */
+  const unsigned char *serialno; /* The serial number; points into */
+  size_t serialnolen;            /* the image of CERT.  */
+
+  const unsigned char *sha1_name_hash; /* The SHA-1 hashes used as key */
+  const unsigned char *sha1_key_hash;  /* for the status cache.  */
 
   /* The actual status as parsed from the response. */
   ksba_isotime_t this_update;  /* The thisUpdate value from the response. */
@@ -73,14 +119,26 @@ struct ocsp_reqitem_s {
   ksba_isotime_t revocation_time;      /* The indicated revocation time. */
   ksba_crl_reason_t revocation_reason; /* The reason given for revocation. */
   struct ocsp_extension_s *single_extensions; /* List of extensions. */
+  int cached;              /* The status was taken from the cache. */
+
+  unsigned int certid_hash;              /* Hash value of the CertID.  */
+  struct ocsp_reqitem_s *next_by_certid; /* Next in the CertID bucket. */
+  struct ocsp_reqitem_s *next_by_cert;   /* Next in the cert bucket.  */
 };
 
 /* A structure used as context for the ocsp subsystem. */
 struct ksba_ocsp_s {
   char *digest_oid;        /* The OID of the digest algorithm to be
                               used for a request. */
+  const char *certid_algo; /* The OID of the hash algorithm used for
+                              the CertIDs; a static string. */
+  size_t certid_hashlen;   /* The length of these hashes.  */
 
   struct ocsp_reqitem_s *requestlist;  /* The list of request items. */
+  struct ocsp_reqitem_s **certid_index; /* Hash tables to find request */
+  struct ocsp_reqitem_s **cert_index;   /* items; built by
+                                           ksba_ocsp_prepare_request. */
+  unsigned int index_mask;              /* Size of the tables minus 1. */
 
   size_t noncelen;          /* 0 if no nonce was sent. */
   unsigned char nonce[16];  /* The random nonce we sent; actual length
@@ -108,6 +166,99 @@ struct ksba_ocsp_s {
     char *keyid;            /* Allocated key ID. */
     size_t keyidlen;        /* length of the KeyID. */
   } responder_id;           /* The reponder ID from the response. */
+
+  ksba_ocsp_cache_t cache;  /* The status cache or NULL.  */
+  unsigned char *response;  /* Copy of the last successful response */
+  size_t responselen;       /* if a cache is used.  */
+};
+
+
+/* A hash algorithm seen in a CertID.  The supported ones are cached
+   by the responder so that the OIDs need to be converted only once;
+   the others are kept only for the current request.  */
+struct ocsp_hashalgo_s {
+  struct ocsp_hashalgo_s *next;
+  char *oid;                /* The OID as string.  */
+  const char *certid_algo;  /* The same OID as a static string or NULL
+                               if we do not support the algorithm.  */
+  size_t hashlen;           /* The length of its hashes.  */
+  size_t derlen;            /* Length of DER.  */
+  unsigned char der[1];     /* The DER encoded OID.  */
+};
+
+/* An issuer known to the responder.  */
+struct ocsp_issuer_s {
+  struct ocsp_issuer_s *next;
+  int idx;                  /* Index of this issuer.  */
+  ksba_cert_t cert;
+};
+
+/* A single request as seen by the responder along with the status to
+   be returned.  All offsets are relative to the POOL of the
+   responder.  */
+struct ocsp_respitem_s {
+  size_t certid_off;        /* The DER encoded CertID.  */
+  size_t certid_len;
+  size_t name_hash_off;     /* The value of the issuerNameHash.  */
+  size_t name_hash_len;
+  size_t key_hash_off;      /* The value of the issuerKeyHash.  */
+  size_t key_hash_len;
+  size_t serial_off;        /* The value of the serialNumber.  */
+  size_t serial_len;
+  struct ocsp_hashalgo_s *hash_algo;
+  int issuer;               /* Index of the matching issuer or -1.  */
+
+  ksba_status_t  status;
+  ksba_isotime_t this_update;
+  ksba_isotime_t next_update;
+  ksba_isotime_t revocation_time;
+  ksba_crl_reason_t revocation_reason;
+};
+
+/* A structure used as context for an OCSP responder.  The buffers
+   are kept when a new request is processed so that a responder
+   running for a long time does not need to allocate memory for each
+   response.  */
+struct ksba_ocsp_responder_s {
+  /* Precomputed parts of the response.  */
+  unsigned char *responder_id;  /* The DER encoded ResponderID.  */
+  size_t responder_id_len;
+  unsigned char *sig_algo;      /* The DER encoded signatureAlgorithm.  */
+  size_t sig_algo_len;
+  unsigned char *certs;         /* The concatenated certificates.  */
+  size_t certs_len;
+
+  /* The signing function, its argument and a buffer for the
+     signature.  */
+  gpg_error_t (*signer) (void *, const unsigned char *, size_t,
+                         unsigned char *, size_t *);
+  void *signer_arg;
+  unsigned char *sigbuf;
+  size_t sigbufsize;
+
+  struct ocsp_issuer_s *issuers;     /* The known issuers.  */
+  int nissuers;
+  const char *certid_algo;      /* The hash algorithm for the CertIDs
+                                   of ksba_ocsp_responder_add_target
+                                   or NULL for SHA-1.  */
+  struct ocsp_hashalgo_s *hash_algos; /* The cached hash algorithms.  */
+  struct ocsp_hashalgo_s *unknown_algos; /* Unsupported hash algorithms
+                                            of the current request.  */
+
+  /* The current request.  */
+  struct ocsp_respitem_s *items;
+  size_t nitems;
+  size_t itemsalloc;
+  unsigned char *pool;          /* Storage for the request data.  */
+  size_t poollen;
+  size_t poolsize;
+  int have_nonce;               /* The request has a nonce.  */
+  size_t nonce_off;             /* The value of the nonce extension.  */
+  size_t nonce_len;
+
+  /* The buffer for the response.  */
+  unsigned char *buffer;
+  size_t bufsize;
 };
 
 
@@ -138,6 +138,16 @@ _ksba_oid_node_to_str (const unsigned char *image, AsnNode node)
 }
 
 
+/* Same as _ksba_oid_node_to_str but for a compact VALUE.  */
+char *
+_ksba_oid_value_to_str (const unsigned char *image, AsnValue value)
+{
+  if (!value || value->type != TYPE_OBJECT_ID || value->off == -1)
+    return NULL;
+  return ksba_oid_to_str (image+value->off + value->nhdr, value->len);
+}
+
+
 
 static size_t
 make_flagged_int (unsigned long value, char *buf, size_t buflen)
@@ -84,7 +84,7 @@ gpg_error_t ksba_priv_key_parse_der (ksba_priv_key_t priv_key, ksba_reader_t rea
   priv_key->root = NULL;
   priv_key->asn_tree = NULL;
 
-  err = ksba_asn_create_tree ("tmttv2", &priv_key->asn_tree);
+  err = _ksba_asn_get_shared_tree ("tmttv2", &priv_key->asn_tree);
   if (err)
     goto leave;
 
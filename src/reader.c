@@ -34,10 +34,37 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include "util.h"
 
 #include "ksba.h"
 #include "reader.h"
+#include "asn1-func.h"
+#include "ber-help.h"
+
+/* The size of the read-ahead buffer.  File descriptors are read in
+   blocks of FD_READAHEAD_SIZE.  Callbacks are never asked for more
+   than the caller requested, except by ksba_reader_peek which asks
+   for READAHEAD_SIZE bytes.  */
+#define READAHEAD_SIZE     4096
+#define FD_READAHEAD_SIZE 65536
+
+/* Regular files of at least this size are mapped into memory.  */
+#define MIN_MAP_SIZE      FD_READAHEAD_SIZE
+
+/* The default limit for the size of an object in push mode.  */
+#define DEFAULT_PUSH_LIMIT (16*1024*1024)
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_FAILED)
+# define USE_MMAP 1
+#endif
 
 /**
  * ksba_reader_new:
@@ -76,8 +103,15 @@ ksba_reader_release (ksba_reader_t r)
       notify_fnc (r->notify_cb_value, r);
     }
   if (r->type == READER_TYPE_MEM)
-    xfree (r->u.mem.buffer);
-  xfree (r->unread.buf);
+    {
+      xfree (r->u.mem.buffer);
+      xfree (r->u.mem.scan);
+    }
+#ifdef USE_MMAP
+  else if (r->type == READER_TYPE_FD && r->u.fd.map)
+    munmap (r->u.fd.map, r->u.fd.mapsize);
+#endif
+  xfree (r->rbuf.buf);
   xfree (r);
 }
 
@@ -106,10 +140,12 @@ ksba_reader_set_release_notify (ksba_reader_t r,
    the logical end of one part of a file.  If BUFFER and BUFLEN are
    not NULL, possible unread data is copied to a newly allocated
    buffer and this buffer is assigned to BUFFER, BUFLEN will be set to
-   the length of the unread bytes. */
+   the length of the unread bytes.  Bytes which have been read ahead
+   from the source but never been returned are kept in the reader. */
 gpg_error_t
 ksba_reader_clear (ksba_reader_t r, unsigned char **buffer, size_t *buflen)
 {
+  gpg_error_t err = 0;
   size_t n;
 
   if (!r)
@@ -118,8 +154,10 @@ ksba_reader_clear (ksba_reader_t r, unsigned char **buffer, size_t *buflen)
   r->eof = 0;
   r->error = 0;
   r->nread = 0;
-  n = r->unread.length;
-  r->unread.length = 0;
+  n = r->rbuf.length - r->rbuf.readpos;
+  if (r->rbuf.ahead > n)
+    r->rbuf.ahead = n;
+  n -= r->rbuf.ahead;
 
   if (buffer && buflen)
     {
@@ -129,13 +167,19 @@ ksba_reader_clear (ksba_reader_t r, unsigned char **buffer, size_t *buflen)
         {
           *buffer = xtrymalloc (n);
           if (!*buffer)
-            return gpg_error_from_errno (errno);
-          memcpy (*buffer, r->unread.buf, n);
-          *buflen = n;
+            err = gpg_error_from_errno (errno);
+          else
+            {
+              memcpy (*buffer, r->rbuf.buf + r->rbuf.readpos, n);
+              *buflen = n;
+            }
         }
     }
+  r->rbuf.readpos += n;
+  if (r->rbuf.readpos == r->rbuf.length)
+    r->rbuf.readpos = r->rbuf.length = r->rbuf.ahead = 0;
 
-  return 0;
+  return err;
 }
 
 
@@ -173,6 +217,7 @@ ksba_reader_set_mem (ksba_reader_t r, const void *buffer, size_t length)
   if (r->type == READER_TYPE_MEM)
     { /* Reuse this reader */
       xfree (r->u.mem.buffer);
+      xfree (r->u.mem.scan);
       r->type = 0;
     }
   if (r->type)
@@ -184,6 +229,55 @@ ksba_reader_set_mem (ksba_reader_t r, const void *buffer, size_t length)
   memcpy (r->u.mem.buffer, buffer, length);
   r->u.mem.size = length;
   r->u.mem.readpos = 0;
+  r->u.mem.allocated = length;
+  r->u.mem.scan = NULL;
+  r->type = READER_TYPE_MEM;
+  r->eof = 0;
+
+  return 0;
+}
+
+
+/**
+ * ksba_reader_set_push:
+ * @r: Reader object
+ * @maxlen: Maximum length of the object or 0 for a default
+ *
+ * Initialize the reader object to read one BER encoded object which
+ * is passed piecewise to ksba_reader_push as it arrives.  This is
+ * only a buffering shim in front of the parsers, which are not
+ * resumable: the whole object is kept in memory until it is complete
+ * and @maxlen limits the size of that buffer.  If @maxlen is 0 a
+ * limit of 16 MiB is used; larger objects need a blocking reader.
+ * Once ksba_reader_push reports that the object is complete, it may
+ * be parsed from @r without waiting for more data.  The reader object
+ * may be reused for the next object by calling this function again.
+ *
+ * Return value: 0 on success or an error code.
+ **/
+gpg_error_t
+ksba_reader_set_push (ksba_reader_t r, size_t maxlen)
+{
+  if (!r)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (r->type == READER_TYPE_MEM)
+    { /* Reuse this reader */
+      xfree (r->u.mem.buffer);
+      xfree (r->u.mem.scan);
+      r->type = 0;
+    }
+  if (r->type)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  r->u.mem.scan = xtrymalloc (sizeof *r->u.mem.scan);
+  if (!r->u.mem.scan)
+    return gpg_error_from_syserror ();
+  _ksba_ber_scan_init (r->u.mem.scan);
+  r->u.mem.buffer = NULL;
+  r->u.mem.size = 0;
+  r->u.mem.readpos = 0;
+  r->u.mem.allocated = 0;
+  r->u.mem.limit = maxlen? maxlen : DEFAULT_PUSH_LIMIT;
   r->type = READER_TYPE_MEM;
   r->eof = 0;
 
@@ -191,6 +285,121 @@ ksba_reader_set_mem (ksba_reader_t r, const void *buffer, size_t length)
 }
 
 
+/**
+ * ksba_reader_push:
+ * @r: Reader object
+ * @buffer: Data
+ * @length: Length of Data (bytes)
+ * @r_nused: Returns the number of bytes taken from @buffer
+ *
+ * Pass the next @length bytes of the object to the reader @r which
+ * has been initialized with ksba_reader_set_push.  The headers of the
+ * encoding are scanned as they arrive so that the end of the object
+ * is found without parsing it.  Bytes following the object are not
+ * taken; the number of bytes taken is stored at @r_nused.
+ *
+ * Return value: 0 if the object is complete, GPG_ERR_EAGAIN if more
+ * data is required, GPG_ERR_TOO_LARGE if the object does not fit into
+ * the limit given to ksba_reader_set_push or another error code.
+ **/
+gpg_error_t
+ksba_reader_push (ksba_reader_t r, const void *buffer, size_t length,
+                  size_t *r_nused)
+{
+  gpg_error_t err;
+  size_t n, nfeed;
+
+  if (r_nused)
+    *r_nused = 0;
+  if (!r || (!buffer && length))
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (r->type != READER_TYPE_MEM || !r->u.mem.scan)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  /* Never feed more than fits into the limit; the bytes which would
+     not fit are only taken if they follow the object.  */
+  nfeed = length;
+  if (_ksba_ber_scan_done (r->u.mem.scan))
+    nfeed = 0;
+  else if (nfeed > r->u.mem.limit - r->u.mem.size)
+    nfeed = r->u.mem.limit - r->u.mem.size;
+
+  if (nfeed && r->u.mem.size + nfeed > r->u.mem.allocated)
+    {
+      /* Make room first so that the scanner state always matches the
+         buffered data.  */
+      size_t newsize = 2 * r->u.mem.allocated;
+      unsigned char *p;
+
+      if (newsize < r->u.mem.size + nfeed
+          || newsize < r->u.mem.allocated)
+        newsize = r->u.mem.size + nfeed;
+      if (newsize > r->u.mem.limit)
+        newsize = r->u.mem.limit;
+      p = xtryrealloc (r->u.mem.buffer, newsize);
+      if (!p)
+        return gpg_error_from_syserror ();
+      r->u.mem.buffer = p;
+      r->u.mem.allocated = newsize;
+    }
+
+  n = _ksba_ber_scan (r->u.mem.scan, buffer, nfeed, &err);
+  if (err)
+    return err;
+  if (n)
+    {
+      memcpy (r->u.mem.buffer + r->u.mem.size, buffer, n);
+      r->u.mem.size += n;
+    }
+  if (r_nused)
+    *r_nused = n;
+
+  if (_ksba_ber_scan_done (r->u.mem.scan))
+    return 0;
+  if (nfeed < length)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  return gpg_error (GPG_ERR_EAGAIN);
+}
+
+
+#ifdef USE_MMAP
+/* Map the rest of the file open on the fd of reader R into memory if
+   it is a regular file which is large enough.  On failure the reader
+   silently falls back to read(2).  */
+static void
+map_fd (ksba_reader_t r)
+{
+  struct stat st;
+  off_t off, pgoff;
+  long pagesize;
+  void *map;
+
+  if (fstat (r->u.fd.fd, &st) || !S_ISREG (st.st_mode))
+    return;
+  off = lseek (r->u.fd.fd, 0, SEEK_CUR);
+  if (off == (off_t)(-1) || st.st_size - off < MIN_MAP_SIZE)
+    return;
+  pagesize = sysconf (_SC_PAGESIZE);
+  if (pagesize <= 0)
+    return;
+  pgoff = off - (off % pagesize);
+  if ((unsigned long long)(st.st_size - pgoff) > (size_t)(-1))
+    return;  /* Does not fit into our address space.  */
+
+  map = mmap (NULL, st.st_size - pgoff, PROT_READ, MAP_PRIVATE,
+              r->u.fd.fd, pgoff);
+  if (map == MAP_FAILED)
+    return;
+#if defined(HAVE_MADVISE) && defined(MADV_SEQUENTIAL)
+  madvise (map, st.st_size - pgoff, MADV_SEQUENTIAL);
+#endif
+  r->u.fd.map = map;
+  r->u.fd.mapsize = st.st_size - pgoff;
+  r->u.fd.readpos = off - pgoff;
+}
+#endif /*USE_MMAP*/
+
+
 /**
  * ksba_reader_set_fd:
  * @r: Reader object
@@ -198,8 +407,12 @@ ksba_reader_set_mem (ksba_reader_t r, const void *buffer, size_t length)
  *
  * Initialize the Reader object with a file descriptor, so that read
  * operations on this object are excuted on this file descriptor.
+ * Data is read in large blocks; a regular file may instead be mapped
+ * into memory, in which case the data is read up to the end of file
+ * as it was at the time of this call.  The file position of @fd is
+ * undefined after reading from this object.
  *
- * Return value:
+ * Return value: 0 on success or an error code.
  **/
 gpg_error_t
 ksba_reader_set_fd (ksba_reader_t r, int fd)
@@ -211,7 +424,17 @@ ksba_reader_set_fd (ksba_reader_t r, int fd)
 
   r->eof = 0;
   r->type = READER_TYPE_FD;
-  r->u.fd = fd;
+  r->u.fd.fd = fd;
+  r->u.fd.map = NULL;
+  r->u.fd.mapsize = r->u.fd.readpos = 0;
+
+#ifdef USE_MMAP
+  map_fd (r);
+#endif
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+  if (!r->u.fd.map)
+    posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 
   return 0;
 }
@@ -284,6 +507,50 @@ ksba_reader_set_cb (ksba_reader_t r,
 }
 
 
+/* Return the size of the read-ahead buffer to use for R.  */
+static size_t
+readahead_size (ksba_reader_t r)
+{
+  return r->type == READER_TYPE_FD? FD_READAHEAD_SIZE : READAHEAD_SIZE;
+}
+
+
+/* Read up to LENGTH bytes from the callback or file descriptor of R
+   into BUFFER and store the number of bytes read at NREAD.  On EOF or
+   error the EOF flag of R is set and -1 is returned.  */
+static int
+read_source (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
+{
+  if (r->type == READER_TYPE_CB)
+    {
+      if (r->u.cb.fnc (r->u.cb.value, buffer, length, nread))
+        {
+          *nread = 0;
+          r->eof = 1;
+          return -1;
+        }
+    }
+  else
+    {
+      ssize_t n;
+
+      do
+        n = read (r->u.fd.fd, buffer, length);
+      while (n == -1 && errno == EINTR);
+      if (n <= 0)
+        {
+          if (n)
+            r->error = errno;
+          *nread = 0;
+          r->eof = 1;
+          return -1;
+        }
+      *nread = n;
+    }
+  return 0;
+}
+
+
 /**
  * ksba_reader_read:
  * @r: Readder object
@@ -315,28 +582,27 @@ ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
 
   if (!buffer)
     {
-      if (r->type != READER_TYPE_MEM)
+      if (r->type == READER_TYPE_MEM)
+        *nread = r->u.mem.size - r->u.mem.readpos;
+      else if (r->type == READER_TYPE_FD && r->u.fd.map)
+        *nread = r->u.fd.mapsize - r->u.fd.readpos;
+      else
         return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
-      *nread = r->u.mem.size - r->u.mem.readpos;
-      if (r->unread.buf)
-        *nread += r->unread.length - r->unread.readpos;
+      *nread += r->rbuf.length - r->rbuf.readpos;
       return *nread? 0 : gpg_error (GPG_ERR_EOF);
     }
 
   *nread = 0;
 
-  if (r->unread.buf && r->unread.length)
+  if (r->rbuf.readpos < r->rbuf.length)
     {
-      nbytes = r->unread.length - r->unread.readpos;
-      if (!nbytes)
-        return gpg_error (GPG_ERR_BUG);
-
+      nbytes = r->rbuf.length - r->rbuf.readpos;
       if (nbytes > length)
         nbytes = length;
-      memcpy (buffer, r->unread.buf + r->unread.readpos, nbytes);
-      r->unread.readpos += nbytes;
-      if (r->unread.readpos == r->unread.length)
-        r->unread.readpos = r->unread.length = 0;
+      memcpy (buffer, r->rbuf.buf + r->rbuf.readpos, nbytes);
+      r->rbuf.readpos += nbytes;
+      if (r->rbuf.readpos == r->rbuf.length)
+        r->rbuf.readpos = r->rbuf.length = 0;
       *nread = nbytes;
       r->nread += nbytes;
       return 0;
@@ -394,17 +660,40 @@ ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
             return gpg_error (GPG_ERR_EOF);
         }
     }
-  else if (r->type == READER_TYPE_CB)
+  else if (r->type == READER_TYPE_FD && r->u.fd.map)
+    {
+      nbytes = r->u.fd.mapsize - r->u.fd.readpos;
+      if (!nbytes)
+        {
+          r->eof = 1;
+          return gpg_error (GPG_ERR_EOF);
+        }
+
+      if (nbytes > length)
+        nbytes = length;
+      memcpy (buffer, r->u.fd.map + r->u.fd.readpos, nbytes);
+      *nread = nbytes;
+      r->nread += nbytes;
+      r->u.fd.readpos += nbytes;
+    }
+  else if (r->type == READER_TYPE_FD || r->type == READER_TYPE_CB)
     {
       if (r->eof)
         return gpg_error (GPG_ERR_EOF);
 
-      if (r->u.cb.fnc (r->u.cb.value, buffer, length, nread))
+      if (r->type == READER_TYPE_FD
+          && length < readahead_size (r) && !_ksba_reader_fill (r))
         {
-          *nread = 0;
-          r->eof = 1;
-          return gpg_error (GPG_ERR_EOF);
+          /* Small reads are served from the read-ahead buffer so
+             that the parsers do not call into the source for each
+             single header byte.  */
+          if (r->rbuf.readpos < r->rbuf.length)
+            return ksba_reader_read (r, buffer, length, nread);
+          return r->eof? gpg_error (GPG_ERR_EOF) : 0;
         }
+
+      if (read_source (r, buffer, length, nread))
+        return gpg_error (GPG_ERR_EOF);
       r->nread += *nread;
     }
   else
@@ -413,6 +702,187 @@ ksba_reader_read (ksba_reader_t r, char *buffer, size_t length, size_t *nread)
   return 0;
 }
 
+
+/* Fill the empty read-ahead buffer of the callback or file
+   descriptor based reader R.  Errors and EOF from the source are
+   flagged in R and reported by the next read; an error is only
+   returned if no buffer could be allocated.  */
+static gpg_error_t
+fill_from_source (ksba_reader_t r)
+{
+  size_t n;
+
+  if (r->rbuf.size < readahead_size (r))
+    {
+      unsigned char *p = xtrymalloc (readahead_size (r));
+
+      if (!p)
+        return gpg_error_from_syserror ();
+      xfree (r->rbuf.buf);
+      r->rbuf.buf = p;
+      r->rbuf.size = readahead_size (r);
+    }
+
+  r->rbuf.readpos = r->rbuf.length = 0;
+  if (!read_source (r, (char*)r->rbuf.buf, r->rbuf.size, &n)
+      && n <= r->rbuf.size)
+    r->rbuf.length = n;
+  r->rbuf.ahead = r->rbuf.length;
+  return 0;
+}
+
+
+/* Fill the read-ahead buffer of R from the data source if it is
+   empty.  This is only done for unmapped file descriptors because a
+   read from them returns what is currently available.  Callbacks
+   may block until the requested number of bytes is available and
+   are thus not read ahead; for the other readers this is a no-op
+   as well.  */
+gpg_error_t
+_ksba_reader_fill (ksba_reader_t r)
+{
+  if (r->rbuf.readpos < r->rbuf.length || r->eof)
+    return 0;
+  if (r->type != READER_TYPE_FD || r->u.fd.map)
+    return 0;
+  return fill_from_source (r);
+}
+
+
+/* Fill the read-ahead buffer of the stdio based reader R.  This is
+   only done on request of ksba_reader_peek.  */
+static gpg_error_t
+fill_from_file (ksba_reader_t r)
+{
+  size_t n;
+
+  if (r->eof)
+    return 0;
+
+  if (r->rbuf.size < READAHEAD_SIZE)
+    {
+      unsigned char *p = xtrymalloc (READAHEAD_SIZE);
+
+      if (!p)
+        return gpg_error_from_syserror ();
+      xfree (r->rbuf.buf);
+      r->rbuf.buf = p;
+      r->rbuf.size = READAHEAD_SIZE;
+    }
+
+  n = fread (r->rbuf.buf, 1, r->rbuf.size, r->u.file);
+  r->rbuf.readpos = 0;
+  r->rbuf.length = r->rbuf.ahead = n;
+  if (n < r->rbuf.size)
+    {
+      if (ferror (r->u.file))
+        r->error = errno;
+      r->eof = 1;
+    }
+  return 0;
+}
+
+
+/**
+ * ksba_reader_peek:
+ * @r: Reader object
+ * @r_buffer: Returns a pointer to the available data
+ * @r_length: Returns the number of available bytes
+ *
+ * Return the data which is available at the current read position
+ * without copying it.  For readers initialized from memory or from a
+ * mapped file this is all the remaining data; for other readers the
+ * read-ahead buffer is filled if required; a callback is asked for up
+ * to 4096 bytes in this case.  The returned data is
+ * valid until the next operation on @r and is not consumed; use
+ * ksba_reader_advance for that.  A @r_length of 0 may be returned if
+ * a callback has currently no data.
+ *
+ * Return value: 0 on success, GPG_ERR_EOF or another error code
+ **/
+gpg_error_t
+ksba_reader_peek (ksba_reader_t r, const void **r_buffer, size_t *r_length)
+{
+  gpg_error_t err;
+  const unsigned char *p;
+  size_t n;
+
+  if (!r || !r_buffer || !r_length)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  *r_buffer = NULL;
+  *r_length = 0;
+
+  p = _ksba_reader_window (r, &n);
+  if (!n)
+    {
+      if (r->type == READER_TYPE_FILE)
+        err = fill_from_file (r);
+      else if (r->type == READER_TYPE_CB && !r->eof)
+        err = fill_from_source (r);
+      else
+        err = _ksba_reader_fill (r);
+      if (err)
+        return err;
+      p = _ksba_reader_window (r, &n);
+    }
+  if (!n)
+    {
+      if (!r->eof && (r->type == READER_TYPE_CB
+                      || (r->type == READER_TYPE_FD && !r->u.fd.map)))
+        return 0;
+      r->eof = 1;
+      return gpg_error (GPG_ERR_EOF);
+    }
+
+  *r_buffer = p;
+  *r_length = n;
+  return 0;
+}
+
+
+/**
+ * ksba_reader_advance:
+ * @r: Reader object
+ * @count: Number of bytes to consume
+ *
+ * Consume @count bytes of the data returned by the last call to
+ * ksba_reader_peek.
+ *
+ * Return value: 0 on success or GPG_ERR_INV_VALUE if @count is larger
+ * than the available data.
+ **/
+gpg_error_t
+ksba_reader_advance (ksba_reader_t r, size_t count)
+{
+  size_t n;
+
+  if (!r)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (!count)
+    return 0;
+  _ksba_reader_window (r, &n);
+  if (count > n)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  _ksba_reader_skip (r, count);
+  return 0;
+}
+
+
+/* The slow path of _ksba_reader_getc.  */
+int
+_ksba_reader_getc_slow (ksba_reader_t r)
+{
+  unsigned char buf;
+  size_t nread;
+  int rc;
+
+  do
+    rc = ksba_reader_read (r, (char*)&buf, 1, &nread);
+  while (!rc && !nread);
+  return rc? -1: buf;
+}
+
+
 gpg_error_t
 ksba_reader_unread (ksba_reader_t r, const void *buffer, size_t count)
 {
@@ -426,25 +896,51 @@ ksba_reader_unread (ksba_reader_t r, const void *buffer, size_t count)
   if (r->nread < count)
     return gpg_error (GPG_ERR_CONFLICT);
 
-  if (!r->unread.buf)
+  /* The pushed back bytes have been returned before; the read-ahead
+     bytes which have never been returned are thus at most the
+     currently pending ones.  */
+  if (r->rbuf.ahead > r->rbuf.length - r->rbuf.readpos)
+    r->rbuf.ahead = r->rbuf.length - r->rbuf.readpos;
+
+  if (r->rbuf.readpos >= count)
     {
-      r->unread.size = count + 100;
-      r->unread.buf = xtrymalloc (r->unread.size);
-      if (!r->unread.buf)
-        return gpg_error (GPG_ERR_ENOMEM);
-      r->unread.length = count;
-      r->unread.readpos = 0;
-      memcpy (r->unread.buf, buffer, count);
-      r->nread -= count;
+      /* This is the common case: The bytes have just been returned
+         from the buffer and there is still room in front of the
+         pending bytes.  */
+      r->rbuf.readpos -= count;
+      memmove (r->rbuf.buf + r->rbuf.readpos, buffer, count);
     }
-  else if (r->unread.length + count < r->unread.size)
+  else
     {
-      memcpy (r->unread.buf+r->unread.length, buffer, count);
-      r->unread.length += count;
-      r->nread -= count;
+      size_t pending = r->rbuf.length - r->rbuf.readpos;
+      unsigned char *p;
+
+      if (pending + count > r->rbuf.size)
+        {
+          size_t newsize = pending + count + 100;
+
+          if (r->type == READER_TYPE_FD && newsize < readahead_size (r))
+            newsize = readahead_size (r);
+          p = xtrymalloc (newsize);
+          if (!p)
+            return gpg_error (GPG_ERR_ENOMEM);
+          if (pending)
+            memcpy (p + count, r->rbuf.buf + r->rbuf.readpos, pending);
+          memcpy (p, buffer, count);
+          xfree (r->rbuf.buf);
+          r->rbuf.buf = p;
+          r->rbuf.size = newsize;
+        }
+      else
+        {
+          p = r->rbuf.buf;
+          memmove (p + count, p + r->rbuf.readpos, pending);
+          memmove (p, buffer, count);
+        }
+      r->rbuf.readpos = 0;
+      r->rbuf.length = pending + count;
     }
-  else
-    return gpg_error (GPG_ERR_NOT_IMPLEMENTED); /* fixme: easy to do */
+  r->nread -= count;
 
   return 0;
 }
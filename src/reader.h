@@ -46,20 +46,34 @@ struct ksba_reader_s {
   int eof;
   int error;   /* If an error occured, takes the value of errno. */
   unsigned long nread;
+  /* The read-ahead buffer.  It holds the bytes pushed back by
+     ksba_reader_unread as well as the bytes fetched in advance from
+     a file descriptor.  The bytes from READPOS to LENGTH are pending
+     and are returned before any new data from the source.  */
   struct {
     unsigned char *buf;
     size_t size;    /* allocated size */
     size_t length;  /* used size */
     size_t readpos; /* offset where to start the next read */
-  } unread;
+    size_t ahead;   /* The last AHEAD pending bytes have never been
+                       returned; only valid up to LENGTH - READPOS.  */
+  } rbuf;
   enum reader_type type;
   union {
     struct {
       unsigned char *buffer;
       size_t size;
       size_t readpos;
+      size_t allocated;         /* Allocated size in push mode.  */
+      size_t limit;             /* Maximum size in push mode.  */
+      struct ber_scan_s *scan;  /* Not NULL in push mode.  */
     } mem;   /* for READER_TYPE_MEM */
-    int fd;  /* for READER_TYPE_FD */
+    struct {
+      int fd;
+      unsigned char *map;  /* The mapped file or NULL.  */
+      size_t mapsize;
+      size_t readpos;
+    } fd;    /* for READER_TYPE_FD */
     FILE *file; /* for READER_TYPE_FILE */
     struct {
       int (*fnc)(void*,char *,size_t,size_t*);
@@ -72,5 +86,66 @@ struct ksba_reader_s {
 
 
 
+int _ksba_reader_getc_slow (ksba_reader_t r);
+gpg_error_t _ksba_reader_fill (ksba_reader_t r);
+
+
+/* Return a pointer to the bytes of reader R which are available
+   without calling into the data source and store their number at
+   R_AVAIL.  The returned bytes may be consumed using
+   _ksba_reader_skip.  */
+static inline const unsigned char *
+_ksba_reader_window (ksba_reader_t r, size_t *r_avail)
+{
+  if (r->rbuf.readpos < r->rbuf.length)
+    {
+      *r_avail = r->rbuf.length - r->rbuf.readpos;
+      return r->rbuf.buf + r->rbuf.readpos;
+    }
+  if (r->type == READER_TYPE_MEM)
+    {
+      *r_avail = r->u.mem.size - r->u.mem.readpos;
+      return r->u.mem.buffer + r->u.mem.readpos;
+    }
+  if (r->type == READER_TYPE_FD && r->u.fd.map)
+    {
+      *r_avail = r->u.fd.mapsize - r->u.fd.readpos;
+      return r->u.fd.map + r->u.fd.readpos;
+    }
+  *r_avail = 0;
+  return NULL;
+}
+
+/* Consume N bytes from those returned by the last _ksba_reader_window.  */
+static inline void
+_ksba_reader_skip (ksba_reader_t r, size_t n)
+{
+  if (r->rbuf.readpos < r->rbuf.length)
+    {
+      r->rbuf.readpos += n;
+      if (r->rbuf.readpos == r->rbuf.length)
+        r->rbuf.readpos = r->rbuf.length = 0;
+    }
+  else if (r->type == READER_TYPE_MEM)
+    r->u.mem.readpos += n;
+  else
+    r->u.fd.readpos += n;
+  r->nread += n;
+}
+
+/* Read one byte from R.  Returns the byte or -1 on error or EOF.  */
+static inline int
+_ksba_reader_getc (ksba_reader_t r)
+{
+  const unsigned char *p;
+  size_t n;
+
+  p = _ksba_reader_window (r, &n);
+  if (!n)
+    return _ksba_reader_getc_slow (r);
+  _ksba_reader_skip (r, 1);
+  return *p;
+}
+
 
 #endif /*READER_H*/
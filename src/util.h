@@ -95,6 +95,38 @@ char *_ksba_xstrdup (const char *p);
     } while (0)
 
 
+/* Atomically replace the pointer at ADDR by NEWVAL if it still has
+   the value OLDVAL.  Returns true on success.  Without compiler
+   support this is a plain compare and assignment; objects relying on
+   it may then not be shared between threads.  */
+#ifdef HAVE_SYNC_BUILTINS
+# define atomic_cas_ptr(addr,oldval,newval) \
+           __sync_bool_compare_and_swap ((addr), (oldval), (newval))
+#else
+# define atomic_cas_ptr(addr,oldval,newval) \
+           (*(addr) == (oldval)? ((*(addr) = (newval)), 1) : 0)
+#endif
+#define atomic_cas_int(addr,oldval,newval) \
+           atomic_cas_ptr ((addr), (oldval), (newval))
+
+/* Atomically add N to the int at ADDR and return the new value.
+   Without compiler support this is a plain addition.  */
+#ifdef HAVE_SYNC_BUILTINS
+# define atomic_add_int(addr,n)  __sync_add_and_fetch ((addr), (n))
+#else
+# define atomic_add_int(addr,n)  (*(addr) += (n))
+#endif
+
+/* Atomically store VAL at the int ADDR.  Without compiler support
+   this is a plain assignment.  */
+#ifdef HAVE_SYNC_BUILTINS
+# define atomic_set_int(addr,val) \
+           ((void)__sync_lock_test_and_set ((addr), (val)))
+#else
+# define atomic_set_int(addr,val)  ((void)(*(addr) = (val)))
+#endif
+
+
 #ifndef HAVE_STPCPY
 char *_ksba_stpcpy (char *a, const char *b);
 #define stpcpy(a,b) _ksba_stpcpy ((a), (b))
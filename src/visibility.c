@@ -151,6 +151,14 @@ ksba_cert_init_from_mem (ksba_cert_t cert,
 }
 
 
+gpg_error_t
+ksba_cert_init_from_mem_nocopy (ksba_cert_t cert,
+                                const void *buffer, size_t length)
+{
+  return _ksba_cert_init_from_mem_nocopy (cert, buffer, length);
+}
+
+
 const unsigned char *
 ksba_cert_get_image (ksba_cert_t cert, size_t *r_length)
 {
@@ -456,6 +464,13 @@ ksba_cms_set_hash_function (ksba_cms_t cms,
 }
 
 
+gpg_error_t
+ksba_cms_set_hasher (ksba_cms_t cms, ksba_hasher_t hasher)
+{
+  return _ksba_cms_set_hasher (cms, hasher);
+}
+
+
 gpg_error_t
 ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx)
 {
@@ -463,6 +478,107 @@ ksba_cms_hash_signed_attrs (ksba_cms_t cms, int idx)
 }
 
 
+gpg_error_t
+ksba_cms_get_signers (ksba_cms_t cms, ksba_cms_signers_t *r_signers)
+{
+  return _ksba_cms_get_signers (cms, r_signers);
+}
+
+
+void
+ksba_cms_signers_release (ksba_cms_signers_t signers)
+{
+  _ksba_cms_signers_release (signers);
+}
+
+
+int
+ksba_cms_signers_count (ksba_cms_signers_t signers)
+{
+  return _ksba_cms_signers_count (signers);
+}
+
+
+gpg_error_t
+ksba_cms_signers_get_issuer_serial (ksba_cms_signers_t signers, int idx,
+                                    const char **r_issuer,
+                                    ksba_const_sexp_t *r_serial)
+{
+  return _ksba_cms_signers_get_issuer_serial (signers, idx,
+                                              r_issuer, r_serial);
+}
+
+
+gpg_error_t
+ksba_cms_signers_get_subj_key_id (ksba_cms_signers_t signers, int idx,
+                                  ksba_const_sexp_t *r_keyid)
+{
+  return _ksba_cms_signers_get_subj_key_id (signers, idx, r_keyid);
+}
+
+
+const char *
+ksba_cms_signers_get_digest_algo (ksba_cms_signers_t signers, int idx)
+{
+  return _ksba_cms_signers_get_digest_algo (signers, idx);
+}
+
+
+gpg_error_t
+ksba_cms_signers_get_signed_attrs (ksba_cms_signers_t signers, int idx,
+                                   const unsigned char **r_der,
+                                   size_t *r_derlen)
+{
+  return _ksba_cms_signers_get_signed_attrs (signers, idx, r_der, r_derlen);
+}
+
+
+gpg_error_t
+ksba_cms_signers_get_message_digest (ksba_cms_signers_t signers, int idx,
+                                     const unsigned char **r_digest,
+                                     size_t *r_digestlen)
+{
+  return _ksba_cms_signers_get_message_digest (signers, idx,
+                                               r_digest, r_digestlen);
+}
+
+
+gpg_error_t
+ksba_cms_signers_get_signing_time (ksba_cms_signers_t signers, int idx,
+                                   ksba_isotime_t r_sigtime)
+{
+  return _ksba_cms_signers_get_signing_time (signers, idx, r_sigtime);
+}
+
+
+ksba_const_sexp_t
+ksba_cms_signers_get_sig_val (ksba_cms_signers_t signers, int idx)
+{
+  return _ksba_cms_signers_get_sig_val (signers, idx);
+}
+
+
+gpg_error_t
+ksba_cms_set_chunk_size (ksba_cms_t cms, size_t size)
+{
+  return _ksba_cms_set_chunk_size (cms, size);
+}
+
+
+gpg_error_t
+ksba_cms_set_lazy_certs (ksba_cms_t cms, int lazy)
+{
+  return _ksba_cms_set_lazy_certs (cms, lazy);
+}
+
+
+gpg_error_t
+ksba_cms_write_data (ksba_cms_t cms, const void *buffer, size_t length)
+{
+  return _ksba_cms_write_data (cms, buffer, length);
+}
+
+
 
 gpg_error_t
 ksba_cms_set_content_type (ksba_cms_t cms, int what,
@@ -587,6 +703,13 @@ ksba_crl_set_hash_function (ksba_crl_t crl,
 }
 
 
+gpg_error_t
+ksba_crl_set_hasher (ksba_crl_t crl, ksba_hasher_t hasher)
+{
+  return _ksba_crl_set_hasher (crl, hasher);
+}
+
+
 const char *
 ksba_crl_get_digest_algo (ksba_crl_t crl)
 {
@@ -627,6 +750,13 @@ ksba_crl_get_crl_number (ksba_crl_t crl, ksba_sexp_t *number)
 }
 
 
+gpg_error_t
+ksba_crl_get_delta_indicator (ksba_crl_t crl, ksba_sexp_t *r_number)
+{
+  return _ksba_crl_get_delta_indicator (crl, r_number);
+}
+
+
 gpg_error_t
 ksba_crl_get_update_times (ksba_crl_t crl,
                            ksba_isotime_t this_update,
@@ -660,6 +790,130 @@ ksba_crl_parse (ksba_crl_t crl, ksba_stop_reason_t *r_stopreason)
 }
 
 
+gpg_error_t
+ksba_crl_start_index (ksba_crl_t crl)
+{
+  return _ksba_crl_start_index (crl);
+}
+
+
+gpg_error_t
+ksba_crl_get_index (ksba_crl_t crl, ksba_crl_index_t *r_index)
+{
+  return _ksba_crl_get_index (crl, r_index);
+}
+
+
+
+gpg_error_t
+ksba_crl_index_new_from_mem (ksba_crl_index_t *r_index,
+                             const void *buffer, size_t length)
+{
+  return _ksba_crl_index_new_from_mem (r_index, buffer, length);
+}
+
+
+void
+ksba_crl_index_release (ksba_crl_index_t index)
+{
+  _ksba_crl_index_release (index);
+}
+
+
+const unsigned char *
+ksba_crl_index_get_image (ksba_crl_index_t index, size_t *r_length)
+{
+  return _ksba_crl_index_get_image (index, r_length);
+}
+
+
+size_t
+ksba_crl_index_get_count (ksba_crl_index_t index)
+{
+  return _ksba_crl_index_get_count (index);
+}
+
+
+gpg_error_t
+ksba_crl_index_lookup (ksba_crl_index_t index, ksba_const_sexp_t serial,
+                       ksba_isotime_t r_revocation_date,
+                       ksba_crl_reason_t *r_reason,
+                       unsigned long *r_extoff)
+{
+  return _ksba_crl_index_lookup (index, serial, r_revocation_date,
+                                 r_reason, r_extoff);
+}
+
+
+gpg_error_t
+ksba_crl_index_new_from_fd (ksba_crl_index_t *r_index, int fd)
+{
+  return _ksba_crl_index_new_from_fd (r_index, fd);
+}
+
+
+gpg_error_t
+ksba_crl_index_write (ksba_crl_index_t index, ksba_writer_t w)
+{
+  return _ksba_crl_index_write (index, w);
+}
+
+
+gpg_error_t
+ksba_crl_index_get_issuer (ksba_crl_index_t index, char **r_issuer)
+{
+  return _ksba_crl_index_get_issuer (index, r_issuer);
+}
+
+
+gpg_error_t
+ksba_crl_index_get_update_times (ksba_crl_index_t index,
+                                 ksba_isotime_t this, ksba_isotime_t next)
+{
+  return _ksba_crl_index_get_update_times (index, this, next);
+}
+
+
+gpg_error_t
+ksba_crl_index_get_crl_number (ksba_crl_index_t index, ksba_sexp_t *r_number)
+{
+  return _ksba_crl_index_get_crl_number (index, r_number);
+}
+
+
+const char *
+ksba_crl_index_get_digest_algo (ksba_crl_index_t index)
+{
+  return _ksba_crl_index_get_digest_algo (index);
+}
+
+
+gpg_error_t
+ksba_crl_index_get_sig_val (ksba_crl_index_t index,
+                            unsigned long *r_tbs_off,
+                            unsigned long *r_tbs_len,
+                            ksba_sexp_t *r_sigval)
+{
+  return _ksba_crl_index_get_sig_val (index, r_tbs_off, r_tbs_len, r_sigval);
+}
+
+
+gpg_error_t
+ksba_crl_index_get_delta_indicator (ksba_crl_index_t index,
+                                    ksba_sexp_t *r_number)
+{
+  return _ksba_crl_index_get_delta_indicator (index, r_number);
+}
+
+
+gpg_error_t
+ksba_crl_index_apply_delta (ksba_crl_index_t base, ksba_crl_index_t delta,
+                            ksba_crl_index_t *r_index)
+{
+  return _ksba_crl_index_apply_delta (base, delta, r_index);
+}
+
+
 
 
 /*-- ocsp.c --*/
@@ -827,6 +1081,222 @@ ksba_ocsp_get_extension (ksba_ocsp_t ocsp, ksba_cert_t cert,
 }
 
 
+gpg_error_t
+ksba_ocsp_cache_new (ksba_ocsp_cache_t *r_cache, unsigned int size)
+{
+  return _ksba_ocsp_cache_new (r_cache, size);
+}
+
+
+void
+ksba_ocsp_cache_release (ksba_ocsp_cache_t cache)
+{
+  _ksba_ocsp_cache_release (cache);
+}
+
+
+gpg_error_t
+ksba_ocsp_cache_lookup (ksba_ocsp_cache_t cache,
+                        ksba_cert_t cert, ksba_cert_t issuer_cert,
+                        const ksba_isotime_t now,
+                        ksba_status_t *r_status,
+                        ksba_isotime_t r_this_update,
+                        ksba_isotime_t r_next_update,
+                        ksba_isotime_t r_revocation_time,
+                        ksba_crl_reason_t *r_reason,
+                        unsigned char **r_response,
+                        size_t *r_responselen)
+{
+  return _ksba_ocsp_cache_lookup (cache, cert, issuer_cert, now, r_status,
+                                  r_this_update, r_next_update,
+                                  r_revocation_time, r_reason,
+                                  r_response, r_responselen);
+}
+
+
+gpg_error_t
+ksba_ocsp_set_cache (ksba_ocsp_t ocsp, ksba_ocsp_cache_t cache)
+{
+  return _ksba_ocsp_set_cache (ocsp, cache);
+}
+
+
+gpg_error_t
+ksba_ocsp_update_cache (ksba_ocsp_t ocsp)
+{
+  return _ksba_ocsp_update_cache (ocsp);
+}
+
+
+gpg_error_t
+ksba_ocsp_set_certid_algo (ksba_ocsp_t ocsp, const char *oid)
+{
+  return _ksba_ocsp_set_certid_algo (ocsp, oid);
+}
+
+
+gpg_error_t
+ksba_ocsp_build_request_into (ksba_ocsp_t ocsp, unsigned char *buffer,
+                              size_t bufsize, size_t *r_buflen)
+{
+  return _ksba_ocsp_build_request_into (ocsp, buffer, bufsize, r_buflen);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_new (ksba_ocsp_responder_t *r_resp)
+{
+  return _ksba_ocsp_responder_new (r_resp);
+}
+
+
+void
+ksba_ocsp_responder_release (ksba_ocsp_responder_t resp)
+{
+  _ksba_ocsp_responder_release (resp);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_set_responder_id (ksba_ocsp_responder_t resp,
+                                      ksba_cert_t cert, int by_key)
+{
+  return _ksba_ocsp_responder_set_responder_id (resp, cert, by_key);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_add_cert (ksba_ocsp_responder_t resp, ksba_cert_t cert)
+{
+  return _ksba_ocsp_responder_add_cert (resp, cert);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_add_issuer (ksba_ocsp_responder_t resp,
+                                ksba_cert_t issuer)
+{
+  return _ksba_ocsp_responder_add_issuer (resp, issuer);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_set_signer (ksba_ocsp_responder_t resp,
+                                const char *sig_algo, size_t maxsiglen,
+                                gpg_error_t (*signer)(void *arg,
+                                                const unsigned char *tbs,
+                                                size_t tbslen,
+                                                unsigned char *sigbuf,
+                                                size_t *r_siglen),
+                                void *signer_arg)
+{
+  return _ksba_ocsp_responder_set_signer (resp, sig_algo, maxsiglen,
+                                          signer, signer_arg);
+}
+
+
+void
+ksba_ocsp_responder_reset (ksba_ocsp_responder_t resp)
+{
+  _ksba_ocsp_responder_reset (resp);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_parse_request (ksba_ocsp_responder_t resp,
+                                   const unsigned char *msg, size_t msglen)
+{
+  return _ksba_ocsp_responder_parse_request (resp, msg, msglen);
+}
+
+
+int
+ksba_ocsp_responder_get_count (ksba_ocsp_responder_t resp)
+{
+  return _ksba_ocsp_responder_get_count (resp);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_get_request (ksba_ocsp_responder_t resp, int idx,
+                                 const char **r_hash_algo,
+                                 const unsigned char **r_name_hash,
+                                 size_t *r_name_hash_len,
+                                 const unsigned char **r_key_hash,
+                                 size_t *r_key_hash_len,
+                                 const unsigned char **r_serial,
+                                 size_t *r_serial_len,
+                                 int *r_issuer)
+{
+  return _ksba_ocsp_responder_get_request (resp, idx, r_hash_algo,
+                                           r_name_hash, r_name_hash_len,
+                                           r_key_hash, r_key_hash_len,
+                                           r_serial, r_serial_len,
+                                           r_issuer);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_get_nonce (ksba_ocsp_responder_t resp,
+                               const unsigned char **r_nonce,
+                               size_t *r_noncelen)
+{
+  return _ksba_ocsp_responder_get_nonce (resp, r_nonce, r_noncelen);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_set_certid_algo (ksba_ocsp_responder_t resp,
+                                     const char *oid)
+{
+  return _ksba_ocsp_responder_set_certid_algo (resp, oid);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_add_target (ksba_ocsp_responder_t resp,
+                                ksba_cert_t cert, ksba_cert_t issuer_cert,
+                                int *r_idx)
+{
+  return _ksba_ocsp_responder_add_target (resp, cert, issuer_cert, r_idx);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_set_status (ksba_ocsp_responder_t resp, int idx,
+                                ksba_status_t status,
+                                const ksba_isotime_t this_update,
+                                const ksba_isotime_t next_update,
+                                const ksba_isotime_t revocation_time,
+                                ksba_crl_reason_t reason)
+{
+  return _ksba_ocsp_responder_set_status (resp, idx, status,
+                                          this_update, next_update,
+                                          revocation_time, reason);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_build_response (ksba_ocsp_responder_t resp,
+                                    const ksba_isotime_t produced_at,
+                                    const unsigned char **r_buf,
+                                    size_t *r_buflen)
+{
+  return _ksba_ocsp_responder_build_response (resp, produced_at,
+                                              r_buf, r_buflen);
+}
+
+
+gpg_error_t
+ksba_ocsp_responder_build_error (ksba_ocsp_responder_t resp,
+                                 ksba_ocsp_response_status_t status,
+                                 const unsigned char **r_buf,
+                                 size_t *r_buflen)
+{
+  return _ksba_ocsp_responder_build_error (resp, status, r_buf, r_buflen);
+}
+
+
 
 
 /*-- certreq.c --*/
@@ -860,6 +1330,13 @@ ksba_certreq_set_hash_function (ksba_certreq_t cr,
 }
 
 
+gpg_error_t
+ksba_certreq_set_hasher (ksba_certreq_t cr, ksba_hasher_t hasher)
+{
+  return _ksba_certreq_set_hasher (cr, hasher);
+}
+
+
 gpg_error_t
 ksba_certreq_set_serial (ksba_certreq_t cr, ksba_const_sexp_t sn)
 {
@@ -1038,6 +1515,35 @@ ksba_reader_unread (ksba_reader_t r, const void *buffer, size_t count)
 }
 
 
+gpg_error_t
+ksba_reader_peek (ksba_reader_t r, const void **r_buffer, size_t *r_length)
+{
+  return _ksba_reader_peek (r, r_buffer, r_length);
+}
+
+
+gpg_error_t
+ksba_reader_advance (ksba_reader_t r, size_t count)
+{
+  return _ksba_reader_advance (r, count);
+}
+
+
+gpg_error_t
+ksba_reader_set_push (ksba_reader_t r, size_t maxlen)
+{
+  return _ksba_reader_set_push (r, maxlen);
+}
+
+
+gpg_error_t
+ksba_reader_push (ksba_reader_t r, const void *buffer, size_t length,
+                  size_t *r_nused)
+{
+  return _ksba_reader_push (r, buffer, length, r_nused);
+}
+
+
 unsigned long
 ksba_reader_tell (ksba_reader_t r)
 {
@@ -1105,6 +1611,13 @@ ksba_writer_set_mem (ksba_writer_t w, size_t initial_size)
 }
 
 
+gpg_error_t
+ksba_writer_set_mem_chunked (ksba_writer_t w, size_t chunk_size)
+{
+  return _ksba_writer_set_mem_chunked (w, chunk_size);
+}
+
+
 const void *
 ksba_writer_get_mem (ksba_writer_t w, size_t *nbytes)
 {
@@ -1112,6 +1625,13 @@ ksba_writer_get_mem (ksba_writer_t w, size_t *nbytes)
 }
 
 
+const void *
+ksba_writer_get_chunk (ksba_writer_t w, int idx, size_t *r_length)
+{
+  return _ksba_writer_get_chunk (w, idx, r_length);
+}
+
+
 void *
 ksba_writer_snatch_mem (ksba_writer_t w, size_t *nbytes)
 {
@@ -1138,6 +1658,13 @@ ksba_writer_write (ksba_writer_t w, const void *buffer, size_t length)
 }
 
 
+gpg_error_t
+ksba_writer_flush (ksba_writer_t w)
+{
+  return _ksba_writer_flush (w);
+}
+
+
 gpg_error_t
 ksba_writer_write_octet_string (ksba_writer_t w,
                                 const void *buffer, size_t length,
@@ -1148,6 +1675,58 @@ ksba_writer_write_octet_string (ksba_writer_t w,
 
 
 
+gpg_error_t
+ksba_hasher_new (ksba_hasher_t *r_hasher)
+{
+  return _ksba_hasher_new (r_hasher);
+}
+
+
+void
+ksba_hasher_release (ksba_hasher_t hasher)
+{
+  _ksba_hasher_release (hasher);
+}
+
+
+gpg_error_t
+ksba_hasher_add (ksba_hasher_t hasher,
+                 void (*hash_fnc)(void *, const void *, size_t),
+                 void *hash_fnc_arg)
+{
+  return _ksba_hasher_add (hasher, hash_fnc, hash_fnc_arg);
+}
+
+
+gpg_error_t
+ksba_hasher_set_buffer_size (ksba_hasher_t hasher, size_t size)
+{
+  return _ksba_hasher_set_buffer_size (hasher, size);
+}
+
+
+void
+ksba_hasher_write (ksba_hasher_t hasher, const void *buffer, size_t length)
+{
+  _ksba_hasher_write (hasher, buffer, length);
+}
+
+
+void
+ksba_hasher_flush (ksba_hasher_t hasher)
+{
+  _ksba_hasher_flush (hasher);
+}
+
+
+void
+ksba_hasher_reset (ksba_hasher_t hasher)
+{
+  _ksba_hasher_reset (hasher);
+}
+
+
+
 /*-- asn1-parse.y --*/
 int
 ksba_asn_parse_file (const char *filename, ksba_asn_tree_t *result,
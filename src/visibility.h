@@ -61,6 +61,7 @@
 #define ksba_cert_get_validity             _ksba_cert_get_validity
 #define ksba_cert_hash                     _ksba_cert_hash
 #define ksba_cert_init_from_mem            _ksba_cert_init_from_mem
+#define ksba_cert_init_from_mem_nocopy     _ksba_cert_init_from_mem_nocopy
 #define ksba_cert_is_ca                    _ksba_cert_is_ca
 #define ksba_cert_new                      _ksba_cert_new
 #define ksba_cert_read_der                 _ksba_cert_read_der
@@ -118,6 +119,36 @@
 #define ksba_cms_set_sig_val               _ksba_cms_set_sig_val
 #define ksba_cms_set_signing_time          _ksba_cms_set_signing_time
 #define ksba_cms_add_smime_capability      _ksba_cms_add_smime_capability
+#define ksba_cms_set_chunk_size            _ksba_cms_set_chunk_size
+#define ksba_cms_write_data                _ksba_cms_write_data
+#define ksba_hasher_new                    _ksba_hasher_new
+#define ksba_hasher_release                _ksba_hasher_release
+#define ksba_hasher_add                    _ksba_hasher_add
+#define ksba_hasher_set_buffer_size        _ksba_hasher_set_buffer_size
+#define ksba_hasher_write                  _ksba_hasher_write
+#define ksba_hasher_flush                  _ksba_hasher_flush
+#define ksba_hasher_reset                  _ksba_hasher_reset
+#define ksba_cms_set_hasher                _ksba_cms_set_hasher
+#define ksba_crl_set_hasher                _ksba_crl_set_hasher
+#define ksba_certreq_set_hasher            _ksba_certreq_set_hasher
+#define ksba_cms_get_signers               _ksba_cms_get_signers
+#define ksba_cms_signers_release           _ksba_cms_signers_release
+#define ksba_cms_signers_count             _ksba_cms_signers_count
+#define ksba_cms_signers_get_issuer_serial _ksba_cms_signers_get_issuer_serial
+#define ksba_cms_signers_get_subj_key_id   _ksba_cms_signers_get_subj_key_id
+#define ksba_cms_signers_get_digest_algo   _ksba_cms_signers_get_digest_algo
+#define ksba_cms_signers_get_signed_attrs  _ksba_cms_signers_get_signed_attrs
+#define ksba_cms_signers_get_message_digest _ksba_cms_signers_get_message_digest
+#define ksba_cms_signers_get_signing_time  _ksba_cms_signers_get_signing_time
+#define ksba_cms_signers_get_sig_val       _ksba_cms_signers_get_sig_val
+#define ksba_writer_flush                  _ksba_writer_flush
+#define ksba_writer_set_mem_chunked        _ksba_writer_set_mem_chunked
+#define ksba_writer_get_chunk              _ksba_writer_get_chunk
+#define ksba_reader_peek                   _ksba_reader_peek
+#define ksba_reader_advance                _ksba_reader_advance
+#define ksba_reader_set_push               _ksba_reader_set_push
+#define ksba_reader_push                   _ksba_reader_push
+#define ksba_cms_set_lazy_certs            _ksba_cms_set_lazy_certs
 
 #define ksba_crl_get_digest_algo           _ksba_crl_get_digest_algo
 #define ksba_crl_get_issuer                _ksba_crl_get_issuer
@@ -132,6 +163,23 @@
 #define ksba_crl_get_extension             _ksba_crl_get_extension
 #define ksba_crl_get_auth_key_id           _ksba_crl_get_auth_key_id
 #define ksba_crl_get_crl_number            _ksba_crl_get_crl_number
+#define ksba_crl_get_delta_indicator       _ksba_crl_get_delta_indicator
+#define ksba_crl_start_index               _ksba_crl_start_index
+#define ksba_crl_get_index                 _ksba_crl_get_index
+#define ksba_crl_index_new_from_mem        _ksba_crl_index_new_from_mem
+#define ksba_crl_index_release             _ksba_crl_index_release
+#define ksba_crl_index_get_image           _ksba_crl_index_get_image
+#define ksba_crl_index_get_count           _ksba_crl_index_get_count
+#define ksba_crl_index_lookup              _ksba_crl_index_lookup
+#define ksba_crl_index_new_from_fd         _ksba_crl_index_new_from_fd
+#define ksba_crl_index_write               _ksba_crl_index_write
+#define ksba_crl_index_get_issuer          _ksba_crl_index_get_issuer
+#define ksba_crl_index_get_update_times    _ksba_crl_index_get_update_times
+#define ksba_crl_index_get_crl_number      _ksba_crl_index_get_crl_number
+#define ksba_crl_index_get_digest_algo     _ksba_crl_index_get_digest_algo
+#define ksba_crl_index_get_sig_val         _ksba_crl_index_get_sig_val
+#define ksba_crl_index_get_delta_indicator _ksba_crl_index_get_delta_indicator
+#define ksba_crl_index_apply_delta         _ksba_crl_index_apply_delta
 
 #define ksba_name_enum                     _ksba_name_enum
 #define ksba_name_get_uri                  _ksba_name_get_uri
@@ -158,6 +206,29 @@
 #define ksba_ocsp_set_requestor            _ksba_ocsp_set_requestor
 #define ksba_ocsp_set_sig_val              _ksba_ocsp_set_sig_val
 #define ksba_ocsp_get_extension            _ksba_ocsp_get_extension
+#define ksba_ocsp_cache_new                _ksba_ocsp_cache_new
+#define ksba_ocsp_cache_release            _ksba_ocsp_cache_release
+#define ksba_ocsp_cache_lookup             _ksba_ocsp_cache_lookup
+#define ksba_ocsp_set_cache                _ksba_ocsp_set_cache
+#define ksba_ocsp_update_cache             _ksba_ocsp_update_cache
+#define ksba_ocsp_set_certid_algo          _ksba_ocsp_set_certid_algo
+#define ksba_ocsp_build_request_into       _ksba_ocsp_build_request_into
+#define ksba_ocsp_responder_new            _ksba_ocsp_responder_new
+#define ksba_ocsp_responder_release        _ksba_ocsp_responder_release
+#define ksba_ocsp_responder_set_responder_id _ksba_ocsp_responder_set_responder_id
+#define ksba_ocsp_responder_add_cert       _ksba_ocsp_responder_add_cert
+#define ksba_ocsp_responder_add_issuer     _ksba_ocsp_responder_add_issuer
+#define ksba_ocsp_responder_set_signer     _ksba_ocsp_responder_set_signer
+#define ksba_ocsp_responder_reset          _ksba_ocsp_responder_reset
+#define ksba_ocsp_responder_parse_request  _ksba_ocsp_responder_parse_request
+#define ksba_ocsp_responder_get_count      _ksba_ocsp_responder_get_count
+#define ksba_ocsp_responder_get_request    _ksba_ocsp_responder_get_request
+#define ksba_ocsp_responder_get_nonce      _ksba_ocsp_responder_get_nonce
+#define ksba_ocsp_responder_set_certid_algo _ksba_ocsp_responder_set_certid_algo
+#define ksba_ocsp_responder_add_target     _ksba_ocsp_responder_add_target
+#define ksba_ocsp_responder_set_status     _ksba_ocsp_responder_set_status
+#define ksba_ocsp_responder_build_response _ksba_ocsp_responder_build_response
+#define ksba_ocsp_responder_build_error    _ksba_ocsp_responder_build_error
 
 #define ksba_oid_from_str                  _ksba_oid_from_str
 #define ksba_oid_to_str                    _ksba_oid_to_str
@@ -261,6 +332,7 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_cert_get_validity
 #undef ksba_cert_hash
 #undef ksba_cert_init_from_mem
+#undef ksba_cert_init_from_mem_nocopy
 #undef ksba_cert_is_ca
 #undef ksba_cert_new
 #undef ksba_cert_read_der
@@ -317,6 +389,36 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_cms_set_sig_val
 #undef ksba_cms_set_signing_time
 #undef ksba_cms_add_smime_capability
+#undef ksba_cms_set_chunk_size
+#undef ksba_cms_write_data
+#undef ksba_hasher_new
+#undef ksba_hasher_release
+#undef ksba_hasher_add
+#undef ksba_hasher_set_buffer_size
+#undef ksba_hasher_write
+#undef ksba_hasher_flush
+#undef ksba_hasher_reset
+#undef ksba_cms_set_hasher
+#undef ksba_crl_set_hasher
+#undef ksba_certreq_set_hasher
+#undef ksba_cms_get_signers
+#undef ksba_cms_signers_release
+#undef ksba_cms_signers_count
+#undef ksba_cms_signers_get_issuer_serial
+#undef ksba_cms_signers_get_subj_key_id
+#undef ksba_cms_signers_get_digest_algo
+#undef ksba_cms_signers_get_signed_attrs
+#undef ksba_cms_signers_get_message_digest
+#undef ksba_cms_signers_get_signing_time
+#undef ksba_cms_signers_get_sig_val
+#undef ksba_writer_flush
+#undef ksba_writer_set_mem_chunked
+#undef ksba_writer_get_chunk
+#undef ksba_reader_peek
+#undef ksba_reader_advance
+#undef ksba_reader_set_push
+#undef ksba_reader_push
+#undef ksba_cms_set_lazy_certs
 
 #undef ksba_crl_get_digest_algo
 #undef ksba_crl_get_issuer
@@ -331,6 +433,23 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_crl_get_extension
 #undef ksba_crl_get_auth_key_id
 #undef ksba_crl_get_crl_number
+#undef ksba_crl_get_delta_indicator
+#undef ksba_crl_start_index
+#undef ksba_crl_get_index
+#undef ksba_crl_index_new_from_mem
+#undef ksba_crl_index_release
+#undef ksba_crl_index_get_image
+#undef ksba_crl_index_get_count
+#undef ksba_crl_index_lookup
+#undef ksba_crl_index_new_from_fd
+#undef ksba_crl_index_write
+#undef ksba_crl_index_get_issuer
+#undef ksba_crl_index_get_update_times
+#undef ksba_crl_index_get_crl_number
+#undef ksba_crl_index_get_digest_algo
+#undef ksba_crl_index_get_sig_val
+#undef ksba_crl_index_get_delta_indicator
+#undef ksba_crl_index_apply_delta
 
 #undef ksba_name_enum
 #undef ksba_name_get_uri
@@ -357,6 +476,29 @@ int ksba_asn_delete_structure (void *dummy);
 #undef ksba_ocsp_set_requestor
 #undef ksba_ocsp_set_sig_val
 #undef ksba_ocsp_get_extension
+#undef ksba_ocsp_cache_new
+#undef ksba_ocsp_cache_release
+#undef ksba_ocsp_cache_lookup
+#undef ksba_ocsp_set_cache
+#undef ksba_ocsp_update_cache
+#undef ksba_ocsp_set_certid_algo
+#undef ksba_ocsp_build_request_into
+#undef ksba_ocsp_responder_new
+#undef ksba_ocsp_responder_release
+#undef ksba_ocsp_responder_set_responder_id
+#undef ksba_ocsp_responder_add_cert
+#undef ksba_ocsp_responder_add_issuer
+#undef ksba_ocsp_responder_set_signer
+#undef ksba_ocsp_responder_reset
+#undef ksba_ocsp_responder_parse_request
+#undef ksba_ocsp_responder_get_count
+#undef ksba_ocsp_responder_get_request
+#undef ksba_ocsp_responder_get_nonce
+#undef ksba_ocsp_responder_set_certid_algo
+#undef ksba_ocsp_responder_add_target
+#undef ksba_ocsp_responder_set_status
+#undef ksba_ocsp_responder_build_response
+#undef ksba_ocsp_responder_build_error
 
 #undef ksba_oid_from_str
 #undef ksba_oid_to_str
@@ -429,6 +571,7 @@ MARK_VISIBLE (ksba_cert_get_subject)
 MARK_VISIBLE (ksba_cert_get_validity)
 MARK_VISIBLE (ksba_cert_hash)
 MARK_VISIBLE (ksba_cert_init_from_mem)
+MARK_VISIBLE (ksba_cert_init_from_mem_nocopy)
 MARK_VISIBLE (ksba_cert_is_ca)
 MARK_VISIBLE (ksba_cert_new)
 MARK_VISIBLE (ksba_cert_read_der)
@@ -485,6 +628,36 @@ MARK_VISIBLE (ksba_cms_set_reader_writer)
 MARK_VISIBLE (ksba_cms_set_sig_val)
 MARK_VISIBLE (ksba_cms_set_signing_time)
 MARK_VISIBLE (ksba_cms_add_smime_capability)
+MARK_VISIBLE (ksba_cms_set_chunk_size)
+MARK_VISIBLE (ksba_cms_write_data)
+MARK_VISIBLE (ksba_hasher_new)
+MARK_VISIBLE (ksba_hasher_release)
+MARK_VISIBLE (ksba_hasher_add)
+MARK_VISIBLE (ksba_hasher_set_buffer_size)
+MARK_VISIBLE (ksba_hasher_write)
+MARK_VISIBLE (ksba_hasher_flush)
+MARK_VISIBLE (ksba_hasher_reset)
+MARK_VISIBLE (ksba_cms_set_hasher)
+MARK_VISIBLE (ksba_crl_set_hasher)
+MARK_VISIBLE (ksba_certreq_set_hasher)
+MARK_VISIBLE (ksba_cms_get_signers)
+MARK_VISIBLE (ksba_cms_signers_release)
+MARK_VISIBLE (ksba_cms_signers_count)
+MARK_VISIBLE (ksba_cms_signers_get_issuer_serial)
+MARK_VISIBLE (ksba_cms_signers_get_subj_key_id)
+MARK_VISIBLE (ksba_cms_signers_get_digest_algo)
+MARK_VISIBLE (ksba_cms_signers_get_signed_attrs)
+MARK_VISIBLE (ksba_cms_signers_get_message_digest)
+MARK_VISIBLE (ksba_cms_signers_get_signing_time)
+MARK_VISIBLE (ksba_cms_signers_get_sig_val)
+MARK_VISIBLE (ksba_writer_flush)
+MARK_VISIBLE (ksba_writer_set_mem_chunked)
+MARK_VISIBLE (ksba_writer_get_chunk)
+MARK_VISIBLE (ksba_reader_peek)
+MARK_VISIBLE (ksba_reader_advance)
+MARK_VISIBLE (ksba_reader_set_push)
+MARK_VISIBLE (ksba_reader_push)
+MARK_VISIBLE (ksba_cms_set_lazy_certs)
 
 MARK_VISIBLE (ksba_crl_get_digest_algo)
 MARK_VISIBLE (ksba_crl_get_issuer)
@@ -499,6 +672,23 @@ MARK_VISIBLE (ksba_crl_set_reader)
 MARK_VISIBLE (ksba_crl_get_extension)
 MARK_VISIBLE (ksba_crl_get_auth_key_id)
 MARK_VISIBLE (ksba_crl_get_crl_number)
+MARK_VISIBLE (ksba_crl_get_delta_indicator)
+MARK_VISIBLE (ksba_crl_start_index)
+MARK_VISIBLE (ksba_crl_get_index)
+MARK_VISIBLE (ksba_crl_index_new_from_mem)
+MARK_VISIBLE (ksba_crl_index_release)
+MARK_VISIBLE (ksba_crl_index_get_image)
+MARK_VISIBLE (ksba_crl_index_get_count)
+MARK_VISIBLE (ksba_crl_index_lookup)
+MARK_VISIBLE (ksba_crl_index_new_from_fd)
+MARK_VISIBLE (ksba_crl_index_write)
+MARK_VISIBLE (ksba_crl_index_get_issuer)
+MARK_VISIBLE (ksba_crl_index_get_update_times)
+MARK_VISIBLE (ksba_crl_index_get_crl_number)
+MARK_VISIBLE (ksba_crl_index_get_digest_algo)
+MARK_VISIBLE (ksba_crl_index_get_sig_val)
+MARK_VISIBLE (ksba_crl_index_get_delta_indicator)
+MARK_VISIBLE (ksba_crl_index_apply_delta)
 
 MARK_VISIBLE (ksba_name_enum)
 MARK_VISIBLE (ksba_name_get_uri)
@@ -525,6 +715,29 @@ MARK_VISIBLE (ksba_ocsp_set_nonce)
 MARK_VISIBLE (ksba_ocsp_set_requestor)
 MARK_VISIBLE (ksba_ocsp_set_sig_val)
 MARK_VISIBLE (ksba_ocsp_get_extension)
+MARK_VISIBLE (ksba_ocsp_cache_new)
+MARK_VISIBLE (ksba_ocsp_cache_release)
+MARK_VISIBLE (ksba_ocsp_cache_lookup)
+MARK_VISIBLE (ksba_ocsp_set_cache)
+MARK_VISIBLE (ksba_ocsp_update_cache)
+MARK_VISIBLE (ksba_ocsp_set_certid_algo)
+MARK_VISIBLE (ksba_ocsp_build_request_into)
+MARK_VISIBLE (ksba_ocsp_responder_new)
+MARK_VISIBLE (ksba_ocsp_responder_release)
+MARK_VISIBLE (ksba_ocsp_responder_set_responder_id)
+MARK_VISIBLE (ksba_ocsp_responder_add_cert)
+MARK_VISIBLE (ksba_ocsp_responder_add_issuer)
+MARK_VISIBLE (ksba_ocsp_responder_set_signer)
+MARK_VISIBLE (ksba_ocsp_responder_reset)
+MARK_VISIBLE (ksba_ocsp_responder_parse_request)
+MARK_VISIBLE (ksba_ocsp_responder_get_count)
+MARK_VISIBLE (ksba_ocsp_responder_get_request)
+MARK_VISIBLE (ksba_ocsp_responder_get_nonce)
+MARK_VISIBLE (ksba_ocsp_responder_set_certid_algo)
+MARK_VISIBLE (ksba_ocsp_responder_add_target)
+MARK_VISIBLE (ksba_ocsp_responder_set_status)
+MARK_VISIBLE (ksba_ocsp_responder_build_response)
+MARK_VISIBLE (ksba_ocsp_responder_build_error)
 
 MARK_VISIBLE (ksba_oid_from_str)
 MARK_VISIBLE (ksba_oid_to_str)
@@ -34,6 +34,12 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
 #include "util.h"
 
 #include "ksba.h"
@@ -41,6 +47,35 @@
 #include "asn1-func.h"
 #include "ber-help.h"
 
+/* The size of the buffer used to coalesce writes to a file
+   descriptor.  Larger writes are passed directly to the system.  */
+#define FD_BUFFER_SIZE 65536
+
+/* The default size of the chunks of a chunked memory writer.  */
+#define DEFAULT_CHUNK_SIZE 65536
+
+#if defined(HAVE_WRITEV) && defined(HAVE_SYS_UIO_H)
+# define USE_WRITEV 1
+#endif
+
+/* Release the buffers of the memory writer W.  */
+static void
+release_mem (ksba_writer_t w)
+{
+  int i;
+
+  xfree (w->u.mem.buffer);
+  w->u.mem.buffer = NULL;
+  w->u.mem.size = 0;
+  for (i=0; i < w->u.mem.nchunks; i++)
+    xfree (w->u.mem.chunks[i].buffer);
+  xfree (w->u.mem.chunks);
+  w->u.mem.chunks = NULL;
+  w->u.mem.nchunks = w->u.mem.chunksalloc = 0;
+  w->u.mem.chunk_size = 0;
+}
+
+
 /**
  * ksba_writer_new:
  *
@@ -79,7 +114,12 @@ ksba_writer_release (ksba_writer_t w)
       notify_fnc (w->notify_cb_value, w);
     }
   if (w->type == WRITER_TYPE_MEM)
-    xfree (w->u.mem.buffer);
+    release_mem (w);
+  else if (w->type == WRITER_TYPE_FD)
+    {
+      ksba_writer_flush (w);
+      xfree (w->u.fd.buffer);
+    }
   xfree (w);
 }
 
@@ -122,6 +162,8 @@ ksba_writer_tell (ksba_writer_t w)
  *
  * Initialize the Writer object with a file descriptor, so that write
  * operations on this object are excuted on this file descriptor.
+ * Small writes are collected in a buffer; use ksba_writer_flush to
+ * write them out.
  *
  * Return value:
  **/
@@ -133,9 +175,14 @@ ksba_writer_set_fd (ksba_writer_t w, int fd)
   if (w->type)
     return gpg_error (GPG_ERR_CONFLICT);
 
+  w->u.fd.buffer = xtrymalloc (FD_BUFFER_SIZE);
+  if (!w->u.fd.buffer)
+    return gpg_error_from_syserror ();
+  w->u.fd.size = FD_BUFFER_SIZE;
+  w->u.fd.used = 0;
+  w->u.fd.fd = fd;
   w->error = 0;
   w->type = WRITER_TYPE_FD;
-  w->u.fd = fd;
 
   return 0;
 }
@@ -208,16 +255,22 @@ ksba_writer_set_mem (ksba_writer_t w, size_t initial_size)
 {
   if (!w)
     return gpg_error (GPG_ERR_INV_VALUE);
-  if (w->type == WRITER_TYPE_MEM)
+  if (w->type == WRITER_TYPE_MEM && !w->u.mem.chunk_size)
     ; /* Reuse the buffer (we ignore the initial size)*/
   else
     {
+      if (w->type == WRITER_TYPE_MEM)
+        {
+          release_mem (w);
+          w->type = 0;
+        }
       if (w->type)
         return gpg_error (GPG_ERR_CONFLICT);
 
       if (!initial_size)
         initial_size = 1024;
 
+      memset (&w->u.mem, 0, sizeof w->u.mem);
       w->u.mem.buffer = xtrymalloc (initial_size);
       if (!w->u.mem.buffer)
         return gpg_error (GPG_ERR_ENOMEM);
@@ -230,6 +283,100 @@ ksba_writer_set_mem (ksba_writer_t w, size_t initial_size)
   return 0;
 }
 
+
+/* Initialize the writer W to store the data in memory as a list of
+   chunks of CHUNK_SIZE bytes; 0 selects a default size.  Unlike with
+   ksba_writer_set_mem, data once written is never moved.  The chunks
+   can be retrieved with ksba_writer_get_chunk or joined by
+   ksba_writer_get_mem and ksba_writer_snatch_mem.  */
+gpg_error_t
+ksba_writer_set_mem_chunked (ksba_writer_t w, size_t chunk_size)
+{
+  if (!w)
+    return gpg_error (GPG_ERR_INV_VALUE);
+  if (w->type == WRITER_TYPE_MEM)
+    release_mem (w);
+  else if (w->type)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  memset (&w->u.mem, 0, sizeof w->u.mem);
+  w->u.mem.chunk_size = chunk_size? chunk_size : DEFAULT_CHUNK_SIZE;
+  w->type = WRITER_TYPE_MEM;
+  w->error = 0;
+  w->nwritten = 0;
+
+  return 0;
+}
+
+
+/* Join all chunks of the chunked memory writer W into one chunk.  */
+static gpg_error_t
+join_chunks (ksba_writer_t w)
+{
+  struct writer_chunk_s *c;
+  unsigned char *buffer;
+  size_t size, n;
+  int i;
+
+  if (w->u.mem.nchunks == 1)
+    return 0;
+
+  if (!w->u.mem.chunksalloc)
+    {
+      w->u.mem.chunks = xtrycalloc (1, sizeof *w->u.mem.chunks);
+      if (!w->u.mem.chunks)
+        return gpg_error_from_syserror ();
+      w->u.mem.chunksalloc = 1;
+    }
+
+  size = w->nwritten? w->nwritten : w->u.mem.chunk_size;
+  buffer = xtrymalloc (size);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  n = 0;
+  for (i=0, c = w->u.mem.chunks; i < w->u.mem.nchunks; i++, c++)
+    {
+      memcpy (buffer + n, c->buffer, c->used);
+      n += c->used;
+      xfree (c->buffer);
+    }
+  c = w->u.mem.chunks;
+  c->buffer = buffer;
+  c->size = size;
+  c->used = n;
+  w->u.mem.nchunks = 1;
+  return 0;
+}
+
+
+/* Return the chunk with index IDX of the memory writer W and store
+   its length at R_LENGTH.  A writer set up by ksba_writer_set_mem
+   has just one chunk.  NULL is returned if there is no such chunk.
+   The chunks are valid until the next call to ksba_writer_get_mem,
+   ksba_writer_set_mem or ksba_writer_release; write operations on a
+   chunked writer do not move them.  */
+const void *
+ksba_writer_get_chunk (ksba_writer_t w, int idx, size_t *r_length)
+{
+  if (!w || w->type != WRITER_TYPE_MEM || w->error || idx < 0)
+    return NULL;
+
+  if (!w->u.mem.chunk_size)
+    {
+      if (idx)
+        return NULL;
+      if (r_length)
+        *r_length = w->nwritten;
+      return w->u.mem.buffer;
+    }
+
+  if (idx >= w->u.mem.nchunks)
+    return NULL;
+  if (r_length)
+    *r_length = w->u.mem.chunks[idx].used;
+  return w->u.mem.chunks[idx].buffer;
+}
+
 /* Return the pointer to the memory and the size of it.  This pointer
    is valid as long as the writer object is valid and no write
    operations takes place (because they might reallocate the buffer).
@@ -243,6 +390,17 @@ ksba_writer_get_mem (ksba_writer_t w, size_t *nbytes)
 {
   if (!w || w->type != WRITER_TYPE_MEM || w->error)
     return NULL;
+  if (w->u.mem.chunk_size)
+    {
+      if (join_chunks (w))
+        {
+          w->error = ENOMEM;
+          return NULL;
+        }
+      if (nbytes)
+        *nbytes = w->nwritten;
+      return w->u.mem.chunks[0].buffer;
+    }
   if (nbytes)
     *nbytes = w->nwritten;
   return w->u.mem.buffer;
@@ -262,10 +420,24 @@ ksba_writer_snatch_mem (ksba_writer_t w, size_t *nbytes)
 
   if (!w || w->type != WRITER_TYPE_MEM || w->error)
     return NULL;
+  if (w->u.mem.chunk_size)
+    {
+      if (join_chunks (w))
+        {
+          w->error = ENOMEM;
+          return NULL;
+        }
+      p = w->u.mem.chunks[0].buffer;
+      w->u.mem.chunks[0].buffer = NULL;
+    }
+  else
+    {
+      p = w->u.mem.buffer;
+      w->u.mem.buffer = NULL;
+    }
   if (nbytes)
     *nbytes = w->nwritten;
-  p = w->u.mem.buffer;
-  w->u.mem.buffer = NULL;
+  release_mem (w);
   w->type = 0;
   w->nwritten = 0;
   return p;
@@ -291,6 +463,137 @@ ksba_writer_set_filter (ksba_writer_t w,
 
 
 
+/* Write the LENGTH bytes from BUFFER to the file descriptor of W.
+   Retry on interrupts and short writes.  */
+static gpg_error_t
+write_fd (ksba_writer_t w, const void *buffer, size_t length)
+{
+  const unsigned char *p = buffer;
+  ssize_t n;
+
+  while (length)
+    {
+      do
+        n = write (w->u.fd.fd, p, length);
+      while (n == -1 && errno == EINTR);
+      if (n == -1)
+        {
+          w->error = errno;
+          return gpg_error_from_errno (w->error);
+        }
+      p += n;
+      length -= n;
+    }
+  return 0;
+}
+
+
+/* Write the pending data of the file descriptor writer W followed by
+   LENGTH bytes from BUFFER.  */
+static gpg_error_t
+flush_fd (ksba_writer_t w, const void *buffer, size_t length)
+{
+  gpg_error_t err;
+#ifdef USE_WRITEV
+  struct iovec iov[2];
+  ssize_t n;
+
+  if (!w->u.fd.used && !length)
+    return 0;
+
+  iov[0].iov_base = w->u.fd.buffer;
+  iov[0].iov_len = w->u.fd.used;
+  iov[1].iov_base = (void*)buffer;
+  iov[1].iov_len = length;
+  do
+    n = writev (w->u.fd.fd, iov, 2);
+  while (n == -1 && errno == EINTR);
+  if (n == -1)
+    {
+      w->error = errno;
+      return gpg_error_from_errno (w->error);
+    }
+  /* Write what is left after a short write.  */
+  if ((size_t)n < w->u.fd.used)
+    {
+      err = write_fd (w, w->u.fd.buffer + n, w->u.fd.used - n);
+      n = 0;
+    }
+  else
+    {
+      n -= w->u.fd.used;
+      err = 0;
+    }
+  w->u.fd.used = 0;
+  if (!err)
+    err = write_fd (w, (const unsigned char*)buffer + n, length - n);
+#else
+  err = write_fd (w, w->u.fd.buffer, w->u.fd.used);
+  w->u.fd.used = 0;
+  if (!err)
+    err = write_fd (w, buffer, length);
+#endif
+  return err;
+}
+
+
+/* Append LENGTH bytes from BUFFER to the chunked memory writer W.
+   The last chunk is filled up and the rest goes into a new chunk.  */
+static gpg_error_t
+write_chunked (ksba_writer_t w, const void *buffer, size_t length)
+{
+  const unsigned char *p = buffer;
+  struct writer_chunk_s *c;
+  size_t n, total = length;
+
+  if (w->u.mem.nchunks)
+    {
+      c = w->u.mem.chunks + w->u.mem.nchunks - 1;
+      n = c->size - c->used;
+      if (n > length)
+        n = length;
+      if (n)
+        {
+          memcpy (c->buffer + c->used, p, n);
+          c->used += n;
+          p += n;
+          length -= n;
+        }
+    }
+
+  if (length)
+    {
+      if (w->u.mem.nchunks == w->u.mem.chunksalloc)
+        {
+          int newalloc = w->u.mem.chunksalloc? 2*w->u.mem.chunksalloc : 16;
+
+          c = xtryrealloc (w->u.mem.chunks, newalloc * sizeof *c);
+          if (!c)
+            goto enomem;
+          w->u.mem.chunks = c;
+          w->u.mem.chunksalloc = newalloc;
+        }
+      c = w->u.mem.chunks + w->u.mem.nchunks;
+      c->size = length > w->u.mem.chunk_size? length : w->u.mem.chunk_size;
+      c->buffer = xtrymalloc (c->size);
+      if (!c->buffer)
+        goto enomem;
+      memcpy (c->buffer, p, length);
+      c->used = length;
+      w->u.mem.nchunks++;
+    }
+
+  w->nwritten += total;
+  return 0;
+
+ enomem:
+  /* Keep what has been written to the last chunk.  */
+  w->nwritten += total - length;
+  w->error = ENOMEM;
+  return gpg_error (GPG_ERR_ENOMEM);
+}
+
+
 static gpg_error_t
 do_writer_write (ksba_writer_t w, const void *buffer, size_t length)
 {
@@ -304,16 +607,19 @@ do_writer_write (ksba_writer_t w, const void *buffer, size_t length)
       if (w->error == ENOMEM)
         return gpg_error (GPG_ERR_ENOMEM); /* it does not make sense to proceed then */
 
+      if (w->u.mem.chunk_size)
+        return write_chunked (w, buffer, length);
+
       if (w->nwritten + length > w->u.mem.size)
         {
           size_t newsize = w->nwritten + length;
           char *p;
 
+          /* Grow geometrically so that building large objects does
+             not copy the data again and again.  */
+          if (newsize < 2 * w->u.mem.size)
+            newsize = 2 * w->u.mem.size;
           newsize = ((newsize + 4095)/4096)*4096;
-          if (newsize < 16384)
-            newsize += 4096;
-          else
-            newsize += 16384;
 
           p = xtryrealloc (w->u.mem.buffer, newsize);
           if (!p)
@@ -356,12 +662,60 @@ do_writer_write (ksba_writer_t w, const void *buffer, size_t length)
         return err;
       w->nwritten += length;
     }
+  else if (w->type == WRITER_TYPE_FD)
+    {
+      gpg_error_t err;
+
+      if (w->error)
+        return gpg_error_from_errno (w->error);
+
+      if (w->u.fd.used + length <= w->u.fd.size)
+        {
+          memcpy (w->u.fd.buffer + w->u.fd.used, buffer, length);
+          w->u.fd.used += length;
+        }
+      else
+        {
+          /* Write the buffer and the new data in one go.  */
+          err = flush_fd (w, buffer, length);
+          if (err)
+            return err;
+        }
+      w->nwritten += length;
+    }
   else
     return gpg_error (GPG_ERR_BUG);
 
   return 0;
 }
 
+
+/* Write out all data buffered by W.  This is required for writers
+   using a file descriptor; for stdio based writers the stream is
+   flushed.  */
+gpg_error_t
+ksba_writer_flush (ksba_writer_t w)
+{
+  if (!w)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (w->type == WRITER_TYPE_FD)
+    {
+      if (w->error)
+        return gpg_error_from_errno (w->error);
+      return flush_fd (w, NULL, 0);
+    }
+  else if (w->type == WRITER_TYPE_FILE)
+    {
+      if (fflush (w->u.file))
+        {
+          w->error = errno;
+          return gpg_error_from_errno (w->error);
+        }
+    }
+  return 0;
+}
+
 /**
  * ksba_writer_write:
  * @w: Writer object
@@ -447,7 +801,7 @@ ksba_writer_write_octet_string (ksba_writer_t w,
       err = _ksba_ber_write_tl (w, 0, 0, 0, 0);
 
   if (flush) /* Reset it even in case of an error. */
-    w->ndef_is_open = 1;
+    w->ndef_is_open = 0;
 
   return err;
 }
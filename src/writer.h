@@ -33,6 +33,14 @@
 
 #include <stdio.h>
 
+/* A chunk of a memory writer in chunked mode.  */
+struct writer_chunk_s {
+  unsigned char *buffer;
+  size_t size;   /* Allocated size of BUFFER.  */
+  size_t used;   /* Bytes used in BUFFER.  */
+};
+
+
 enum writer_type {
   WRITER_TYPE_NONE = 0,
   WRITER_TYPE_FD,
@@ -54,7 +62,12 @@ struct ksba_writer_s {
   void *filter_arg;
 
   union {
-    int fd;  /* for WRITER_TYPE_FD */
+    struct {
+      int fd;
+      unsigned char *buffer;  /* Buffer to coalesce small writes.  */
+      size_t size;            /* Allocated size of BUFFER.  */
+      size_t used;            /* Bytes pending in BUFFER.  */
+    } fd;  /* for WRITER_TYPE_FD */
     FILE *file; /* for WRITER_TYPE_FILE */
     struct {
       int (*fnc)(void*,const void *,size_t);
@@ -63,6 +76,10 @@ struct ksba_writer_s {
     struct {
       unsigned char *buffer;
       size_t size;
+      size_t chunk_size;  /* If not 0 the data is kept in CHUNKS.  */
+      struct writer_chunk_s *chunks;
+      int nchunks;
+      int chunksalloc;
     } mem;   /* for WRITER_TYPE_MEM */
   } u;
   void (*notify_cb)(void*,ksba_writer_t);
@@ -17,11 +17,15 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
 
 #include "../src/ksba.h"
 #define _KSBA_VISIBILITY_DEFAULT /*  */
@@ -565,6 +569,179 @@ one_file (const char *fname)
 }
 
 
+/* Check that parsing a certificate from memory without copying
+   yields the same certificate as the regular parser.  */
+static void
+check_nocopy (const char *fname)
+{
+  gpg_error_t err;
+  FILE *fp;
+  unsigned char *buffer;
+  size_t buflen, n1, n2;
+  ksba_cert_t cert1, cert2;
+  const unsigned char *img1, *img2;
+  char *dn1, *dn2;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  buffer = xmalloc (65536);
+  buflen = fread (buffer, 1, 65536, fp);
+  fclose (fp);
+
+  err = ksba_cert_new (&cert1);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem (cert1, buffer, buflen);
+  fail_if_err2 (fname, err);
+
+  err = ksba_cert_new (&cert2);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem_nocopy (cert2, buffer, buflen);
+  fail_if_err2 (fname, err);
+
+  img1 = ksba_cert_get_image (cert1, &n1);
+  img2 = ksba_cert_get_image (cert2, &n2);
+  if (!img1 || !img2)
+    fail ("no image");
+  if (img2 != buffer)
+    fail ("nocopy image does not point into the buffer");
+  if (n1 != n2 || memcmp (img1, img2, n1))
+    fail ("nocopy image does not match");
+
+  dn1 = ksba_cert_get_subject (cert1, 0);
+  dn2 = ksba_cert_get_subject (cert2, 0);
+  if (!dn1 || !dn2 || strcmp (dn1, dn2))
+    fail ("nocopy subject does not match");
+  ksba_free (dn1);
+  ksba_free (dn2);
+
+  ksba_cert_release (cert2);
+  ksba_cert_release (cert1);
+  xfree (buffer);
+}
+
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYNC_BUILTINS)
+/* The number of threads and rounds used by check_threads.  */
+#define CERT_THREADS  4
+#define CERT_ROUNDS  50
+
+/* The certificate shared by the threads and the expected values
+   taken from a second certificate object.  */
+static ksba_cert_t shared_cert;
+static const char *expected_algo;
+static const char *expected_oids[32];
+static size_t expected_offs[32];
+static int expected_nextns;
+
+
+/* Thread to call the read-only accessors on SHARED_CERT.  */
+static void *
+cert_reader (void *arg)
+{
+  gpg_error_t err;
+  const char *algo, *oid;
+  int i, idx, crit;
+  size_t off, len;
+  char *dn;
+
+  (void)arg;
+
+  for (i=0; i < 100; i++)
+    {
+      ksba_cert_ref (shared_cert);
+
+      algo = ksba_cert_get_digest_algo (shared_cert);
+      if (!algo || strcmp (algo, expected_algo))
+        fail ("digest algo does not match");
+
+      for (idx=0; !(err = ksba_cert_get_extension (shared_cert, idx, &oid,
+                                                   &crit, &off, &len));
+           idx++)
+        if (idx >= expected_nextns
+            || strcmp (oid, expected_oids[idx]) || off != expected_offs[idx])
+          fail ("extension does not match");
+      if (gpg_err_code (err) != GPG_ERR_EOF || idx != expected_nextns)
+        fail ("wrong number of extensions");
+
+      /* This fails and thus stores an error code in the object.  */
+      dn = ksba_cert_get_subject (shared_cert, 1000);
+      if (dn)
+        fail ("subject with a bogus index found");
+
+      ksba_cert_release (shared_cert);
+    }
+  return NULL;
+}
+
+
+/* Let several threads use one certificate object at the same time.
+   Each round starts with a fresh object so that the values computed
+   on demand are computed concurrently.  */
+static void
+check_threads (const char *fname)
+{
+  gpg_error_t err;
+  FILE *fp;
+  unsigned char *buffer;
+  size_t buflen, off, len;
+  ksba_cert_t cert;
+  pthread_t threads[CERT_THREADS];
+  const char *oid;
+  int round, i, crit;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open `%s': %s\n",
+               __FILE__, __LINE__, fname, strerror (errno));
+      exit (1);
+    }
+  buffer = xmalloc (65536);
+  buflen = fread (buffer, 1, 65536, fp);
+  fclose (fp);
+
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+  err = ksba_cert_init_from_mem (cert, buffer, buflen);
+  fail_if_err2 (fname, err);
+  expected_algo = ksba_cert_get_digest_algo (cert);
+  if (!expected_algo)
+    fail ("no digest algo");
+  for (i=0; !(err = ksba_cert_get_extension (cert, i, &oid, &crit,
+                                             &off, &len)); i++)
+    {
+      if (i >= sizeof expected_oids / sizeof *expected_oids)
+        fail ("too many extensions");
+      expected_oids[i] = oid;
+      expected_offs[i] = off;
+    }
+  expected_nextns = i;
+
+  for (round=0; round < CERT_ROUNDS; round++)
+    {
+      err = ksba_cert_new (&shared_cert);
+      fail_if_err (err);
+      err = ksba_cert_init_from_mem (shared_cert, buffer, buflen);
+      fail_if_err2 (fname, err);
+      for (i=0; i < CERT_THREADS; i++)
+        if (pthread_create (threads + i, NULL, cert_reader, NULL))
+          fail ("can't create thread");
+      for (i=0; i < CERT_THREADS; i++)
+        pthread_join (threads[i], NULL);
+      ksba_cert_release (shared_cert);
+    }
+
+  ksba_cert_release (cert);
+  xfree (buffer);
+}
+#endif /*HAVE_PTHREAD && HAVE_SYNC_BUILTINS*/
+
+
 
 
 int
@@ -611,6 +788,10 @@ main (int argc, char **argv)
           strcat (fname, "/");
           strcat (fname, files[idx]);
           one_file (fname);
+          check_nocopy (fname);
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYNC_BUILTINS)
+          check_threads (fname);
+#endif
           ksba_free (fname);
         }
     }
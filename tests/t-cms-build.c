@@ -0,0 +1,283 @@
+/* t-cms-build.c - Regression tests for the CMS builder
+ *      Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "../src/ksba.h"
+
+#include "t-common.h"
+
+
+/* The size of the content; it spans many chunks of the smallest
+   size.  */
+#define DATALEN 300000
+
+/* The data passed to the hash function.  */
+static unsigned char *hashed;
+static size_t hashedlen;
+
+
+static void
+collect_hash_fnc (void *arg, const void *buffer, size_t length)
+{
+  (void)arg;
+
+  if (hashedlen + length > DATALEN)
+    fail ("too much data hashed");
+  memcpy (hashed + hashedlen, buffer, length);
+  hashedlen += length;
+}
+
+
+static ksba_cert_t
+get_one_cert (const char *fname)
+{
+  gpg_error_t err;
+  char *f;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_cert_t cert;
+
+  f = prepend_srcdir (fname);
+  fp = fopen (f, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "can't open `%s': %s\n", f, strerror (errno));
+      exit (1);
+    }
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_cert_new (&cert);
+  fail_if_err (err);
+  err = ksba_cert_read_der (cert, r);
+  fail_if_err2 (f, err);
+  ksba_reader_release (r);
+  fclose (fp);
+  xfree (f);
+  return cert;
+}
+
+
+/* Build a signed data object with the content DATA using chunks of
+   CHUNKSIZE bytes and parse it back.  With DETACHED the content is
+   only hashed.  */
+static void
+check_signed_data (ksba_cert_t cert, const unsigned char *data,
+                   size_t chunksize, int detached)
+{
+  /* The sizes of the pieces passed to ksba_cms_write_data.  */
+  static const size_t sizes[] = { 1, 511, 512, 513, 5000, 100000, 2,
+                                  60000, 1023, 1 };
+  const int nsizes = sizeof sizes / sizeof *sizes;
+  gpg_error_t err;
+  ksba_cms_t cms;
+  ksba_writer_t w;
+  ksba_reader_t r;
+  ksba_stop_reason_t stopreason;
+  char digest[20];
+  char *parsed_digest;
+  unsigned char *image, *content;
+  size_t imagelen, contentlen, off, n;
+  int i;
+
+  hashed = xmalloc (DATALEN);
+  hashedlen = 0;
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 1024);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, NULL, w);
+  fail_if_err (err);
+  err = ksba_cms_set_chunk_size (cms, chunksize);
+  fail_if_err (err);
+  err = ksba_cms_set_content_type (cms, 0, KSBA_CT_SIGNED_DATA);
+  fail_if_err (err);
+  err = ksba_cms_set_content_type (cms, 1, KSBA_CT_DATA);
+  fail_if_err (err);
+  err = ksba_cms_add_digest_algo (cms, "1.3.14.3.2.26");
+  fail_if_err (err);
+  err = ksba_cms_add_signer (cms, cert);
+  fail_if_err (err);
+  err = ksba_cms_add_cert (cms, cert);
+  fail_if_err (err);
+  err = ksba_cms_set_signing_time (cms, 0, "20260101T000000");
+  fail_if_err (err);
+  ksba_cms_set_hash_function (cms, collect_hash_fnc, NULL);
+
+  /* A detached signature is requested by setting the digest in
+     advance; we don't know it yet.  */
+  memset (digest, 0, sizeof digest);
+  if (detached)
+    {
+      err = ksba_cms_set_message_digest (cms, 0, digest, sizeof digest);
+      fail_if_err (err);
+    }
+
+  err = ksba_cms_write_data (cms, data, 1);
+  if (gpg_err_code (err) != GPG_ERR_INV_STATE)
+    fail ("data accepted before the data phase");
+
+  off = 0;
+  do
+    {
+      err = ksba_cms_build (cms, &stopreason);
+      fail_if_err (err);
+      if ((stopreason == KSBA_SR_BEGIN_DATA && !detached)
+          || (stopreason == KSBA_SR_END_DATA && detached && !off))
+        {
+          for (i=0; off < DATALEN; off += n, i++)
+            {
+              n = sizes[i % nsizes];
+              if (n > DATALEN - off)
+                n = DATALEN - off;
+              err = ksba_cms_write_data (cms, data + off, n);
+              fail_if_err (err);
+            }
+          if (!detached)
+            {
+              err = ksba_cms_set_chunk_size (cms, 4096);
+              if (gpg_err_code (err) != GPG_ERR_INV_STATE)
+                fail ("chunk size changed while data is pending");
+            }
+          if (hashedlen != DATALEN || memcmp (hashed, data, DATALEN))
+            fail ("wrong data hashed while building");
+          sha1_hash_buffer (digest, (char*)data, DATALEN);
+          err = ksba_cms_set_message_digest (cms, 0, digest, sizeof digest);
+          fail_if_err (err);
+        }
+      else if (stopreason == KSBA_SR_NEED_SIG)
+        {
+          err = ksba_cms_set_sig_val
+            (cms, 0, (const unsigned char*)"(7:sig-val(3:rsa(1:s4:abcd)))");
+          fail_if_err (err);
+        }
+    }
+  while (stopreason != KSBA_SR_READY);
+  ksba_cms_release (cms);
+  image = ksba_writer_snatch_mem (w, &imagelen);
+  if (!image)
+    fail ("no signed data built");
+  ksba_writer_release (w);
+
+  /* Parse the object back.  */
+  hashedlen = 0;
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, image, imagelen);
+  fail_if_err (err);
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 1024);
+  fail_if_err (err);
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (cms, r, w);
+  fail_if_err (err);
+  ksba_cms_set_hash_function (cms, collect_hash_fnc, NULL);
+  do
+    {
+      err = ksba_cms_parse (cms, &stopreason);
+      fail_if_err (err);
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  content = ksba_writer_snatch_mem (w, &contentlen);
+  if (detached)
+    {
+      if (contentlen || hashedlen)
+        fail ("content found in detached signature");
+    }
+  else
+    {
+      if (contentlen != DATALEN || memcmp (content, data, DATALEN))
+        fail ("content does not match");
+      if (hashedlen != DATALEN || memcmp (hashed, data, DATALEN))
+        fail ("wrong data hashed while parsing");
+    }
+  err = ksba_cms_get_message_digest (cms, 0, &parsed_digest, &n);
+  fail_if_err (err);
+  if (n != sizeof digest || memcmp (parsed_digest, digest, n))
+    fail ("message digest does not match");
+
+  xfree (parsed_digest);
+  xfree (content);
+  xfree (image);
+  xfree (hashed);
+  ksba_cms_release (cms);
+  ksba_writer_release (w);
+  ksba_reader_release (r);
+}
+
+
+/* Check the limits of the chunk size.  */
+static void
+check_chunk_size (void)
+{
+  gpg_error_t err;
+  ksba_cms_t cms;
+
+  err = ksba_cms_new (&cms);
+  fail_if_err (err);
+  if (gpg_err_code (ksba_cms_set_chunk_size (cms, 511)) != GPG_ERR_INV_VALUE)
+    fail ("too small chunk size accepted");
+  if (gpg_err_code (ksba_cms_set_chunk_size (cms, 16*1024*1024 + 1))
+      != GPG_ERR_INV_VALUE)
+    fail ("too large chunk size accepted");
+  err = ksba_cms_set_chunk_size (cms, 512);
+  fail_if_err (err);
+  err = ksba_cms_set_chunk_size (cms, 16*1024*1024);
+  fail_if_err (err);
+  err = ksba_cms_set_chunk_size (cms, 0);
+  fail_if_err (err);
+  ksba_cms_release (cms);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  ksba_cert_t cert;
+  unsigned char *data;
+  size_t i;
+
+  (void)argc;
+  (void)argv;
+
+  data = xmalloc (DATALEN);
+  for (i=0; i < DATALEN; i++)
+    data[i] = (i * 7) ^ (i >> 9);
+
+  cert = get_one_cert ("samples/ov-user.crt");
+  check_chunk_size ();
+  check_signed_data (cert, data, 512, 0);
+  check_signed_data (cert, data, 512, 1);
+  check_signed_data (cert, data, 65536, 0);
+  ksba_cert_release (cert);
+  xfree (data);
+  return 0;
+}
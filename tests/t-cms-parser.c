@@ -47,8 +47,308 @@ dummy_writer_cb (void *cb_value, const void *buffer, size_t count)
 
 
 
+/* Take a snapshot of the signer infos of CMS and check that it
+   matches the values returned for each index.  */
+static ksba_cms_signers_t
+get_signers (const char *fname, ksba_cms_t cms)
+{
+  gpg_error_t err;
+  ksba_cms_signers_t signers;
+  const unsigned char *der;
+  size_t derlen, n;
+  const char *issuer;
+  ksba_const_sexp_t serial, keyid;
+  ksba_isotime_t t1, t2;
+  char *dn, *digest;
+  ksba_sexp_t p;
+  int idx;
+
+  err = ksba_cms_get_signers (cms, &signers);
+  fail_if_err2 (fname, err);
+  for (idx=0; idx < ksba_cms_signers_count (signers); idx++)
+    {
+      err = ksba_cms_signers_get_subj_key_id (signers, idx, &keyid);
+      if (!err)
+        {
+          /* The signer is identified by its subjectKeyIdentifier.  */
+          if (*keyid != '(')
+            fail ("snapshot key identifier is not an S-expression");
+          err = ksba_cms_signers_get_issuer_serial (signers, idx,
+                                                    &issuer, &serial);
+          if (gpg_err_code (err) != GPG_ERR_NO_DATA || issuer || serial)
+            fail ("snapshot has an issuer for a key identifier");
+        }
+      else
+        {
+          if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+            fail_if_err2 (fname, err);
+          err = ksba_cms_get_issuer_serial (cms, idx, &dn, &p);
+          fail_if_err2 (fname, err);
+          err = ksba_cms_signers_get_issuer_serial (signers, idx,
+                                                    &issuer, &serial);
+          fail_if_err2 (fname, err);
+          if (strcmp (dn, issuer) || strcmp ((char*)p, (const char*)serial))
+            fail ("snapshot issuer or serial does not match");
+          ksba_free (dn);
+          ksba_free (p);
+        }
+
+      if (strcmp (ksba_cms_get_digest_algo (cms, idx),
+                  ksba_cms_signers_get_digest_algo (signers, idx)))
+        fail ("snapshot digest algo does not match");
+
+      err = ksba_cms_get_message_digest (cms, idx, &digest, &n);
+      fail_if_err2 (fname, err);
+      err = ksba_cms_signers_get_message_digest (signers, idx, &der, &derlen);
+      if (digest)
+        {
+          fail_if_err2 (fname, err);
+          if (n != derlen || memcmp (digest, der, n))
+            fail ("snapshot message digest does not match");
+        }
+      else if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+        fail ("snapshot message digest unexpectedly found");
+      ksba_free (digest);
+
+      err = ksba_cms_get_signing_time (cms, idx, t1);
+      fail_if_err2 (fname, err);
+      err = ksba_cms_signers_get_signing_time (signers, idx, t2);
+      fail_if_err2 (fname, err);
+      if (strcmp (t1, t2))
+        fail ("snapshot signing time does not match");
+
+      err = ksba_cms_signers_get_signed_attrs (signers, idx, &der, &derlen);
+      if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+        {
+          fail_if_err2 (fname, err);
+          if (!derlen || *der != 0x31)
+            fail ("snapshot signed attributes are not a SET");
+        }
+
+      p = ksba_cms_get_sig_val (cms, idx);
+      if (!p != !ksba_cms_signers_get_sig_val (signers, idx)
+          || (p && strcmp ((char*)p,
+                           (const char*)ksba_cms_signers_get_sig_val
+                           (signers, idx))))
+        fail ("snapshot signature does not match");
+      ksba_free (p);
+    }
+  if (ksba_cms_signers_get_digest_algo (signers, idx))
+    fail ("snapshot has too many signers");
+
+  return signers;
+}
+
+
+/* Check that the snapshot SIGNERS is still usable.  */
 static void
-one_file (const char *fname)
+check_signers (const char *fname, ksba_cms_signers_t signers)
+{
+  gpg_error_t err;
+  const char *issuer;
+  ksba_const_sexp_t serial, keyid;
+  int idx;
+
+  for (idx=0; idx < ksba_cms_signers_count (signers); idx++)
+    {
+      err = ksba_cms_signers_get_subj_key_id (signers, idx, &keyid);
+      if (!err)
+        {
+          if (*keyid != '(')
+            fail ("snapshot is not usable");
+          continue;
+        }
+      err = ksba_cms_signers_get_issuer_serial (signers, idx,
+                                                &issuer, &serial);
+      fail_if_err2 (fname, err);
+      if (!*issuer || *serial != '(')
+        fail ("snapshot is not usable");
+    }
+  ksba_cms_signers_release (signers);
+}
+
+
+/* Parse FNAME again with lazy parsing of the certificates and compare
+   them with the certificates of CMS.  */
+static void
+check_lazy_certs (const char *fname, ksba_cms_t cms)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_writer_t w;
+  ksba_cms_t lazy;
+  ksba_stop_reason_t stopreason;
+  ksba_cert_t a, b;
+  const unsigned char *imga, *imgb;
+  size_t lena, lenb;
+  int idx;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    fail ("can't open file");
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_cb (w, dummy_writer_cb, NULL);
+  fail_if_err (err);
+  err = ksba_cms_new (&lazy);
+  fail_if_err (err);
+  err = ksba_cms_set_lazy_certs (lazy, 1);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (lazy, r, w);
+  fail_if_err (err);
+  ksba_cms_set_hash_function (lazy, dummy_hash_fnc, NULL);
+  do
+    {
+      err = ksba_cms_parse (lazy, &stopreason);
+      fail_if_err2 (fname, err);
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  for (idx=0; (a = ksba_cms_get_cert (cms, idx)); idx++)
+    {
+      b = ksba_cms_get_cert (lazy, idx);
+      if (!b)
+        fail ("lazy certificate missing");
+      imga = ksba_cert_get_image (a, &lena);
+      imgb = ksba_cert_get_image (b, &lenb);
+      if (!imga || !imgb || lena != lenb || memcmp (imga, imgb, lena))
+        fail ("lazy certificate does not match");
+      ksba_cert_release (a);
+      ksba_cert_release (b);
+    }
+  if (ksba_cms_get_cert (lazy, idx))
+    fail ("too many lazy certificates");
+
+  ksba_cms_release (lazy);
+  ksba_writer_release (w);
+  ksba_reader_release (r);
+  fclose (fp);
+}
+
+
+/* Parse the object IMAGE of length IMAGELEN with lazy parsing of the
+   certificates and return the number of certificates or -1 if the
+   parser failed.  */
+static int
+count_lazy_certs (const unsigned char *image, size_t imagelen)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  ksba_writer_t w;
+  ksba_cms_t lazy;
+  ksba_stop_reason_t stopreason;
+  ksba_cert_t cert;
+  int idx;
+
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, image, imagelen);
+  fail_if_err (err);
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_cb (w, dummy_writer_cb, NULL);
+  fail_if_err (err);
+  err = ksba_cms_new (&lazy);
+  fail_if_err (err);
+  err = ksba_cms_set_lazy_certs (lazy, 1);
+  fail_if_err (err);
+  err = ksba_cms_set_reader_writer (lazy, r, w);
+  fail_if_err (err);
+  ksba_cms_set_hash_function (lazy, dummy_hash_fnc, NULL);
+  do
+    err = ksba_cms_parse (lazy, &stopreason);
+  while (!err && stopreason != KSBA_SR_READY);
+
+  idx = -1;
+  if (!err)
+    {
+      for (idx=0; (cert = ksba_cms_get_cert (lazy, idx)); idx++)
+        ksba_cert_release (cert);
+      /* A second pass must see the same certificates.  */
+      cert = ksba_cms_get_cert (lazy, idx - 1);
+      if (idx && !cert)
+        fail ("lazy certificate vanished");
+      ksba_cert_release (cert);
+    }
+
+  ksba_cms_release (lazy);
+  ksba_writer_release (w);
+  ksba_reader_release (r);
+  return idx;
+}
+
+
+/* Corrupt the first certificate of CMS in a copy of FNAME and check
+   that lazy parsing skips it or rejects the object.  NCERTS is the
+   number of certificates in FNAME.  */
+static void
+check_broken_lazy_cert (const char *fname, ksba_cms_t cms, int ncerts)
+{
+  FILE *fp;
+  ksba_cert_t cert;
+  const unsigned char *certimg;
+  unsigned char *image, *p;
+  size_t certlen, imagelen, off;
+  long len;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    fail ("can't open file");
+  if (fseek (fp, 0, SEEK_END) || (len = ftell (fp)) <= 0)
+    fail ("can't get the file size");
+  imagelen = len;
+  rewind (fp);
+  image = xmalloc (imagelen);
+  if (fread (image, imagelen, 1, fp) != 1)
+    fail ("error reading the file");
+  fclose (fp);
+
+  cert = ksba_cms_get_cert (cms, 0);
+  if (!cert)
+    fail ("no certificate");
+  certimg = ksba_cert_get_image (cert, &certlen);
+  for (off=0; off + certlen <= imagelen; off++)
+    if (!memcmp (image + off, certimg, certlen))
+      break;
+  if (off + certlen > imagelen)
+    fail ("certificate not found in the file");
+  ksba_cert_release (cert);
+
+  /* We expect 4 byte headers for the certificate and the
+     tbsCertificate followed by the version.  */
+  p = image + off;
+  if (p[0] != 0x30 || p[1] != 0x82 || p[4] != 0x30 || p[5] != 0x82
+      || p[8] != 0xa0 || p[9] != 0x03)
+    fail ("unexpected encoding of the certificate");
+
+  /* Break the length of the version but keep the outer structure.  */
+  p[9] = 0xff;
+  if (count_lazy_certs (image, imagelen) != ncerts - 1)
+    fail ("broken lazy certificate not skipped");
+  p[9] = 0x03;
+
+  /* Break the outer structure.  */
+  p[4] = 0x31;
+  if (count_lazy_certs (image, imagelen) != -1)
+    fail ("broken certificate structure not detected");
+  p[4] = 0x30;
+
+  if (count_lazy_certs (image, imagelen) != ncerts)
+    fail ("wrong number of lazy certificates");
+  xfree (image);
+}
+
+
+/* Parse the CMS object in FNAME.  If NSIGNERS or NCERTS are not
+   negative, the object is expected to have that many signers and
+   certificates.  */
+static void
+one_file (const char *fname, int nsigners, int ncerts)
 {
   gpg_error_t err;
   FILE *fp;
@@ -61,8 +361,10 @@ one_file (const char *fname)
   const char *s;
   size_t n;
   ksba_sexp_t p;
+  ksba_const_sexp_t keyid;
   char *dn;
   int idx;
+  ksba_cms_signers_t signers = NULL;
 
   printf ("*** checking `%s' ***\n", fname);
   fp = fopen (fname, "r");
@@ -162,24 +464,36 @@ one_file (const char *fname)
     }
   else
     {
+      if (ksba_cms_get_digest_algo (cms, 0))
+        signers = get_signers (fname, cms);
       for (idx=0; idx < 1; idx++)
         {
-          err = ksba_cms_get_issuer_serial (cms, idx, &dn, &p);
-          if (gpg_err_code (err) == GPG_ERR_NO_DATA && !idx)
+          if (signers
+              && !ksba_cms_signers_get_subj_key_id (signers, idx, &keyid))
             {
-              printf ("this is a certs-only message\n");
-              break;
+              printf ("signer %d - keyid: ", idx);
+              print_sexp_hex (keyid);
+              putchar ('\n');
+            }
+          else
+            {
+              err = ksba_cms_get_issuer_serial (cms, idx, &dn, &p);
+              if (gpg_err_code (err) == GPG_ERR_NO_DATA && !idx)
+                {
+                  printf ("this is a certs-only message\n");
+                  break;
+                }
+
+              fail_if_err2 (fname, err);
+              printf ("signer %d - issuer: ", idx);
+              print_dn (dn);
+              ksba_free (dn);
+              putchar ('\n');
+              printf ("signer %d - serial: ", idx);
+              print_sexp_hex (p);
+              ksba_free (p);
+              putchar ('\n');
             }
-
-          fail_if_err2 (fname, err);
-          printf ("signer %d - issuer: ", idx);
-          print_dn (dn);
-          ksba_free (dn);
-          putchar ('\n');
-          printf ("signer %d - serial: ", idx);
-          print_sexp_hex (p);
-          ksba_free (p);
-          putchar ('\n');
 
           err = ksba_cms_get_message_digest (cms, idx, &dn, &n);
           fail_if_err2 (fname, err);
@@ -217,11 +531,29 @@ one_file (const char *fname)
             printf ("signer %d - signature not found\n", idx);
           ksba_free (dn);
         }
+      if (nsigners >= 0
+          && (signers? ksba_cms_signers_count (signers) : 0) != nsigners)
+        fail ("wrong number of signers");
+      if (ncerts >= 0)
+        {
+          ksba_cert_t cert;
+
+          for (idx=0; (cert = ksba_cms_get_cert (cms, idx)); idx++)
+            ksba_cert_release (cert);
+          if (idx != ncerts)
+            fail ("wrong number of certificates");
+        }
+      check_lazy_certs (fname, cms);
+      if (ncerts > 1)
+        check_broken_lazy_cert (fname, cms, ncerts);
     }
 
   ksba_cms_release (cms);
+  ksba_writer_release (w);
   ksba_reader_release (r);
   fclose (fp);
+  if (signers)
+    check_signers (fname, signers);
 }
 
 
@@ -230,10 +562,19 @@ one_file (const char *fname)
 int
 main (int argc, char **argv)
 {
+  char *fname;
+
   if (argc > 1)
-    one_file (argv[1]);
+    one_file (argv[1], -1, -1);
   else
-    one_file ("x.ber");
+    {
+      fname = prepend_srcdir ("samples/ov-two-signers.p7m");
+      one_file (fname, 2, 3);
+      xfree (fname);
+      fname = prepend_srcdir ("samples/ov-keyid-signer.p7m");
+      one_file (fname, 1, 1);
+      xfree (fname);
+    }
   /*one_file ("pkcs7-1.ber");*/
   /*one_file ("root-cert-2.der");  should fail */
 
@@ -88,6 +88,453 @@ print_names (int indent, ksba_name_t name)
 
 
 
+/* The entries of a CRL as returned by ksba_crl_get_item.  */
+struct item_s
+{
+  ksba_sexp_t serial;
+  ksba_isotime_t rdate;
+  ksba_crl_reason_t reason;
+};
+
+
+/* Parse FNAME again, this time building an index, and check that
+   the NITEMS ITEMS are found in the index and in a copy of it.  */
+struct membuf_s
+{
+  unsigned char *buf;
+  size_t len;
+};
+
+
+/* Return the length of the canonical S-expression SEXP.  */
+static size_t
+sexp_length (ksba_const_sexp_t sexp)
+{
+  const unsigned char *p = sexp;
+  int depth = 0;
+  char *endp;
+
+  do
+    {
+      if (*p == '(')
+        {
+          depth++;
+          p++;
+        }
+      else if (*p == ')')
+        {
+          depth--;
+          p++;
+        }
+      else
+        {
+          unsigned long n = strtoul ((const char*)p, &endp, 10);
+
+          if (endp == (const char*)p || *endp != ':')
+            fail ("invalid S-expression");
+          p = (const unsigned char*)endp + 1 + n;
+        }
+    }
+  while (depth > 0);
+  return p - sexp;
+}
+
+
+static int
+sexp_equal (ksba_const_sexp_t a, ksba_const_sexp_t b)
+{
+  size_t n = sexp_length (a);
+
+  return n == sexp_length (b) && !memcmp (a, b, n);
+}
+
+
+/* Hash function used by check_index to collect the signed data.  */
+static void
+collect_hasher (void *arg, const void *buffer, size_t length)
+{
+  struct membuf_s *mb = arg;
+
+  mb->buf = realloc (mb->buf, mb->len + length);
+  if (!mb->buf)
+    fail ("out of core");
+  memcpy (mb->buf + mb->len, buffer, length);
+  mb->len += length;
+}
+
+
+/* Compare the CRL info stored in INDEX with the values from CRL and
+   check that the tbs span of FNAME matches the hashed data MB.  */
+static void
+check_index_info (const char *fname, ksba_crl_index_t index,
+                  ksba_crl_t crl, struct membuf_s *mb)
+{
+  gpg_error_t err;
+  char *a, *b;
+  ksba_sexp_t sa, sb;
+  ksba_isotime_t this1, next1, this2, next2;
+  unsigned long tbs_off, tbs_len;
+  unsigned char *buf;
+  FILE *fp;
+
+  err = ksba_crl_get_issuer (crl, &a);
+  fail_if_err (err);
+  err = ksba_crl_index_get_issuer (index, &b);
+  fail_if_err (err);
+  if (strcmp (a, b))
+    fail ("index issuer does not match");
+  ksba_free (a);
+  ksba_free (b);
+
+  err = ksba_crl_get_update_times (crl, this1, next1);
+  fail_if_err (err);
+  err = ksba_crl_index_get_update_times (index, this2, next2);
+  fail_if_err (err);
+  if (strcmp (this1, this2) || strcmp (next1, next2))
+    fail ("index update times do not match");
+
+  err = ksba_crl_get_crl_number (crl, &sa);
+  if (gpg_err_code (err) == GPG_ERR_NO_DATA)
+    sa = NULL;
+  else
+    fail_if_err (err);
+  err = ksba_crl_index_get_crl_number (index, &sb);
+  if (sa)
+    {
+      fail_if_err (err);
+      if (!sexp_equal (sa, sb))
+        fail ("index CRL number does not match");
+    }
+  else if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+    fail ("index CRL number unexpectedly present");
+  ksba_free (sa);
+  ksba_free (sb);
+
+  a = (char*)ksba_crl_get_digest_algo (crl);
+  b = (char*)ksba_crl_index_get_digest_algo (index);
+  if (!a || !b || strcmp (a, b))
+    fail ("index digest algorithm does not match");
+
+  sa = ksba_crl_get_sig_val (crl);
+  if (!sa)
+    fail ("no signature value");
+  err = ksba_crl_index_get_sig_val (index, &tbs_off, &tbs_len, &sb);
+  fail_if_err (err);
+  if (!sexp_equal (sa, sb))
+    fail ("index signature value does not match");
+  ksba_free (sa);
+  ksba_free (sb);
+
+  /* The tbs span must cover exactly the hashed bytes.  */
+  if (tbs_len != mb->len)
+    fail ("index tbs length does not match");
+  buf = xmalloc (tbs_len);
+  fp = fopen (fname, "rb");
+  if (!fp)
+    fail ("can't open file");
+  if (fseek (fp, tbs_off, SEEK_SET)
+      || fread (buf, tbs_len, 1, fp) != 1)
+    fail ("can't read the tbs span");
+  fclose (fp);
+  if (memcmp (buf, mb->buf, tbs_len))
+    fail ("index tbs span does not match the hashed data");
+  xfree (buf);
+}
+
+
+static void
+check_index (const char *fname, struct item_s *items, int nitems)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_crl_index_t index, index2;
+  ksba_writer_t w;
+  struct membuf_s mb = { NULL, 0 };
+  ksba_stop_reason_t stopreason;
+  const unsigned char *image;
+  size_t imagelen;
+  ksba_isotime_t rdate;
+  ksba_crl_reason_t reason;
+  int i;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    fail ("can't open file");
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, r);
+  fail_if_err (err);
+  err = ksba_crl_start_index (crl);
+  fail_if_err (err);
+  ksba_crl_set_hash_function (crl, collect_hasher, &mb);
+
+  do
+    {
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err2 (fname, err);
+      if (stopreason == KSBA_SR_GOT_ITEM)
+        fail ("unexpected stop reason");
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  err = ksba_crl_get_index (crl, &index);
+  fail_if_err (err);
+  check_index_info (fname, index, crl, &mb);
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+  free (mb.buf);
+
+  /* Check that the image survives a round trip through a file.  */
+  image = ksba_crl_index_get_image (index, &imagelen);
+  if (!image)
+    fail ("no index image");
+  err = ksba_crl_index_new_from_mem (&index2, image, imagelen);
+  fail_if_err (err);
+  ksba_crl_index_release (index2);
+  fp = tmpfile ();
+  if (!fp)
+    fail ("can't create temporary file");
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_file (w, fp);
+  fail_if_err (err);
+  err = ksba_crl_index_write (index, w);
+  fail_if_err (err);
+  ksba_writer_release (w);
+  if (fflush (fp))
+    fail ("error writing the index file");
+  err = ksba_crl_index_new_from_fd (&index2, fileno (fp));
+  fail_if_err (err);
+  fclose (fp);
+  ksba_crl_index_release (index);
+
+  if (ksba_crl_index_get_count (index2) != nitems)
+    fail ("wrong number of entries in the index");
+  for (i=0; i < nitems; i++)
+    {
+      err = ksba_crl_index_lookup (index2, items[i].serial,
+                                   rdate, &reason, NULL);
+      fail_if_err (err);
+      if (strcmp (rdate, items[i].rdate) || reason != items[i].reason)
+        fail ("index entry does not match");
+    }
+  err = ksba_crl_index_lookup
+    (index2, (const unsigned char*)"(21:\x01\x02\x03\x04\x05\x06\x07\x08"
+     "\x09\x0a\x0b\x0c\x0d\x0e\x0f\x10\x11\x12\x13\x14\x15)",
+     NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("lookup of a non-listed serial did not fail");
+  ksba_crl_index_release (index2);
+}
+
+
+/* Parse FNAME and pass the signed data to the hash function or, if
+   BUFSIZE is not -1, to a hasher with two hash functions and a buffer
+   of BUFSIZE.  The collected data is stored at MB and MB2.  */
+static void
+hash_crl_file (const char *fname, int bufsize,
+               struct membuf_s *mb, struct membuf_s *mb2)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_hasher_t hasher = NULL;
+  ksba_stop_reason_t stopreason;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    fail ("can't open file");
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, r);
+  fail_if_err (err);
+  if (bufsize == -1)
+    ksba_crl_set_hash_function (crl, collect_hasher, mb);
+  else
+    {
+      err = ksba_hasher_new (&hasher);
+      fail_if_err (err);
+      err = ksba_hasher_set_buffer_size (hasher, bufsize);
+      fail_if_err (err);
+      err = ksba_hasher_add (hasher, collect_hasher, mb);
+      fail_if_err (err);
+      err = ksba_hasher_add (hasher, collect_hasher, mb2);
+      fail_if_err (err);
+      err = ksba_crl_set_hasher (crl, hasher);
+      fail_if_err (err);
+    }
+
+  do
+    {
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err2 (fname, err);
+    }
+  while (stopreason != KSBA_SR_READY);
+
+  ksba_crl_release (crl);
+  ksba_hasher_release (hasher);
+  ksba_reader_release (r);
+  fclose (fp);
+}
+
+
+/* Check that a hasher passes the same data to all its hash functions
+   as a plain hash function gets.  */
+static void
+check_hasher (const char *fname)
+{
+  static const int bufsizes[] = { 0, 1, 100, 4096 };
+  struct membuf_s mb = { NULL, 0 };
+  struct membuf_s mb1, mb2;
+  int i;
+
+  hash_crl_file (fname, -1, &mb, NULL);
+  for (i=0; i < sizeof bufsizes / sizeof *bufsizes; i++)
+    {
+      mb1.buf = mb2.buf = NULL;
+      mb1.len = mb2.len = 0;
+      hash_crl_file (fname, bufsizes[i], &mb1, &mb2);
+      if (mb1.len != mb.len || memcmp (mb1.buf, mb.buf, mb.len)
+          || mb2.len != mb.len || memcmp (mb2.buf, mb.buf, mb.len))
+        fail ("data passed to the hasher does not match");
+      free (mb1.buf);
+      free (mb2.buf);
+    }
+  free (mb.buf);
+}
+
+
+/* Parse the CRL FNAME and return its index.  */
+static ksba_crl_index_t
+index_from_file (const char *fname)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_reader_t r;
+  ksba_crl_t crl;
+  ksba_crl_index_t index;
+  ksba_stop_reason_t stopreason;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    fail ("can't open file");
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_file (r, fp);
+  fail_if_err (err);
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, r);
+  fail_if_err (err);
+  err = ksba_crl_start_index (crl);
+  fail_if_err (err);
+  do
+    {
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err2 (fname, err);
+    }
+  while (stopreason != KSBA_SR_READY);
+  err = ksba_crl_get_index (crl, &index);
+  fail_if_err (err);
+  ksba_crl_release (crl);
+  ksba_reader_release (r);
+  fclose (fp);
+  return index;
+}
+
+
+/* Merge a delta CRL into its base CRL.  The base CRL lists the
+   serial numbers 1, 2 and 3 (on hold); the delta CRL removes 3 and
+   adds 4.  */
+static void
+check_delta (void)
+{
+  gpg_error_t err;
+  char *fname;
+  ksba_crl_index_t base, delta, merged, tmp;
+  ksba_sexp_t number;
+  ksba_isotime_t rdate;
+  ksba_crl_reason_t reason;
+
+  fname = prepend_srcdir ("crl_delta_base.der");
+  base = index_from_file (fname);
+  xfree (fname);
+  fname = prepend_srcdir ("crl_delta_delta.der");
+  delta = index_from_file (fname);
+  xfree (fname);
+
+  err = ksba_crl_index_get_delta_indicator (base, &number);
+  if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+    fail ("base CRL has a delta indicator");
+  err = ksba_crl_index_get_delta_indicator (delta, &number);
+  fail_if_err (err);
+  if (!sexp_equal (number, (const unsigned char*)"(1:\x01)"))
+    fail ("wrong delta indicator");
+  ksba_free (number);
+
+  err = ksba_crl_index_apply_delta (base, delta, &merged);
+  fail_if_err (err);
+
+  if (ksba_crl_index_get_count (merged) != 3)
+    fail ("wrong number of entries after merging");
+  err = ksba_crl_index_lookup (merged, (const unsigned char*)"(1:\x01)",
+                               rdate, &reason, NULL);
+  fail_if_err (err);
+  if (strcmp (rdate, "20260101T000000")
+      || reason != KSBA_CRLREASON_KEY_COMPROMISE)
+    fail ("base entry not kept");
+  err = ksba_crl_index_lookup (merged, (const unsigned char*)"(1:\x02)",
+                               NULL, NULL, NULL);
+  fail_if_err (err);
+  err = ksba_crl_index_lookup (merged, (const unsigned char*)"(1:\x03)",
+                               NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("removed entry still listed");
+  err = ksba_crl_index_lookup (merged, (const unsigned char*)"(1:\x04)",
+                               rdate, &reason, NULL);
+  fail_if_err (err);
+  if (strcmp (rdate, "20260110T000000")
+      || reason != KSBA_CRLREASON_KEY_COMPROMISE)
+    fail ("delta entry not added");
+
+  err = ksba_crl_index_get_crl_number (merged, &number);
+  fail_if_err (err);
+  if (!sexp_equal (number, (const unsigned char*)"(1:\x02)"))
+    fail ("wrong CRL number after merging");
+  ksba_free (number);
+  err = ksba_crl_index_get_sig_val (merged, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+    fail ("merged index has a signature");
+
+  /* The delta may not be applied twice nor to itself.  */
+  err = ksba_crl_index_apply_delta (merged, delta, &tmp);
+  if (gpg_err_code (err) != GPG_ERR_CRL_TOO_OLD)
+    fail ("delta CRL applied twice");
+  err = ksba_crl_index_apply_delta (delta, delta, &tmp);
+  if (gpg_err_code (err) != GPG_ERR_CONFLICT)
+    fail ("delta CRL used as base");
+  err = ksba_crl_index_apply_delta (base, base, &tmp);
+  if (gpg_err_code (err) != GPG_ERR_CONFLICT)
+    fail ("base CRL used as delta");
+
+  ksba_crl_index_release (merged);
+  ksba_crl_index_release (delta);
+  ksba_crl_index_release (base);
+}
+
+
 static void
 one_file (const char *fname)
 {
@@ -98,6 +545,7 @@ one_file (const char *fname)
   ksba_stop_reason_t stopreason;
   int count = 0;
   FILE *hashlog = NULL;
+  struct item_s *items = NULL;
 
 #ifdef ENABLE_HASH_LOGGING
     {
@@ -183,7 +631,12 @@ one_file (const char *fname)
             printf (", t=");
             print_time (rdate);
             printf (", r=%x\n", reason);
-            xfree (serial);
+            items = realloc (items, count * sizeof *items);
+            if (!items)
+              fail ("out of core");
+            items[count-1].serial = serial;
+            strcpy (items[count-1].rdate, rdate);
+            items[count-1].reason = reason;
           }
           break;
 
@@ -297,6 +750,12 @@ one_file (const char *fname)
   fclose (fp);
   if (hashlog)
     fclose (hashlog);
+
+  check_index (fname, items, count);
+  check_hasher (fname);
+  while (count)
+    xfree (items[--count].serial);
+  free (items);
 }
 
 
@@ -319,6 +778,8 @@ main (int argc, char **argv)
     {
       const char *files[] = {
         "crl_testpki_testpca.der",
+        "crl_delta_base.der",
+        "crl_delta_delta.der",
         NULL
       };
       int idx;
@@ -334,6 +795,7 @@ main (int argc, char **argv)
           one_file (fname);
           xfree (fname);
         }
+      check_delta ();
     }
 
   return 0;
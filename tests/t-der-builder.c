@@ -0,0 +1,229 @@
+/* t-der-builder.c - Regression tests for the DER builder
+ *      Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "../src/ksba.h"
+#define _KSBA_VISIBILITY_DEFAULT /*  */
+#include "../src/asn1-func.h"
+#include "../src/der-builder.h"
+
+#include "t-common.h"
+
+/* Under Windows the functions of the DER builder are not exported.  */
+#ifndef __WIN32
+
+
+/* The expected encoding.  Each header is followed by VALUELEN bytes
+   of the pattern; a VALUELEN of -1 marks a constructed element.  */
+static struct {
+  unsigned char hdr[6];
+  int hdrlen;
+  long valuelen;
+} expected[] = {
+  { { 0x30, 0x83, 0x02, 0x03, 0xa3 }, 5, -1 },    /* SEQUENCE */
+  { { 0x04, 0x7f },                   2, 0x7f },
+  { { 0x04, 0x81, 0x80 },             3, 0x80 },
+  { { 0xa0, 0x82, 0x01, 0x02 },       4, -1 },    /* [0] */
+  { { 0x04, 0x81, 0xff },             3, 0xff },
+  { { 0x31, 0x83, 0x01, 0x01, 0x0a }, 5, -1 },    /* SET */
+  { { 0x04, 0x82, 0x01, 0x00 },       4, 0x100 },
+  { { 0x81, 0x82, 0xff, 0xff },       4, 0xffff },
+  { { 0x02, 0x01 },                   2, 1 },
+  { { 0x04, 0x83, 0x01, 0x00, 0x00 }, 5, 0x10000 },
+  { { 0xa2, 0x81, 0x80 },             3, -1 },    /* [2] */
+  { { 0x04, 0x7e },                   2, 0x7e },
+  { { 0x05, 0x00 },                   2, 0 }      /* NULL */
+};
+
+
+/* Build the object described by EXPECTED using the values from
+   PATTERN.  */
+static DerBuilder
+build_object (const unsigned char *pattern)
+{
+  DerBuilder d;
+
+  d = _ksba_der_builder_new (0);
+  if (!d)
+    fail ("can't create a DER builder");
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, pattern, 0x7f);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, pattern, 0x80);
+  _ksba_der_add_tag (d, CLASS_CONTEXT, 0);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, pattern, 0xff);
+  _ksba_der_add_end (d);
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SET);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, pattern, 0x100);
+  _ksba_der_add_ptr (d, CLASS_CONTEXT, 1, pattern, 0xffff);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_INTEGER, pattern, 1);
+  _ksba_der_add_end (d);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING,
+                     pattern, 0x10000);
+  /* The content of this one has a length of 0x80.  */
+  _ksba_der_add_tag (d, CLASS_CONTEXT, 2);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, pattern, 0x7e);
+  _ksba_der_add_end (d);
+  _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_NULL, NULL, 0);
+  _ksba_der_add_end (d);
+  return d;
+}
+
+
+static void
+check_result (const unsigned char *der, size_t derlen,
+              const unsigned char *pattern)
+{
+  size_t off = 0;
+  int i;
+
+  for (i=0; i < sizeof expected / sizeof *expected; i++)
+    {
+      if (off + expected[i].hdrlen > derlen
+          || memcmp (der + off, expected[i].hdr, expected[i].hdrlen))
+        {
+          fprintf (stderr, "mismatch in header of element %d\n", i);
+          fail ("wrong encoding");
+        }
+      off += expected[i].hdrlen;
+      if (expected[i].valuelen < 0)
+        continue;
+      if (off + expected[i].valuelen > derlen
+          || memcmp (der + off, pattern, expected[i].valuelen))
+        {
+          fprintf (stderr, "mismatch in value of element %d\n", i);
+          fail ("wrong encoding");
+        }
+      off += expected[i].valuelen;
+    }
+  if (off != derlen)
+    fail ("wrong length of the encoding");
+}
+
+
+static void
+test_lengths (void)
+{
+  gpg_error_t err;
+  DerBuilder d;
+  ksba_writer_t w;
+  unsigned char *pattern, *der;
+  const unsigned char *p;
+  size_t derlen, i;
+
+  pattern = xmalloc (0x10000);
+  for (i=0; i < 0x10000; i++)
+    pattern[i] = i * 7;
+
+  d = build_object (pattern);
+  err = _ksba_der_builder_get (d, &der, &derlen);
+  fail_if_err (err);
+  check_result (der, derlen, pattern);
+  xfree (der);
+
+  /* The same builder may be written again.  */
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_mem (w, 1024);
+  fail_if_err (err);
+  err = _ksba_der_builder_write (d, w);
+  fail_if_err (err);
+  p = ksba_writer_get_mem (w, &derlen);
+  if (!p)
+    fail ("no data written");
+  check_result (p, derlen, pattern);
+  ksba_writer_release (w);
+  _ksba_der_builder_release (d);
+
+  xfree (pattern);
+}
+
+
+static void
+test_errors (void)
+{
+  gpg_error_t err;
+  DerBuilder d;
+  unsigned char *der;
+  size_t derlen;
+
+  /* A missing end.  */
+  d = _ksba_der_builder_new (0);
+  if (!d)
+    fail ("can't create a DER builder");
+  _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+  err = _ksba_der_builder_get (d, &der, &derlen);
+  if (gpg_err_code (err) != GPG_ERR_INV_STATE)
+    fail ("missing end not detected");
+  _ksba_der_builder_release (d);
+
+  /* A length which does not fit into 4 bytes.  The value is never
+     accessed because the lengths are checked first.  */
+  if (sizeof (size_t) > 4)
+    {
+      d = _ksba_der_builder_new (0);
+      if (!d)
+        fail ("can't create a DER builder");
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, "",
+                         (size_t)0xffffffff + 1);
+      _ksba_der_add_end (d);
+      err = _ksba_der_builder_get (d, &der, &derlen);
+      if (gpg_err_code (err) != GPG_ERR_TOO_LARGE)
+        fail ("too large length not detected");
+      _ksba_der_builder_release (d);
+
+      /* The same for the length of a constructed element.  */
+      d = _ksba_der_builder_new (0);
+      if (!d)
+        fail ("can't create a DER builder");
+      _ksba_der_add_tag (d, CLASS_UNIVERSAL, TYPE_SEQUENCE);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, "",
+                         0xfffffff0);
+      _ksba_der_add_ptr (d, CLASS_UNIVERSAL, TYPE_OCTET_STRING, "", 0x10);
+      _ksba_der_add_end (d);
+      err = _ksba_der_builder_get (d, &der, &derlen);
+      if (gpg_err_code (err) != GPG_ERR_TOO_LARGE)
+        fail ("too large constructed length not detected");
+      _ksba_der_builder_release (d);
+    }
+}
+
+
+#endif /*!__WIN32*/
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+#ifdef __WIN32
+  return 77;  /* Skip.  */
+#else
+  test_lengths ();
+  test_errors ();
+  return 0;
+#endif
+}
@@ -17,6 +17,7 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +26,9 @@
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
 
 #include "../src/ksba.h"
 
@@ -119,6 +123,8 @@ get_one_cert (const char *fname)
 
   err = ksba_cert_read_der (cert, r);
   fail_if_err2 (fname, err);
+  ksba_reader_release (r);
+  fclose (fp);
   return cert;
 }
 
@@ -344,6 +350,17 @@ my_hash_buffer (void *arg, const char *oid,
 {
   (void)arg; /* Not used.  */
 
+  if (oid && !strcmp (oid, "2.16.840.1.101.3.4.2.1"))
+    {
+      /* We have no SHA-256 here.  For testing the CertID matching a
+         32 byte value derived from SHA-1 is sufficient.  */
+      if (resultsize < 32)
+        return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+      sha1_hash_buffer (result, buffer, length);
+      sha1_hash_buffer (result + 12, result, 20);
+      *resultlen = 32;
+      return 0;
+    }
   if (oid && strcmp (oid, "1.3.14.3.2.26"))
     return gpg_error (GPG_ERR_NOT_SUPPORTED); /* We only support SHA-1. */
   if (resultsize < 20)
@@ -356,6 +373,605 @@ my_hash_buffer (void *arg, const char *oid,
 
 
 
+/* A dummy signing function for the responder.  */
+static gpg_error_t
+dummy_signer (void *arg, const unsigned char *tbs, size_t tbslen,
+              unsigned char *sigbuf, size_t *r_siglen)
+{
+  (void)arg;
+
+  if (!tbslen || *tbs != 0x30)
+    fail ("bad tbsResponseData passed to signer");
+  if (*r_siglen < 128)
+    return gpg_error (GPG_ERR_BUFFER_TOO_SHORT);
+  memset (sigbuf, 0x42, 128);
+  *r_siglen = 128;
+  return 0;
+}
+
+
+/* Return true if the serial number SERIAL of length SERIALLEN
+   matches the serial number of CERT.  */
+static int
+serial_matches (ksba_cert_t cert, const unsigned char *serial,
+                size_t seriallen)
+{
+  ksba_sexp_t sexp = ksba_cert_get_serial (cert);
+  const char *s;
+  unsigned long n;
+  int result;
+
+  if (!sexp)
+    fail ("error getting serial number");
+  s = (const char *)sexp + 1;
+  n = strtoul (s, (char **)&s, 10);
+  result = (*s == ':' && n == seriallen && !memcmp (s+1, serial, n));
+  ksba_free (sexp);
+  return result;
+}
+
+
+/* Create a request for two certificates, answer it using the
+   responder API and check the response using the client API.  */
+static void
+check_responder (void)
+{
+  gpg_error_t err;
+  char *f;
+  ksba_cert_t certs[2], issuer_cert, responder_cert;
+  ksba_ocsp_t ocsp;
+  ksba_ocsp_responder_t resp;
+  ksba_ocsp_response_status_t response_status;
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update, next_update, revocation_time;
+  unsigned char *request;
+  size_t requestlen;
+  const unsigned char *response, *nonce, *serial;
+  size_t responselen, noncelen, seriallen;
+  const char *hash_algo;
+  int i, issuer, idx;
+  int item_of[2] = { -1, -1 };
+  char *name;
+  ksba_sexp_t keyid;
+  ksba_cert_t acert;
+
+  f = prepend_srcdir ("samples/ov-user.crt");
+  certs[0] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-userrev.crt");
+  certs[1] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-root-ca-cert.crt");
+  issuer_cert = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-ocsp-server.crt");
+  responder_cert = get_one_cert (f);
+  xfree (f);
+
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  for (i=0; i < 2; i++)
+    {
+      err = ksba_ocsp_add_target (ocsp, certs[i], issuer_cert);
+      fail_if_err (err);
+    }
+  ksba_ocsp_set_nonce (ocsp, "ABCDEFGHIJKLMNOP", 16);
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  fail_if_err (err);
+
+  err = ksba_ocsp_responder_new (&resp);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_responder_id (resp, responder_cert, 1);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_add_cert (resp, responder_cert);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_add_issuer (resp, issuer_cert);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_signer (resp, "1.2.840.113549.1.1.5", 256,
+                                        dummy_signer, NULL);
+  fail_if_err (err);
+
+  err = ksba_ocsp_responder_parse_request (resp, request, requestlen);
+  fail_if_err (err);
+  xfree (request);
+  if (ksba_ocsp_responder_get_count (resp) != 2)
+    fail ("wrong number of requests");
+  /* The order of the requests is not defined; thus we map them to
+     our certificates.  */
+  for (i=0; i < 2; i++)
+    {
+      err = ksba_ocsp_responder_get_request (resp, i, &hash_algo,
+                                             NULL, NULL, NULL, NULL,
+                                             &serial, &seriallen, &issuer);
+      fail_if_err (err);
+      if (strcmp (hash_algo, "1.3.14.3.2.26"))
+        fail ("wrong hash algorithm in request");
+      if (issuer)
+        fail ("issuer not matched");
+      if (serial_matches (certs[0], serial, seriallen))
+        item_of[0] = i;
+      else if (serial_matches (certs[1], serial, seriallen))
+        item_of[1] = i;
+      else
+        fail ("wrong serial number in request");
+    }
+  if (item_of[0] == -1 || item_of[1] == -1)
+    fail ("request missing");
+  err = ksba_ocsp_responder_get_request (resp, 2, NULL, NULL, NULL, NULL,
+                                         NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_EOF)
+    fail ("expected EOF after the last request");
+  err = ksba_ocsp_responder_get_nonce (resp, &nonce, &noncelen);
+  fail_if_err (err);
+  if (noncelen != 16 || memcmp (nonce, "ABCDEFGHIJKLMNOP", 16))
+    fail ("wrong nonce");
+
+  err = ksba_ocsp_responder_set_status (resp, item_of[0],
+                                        KSBA_STATUS_GOOD,
+                                        "20260101T000000", "20260108T000000",
+                                        NULL, 0);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_status (resp, item_of[1],
+                                        KSBA_STATUS_REVOKED,
+                                        "20260101T000000", NULL,
+                                        "20251224T120000",
+                                        KSBA_CRLREASON_KEY_COMPROMISE);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_build_response (resp, "20260101T120000",
+                                            &response, &responselen);
+  fail_if_err (err);
+
+  err = ksba_ocsp_parse_response (ocsp, response, responselen,
+                                  &response_status);
+  fail_if_err (err);
+  if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+    fail ("response not successful");
+  err = ksba_ocsp_get_responder_id (ocsp, &name, &keyid);
+  fail_if_err (err);
+  if (name || !keyid)
+    fail ("wrong responder id");
+  ksba_free (keyid);
+  acert = ksba_ocsp_get_cert (ocsp, 0);
+  if (!acert)
+    fail ("responder certificate missing");
+  ksba_cert_release (acert);
+
+  err = ksba_ocsp_get_status (ocsp, certs[0], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_GOOD
+      || strcmp (this_update, "20260101T000000")
+      || strcmp (next_update, "20260108T000000"))
+    fail ("wrong status for the good certificate");
+  err = ksba_ocsp_get_status (ocsp, certs[1], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_REVOKED
+      || strcmp (revocation_time, "20251224T120000")
+      || reason != KSBA_CRLREASON_KEY_COMPROMISE
+      || *next_update)
+    fail ("wrong status for the revoked certificate");
+  ksba_ocsp_release (ocsp);
+
+  /* Reuse the responder for a response without a request.  */
+  ksba_ocsp_responder_reset (resp);
+  err = ksba_ocsp_responder_add_target (resp, certs[1], issuer_cert, &idx);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_get_request (resp, idx, NULL, NULL, NULL, NULL,
+                                         NULL, &serial, &seriallen, &issuer);
+  fail_if_err (err);
+  if (idx || issuer || !serial_matches (certs[1], serial, seriallen))
+    fail ("wrong target added");
+  err = ksba_ocsp_responder_get_nonce (resp, &nonce, &noncelen);
+  if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+    fail ("unexpected nonce");
+  err = ksba_ocsp_responder_build_response (resp, NULL,
+                                            &response, &responselen);
+  fail_if_err (err);
+
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  err = ksba_ocsp_add_target (ocsp, certs[1], issuer_cert);
+  fail_if_err (err);
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  fail_if_err (err);
+  xfree (request);
+  err = ksba_ocsp_parse_response (ocsp, response, responselen,
+                                  &response_status);
+  fail_if_err (err);
+  if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+    fail ("response not successful");
+  err = ksba_ocsp_get_status (ocsp, certs[1], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_UNKNOWN)
+    fail ("wrong status for a target without status");
+  ksba_ocsp_release (ocsp);
+
+  err = ksba_ocsp_responder_build_error (resp, KSBA_OCSP_RSPSTATUS_TRYLATER,
+                                         &response, &responselen);
+  fail_if_err (err);
+  if (responselen != 5 || memcmp (response, "\x30\x03\x0a\x01\x03", 5))
+    fail ("wrong error response");
+
+  ksba_ocsp_responder_release (resp);
+  ksba_cert_release (responder_cert);
+  ksba_cert_release (issuer_cert);
+  ksba_cert_release (certs[0]);
+  ksba_cert_release (certs[1]);
+}
+
+
+/* Let RESP answer REQUEST: CERTS[0] is good until NEXT_UPDATE and
+   CERTS[1] is revoked without a nextUpdate.  */
+static void
+answer_request (ksba_ocsp_responder_t resp, ksba_cert_t *certs,
+                unsigned char *request, size_t requestlen,
+                const char *next_update,
+                const unsigned char **r_response, size_t *r_responselen)
+{
+  gpg_error_t err;
+  const unsigned char *serial;
+  size_t seriallen;
+  int i;
+
+  err = ksba_ocsp_responder_parse_request (resp, request, requestlen);
+  fail_if_err (err);
+  for (i=0; i < ksba_ocsp_responder_get_count (resp); i++)
+    {
+      err = ksba_ocsp_responder_get_request (resp, i, NULL, NULL, NULL,
+                                             NULL, NULL, &serial, &seriallen,
+                                             NULL);
+      fail_if_err (err);
+      if (serial_matches (certs[0], serial, seriallen))
+        err = ksba_ocsp_responder_set_status (resp, i, KSBA_STATUS_GOOD,
+                                              "20260101T000000", next_update,
+                                              NULL, 0);
+      else
+        err = ksba_ocsp_responder_set_status (resp, i, KSBA_STATUS_REVOKED,
+                                              "20260101T000000", NULL,
+                                              "20251224T120000",
+                                              KSBA_CRLREASON_SUPERSEDED);
+      fail_if_err (err);
+    }
+  err = ksba_ocsp_responder_build_response (resp, "20260101T120000",
+                                            r_response, r_responselen);
+  fail_if_err (err);
+}
+
+
+/* Check that the status cache answers requests.  */
+static void
+check_cache (void)
+{
+  gpg_error_t err;
+  char *f;
+  ksba_cert_t certs[2], issuer_cert;
+  ksba_ocsp_cache_t cache;
+  ksba_ocsp_t ocsp;
+  ksba_ocsp_responder_t resp;
+  ksba_ocsp_response_status_t response_status;
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update, next_update, revocation_time;
+  unsigned char *request, *cached;
+  size_t requestlen, cachedlen;
+  const unsigned char *response;
+  size_t responselen;
+  int i;
+
+  f = prepend_srcdir ("samples/ov-user.crt");
+  certs[0] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-userrev.crt");
+  certs[1] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-root-ca-cert.crt");
+  issuer_cert = get_one_cert (f);
+  xfree (f);
+
+  err = ksba_ocsp_cache_new (&cache, 0);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_new (&resp);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_responder_id (resp, issuer_cert, 0);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_signer (resp, "1.2.840.113549.1.1.5", 256,
+                                        dummy_signer, NULL);
+  fail_if_err (err);
+
+  /* Fill the cache.  Only the good certificate has a nextUpdate and
+     is thus cached.  */
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  err = ksba_ocsp_set_cache (ocsp, cache);
+  fail_if_err (err);
+  for (i=0; i < 2; i++)
+    {
+      err = ksba_ocsp_add_target (ocsp, certs[i], issuer_cert);
+      fail_if_err (err);
+    }
+  ksba_ocsp_set_nonce (ocsp, "ABCDEFGHIJKLMNOP", 16);
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  fail_if_err (err);
+  answer_request (resp, certs, request, requestlen, "20990101T000000",
+                  &response, &responselen);
+  xfree (request);
+  if (ksba_ocsp_responder_get_count (resp) != 2)
+    fail ("wrong number of requests");
+  err = ksba_ocsp_parse_response (ocsp, response, responselen,
+                                  &response_status);
+  fail_if_err (err);
+  if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+    fail ("response not successful");
+  err = ksba_ocsp_update_cache (ocsp);
+  fail_if_err (err);
+  ksba_ocsp_release (ocsp);
+
+  err = ksba_ocsp_cache_lookup (cache, certs[0], issuer_cert,
+                                "20260201T000000", &status,
+                                this_update, next_update, revocation_time,
+                                &reason, &cached, &cachedlen);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_GOOD || strcmp (next_update, "20990101T000000"))
+    fail ("wrong status in cache");
+  if (cachedlen != responselen || memcmp (cached, response, responselen))
+    fail ("wrong response in cache");
+  xfree (cached);
+  err = ksba_ocsp_cache_lookup (cache, certs[0], issuer_cert,
+                                "20990101T000000", &status,
+                                NULL, NULL, NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("expired status returned from cache");
+  err = ksba_ocsp_cache_lookup (cache, certs[1], issuer_cert, NULL, &status,
+                                NULL, NULL, NULL, NULL, NULL, NULL);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    fail ("status without nextUpdate cached");
+
+  /* Only the revoked certificate must now be requested.  */
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  err = ksba_ocsp_set_cache (ocsp, cache);
+  fail_if_err (err);
+  for (i=0; i < 2; i++)
+    {
+      err = ksba_ocsp_add_target (ocsp, certs[i], issuer_cert);
+      fail_if_err (err);
+    }
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  fail_if_err (err);
+  answer_request (resp, certs, request, requestlen, "20990101T000000",
+                  &response, &responselen);
+  xfree (request);
+  if (ksba_ocsp_responder_get_count (resp) != 1)
+    fail ("cached target was requested");
+  err = ksba_ocsp_parse_response (ocsp, response, responselen,
+                                  &response_status);
+  fail_if_err (err);
+  if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+    fail ("response not successful");
+  err = ksba_ocsp_get_status (ocsp, certs[0], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_GOOD)
+    fail ("wrong status for the cached certificate");
+  err = ksba_ocsp_get_status (ocsp, certs[1], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_REVOKED || reason != KSBA_CRLREASON_SUPERSEDED)
+    fail ("wrong status for the revoked certificate");
+  ksba_ocsp_release (ocsp);
+
+  /* No request is needed if all targets are cached.  */
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  err = ksba_ocsp_set_cache (ocsp, cache);
+  fail_if_err (err);
+  err = ksba_ocsp_add_target (ocsp, certs[0], issuer_cert);
+  fail_if_err (err);
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+    fail ("request built for a cached target");
+  err = ksba_ocsp_get_status (ocsp, certs[0], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_GOOD)
+    fail ("wrong status for the cached certificate");
+  ksba_ocsp_release (ocsp);
+
+  ksba_ocsp_responder_release (resp);
+  ksba_ocsp_cache_release (cache);
+  ksba_cert_release (issuer_cert);
+  ksba_cert_release (certs[0]);
+  ksba_cert_release (certs[1]);
+}
+
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYNC_BUILTINS)
+/* The number of threads and rounds used by check_cache_threads.  */
+#define CACHE_INSERTERS  4
+#define CACHE_LOOKUPS    2
+#define CACHE_ROUNDS   150
+#define CACHE_UPDATES   20
+
+/* The certificates used by check_cache_threads.  Each of them is also
+   used as issuer of the others; this gives many different CertIDs.  */
+static ksba_cert_t thread_certs[10];
+static int thread_ncerts;
+static ksba_ocsp_cache_t thread_cache;
+static int inserters_left;
+
+
+/* Return the target with number N; there are THREAD_NCERTS squared
+   targets.  */
+static void
+thread_target (unsigned int n, ksba_cert_t *r_cert, ksba_cert_t *r_issuer)
+{
+  n %= thread_ncerts * thread_ncerts;
+  *r_cert = thread_certs[n / thread_ncerts];
+  *r_issuer = thread_certs[n % thread_ncerts];
+}
+
+
+/* Thread to request the status of three targets per round and to
+   store the answers in the cache.  */
+static void *
+cache_inserter (void *arg)
+{
+  gpg_error_t err;
+  unsigned int seed = (unsigned int)(long)arg;
+  ksba_ocsp_responder_t resp;
+  ksba_ocsp_t ocsp;
+  ksba_ocsp_response_status_t response_status;
+  ksba_cert_t cert, issuer;
+  unsigned char *request;
+  size_t requestlen, responselen;
+  const unsigned char *response;
+  int round, i;
+
+  err = ksba_ocsp_responder_new (&resp);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_responder_id (resp, thread_certs[0], 0);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_signer (resp, "1.2.840.113549.1.1.5", 256,
+                                        dummy_signer, NULL);
+  fail_if_err (err);
+
+  for (round=0; round < CACHE_ROUNDS; round++)
+    {
+      seed = seed * 1103515245 + 12345;
+      err = ksba_ocsp_new (&ocsp);
+      fail_if_err (err);
+      for (i=0; i < 3; i++)
+        {
+          thread_target ((seed >> 8) + i, &cert, &issuer);
+          err = ksba_ocsp_add_target (ocsp, cert, issuer);
+          fail_if_err (err);
+        }
+      err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+      fail_if_err (err);
+      /* Set the cache only now so that all targets are requested.  */
+      err = ksba_ocsp_set_cache (ocsp, thread_cache);
+      fail_if_err (err);
+
+      err = ksba_ocsp_responder_parse_request (resp, request, requestlen);
+      fail_if_err (err);
+      xfree (request);
+      for (i=0; i < ksba_ocsp_responder_get_count (resp); i++)
+        {
+          err = ksba_ocsp_responder_set_status (resp, i, KSBA_STATUS_GOOD,
+                                                "20260101T000000",
+                                                "20990101T000000", NULL, 0);
+          fail_if_err (err);
+        }
+      err = ksba_ocsp_responder_build_response (resp, "20260101T120000",
+                                                &response, &responselen);
+      fail_if_err (err);
+      err = ksba_ocsp_parse_response (ocsp, response, responselen,
+                                      &response_status);
+      fail_if_err (err);
+      if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+        fail ("response not successful");
+      /* Store the same status several times; each one replaces the
+         former entry so that many entries are retired.  */
+      for (i=0; i < CACHE_UPDATES; i++)
+        {
+          err = ksba_ocsp_update_cache (ocsp);
+          fail_if_err (err);
+        }
+      ksba_ocsp_release (ocsp);
+    }
+
+  ksba_ocsp_responder_release (resp);
+  __sync_sub_and_fetch (&inserters_left, 1);
+  return NULL;
+}
+
+
+/* Thread to look up random targets in the cache while the inserters
+   are running.  */
+static void *
+cache_looker (void *arg)
+{
+  gpg_error_t err;
+  unsigned int seed = (unsigned int)(long)arg;
+  ksba_cert_t cert, issuer;
+  ksba_status_t status;
+  ksba_isotime_t this_update, next_update;
+  unsigned char *cached;
+  size_t cachedlen;
+  int found = 0;
+
+  while (__sync_add_and_fetch (&inserters_left, 0) || !found)
+    {
+      seed = seed * 1103515245 + 12345;
+      thread_target (seed >> 8, &cert, &issuer);
+      err = ksba_ocsp_cache_lookup (thread_cache, cert, issuer,
+                                    "20260201T000000", &status,
+                                    this_update, next_update, NULL, NULL,
+                                    &cached, &cachedlen);
+      if (gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+        continue;
+      fail_if_err (err);
+      if (status != KSBA_STATUS_GOOD
+          || strcmp (this_update, "20260101T000000")
+          || strcmp (next_update, "20990101T000000"))
+        fail ("wrong status in cache");
+      if (!cachedlen || *cached != 0x30)
+        fail ("wrong response in cache");
+      xfree (cached);
+      found = 1;
+    }
+  return NULL;
+}
+
+
+/* Let several threads store and look up the status of many targets
+   in a small cache so that their CertIDs collide.  */
+static void
+check_cache_threads (void)
+{
+  static const char *files[] = {
+    "samples/ov-user.crt", "samples/ov-userrev.crt",
+    "samples/ov-server.crt", "samples/ov-serverrev.crt",
+    "samples/ov-root-ca-cert.crt", "samples/ov-ocsp-server.crt",
+    "samples/ov2-user.crt", "samples/ov2-userrev.crt",
+    "samples/ov2-root-ca-cert.crt", "samples/ov2-ocsp-server.crt"
+  };
+  gpg_error_t err;
+  pthread_t threads[CACHE_INSERTERS + CACHE_LOOKUPS];
+  char *f;
+  int i;
+
+  for (i=0; i < sizeof files / sizeof *files; i++)
+    {
+      f = prepend_srcdir (files[i]);
+      thread_certs[i] = get_one_cert (f);
+      xfree (f);
+    }
+  thread_ncerts = i;
+
+  /* The smallest cache has as many slots as are probed.  */
+  err = ksba_ocsp_cache_new (&thread_cache, 1);
+  fail_if_err (err);
+
+  inserters_left = CACHE_INSERTERS;
+  for (i=0; i < CACHE_INSERTERS + CACHE_LOOKUPS; i++)
+    if (pthread_create (threads + i, NULL,
+                        i < CACHE_INSERTERS? cache_inserter : cache_looker,
+                        (void*)(long)(i + 1)))
+      fail ("can't create thread");
+  for (i=0; i < CACHE_INSERTERS + CACHE_LOOKUPS; i++)
+    pthread_join (threads[i], NULL);
+
+  ksba_ocsp_cache_release (thread_cache);
+  for (i=0; i < thread_ncerts; i++)
+    ksba_cert_release (thread_certs[i]);
+}
+#endif /*HAVE_PTHREAD && HAVE_SYNC_BUILTINS*/
+
+
 /* ( printf "POST / HTTP/1.0\r\nContent-Type: application/ocsp-request\r\nContent-Length: `wc -c <a.req | tr -d ' '`\r\n\r\n"; cat a.req ) |  nc -v ocsp.openvalidation.org 8088   | sed '1,/^\r$/d' >a.rsp
 
     Openvalidation test reponders:
@@ -380,6 +996,373 @@ my_hash_buffer (void *arg, const char *oid,
 
 */
 
+/* Check requests using a CertID hash algorithm other than SHA-1.  */
+static void
+check_certid_algo (void)
+{
+  gpg_error_t err;
+  char *f;
+  ksba_cert_t certs[2], issuer_cert;
+  ksba_ocsp_cache_t cache;
+  ksba_ocsp_t ocsp;
+  ksba_ocsp_responder_t resp;
+  ksba_ocsp_response_status_t response_status;
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update, next_update, revocation_time;
+  unsigned char *request;
+  size_t requestlen;
+  const unsigned char *response;
+  size_t responselen;
+  const char *algo;
+  size_t name_hash_len, key_hash_len;
+  static const unsigned char der_oid_sha256[] =
+    { 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01 };
+  unsigned char *p;
+  int i, n, issuer;
+
+  f = prepend_srcdir ("samples/ov-user.crt");
+  certs[0] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-userrev.crt");
+  certs[1] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-root-ca-cert.crt");
+  issuer_cert = get_one_cert (f);
+  xfree (f);
+
+  err = ksba_ocsp_cache_new (&cache, 0);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_new (&resp);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_responder_id (resp, issuer_cert, 1);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_add_issuer (resp, issuer_cert);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_signer (resp, "1.2.840.113549.1.1.5", 256,
+                                        dummy_signer, NULL);
+  fail_if_err (err);
+
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  err = ksba_ocsp_set_certid_algo (ocsp, "1.2.3.4");
+  if (gpg_err_code (err) != GPG_ERR_DIGEST_ALGO)
+    fail ("unknown CertID algorithm accepted");
+  err = ksba_ocsp_set_certid_algo (ocsp, "2.16.840.1.101.3.4.2.1");
+  fail_if_err (err);
+  err = ksba_ocsp_set_cache (ocsp, cache);
+  fail_if_err (err);
+  for (i=0; i < 2; i++)
+    {
+      err = ksba_ocsp_add_target (ocsp, certs[i], issuer_cert);
+      fail_if_err (err);
+    }
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  fail_if_err (err);
+
+  /* The responder must see the algorithm and find the issuer.  */
+  answer_request (resp, certs, request, requestlen, "20990101T000000",
+                  &response, &responselen);
+  if (ksba_ocsp_responder_get_count (resp) != 2)
+    fail ("wrong number of requests");
+  for (i=0; i < 2; i++)
+    {
+      err = ksba_ocsp_responder_get_request (resp, i, &algo,
+                                             NULL, &name_hash_len,
+                                             NULL, &key_hash_len,
+                                             NULL, NULL, &issuer);
+      fail_if_err (err);
+      if (strcmp (algo, "2.16.840.1.101.3.4.2.1")
+          || name_hash_len != 32 || key_hash_len != 32)
+        fail ("wrong CertID algorithm in request");
+      if (issuer != 0)
+        fail ("issuer not found for SHA-256 CertID");
+    }
+
+  err = ksba_ocsp_parse_response (ocsp, response, responselen,
+                                  &response_status);
+  fail_if_err (err);
+  if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+    fail ("response not successful");
+  err = ksba_ocsp_get_status (ocsp, certs[0], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_GOOD)
+    fail ("wrong status for the good certificate");
+  err = ksba_ocsp_get_status (ocsp, certs[1], &status, this_update,
+                              next_update, revocation_time, &reason);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_REVOKED || reason != KSBA_CRLREASON_SUPERSEDED)
+    fail ("wrong status for the revoked certificate");
+
+  /* The cache is keyed by the SHA-1 CertID.  */
+  err = ksba_ocsp_update_cache (ocsp);
+  fail_if_err (err);
+  ksba_ocsp_release (ocsp);
+  err = ksba_ocsp_cache_lookup (cache, certs[0], issuer_cert,
+                                "20260201T000000", &status,
+                                NULL, NULL, NULL, NULL, NULL, NULL);
+  fail_if_err (err);
+  if (status != KSBA_STATUS_GOOD)
+    fail ("wrong status in cache");
+
+  /* Unknown algorithms are reported but not matched, however many
+     different ones are seen.  */
+  for (i=0; i + sizeof der_oid_sha256 <= requestlen; i++)
+    if (!memcmp (request + i, der_oid_sha256, sizeof der_oid_sha256))
+      break;
+  if (i + sizeof der_oid_sha256 > requestlen)
+    fail ("SHA-256 OID not found in request");
+  p = request + i + sizeof der_oid_sha256 - 1;
+  for (n=0; n < 40; n++)
+    {
+      char oidbuf[40];
+
+      *p = 0x40 + n;
+      err = ksba_ocsp_responder_parse_request (resp, request, requestlen);
+      fail_if_err (err);
+      err = ksba_ocsp_responder_get_request (resp, 0, &algo,
+                                             NULL, NULL, NULL, NULL,
+                                             NULL, NULL, &issuer);
+      fail_if_err (err);
+      snprintf (oidbuf, sizeof oidbuf, "2.16.840.1.101.3.4.2.%d", 0x40 + n);
+      if (strcmp (algo, oidbuf) || issuer != -1)
+        fail ("unknown CertID algorithm not reported");
+    }
+  xfree (request);
+
+  ksba_ocsp_responder_release (resp);
+  ksba_ocsp_cache_release (cache);
+  ksba_cert_release (issuer_cert);
+  ksba_cert_release (certs[0]);
+  ksba_cert_release (certs[1]);
+}
+
+
+/* The number of certificates for check_many_targets; each is used
+   as target and as issuer and thus needs a unique serial number,
+   name and key.  */
+#define MANY_NCERTS 10
+
+/* Build a response for MANY_NCERTS squared targets without a request,
+   using the hash algorithm ALGO for the CertIDs, and check that the
+   client finds the status of each target.  Each certificate is the
+   target of several CertIDs which only differ in the issuer hashes
+   and many CertIDs share a bucket of the client's index.  */
+static void
+check_many_targets (const char *algo)
+{
+  static const char *files[MANY_NCERTS] = {
+    "samples/ov-user.crt", "samples/ov-userrev.crt",
+    "samples/ov-server.crt", "samples/ov-serverrev.crt",
+    "samples/ov-root-ca-cert.crt", "samples/ov-ocsp-server.crt",
+    "samples/authority.crt", "samples/betsy.crt", "samples/bull.crt",
+    "samples/openssl-secp256r1ca.cert.crt"
+  };
+  enum { ntargets = MANY_NCERTS * MANY_NCERTS };
+  gpg_error_t err;
+  char *f;
+  ksba_cert_t issuers[MANY_NCERTS], targets[ntargets];
+  ksba_ocsp_t ocsp;
+  ksba_ocsp_responder_t resp;
+  ksba_ocsp_response_status_t response_status;
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update, next_update, revocation_time;
+  unsigned char *request;
+  size_t requestlen;
+  const unsigned char *response, *serial;
+  size_t responselen, seriallen;
+  const char *hash_algo;
+  int i, n, idx, issuer;
+
+  /* Every target gets its own certificate object so that the status
+     can be asked for each CertID.  */
+  for (i=0; i < MANY_NCERTS; i++)
+    {
+      f = prepend_srcdir (files[i]);
+      issuers[i] = get_one_cert (f);
+      for (n=0; n < MANY_NCERTS; n++)
+        targets[i * MANY_NCERTS + n] = get_one_cert (f);
+      xfree (f);
+    }
+
+  err = ksba_ocsp_responder_new (&resp);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_signer (resp, "1.2.840.113549.1.1.5", 256,
+                                        dummy_signer, NULL);
+  fail_if_err (err);
+  err = ksba_ocsp_responder_set_responder_id (resp, issuers[0], 1);
+  fail_if_err (err);
+  for (i=0; i < MANY_NCERTS; i++)
+    {
+      err = ksba_ocsp_responder_add_issuer (resp, issuers[i]);
+      fail_if_err (err);
+    }
+  err = ksba_ocsp_responder_set_certid_algo (resp, "1.2.3.4");
+  if (gpg_err_code (err) != GPG_ERR_DIGEST_ALGO)
+    fail ("unknown CertID algorithm accepted by the responder");
+  if (algo)
+    {
+      err = ksba_ocsp_responder_set_certid_algo (resp, algo);
+      fail_if_err (err);
+    }
+
+  /* Add the targets in reverse order of the request.  Target N is
+     good, revoked or unknown depending on N modulo 3.  */
+  for (n = ntargets - 1; n >= 0; n--)
+    {
+      err = ksba_ocsp_responder_add_target (resp, targets[n],
+                                            issuers[n % MANY_NCERTS], &idx);
+      fail_if_err (err);
+      if (idx != ntargets - 1 - n)
+        fail ("wrong index for target");
+      err = ksba_ocsp_responder_get_request (resp, idx, &hash_algo,
+                                             NULL, NULL, NULL, NULL,
+                                             &serial, &seriallen, &issuer);
+      fail_if_err (err);
+      if (strcmp (hash_algo, algo? algo : "1.3.14.3.2.26"))
+        fail ("wrong CertID algorithm of target");
+      if (issuer != n % MANY_NCERTS
+          || !serial_matches (targets[n], serial, seriallen))
+        fail ("wrong CertID of target");
+      if (n % 3 == 0)
+        err = ksba_ocsp_responder_set_status (resp, idx, KSBA_STATUS_GOOD,
+                                              "20260101T000000",
+                                              "20260108T000000", NULL, 0);
+      else if (n % 3 == 1)
+        err = ksba_ocsp_responder_set_status (resp, idx, KSBA_STATUS_REVOKED,
+                                              "20260101T000000", NULL,
+                                              "20251224T120000",
+                                              KSBA_CRLREASON_KEY_COMPROMISE);
+      fail_if_err (err);
+    }
+  if (ksba_ocsp_responder_get_count (resp) != ntargets)
+    fail ("wrong number of targets");
+  err = ksba_ocsp_responder_build_response (resp, "20260101T120000",
+                                            &response, &responselen);
+  fail_if_err (err);
+
+  err = ksba_ocsp_new (&ocsp);
+  fail_if_err (err);
+  if (algo)
+    {
+      err = ksba_ocsp_set_certid_algo (ocsp, algo);
+      fail_if_err (err);
+    }
+  for (n=0; n < ntargets; n++)
+    {
+      err = ksba_ocsp_add_target (ocsp, targets[n], issuers[n % MANY_NCERTS]);
+      fail_if_err (err);
+    }
+  err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+  fail_if_err (err);
+  xfree (request);
+  err = ksba_ocsp_parse_response (ocsp, response, responselen,
+                                  &response_status);
+  fail_if_err (err);
+  if (response_status != KSBA_OCSP_RSPSTATUS_SUCCESS)
+    fail ("response not successful");
+  for (n=0; n < ntargets; n++)
+    {
+      err = ksba_ocsp_get_status (ocsp, targets[n], &status, this_update,
+                                  next_update, revocation_time, &reason);
+      fail_if_err (err);
+      if (n % 3 == 0
+          && (status != KSBA_STATUS_GOOD
+              || strcmp (next_update, "20260108T000000")))
+        fail ("wrong status for a good target");
+      else if (n % 3 == 1
+               && (status != KSBA_STATUS_REVOKED
+                   || reason != KSBA_CRLREASON_KEY_COMPROMISE
+                   || strcmp (revocation_time, "20251224T120000")))
+        fail ("wrong status for a revoked target");
+      else if (n % 3 == 2 && status != KSBA_STATUS_UNKNOWN)
+        fail ("wrong status for an unknown target");
+    }
+  ksba_ocsp_release (ocsp);
+
+  ksba_ocsp_responder_release (resp);
+  for (n=0; n < ntargets; n++)
+    ksba_cert_release (targets[n]);
+  for (i=0; i < MANY_NCERTS; i++)
+    ksba_cert_release (issuers[i]);
+}
+
+
+/* Check that ksba_ocsp_build_request_into creates the same request
+   as ksba_ocsp_build_request.  */
+static void
+check_request_into (void)
+{
+  gpg_error_t err;
+  char *f;
+  ksba_cert_t certs[2], issuer_cert;
+  ksba_ocsp_t ocsp;
+  unsigned char *request, *buffer;
+  size_t requestlen, length;
+  int i, pass;
+
+  f = prepend_srcdir ("samples/ov-user.crt");
+  certs[0] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-userrev.crt");
+  certs[1] = get_one_cert (f);
+  xfree (f);
+  f = prepend_srcdir ("samples/ov-root-ca-cert.crt");
+  issuer_cert = get_one_cert (f);
+  xfree (f);
+
+  request = NULL;
+  requestlen = 0;
+  for (pass=0; pass < 3; pass++)
+    {
+      err = ksba_ocsp_new (&ocsp);
+      fail_if_err (err);
+      for (i=0; i < 2; i++)
+        {
+          err = ksba_ocsp_add_target (ocsp, certs[i], issuer_cert);
+          fail_if_err (err);
+        }
+      ksba_ocsp_set_nonce (ocsp, "ABCDEFGHIJKLMNOP", 16);
+
+      if (!pass)
+        {
+          err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
+          fail_if_err (err);
+          ksba_ocsp_release (ocsp);
+          continue;
+        }
+
+      /* In the second pass use a prepared request.  */
+      if (pass == 2)
+        {
+          err = ksba_ocsp_prepare_request (ocsp);
+          fail_if_err (err);
+        }
+      err = ksba_ocsp_build_request_into (ocsp, NULL, 0, &length);
+      if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT
+          || length != requestlen)
+        fail ("wrong length of request returned");
+      buffer = xmalloc (length);
+      err = ksba_ocsp_build_request_into (ocsp, buffer, length - 1, &length);
+      if (gpg_err_code (err) != GPG_ERR_BUFFER_TOO_SHORT)
+        fail ("too short buffer not detected");
+      err = ksba_ocsp_build_request_into (ocsp, buffer, length, &length);
+      fail_if_err (err);
+      if (length != requestlen || memcmp (buffer, request, length))
+        fail ("request written to buffer differs");
+      xfree (buffer);
+      ksba_ocsp_release (ocsp);
+    }
+
+  xfree (request);
+  ksba_cert_release (issuer_cert);
+  ksba_cert_release (certs[0]);
+  ksba_cert_release (certs[1]);
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -467,6 +1450,16 @@ main (int argc, char **argv)
           xfree (f2);
           xfree (f1);
         }
+
+      check_responder ();
+      check_cache ();
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYNC_BUILTINS)
+      check_cache_threads ();
+#endif
+      check_certid_algo ();
+      check_many_targets (NULL);
+      check_many_targets ("2.16.840.1.101.3.4.2.1");
+      check_request_into ();
     }
 
   return 0;
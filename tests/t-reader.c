@@ -0,0 +1,488 @@
+/* t-reader.c - Regression tests for the reader object
+ *      Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#ifndef __WIN32
+# include <unistd.h>
+# include <sys/types.h>
+# include <sys/wait.h>
+#endif
+
+#include "../src/ksba.h"
+
+#include "t-common.h"
+
+
+/* The size of the test data; larger than the read-ahead buffer and
+   the minimum size for mapping a file.  */
+#define DATALEN  200000
+
+/* The offset at which the file is read.  It is not page aligned.  */
+#define STARTOFF 1234
+
+/* A buffer for a callback reader.  */
+struct membuf_s
+{
+  unsigned char *buf;
+  size_t len;
+};
+
+
+static unsigned char *
+make_data (size_t length)
+{
+  unsigned char *data;
+  size_t i;
+
+  data = xmalloc (length);
+  for (i=0; i < length; i++)
+    data[i] = (i * 7) ^ (i >> 8);
+  return data;
+}
+
+
+/* Read all data from reader R in pieces of different size and compare
+   it to the LENGTH bytes at EXPECTED.  */
+static void
+read_and_compare (ksba_reader_t r, const unsigned char *expected,
+                  size_t length)
+{
+  gpg_error_t err;
+  static const size_t sizes[] = { 1, 13, 4103, 1, 70001, 512, 2 };
+  const int nsizes = sizeof sizes / sizeof *sizes;
+  unsigned char *buf;
+  size_t off, n;
+  int i;
+
+  buf = xmalloc (70001);
+  for (off=0, i=0; ; i++)
+    {
+      err = ksba_reader_read (r, (char*)buf, sizes[i % nsizes], &n);
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        break;
+      fail_if_err (err);
+      if (off + n > length || memcmp (buf, expected + off, n))
+        fail ("data read does not match");
+      off += n;
+      /* Push some bytes back from time to time.  */
+      if (!(i % 5) && n > 2)
+        {
+          err = ksba_reader_unread (r, buf + n - 2, 2);
+          fail_if_err (err);
+          off -= 2;
+        }
+      if (ksba_reader_tell (r) != off)
+        fail ("wrong read position");
+    }
+  if (off != length)
+    fail ("not all data has been read");
+  xfree (buf);
+}
+
+
+/* Read a regular file starting at a non page aligned offset.  With
+   LENGTH larger than the minimum size the file is mapped.  */
+static void
+check_file (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  FILE *fp;
+  size_t n;
+
+  fp = tmpfile ();
+  if (!fp || fwrite (data, length, 1, fp) != 1 || fflush (fp))
+    fail ("can't write temporary file");
+  if (fseek (fp, STARTOFF, SEEK_SET))
+    fail ("can't seek in temporary file");
+
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_fd (r, fileno (fp));
+  fail_if_err (err);
+
+  /* The size of the remaining data is only known if the file has
+     been mapped.  */
+  err = ksba_reader_read (r, NULL, 0, &n);
+  if (gpg_err_code (err) != GPG_ERR_NOT_IMPLEMENTED)
+    {
+      fail_if_err (err);
+      if (n != length - STARTOFF)
+        fail ("wrong size of the mapped file");
+    }
+
+  read_and_compare (r, data + STARTOFF, length - STARTOFF);
+  ksba_reader_release (r);
+  fclose (fp);
+}
+
+
+#ifndef __WIN32
+/* Read from a pipe which is filled in small pieces by a child process
+   so that read(2) returns less than requested.  */
+static void
+check_pipe (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  int fds[2];
+  pid_t pid;
+  size_t off, n;
+  int status;
+
+  if (pipe (fds))
+    fail ("can't create pipe");
+  pid = fork ();
+  if (pid == (pid_t)(-1))
+    fail ("can't fork");
+  if (!pid)
+    {
+      close (fds[0]);
+      for (off=0; off < length; off += n)
+        {
+          n = (off % 4093) + 1;
+          if (n > length - off)
+            n = length - off;
+          if (write (fds[1], data + off, n) != (ssize_t)n)
+            _exit (1);
+        }
+      _exit (0);
+    }
+  close (fds[1]);
+
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_fd (r, fds[0]);
+  fail_if_err (err);
+  read_and_compare (r, data, length);
+  ksba_reader_release (r);
+  close (fds[0]);
+
+  if (waitpid (pid, &status, 0) != pid
+      || !WIFEXITED (status) || WEXITSTATUS (status))
+    fail ("writer process failed");
+}
+#endif /*!__WIN32*/
+
+
+/* Callback for a reader which returns at most 100 bytes at once.  */
+static int
+peek_reader_cb (void *cb_value, char *buffer, size_t count, size_t *r_nread)
+{
+  struct membuf_s *mb = cb_value;
+
+  if (!mb->len)
+    return -1;
+  if (count > 100)
+    count = 100;
+  if (count > mb->len)
+    count = mb->len;
+  memcpy (buffer, mb->buf, count);
+  mb->buf += count;
+  mb->len -= count;
+  *r_nread = count;
+  return 0;
+}
+
+
+/* Read DATA back using ksba_reader_peek from readers of all types
+   and check the result.  */
+static void
+check_reader_peek (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  FILE *fp;
+  struct membuf_s mb;
+  const void *p;
+  size_t n, off;
+  int mode, unread;
+
+  for (mode=0; mode < 3; mode++)
+    {
+      fp = NULL;
+      err = ksba_reader_new (&r);
+      fail_if_err (err);
+      if (!mode)
+        err = ksba_reader_set_mem (r, data, length);
+      else if (mode == 1)
+        {
+          fp = tmpfile ();
+          if (!fp || fwrite (data, length, 1, fp) != 1)
+            fail ("can't write temporary file");
+          rewind (fp);
+          err = ksba_reader_set_file (r, fp);
+        }
+      else
+        {
+          mb.buf = (unsigned char *)data;
+          mb.len = length;
+          err = ksba_reader_set_cb (r, peek_reader_cb, &mb);
+        }
+      fail_if_err (err);
+
+      off = 0;
+      while (!(err = ksba_reader_peek (r, &p, &n)))
+        {
+          if (off + n > length || memcmp (p, data + off, n))
+            fail ("peeked data does not match");
+          /* Consume in two steps and push a byte back.  */
+          unread = n > 1;
+          if (n > 1)
+            {
+              err = ksba_reader_advance (r, n/2);
+              fail_if_err (err);
+              off += n/2;
+              n -= n/2;
+            }
+          err = ksba_reader_advance (r, n);
+          fail_if_err (err);
+          off += n;
+          if (unread && off < length)
+            {
+              err = ksba_reader_unread (r, data + off - 1, 1);
+              fail_if_err (err);
+              off--;
+            }
+          if (ksba_reader_tell (r) != off)
+            fail ("wrong read position");
+        }
+      if (gpg_err_code (err) != GPG_ERR_EOF)
+        fail_if_err (err);
+      if (off != length)
+        fail ("peeking did not return all data");
+      if (!ksba_reader_advance (r, 1))
+        fail ("advancing beyond the data did not fail");
+      ksba_reader_release (r);
+      if (fp)
+        fclose (fp);
+    }
+}
+
+
+/* Largest request seen by counting_reader_cb.  */
+static size_t max_cb_request;
+
+/* Callback for a reader which records the largest request.  */
+static int
+counting_reader_cb (void *cb_value, char *buffer, size_t count,
+                    size_t *r_nread)
+{
+  if (count > max_cb_request)
+    max_cb_request = count;
+  return peek_reader_cb (cb_value, buffer, count, r_nread);
+}
+
+
+/* Check that callbacks are not asked for more data than requested
+   and that ksba_reader_clear keeps the bytes read ahead from a file
+   descriptor.  */
+static void
+check_reader_clear (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  ksba_reader_t r;
+  FILE *fp;
+  struct membuf_s mb;
+  unsigned char buf[20], *rest;
+  size_t n, restlen;
+  int i;
+
+  if (length < 40)
+    fail ("data too short");
+
+  /* Read byte by byte from a callback.  */
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  mb.buf = (unsigned char *)data;
+  mb.len = length;
+  err = ksba_reader_set_cb (r, counting_reader_cb, &mb);
+  fail_if_err (err);
+  max_cb_request = 0;
+  for (i=0; i < 10; i++)
+    {
+      err = ksba_reader_read (r, (char*)buf, 1, &n);
+      fail_if_err (err);
+      if (n != 1 || *buf != data[i])
+        fail ("reading from the callback failed");
+    }
+  if (max_cb_request != 1 || mb.len != length - 10)
+    fail ("callback was asked for more than requested");
+  ksba_reader_release (r);
+
+  fp = tmpfile ();
+  if (!fp || fwrite (data, length, 1, fp) != 1)
+    fail ("can't write temporary file");
+  rewind (fp);
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_fd (r, fileno (fp));
+  fail_if_err (err);
+  err = ksba_reader_read (r, (char*)buf, 20, &n);
+  fail_if_err (err);
+  if (n != 20 || memcmp (buf, data, 20))
+    fail ("reading from the file descriptor failed");
+  err = ksba_reader_unread (r, buf + 15, 5);
+  fail_if_err (err);
+  err = ksba_reader_clear (r, &rest, &restlen);
+  fail_if_err (err);
+  if (restlen != 5 || memcmp (rest, data + 15, 5))
+    fail ("ksba_reader_clear returned the wrong bytes");
+  xfree (rest);
+  err = ksba_reader_read (r, (char*)buf, 20, &n);
+  fail_if_err (err);
+  if (n != 20 || memcmp (buf, data + 20, 20))
+    fail ("ksba_reader_clear dropped read-ahead data");
+  ksba_reader_release (r);
+  fclose (fp);
+}
+
+
+/* Parse the CRL from reader R and return the number of entries.  */
+static int
+count_crl_entries (const char *fname, ksba_reader_t r)
+{
+  gpg_error_t err;
+  ksba_crl_t crl;
+  ksba_stop_reason_t stopreason;
+  int count = 0;
+
+  err = ksba_crl_new (&crl);
+  fail_if_err (err);
+  err = ksba_crl_set_reader (crl, r);
+  fail_if_err (err);
+  do
+    {
+      err = ksba_crl_parse (crl, &stopreason);
+      fail_if_err2 (fname, err);
+      if (stopreason == KSBA_SR_GOT_ITEM)
+        {
+          err = ksba_crl_get_item (crl, NULL, NULL, NULL);
+          fail_if_err (err);
+          count++;
+        }
+    }
+  while (stopreason != KSBA_SR_READY);
+  ksba_crl_release (crl);
+  return count;
+}
+
+
+/* Pass the CRL FNAME in pieces of different size to a reader in push
+   mode followed by some garbage and then parse it.  The first round
+   pushes single bytes, the second one pieces of odd size with a limit
+   which just fits.  A last push checks that a too small limit is
+   detected.  */
+static void
+check_push (const char *fname)
+{
+  gpg_error_t err;
+  FILE *fp;
+  unsigned char *image;
+  size_t imagelen, off, n, nused;
+  ksba_reader_t r;
+  int round, nitems;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    fail ("can't open file");
+  image = xmalloc (1024*1024 + 2);
+  imagelen = fread (image, 1, 1024*1024, fp);
+  fclose (fp);
+  if (!imagelen || imagelen == 1024*1024)
+    fail ("can't read the CRL");
+  image[imagelen] = 0x30;
+  image[imagelen+1] = 0x00;
+
+  err = ksba_reader_new (&r);
+  fail_if_err (err);
+  err = ksba_reader_set_mem (r, image, imagelen);
+  fail_if_err (err);
+  nitems = count_crl_entries (fname, r);
+  if (!nitems)
+    fail ("CRL without entries");
+
+  for (round=0; round < 2; round++)
+    {
+      err = ksba_reader_set_push (r, round? imagelen : 0);
+      fail_if_err (err);
+      for (off=0; ; off += nused)
+        {
+          n = round? 2 * (off % 125) + 1 : 1;
+          if (off + n > imagelen + 2)
+            n = imagelen + 2 - off;
+          err = ksba_reader_push (r, image + off, n, &nused);
+          if (!err)
+            break;
+          if (gpg_err_code (err) != GPG_ERR_EAGAIN)
+            fail_if_err (err);
+          if (nused != n)
+            fail ("incomplete object did not take all bytes");
+          if (off + nused >= imagelen)
+            fail ("object not complete at its end");
+        }
+      if (off + nused != imagelen)
+        fail ("object complete at the wrong offset");
+      if (count_crl_entries (fname, r) != nitems)
+        fail ("wrong number of entries after pushing the CRL");
+    }
+
+  err = ksba_reader_set_push (r, imagelen - 1);
+  fail_if_err (err);
+  err = ksba_reader_push (r, image, imagelen + 2, &nused);
+  if (gpg_err_code (err) != GPG_ERR_TOO_LARGE)
+    fail ("too large object not detected");
+  if (nused != imagelen - 1)
+    fail ("wrong number of bytes taken from a too large object");
+  err = ksba_reader_push (r, image + nused, imagelen + 2 - nused, &nused);
+  if (gpg_err_code (err) != GPG_ERR_TOO_LARGE || nused)
+    fail ("push after reaching the limit did not fail");
+  ksba_reader_release (r);
+  xfree (image);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  unsigned char *data;
+  char *fname;
+
+  (void)argc;
+  (void)argv;
+
+  data = make_data (DATALEN);
+  check_file (data, DATALEN);
+  check_file (data, STARTOFF + 1000);
+#ifndef __WIN32
+  check_pipe (data, DATALEN);
+#endif
+  check_reader_peek (data, DATALEN);
+  check_reader_clear (data, DATALEN);
+  xfree (data);
+
+  fname = prepend_srcdir ("crl_testpki_testpca.der");
+  check_push (fname);
+  xfree (fname);
+  return 0;
+}
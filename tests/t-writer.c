@@ -0,0 +1,361 @@
+/* t-writer.c - Regression tests for the writer object
+ *      Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#ifndef __WIN32
+# include <unistd.h>
+# include <signal.h>
+# include <sys/types.h>
+# include <sys/time.h>
+# include <sys/wait.h>
+#endif
+
+#include "../src/ksba.h"
+
+#include "t-common.h"
+
+
+/* The size of the data used for the writers; it is written several
+   times.  */
+#define DATALEN  5000
+
+/* The size of the internal buffer of a file descriptor writer.  */
+#define FD_BUFFER_SIZE 65536
+
+
+static unsigned char *
+make_data (size_t length)
+{
+  unsigned char *data;
+  size_t i;
+
+  data = xmalloc (length);
+  for (i=0; i < length; i++)
+    data[i] = (i * 7) ^ (i >> 8);
+  return data;
+}
+
+
+/* Write DATA of LENGTH COPIES times to the writer W in pieces of
+   different size.  */
+static void
+write_copies (ksba_writer_t w, const unsigned char *data, size_t length,
+              int copies)
+{
+  gpg_error_t err;
+  size_t off, n;
+  int i;
+
+  for (i=0; i < copies; i++)
+    {
+      if ((i % 4) == 3)
+        {
+          err = ksba_writer_write (w, data, length);
+          fail_if_err (err);
+          continue;
+        }
+      for (off=0; off < length; off += n)
+        {
+          n = (off % 13) + 1;
+          if (n > length - off)
+            n = length - off;
+          err = ksba_writer_write (w, data + off, n);
+          fail_if_err (err);
+        }
+    }
+}
+
+
+/* Write DATA a number of times in pieces of different size to a
+   writer using a file descriptor and check the file.  */
+static void
+check_fd_writer (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  FILE *fp;
+  ksba_writer_t w;
+  unsigned char *buf;
+  int copies, i;
+
+  /* Enough copies to overflow the internal buffer a few times.  */
+  copies = 3 * FD_BUFFER_SIZE / length + 2;
+
+  fp = tmpfile ();
+  if (!fp)
+    fail ("can't create temporary file");
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_fd (w, fileno (fp));
+  fail_if_err (err);
+  write_copies (w, data, length, copies);
+  if (ksba_writer_tell (w) != copies * length)
+    fail ("wrong number of bytes written");
+  err = ksba_writer_flush (w);
+  fail_if_err (err);
+  ksba_writer_release (w);
+
+  buf = xmalloc (length);
+  rewind (fp);
+  for (i=0; i < copies; i++)
+    {
+      if (fread (buf, length, 1, fp) != 1)
+        fail ("error reading back the written data");
+      if (memcmp (buf, data, length))
+        fail ("written data does not match");
+    }
+  if (getc (fp) != EOF)
+    fail ("too much data written");
+  xfree (buf);
+  fclose (fp);
+}
+
+
+/* Write DATA a number of times in pieces to memory writers with and
+   without chunks and check the result.  */
+static void
+check_mem_writer (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  const unsigned char *chunk;
+  unsigned char *buf;
+  size_t off, n, len;
+  int copies, chunked, i;
+
+  copies = 200000 / length + 2;
+  for (chunked=0; chunked < 2; chunked++)
+    {
+      err = ksba_writer_new (&w);
+      fail_if_err (err);
+      if (chunked)
+        err = ksba_writer_set_mem_chunked (w, 1000);
+      else
+        err = ksba_writer_set_mem (w, 1);
+      fail_if_err (err);
+      for (i=0; i < copies; i++)
+        for (off=0; off < length; off += n)
+          {
+            n = (i % 2)? length : (off % 17) + 1;
+            if (n > length - off)
+              n = length - off;
+            err = ksba_writer_write (w, data + off, n);
+            fail_if_err (err);
+          }
+
+      /* Walk the chunks.  */
+      off = 0;
+      for (i=0; (chunk = ksba_writer_get_chunk (w, i, &n)); i++)
+        {
+          if (!n)
+            fail ("empty chunk returned");
+          for (len=0; len < n; len++, off++)
+            if (chunk[len] != data[off % length])
+              fail ("chunk does not match the written data");
+        }
+      if (off != copies * length)
+        fail ("wrong length of the chunks");
+      if (chunked && i < 2)
+        fail ("chunked writer returned only one chunk");
+      if (ksba_writer_get_chunk (w, -1, &n))
+        fail ("chunk with a negative index returned");
+
+      buf = ksba_writer_snatch_mem (w, &len);
+      if (!buf || len != copies * length)
+        fail ("snatching the memory failed");
+      for (i=0; i < copies; i++)
+        if (memcmp (buf + i * length, data, length))
+          fail ("written data does not match");
+      xfree (buf);
+      ksba_writer_release (w);
+    }
+}
+
+
+#ifndef __WIN32
+static void
+alarm_handler (int sig)
+{
+  (void)sig;
+}
+
+
+/* Write DATA a number of times to a pipe which is slowly read by a
+   child process.  A timer interrupts the blocked writes so that
+   write(2) and writev(2) return early or fail with EINTR.  */
+static void
+check_pipe_writer (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  struct sigaction sa, oldsa;
+  struct itimerval timer;
+  unsigned char *buf;
+  size_t off, n, total;
+  int fds[2];
+  pid_t pid;
+  int copies, status;
+
+  copies = 4 * FD_BUFFER_SIZE / length + 2;
+
+  if (pipe (fds))
+    fail ("can't create pipe");
+  pid = fork ();
+  if (pid == (pid_t)(-1))
+    fail ("can't fork");
+  if (!pid)
+    {
+      close (fds[1]);
+      buf = xmalloc (4096);
+      for (total=0; ; total += n)
+        {
+          ssize_t nread;
+
+          if (!(total % 16))
+            usleep (1000);
+          nread = read (fds[0], buf, (total % 4093) + 1);
+          if (nread < 0 && errno == EINTR)
+            {
+              n = 0;
+              continue;
+            }
+          if (nread < 0)
+            _exit (1);
+          if (!nread)
+            break;
+          n = nread;
+          for (off=0; off < n; off++)
+            if (buf[off] != data[(total + off) % length])
+              _exit (2);
+        }
+      _exit (total == copies * length? 0 : 3);
+    }
+  close (fds[0]);
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = alarm_handler;
+  sigemptyset (&sa.sa_mask);
+  sa.sa_flags = 0;  /* No SA_RESTART.  */
+  if (sigaction (SIGALRM, &sa, &oldsa))
+    fail ("can't install signal handler");
+  memset (&timer, 0, sizeof timer);
+  timer.it_interval.tv_usec = 500;
+  timer.it_value.tv_usec = 500;
+  if (setitimer (ITIMER_REAL, &timer, NULL))
+    fail ("can't start timer");
+
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_fd (w, fds[1]);
+  fail_if_err (err);
+  write_copies (w, data, length, copies);
+  err = ksba_writer_flush (w);
+  fail_if_err (err);
+  ksba_writer_release (w);
+  close (fds[1]);
+
+  memset (&timer, 0, sizeof timer);
+  setitimer (ITIMER_REAL, &timer, NULL);
+  sigaction (SIGALRM, &oldsa, NULL);
+
+  if (waitpid (pid, &status, 0) != pid
+      || !WIFEXITED (status) || WEXITSTATUS (status))
+    fail ("data read from the pipe does not match");
+}
+
+
+/* Check that errors of the file descriptor are returned by the writer
+   and that they stick.  */
+static void
+check_fd_errors (const unsigned char *data, size_t length)
+{
+  gpg_error_t err;
+  ksba_writer_t w;
+  unsigned char *big;
+  void (*oldhandler)(int);
+  int fds[2];
+
+  oldhandler = signal (SIGPIPE, SIG_IGN);
+
+  /* A small write is only buffered; the error shows up with the
+     flush.  */
+  if (pipe (fds))
+    fail ("can't create pipe");
+  close (fds[0]);
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_fd (w, fds[1]);
+  fail_if_err (err);
+  err = ksba_writer_write (w, data, length);
+  fail_if_err (err);
+  err = ksba_writer_flush (w);
+  if (gpg_err_code (err) != GPG_ERR_EPIPE)
+    fail ("flush to a closed pipe did not fail");
+  err = ksba_writer_write (w, data, 1);
+  if (gpg_err_code (err) != GPG_ERR_EPIPE)
+    fail ("error of the writer did not stick");
+  err = ksba_writer_flush (w);
+  if (gpg_err_code (err) != GPG_ERR_EPIPE)
+    fail ("error of the writer did not stick");
+  ksba_writer_release (w);
+  close (fds[1]);
+
+  /* A write larger than the buffer fails at once.  */
+  if (pipe (fds))
+    fail ("can't create pipe");
+  close (fds[0]);
+  err = ksba_writer_new (&w);
+  fail_if_err (err);
+  err = ksba_writer_set_fd (w, fds[1]);
+  fail_if_err (err);
+  big = xmalloc (2 * FD_BUFFER_SIZE);
+  memset (big, 'x', 2 * FD_BUFFER_SIZE);
+  err = ksba_writer_write (w, big, 2 * FD_BUFFER_SIZE);
+  if (gpg_err_code (err) != GPG_ERR_EPIPE)
+    fail ("large write to a closed pipe did not fail");
+  xfree (big);
+  ksba_writer_release (w);
+  close (fds[1]);
+
+  signal (SIGPIPE, oldhandler);
+}
+#endif /*!__WIN32*/
+
+
+int
+main (int argc, char **argv)
+{
+  unsigned char *data;
+
+  (void)argc;
+  (void)argv;
+
+  data = make_data (DATALEN);
+  check_fd_writer (data, DATALEN);
+  check_mem_writer (data, DATALEN);
+#ifndef __WIN32
+  check_pipe_writer (data, DATALEN);
+  check_fd_errors (data, DATALEN);
+#endif
+  xfree (data);
+  return 0;
+}